@@ -6,6 +6,9 @@
  * Usage: cp oldfile newfile
  */
 
+/* How much to ask fcopy for at once */
+#define COPYCHUNK (1024*1024)
+
 
 /* Copy one file to another. */
 static
@@ -29,6 +32,19 @@ copy(const char *from, const char *to)
 		err(1, "%s", to);
 	}
 
+	/*
+	 * Have the kernel do the copy if it can. If that fails outright
+	 * (say, the kernel doesn't have fcopy), fall back to reading and
+	 * writing. A failing fcopy call has copied nothing, so the loop
+	 * below picks up exactly where it left off.
+	 */
+	while ((len = fcopy(fromfd, tofd, COPYCHUNK))>0) {
+		/* nothing else to do */
+	}
+	if (len==0) {
+		goto done;
+	}
+
 	/*
 	 * As long as we get more than zero bytes, we haven't hit EOF.
 	 * Zero means EOF. Less than zero means an error occurred.
@@ -56,6 +72,7 @@ copy(const char *from, const char *to)
 		err(1, "%s", from);
 	}
 
+ done:
 	if (close(fromfd) < 0) {
 		err(1, "%s: close", from);
 	}
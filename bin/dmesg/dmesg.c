@@ -0,0 +1,33 @@
+#include <unistd.h>
+#include <err.h>
+
+/*
+ * dmesg - print the kernel log.
+ * Usage: dmesg
+ *
+ * Uses the dmesg system call to fetch what the kernel has printed
+ * recently.
+ */
+
+#define LOGSIZE 16384
+
+static char buf[LOGSIZE];
+
+int
+main()
+{
+	int len, r, i;
+
+	len = dmesg(buf, sizeof(buf));
+	if (len < 0) {
+		err(1, "dmesg");
+	}
+
+	for (i=0; i<len; i += r) {
+		r = write(STDOUT_FILENO, buf+i, len-i);
+		if (r <= 0) {
+			err(1, "stdout");
+		}
+	}
+	return 0;
+}
@@ -3,6 +3,7 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <string.h>
+#include <dirent.h>
 #include <errno.h>
 #include <err.h>
 
@@ -78,6 +79,23 @@ isdir(const char *path)
 	return S_ISDIR(buf.st_mode);
 }
 
+/*
+ * Read the next batch of directory entries from FD into BUF.
+ * Returns the number of bytes of records, 0 at end of directory.
+ */
+static
+int
+readentries(int fd, const char *path, char *buf, size_t buflen)
+{
+	int len;
+
+	len = getdirentries(fd, buf, buflen);
+	if (len<0) {
+		err(1, "%s: getdirentries", path);
+	}
+	return len;
+}
+
 /*
  * When listing one of several subdirectories, show the name of the
  * directory.
@@ -164,9 +182,10 @@ void
 listdir(const char *path, int showheader)
 {
 	int fd;
-	char buf[1024];
+	char buf[4096];
 	char newpath[1024];
-	int len;
+	struct dirent *d;
+	int len, pos;
 
 	if (showheader) {
 		printheader(path);
@@ -181,22 +200,22 @@ listdir(const char *path, int showheader)
 	}
 
 	/*
-	 * List the directory.
+	 * List the directory, a bufferful of entries at a time.
 	 */
-	while ((len = getdirentry(fd, buf, sizeof(buf)-1)) > 0) {
-		buf[len] = 0;
+	while ((len = readentries(fd, path, buf, sizeof(buf))) > 0) {
+		for (pos=0; pos<len; pos += d->d_reclen) {
+			d = (struct dirent *)(buf+pos);
 
-		/* Assemble the full name of the new item */
-		snprintf(newpath, sizeof(newpath), "%s/%s", path, buf);
+			/* Assemble the full name of the new item */
+			snprintf(newpath, sizeof(newpath), "%s/%s",
+				 path, d->d_name);
 
-		if (aopt || buf[0]!='.') {
-			/* Print it */
-			print(newpath);
+			if (aopt || d->d_name[0]!='.') {
+				/* Print it */
+				print(newpath);
+			}
 		}
 	}
-	if (len<0) {
-		err(1, "%s: getdirentry", path);
-	}
 
 	/* Done */
 	close(fd);
@@ -207,9 +226,10 @@ void
 recursedir(const char *path)
 {
 	int fd;
-	char buf[1024];
+	char buf[4096];
 	char newpath[1024];
-	int len;
+	struct dirent *d;
+	int len, pos;
 
 	/*
 	 * Open it.
@@ -222,34 +242,41 @@ recursedir(const char *path)
 	/*
 	 * List the directory.
 	 */
-	while ((len = getdirentry(fd, buf, sizeof(buf)-1)) > 0) {
-		buf[len] = 0;
+	while ((len = readentries(fd, path, buf, sizeof(buf))) > 0) {
+		for (pos=0; pos<len; pos += d->d_reclen) {
+			d = (struct dirent *)(buf+pos);
 
-		/* Assemble the full name of the new item */
-		snprintf(newpath, sizeof(newpath), "%s/%s", path, buf);
+			if (!aopt && d->d_name[0]=='.') {
+				/* skip this one */
+				continue;
+			}
 
-		if (!aopt && buf[0]=='.') {
-			/* skip this one */
-			continue;
-		}
+			if (!strcmp(d->d_name, ".") ||
+			    !strcmp(d->d_name, "..")) {
+				/* always skip these */
+				continue;
+			}
 
-		if (!strcmp(buf, ".") || !strcmp(buf, "..")) {
-			/* always skip these */
-			continue;
-		}
+			/* Assemble the full name of the new item */
+			snprintf(newpath, sizeof(newpath), "%s/%s",
+				 path, d->d_name);
 
-		if (!isdir(newpath)) {
-			continue;
-		}
+			/* Only ask the file if the filesystem didn't say */
+			if (d->d_type == DT_UNKNOWN) {
+				if (!isdir(newpath)) {
+					continue;
+				}
+			}
+			else if (d->d_type != DT_DIR) {
+				continue;
+			}
 
-		listdir(newpath, 1 /*showheader*/);
-		if (Ropt) {
-			recursedir(newpath);
+			listdir(newpath, 1 /*showheader*/);
+			if (Ropt) {
+				recursedir(newpath);
+			}
 		}
 	}
-	if (len<0) {
-		err(1, "%s", path);
-	}
 
 	close(fd);
 }
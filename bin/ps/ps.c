@@ -0,0 +1,72 @@
+#include <sys/types.h>
+#include <sys/resource.h>
+#include <stdio.h>
+#include <string.h>
+#include <err.h>
+
+/*
+ * ps - list threads.
+ * Usage: ps [-u]
+ *
+ * Lists every thread in the system, kernel threads (shown in
+ * brackets) included, with its state, priority, CPU time, page faults
+ * and context switches. With -u, only user processes are listed.
+ */
+
+#define MAXTHREADS 256
+
+static struct threadinfo ti[MAXTHREADS];
+
+/*
+ * Print a time as seconds, to hundredths.
+ */
+static
+void
+printtime(time_t secs, u_int32_t nsecs)
+{
+	printf(" %5d.%02u", secs, nsecs / 10000000);
+}
+
+int
+main(int argc, char *argv[])
+{
+	int useronly = 0;
+	int i, n;
+
+	if (argc == 2 && !strcmp(argv[1], "-u")) {
+		useronly = 1;
+	}
+	else if (argc != 1) {
+		errx(1, "Usage: ps [-u]");
+	}
+
+	n = threadinfo(ti, MAXTHREADS);
+	if (n < 0) {
+		err(1, "threadinfo");
+	}
+	if (n > MAXTHREADS) {
+		n = MAXTHREADS;
+	}
+
+	printf("   ID S PRI    UTIME    STIME  MINFLT MAJFLT    VCSW   IVCSW"
+	       " NAME\n");
+	for (i=0; i<n; i++) {
+		if (useronly && !ti[i].ti_user) {
+			continue;
+		}
+		printf("%5u %c %3d", ti[i].ti_id, ti[i].ti_state,
+		       ti[i].ti_pri);
+		printtime(ti[i].ti_ru.ru_utime_sec, ti[i].ti_ru.ru_utime_nsec);
+		printtime(ti[i].ti_ru.ru_stime_sec, ti[i].ti_ru.ru_stime_nsec);
+		printf(" %7u %6u %7u %7u", ti[i].ti_ru.ru_minflt,
+		       ti[i].ti_ru.ru_majflt, ti[i].ti_ru.ru_nvcsw,
+		       ti[i].ti_ru.ru_nivcsw);
+		if (ti[i].ti_user) {
+			printf(" %s\n", ti[i].ti_name);
+		}
+		else {
+			printf(" [%s]\n", ti[i].ti_name);
+		}
+	}
+	return 0;
+}
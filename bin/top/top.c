@@ -0,0 +1,178 @@
+#include <sys/types.h>
+#include <sys/resource.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+
+/*
+ * top - show which threads are using the CPU.
+ * Usage: top [-d secs] [-n count]
+ *
+ * Every SECS seconds (default 1) prints the threads that ran in the
+ * interval, busiest first, with the share of the CPU each got and the
+ * page faults each took. Stops after COUNT reports (default 10).
+ *
+ * CPU shares are worked out from two threadinfo snapshots; time used
+ * by threads that exited in between isn't seen, so it shows up as
+ * idle.
+ */
+
+#define MAXTHREADS 256
+#define MAXLINES   20
+
+struct snapshot {
+	struct threadinfo s_ti[MAXTHREADS];
+	int s_n;
+	time_t s_secs;
+	unsigned long s_nsecs;
+};
+
+static struct snapshot snaps[2];
+
+/* Per-thread results for one report, for sorting */
+static int order[MAXTHREADS];
+static u_int32_t busy[MAXTHREADS];	/* CPU time in the interval (us) */
+static u_int32_t faults[MAXTHREADS];	/* page faults in the interval */
+
+static
+void
+snap(struct snapshot *s)
+{
+	s->s_n = threadinfo(s->s_ti, MAXTHREADS);
+	if (s->s_n < 0) {
+		err(1, "threadinfo");
+	}
+	if (s->s_n > MAXTHREADS) {
+		s->s_n = MAXTHREADS;
+	}
+	__time(&s->s_secs, &s->s_nsecs);
+}
+
+/*
+ * Total CPU time, in microseconds, modulo 2^32. Differences of these
+ * are right as long as the interval is under an hour or so.
+ */
+static
+u_int32_t
+cputime(const struct rusage *ru)
+{
+	return (u_int32_t)(ru->ru_utime_sec + ru->ru_stime_sec) * 1000000 +
+		ru->ru_utime_nsec / 1000 + ru->ru_stime_nsec / 1000;
+}
+
+static
+const struct threadinfo *
+findthread(const struct snapshot *s, u_int32_t id)
+{
+	int i;
+
+	for (i=0; i<s->s_n; i++) {
+		if (s->s_ti[i].ti_id == id) {
+			return &s->s_ti[i];
+		}
+	}
+	return NULL;
+}
+
+static
+void
+report(const struct snapshot *prev, const struct snapshot *cur)
+{
+	const struct threadinfo *t, *p;
+	u_int32_t wallms, total, pct;
+	int i, j, k, nready, nsleep, nzomb;
+
+	wallms = (cur->s_secs - prev->s_secs) * 1000 +
+		cur->s_nsecs / 1000000 - prev->s_nsecs / 1000000;
+	if (wallms == 0) {
+		wallms = 1;
+	}
+
+	total = 0;
+	nready = nsleep = nzomb = 0;
+	for (i=0; i<cur->s_n; i++) {
+		t = &cur->s_ti[i];
+		p = findthread(prev, t->ti_id);
+		busy[i] = cputime(&t->ti_ru);
+		faults[i] = t->ti_ru.ru_minflt + t->ti_ru.ru_majflt;
+		if (p != NULL) {
+			busy[i] -= cputime(&p->ti_ru);
+			faults[i] -= p->ti_ru.ru_minflt + p->ti_ru.ru_majflt;
+		}
+		total += busy[i];
+
+		switch (t->ti_state) {
+		    case TI_READY: nready++; break;
+		    case TI_SLEEP: nsleep++; break;
+		    case TI_ZOMB: nzomb++; break;
+		}
+
+		/* Insertion sort, busiest first */
+		for (j=i; j>0 && busy[order[j-1]] < busy[i]; j--) {
+			order[j] = order[j-1];
+		}
+		order[j] = i;
+	}
+
+	/* Tenths of a percent */
+	pct = total / wallms;
+	if (pct > 1000) {
+		pct = 1000;
+	}
+	printf("\ntop: %d threads: 1 running, %d ready, %d sleeping, "
+	       "%d zombie; cpu %u.%u%% busy, %u.%u%% idle\n",
+	       cur->s_n, nready, nsleep, nzomb,
+	       pct / 10, pct % 10, (1000 - pct) / 10, (1000 - pct) % 10);
+	printf("   ID S PRI  %%CPU   FLT     TIME NAME\n");
+
+	for (k=0; k<cur->s_n && k<MAXLINES; k++) {
+		i = order[k];
+		t = &cur->s_ti[i];
+		if (busy[i] == 0 && faults[i] == 0) {
+			break;
+		}
+		pct = busy[i] / wallms;
+		printf("%5u %c %3d %3u.%u %5u %5d.%02u %s%s%s\n",
+		       t->ti_id, t->ti_state, t->ti_pri,
+		       pct / 10, pct % 10, faults[i],
+		       t->ti_ru.ru_utime_sec + t->ti_ru.ru_stime_sec
+		       + (t->ti_ru.ru_utime_nsec + t->ti_ru.ru_stime_nsec)
+		       / 1000000000,
+		       (t->ti_ru.ru_utime_nsec + t->ti_ru.ru_stime_nsec)
+		       % 1000000000 / 10000000,
+		       t->ti_user ? "" : "[", t->ti_name,
+		       t->ti_user ? "" : "]");
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	int delay = 1, count = 10;
+	int i;
+
+	for (i=1; i<argc; i++) {
+		if (!strcmp(argv[i], "-d") && i+1 < argc) {
+			delay = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-n") && i+1 < argc) {
+			count = atoi(argv[++i]);
+		}
+		else {
+			errx(1, "Usage: top [-d secs] [-n count]");
+		}
+	}
+	if (delay < 1 || count < 1) {
+		errx(1, "Usage: top [-d secs] [-n count]");
+	}
+
+	snap(&snaps[0]);
+	for (i=0; i<count; i++) {
+		sleep(delay);
+		snap(&snaps[(i+1) % 2]);
+		report(&snaps[i % 2], &snaps[(i+1) % 2]);
+	}
+	return 0;
+}
@@ -0,0 +1,17 @@
+#ifndef _DIRENT_H_
+#define _DIRENT_H_
+
+#include <sys/types.h>
+
+/* Get struct dirent and the DT_* codes from the kernel headers */
+#include <kern/dirent.h>
+
+/*
+ * Fill BUF with as many struct dirent records for directory FD as fit,
+ * starting at its current position, and return the number of bytes
+ * used; 0 means the end of the directory. Walk the buffer by d_reclen.
+ * Fails with EINVAL if BUF is too small for the next entry.
+ */
+int getdirentries(int fd, char *buf, size_t buflen);
+
+#endif /* _DIRENT_H_ */
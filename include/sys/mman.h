@@ -0,0 +1,21 @@
+#ifndef _SYS_MMAN_H_
+#define _SYS_MMAN_H_
+
+#include <sys/types.h>
+
+/* Get the flags and codes from the kernel headers */
+#include <kern/mman.h>
+
+/* What mmap returns on failure */
+#define MAP_FAILED ((void *)-1)
+
+/*
+ * mmap actually takes six arguments; the last two are passed on the
+ * stack. ADDR is only a hint and is currently ignored. OFFSET must
+ * be page-aligned.
+ */
+void *mmap(void *addr, size_t len, int prot, int flags, int fd, off_t offset);
+int munmap(void *addr, size_t len);
+int msync(void *addr, size_t len, int flags);
+
+#endif /* _SYS_MMAN_H_ */
@@ -0,0 +1,24 @@
+#ifndef _SYS_RESOURCE_H_
+#define _SYS_RESOURCE_H_
+
+#include <sys/types.h>
+
+/*
+ * Get struct rusage, struct threadinfo and the #defines from the
+ * kernel
+ */
+#include <kern/resource.h>
+
+/*
+ * Resource usage of the calling process. WHO must be RUSAGE_SELF.
+ */
+int getrusage(int who, struct rusage *usage);
+
+/*
+ * Describe up to NBUF of the system's threads, kernel and user, in
+ * BUF. Returns the total number of threads, which may be more than
+ * NBUF.
+ */
+int threadinfo(struct threadinfo *buf, size_t nbuf);
+
+#endif /* _SYS_RESOURCE_H_ */
@@ -0,0 +1,21 @@
+#ifndef _SYS_UIO_H_
+#define _SYS_UIO_H_
+
+#include <sys/types.h>
+
+/* Most buffers in one call (IOV_MAX) */
+#include <kern/limits.h>
+
+/*
+ * One buffer for readv or writev. Laid out the same as the kernel's
+ * struct iovec.
+ */
+struct iovec {
+	void *iov_base;
+	size_t iov_len;
+};
+
+int readv(int filehandle, const struct iovec *iov, int iovcnt);
+int writev(int filehandle, const struct iovec *iov, int iovcnt);
+
+#endif /* _SYS_UIO_H_ */
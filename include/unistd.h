@@ -119,8 +119,27 @@ int readlink(const char *path, char *buf, size_t buflen);
 int dup2(int filehandle, int newhandle);
 int pipe(int filehandles[2]);
 time_t __time(time_t *seconds, unsigned long *nanoseconds);
+/* The __time system call itself; __time only traps for nanoseconds */
+time_t __sys_time(time_t *seconds, unsigned long *nanoseconds);
 unsigned int sleep(unsigned int seconds);
 int __getcwd(char *buf, size_t buflen);
+/*
+ * Copy up to LEN bytes from FROMFD to TOFD, at their current
+ * positions, inside the kernel. Returns the count copied; 0 at EOF.
+ */
+int fcopy(int fromfd, int tofd, size_t len);
+/* getdirentries - see dirent.h */
+/*
+ * Set the calling thread's scheduling priority, from 0 (lowest) up to
+ * the default, 3; the kernel's own threads can go up to 7. Returns the
+ * previous priority.
+ */
+int setpriority(int pri);
+/*
+ * Copy the most recent kernel log text, up to BUFLEN bytes, into BUF.
+ * Returns the count copied. The log holds the last 16K of output.
+ */
+int dmesg(char *buf, size_t buflen);
 /* stat - see sys/stat.h */
 /* lstat - see sys/stat.h */
 
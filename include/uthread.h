@@ -0,0 +1,100 @@
+#ifndef _UTHREAD_H_
+#define _UTHREAD_H_
+
+#include <sys/types.h>
+
+/*
+ * User-level threads.
+ *
+ * Cooperative threads within one process, switched with setjmp and
+ * longjmp. Only one runs at a time; the running thread keeps the
+ * processor until it yields, blocks (uthread_join, umutex_lock,
+ * ucond_wait) or exits. Threads that are ready wait in a FIFO run
+ * queue. Each thread has its own stack, from malloc.
+ *
+ * The thread running main() becomes a uthread the first time the
+ * library is used. If it returns from main(), the process exits, and
+ * the other threads with it; to wait for them, it can call
+ * uthread_exit instead, and the process exits when the last thread
+ * does. If every thread is blocked, the process dies with a message.
+ *
+ * Functions other than uthread_tick return 0 on success and -1 with
+ * errno set on failure.
+ *
+ *    uthread_create - make a thread that calls FUNC(ARG) on a stack of
+ *                     STACKSIZE bytes (0 for UTHREAD_STACKSIZE), and
+ *                     put it on the run queue. The caller keeps
+ *                     running. If RET is not NULL, the thread is
+ *                     handed back there and is joinable: when it
+ *                     exits, it's kept until uthread_join. Otherwise
+ *                     it's freed when it exits.
+ *    uthread_join   - wait for a joinable thread to exit, and free it.
+ *                     Fails with EINVAL if it isn't joinable or is
+ *                     already being joined, and EDEADLK if it's the
+ *                     caller.
+ *    uthread_exit   - end the calling thread. Returning from FUNC
+ *                     does the same.
+ *    uthread_yield  - let the other ready threads run first.
+ *    uthread_self   - the calling thread.
+ *
+ *    uthread_tick   - preemption hook, for a timer signal handler once
+ *                     OS/161 has signals: yields for the running
+ *                     thread, or if it's inside the library, as soon
+ *                     as it leaves.
+ *
+ * Mutexes and condition variables, which may be set up statically
+ * with UMUTEX_INITIALIZER and UCOND_INITIALIZER:
+ *
+ *    umutex_lock    - acquire, waiting if another thread has it.
+ *                     Waiters get the mutex in the order they came.
+ *    umutex_trylock - acquire, or fail with EBUSY.
+ *    umutex_unlock  - release; the caller must hold it.
+ *    ucond_wait     - release the mutex, wait for a signal, and
+ *                     reacquire the mutex.
+ *    ucond_signal   - wake one waiter, if there is one.
+ *    ucond_broadcast - wake all of them.
+ */
+
+struct uthread;
+
+/* Default and smallest stack sizes */
+#define UTHREAD_STACKSIZE  8192
+#define UTHREAD_STACKMIN   2048
+
+/* A FIFO of threads, linked through the threads */
+struct uthread_queue {
+	struct uthread *uq_head;
+	struct uthread *uq_tail;
+};
+
+struct umutex {
+	struct uthread *um_owner;
+	struct uthread_queue um_waiters;
+};
+
+struct ucond {
+	struct uthread_queue uc_waiters;
+};
+
+#define UMUTEX_INITIALIZER  { NULL, { NULL, NULL } }
+#define UCOND_INITIALIZER   { { NULL, NULL } }
+
+int uthread_create(struct uthread **ret, size_t stacksize,
+		   void (*func)(void *), void *arg);
+int uthread_join(struct uthread *t);
+void uthread_exit(void) __attribute__((__noreturn__));
+void uthread_yield(void);
+struct uthread *uthread_self(void);
+void uthread_tick(void);
+
+void umutex_init(struct umutex *m);
+void umutex_lock(struct umutex *m);
+int umutex_trylock(struct umutex *m);
+void umutex_unlock(struct umutex *m);
+
+void ucond_init(struct ucond *c);
+void ucond_wait(struct ucond *c, struct umutex *m);
+void ucond_signal(struct ucond *c);
+void ucond_broadcast(struct ucond *c);
+
+#endif /* _UTHREAD_H_ */
@@ -24,20 +24,25 @@
  *        is not set. To completely invalidate the TLB, load it with
  *        translations for addresses in one of the unmapped address
  *        ranges - these will never be matched.
+ *
+ *   TLB_SetHi: load ENTRYHI into the processor's entryhi register
+ *        without touching the TLB. The PID field of that register is
+ *        the current address space ID; all the other functions above
+ *        change it, so it must be put back afterwards (see asid.c).
  */
 
 void TLB_Random(u_int32_t entryhi, u_int32_t entrylo);
 void TLB_Write(u_int32_t entryhi, u_int32_t entrylo, u_int32_t index);
 void TLB_Read(u_int32_t *entryhi, u_int32_t *entrylo, u_int32_t index);
 int TLB_Probe(u_int32_t entryhi, u_int32_t entrylo);
+void TLB_SetHi(u_int32_t entryhi);
 
 /*
  * TLB entry fields.
  *
- * Note that the MIPS has support for a 6-bit address space ID. In the
- * interests of simplicity, we don't use it. The fields related to it
- * (TLBLO_GLOBAL and TLBHI_PID) can be left always zero, as can the
- * bits that aren't assigned a meaning.
+ * The MIPS has support for a 6-bit address space ID, which asid.c
+ * manages. TLBLO_GLOBAL is not used and can be left always zero, as
+ * can the bits that aren't assigned a meaning.
  *
  * The TLBLO_DIRTY bit is actually a write privilege bit - it is not
  * ever set by the processor. If you set it, writes are permitted. If
@@ -49,7 +54,8 @@ int TLB_Probe(u_int32_t entryhi, u_int32_t entrylo);
 
 /* Fields in the high-order word */
 #define TLBHI_VPAGE   0xfffff000
-/*      TLBHI_PID     0x00000fc0 */
+#define TLBHI_PID     0x00000fc0
+#define TLBHI_PIDSHIFT 6
 
 /* Fields in the low-order word */
 #define TLBLO_PPAGE   0xfffff000
@@ -72,5 +78,46 @@ int TLB_Probe(u_int32_t entryhi, u_int32_t entrylo);
 
 #define NUM_TLB  64
 
+/*
+ * Address space IDs, in asid.c.
+ *
+ * Each address space gets an ASID tagged with the generation it was
+ * handed out in. Entries for all address spaces can then stay in the
+ * TLB across context switches; only when the ASIDs run out does the
+ * generation change, the TLB get flushed, and everyone get a new ASID
+ * the next time they run. ASID 0 is never handed out.
+ *
+ *   asid_activate: make the address space with *ASID and *GEN current,
+ *        assigning it a new ASID if it has none from this generation.
+ *        Call when switching to it.
+ *   asid_hi:     current ASID in entryhi position; OR it into the
+ *        vaddr when building TLB entries.
+ *   tlb_flush:   invalidate the whole TLB (all address spaces).
+ *   tlb_invalidate: drop the current address space's entry for VADDR,
+ *        if any.
+ */
+
+#define NUM_ASID  64
+
+void asid_activate(u_int32_t *asid, u_int32_t *gen);
+u_int32_t asid_hi(void);
+void tlb_flush(void);
+void tlb_invalidate(u_int32_t vaddr);
+
+/*
+ * Counters. Faults are counted by vm_fault.
+ */
+struct tlb_stats {
+	u_int32_t ts_misses;		/* TLB miss faults */
+	u_int32_t ts_modfaults;		/* writes to read-only entries */
+	u_int32_t ts_activates;		/* address space switches */
+	u_int32_t ts_asidhits;		/* ... that kept their ASID */
+	u_int32_t ts_asidassigns;	/* ASIDs handed out */
+	u_int32_t ts_flushes;		/* full TLB flushes */
+};
+extern struct tlb_stats tlb_stats;
+
+void tlb_printstats(void);
+
 
 #endif /* _MACHINE_TLB_H_ */
@@ -0,0 +1,116 @@
+/*
+ * TLB address space IDs.
+ *
+ * Without these, every switch to a user thread has to flush the whole
+ * TLB, and with a one-tick quantum each process refaults its working
+ * set after every timer interrupt. Instead each address space gets a
+ * 6-bit ASID that tags its TLB entries, so entries for several
+ * processes live in the TLB at once and switching is just a matter
+ * of loading the PID field of entryhi.
+ *
+ * ASIDs are handed out in order. When they run out, the generation
+ * number goes up and the TLB is flushed; address spaces holding an
+ * ASID from an older generation get a fresh one when they next run.
+ * An address space that goes away just abandons its ASID; its stale
+ * entries can't match anything until the flush that precedes reuse.
+ *
+ * Everything here runs at splhigh.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <machine/spl.h>
+#include <machine/tlb.h>
+
+struct tlb_stats tlb_stats;
+
+/* Current ASID; 0 until the first user address space is activated */
+static u_int32_t asid_cur = 0;
+
+/* Next ASID to hand out and current generation. Generation 0 is never
+ * current, so address spaces can start with *gen == 0. */
+static u_int32_t asid_next = 1;
+static u_int32_t asid_gen = 1;
+
+void
+tlb_flush(void)
+{
+	int i, spl;
+
+	spl = splhigh();
+
+	for (i=0; i<NUM_TLB; i++) {
+		TLB_Write(TLBHI_INVALID(i), TLBLO_INVALID(), i);
+	}
+	TLB_SetHi(asid_cur << TLBHI_PIDSHIFT);
+	tlb_stats.ts_flushes++;
+
+	splx(spl);
+}
+
+void
+tlb_invalidate(u_int32_t vaddr)
+{
+	int ix, spl;
+
+	spl = splhigh();
+
+	ix = TLB_Probe((vaddr & TLBHI_VPAGE) | (asid_cur << TLBHI_PIDSHIFT), 0);
+	if (ix >= 0) {
+		TLB_Write(TLBHI_INVALID(ix), TLBLO_INVALID(), ix);
+	}
+	TLB_SetHi(asid_cur << TLBHI_PIDSHIFT);
+
+	splx(spl);
+}
+
+void
+asid_activate(u_int32_t *asid, u_int32_t *gen)
+{
+	int spl;
+
+	spl = splhigh();
+
+	tlb_stats.ts_activates++;
+
+	if (*gen == asid_gen) {
+		tlb_stats.ts_asidhits++;
+	}
+	else {
+		if (asid_next >= NUM_ASID) {
+			/* Out of ASIDs: start a new generation */
+			asid_gen++;
+			if (asid_gen == 0) {
+				asid_gen++;
+			}
+			asid_next = 1;
+			asid_cur = 0;
+			tlb_flush();
+		}
+		*asid = asid_next++;
+		*gen = asid_gen;
+		tlb_stats.ts_asidassigns++;
+	}
+
+	asid_cur = *asid;
+	TLB_SetHi(asid_cur << TLBHI_PIDSHIFT);
+
+	splx(spl);
+}
+
+u_int32_t
+asid_hi(void)
+{
+	return asid_cur << TLBHI_PIDSHIFT;
+}
+
+void
+tlb_printstats(void)
+{
+	kprintf("tlb: %u misses, %u modify faults\n",
+		tlb_stats.ts_misses, tlb_stats.ts_modfaults);
+	kprintf("tlb: %u activations, %u kept ASID, %u ASIDs assigned, "
+		"%u flushes\n",
+		tlb_stats.ts_activates, tlb_stats.ts_asidhits,
+		tlb_stats.ts_asidassigns, tlb_stats.ts_flushes);
+}
@@ -1,5 +1,6 @@
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/timepage.h>
 #include <lib.h>
 #include <thread.h>
 #include <curthread.h>
@@ -18,11 +19,7 @@
 /* under dumbvm, always have 48k of user stack */
 #define DUMBVM_STACKPAGES    12
 
-void
-vm_bootstrap(void)
-{
-	/* Do nothing. */
-}
+paddr_t vm_timepage;
 
 static
 paddr_t
@@ -39,6 +36,19 @@ getppages(unsigned long npages)
 	return addr;
 }
 
+void
+vm_bootstrap(void)
+{
+	paddr_t pa;
+
+	pa = getppages(1);
+	if (pa == 0) {
+		panic("dumbvm: no memory for the time page\n");
+	}
+	bzero((void *)PADDR_TO_KVADDR(pa), PAGE_SIZE);
+	vm_timepage = pa;
+}
+
 /* Allocate/free some kernel-space virtual pages */
 vaddr_t 
 alloc_kpages(int npages)
@@ -64,8 +74,7 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 {
 	vaddr_t vbase1, vtop1, vbase2, vtop2, stackbase, stacktop;
 	paddr_t paddr;
-	int i;
-	u_int32_t ehi, elo;
+	u_int32_t ehi, elo, dirty;
 	struct addrspace *as;
 	int spl;
 
@@ -77,10 +86,12 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 
 	switch (faulttype) {
 	    case VM_FAULT_READONLY:
-		/* We always create pages read-write, so we can't get this */
-		panic("dumbvm: got VM_FAULT_READONLY\n");
+		/* Only the time page is read-only */
+		splx(spl);
+		return EFAULT;
 	    case VM_FAULT_READ:
 	    case VM_FAULT_WRITE:
+		tlb_stats.ts_misses++;
 		break;
 	    default:
 		splx(spl);
@@ -117,6 +128,7 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 	vtop2 = vbase2 + as->as_npages2 * PAGE_SIZE;
 	stackbase = USERSTACK - DUMBVM_STACKPAGES * PAGE_SIZE;
 	stacktop = USERSTACK;
+	dirty = TLBLO_DIRTY;
 
 	if (faultaddress >= vbase1 && faultaddress < vtop1) {
 		paddr = (faultaddress - vbase1) + as->as_pbase1;
@@ -127,6 +139,10 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 	else if (faultaddress >= stackbase && faultaddress < stacktop) {
 		paddr = (faultaddress - stackbase) + as->as_stackpbase;
 	}
+	else if (faultaddress == TIMEPAGE && faulttype == VM_FAULT_READ) {
+		paddr = vm_timepage;
+		dirty = 0;
+	}
 	else {
 		splx(spl);
 		return EFAULT;
@@ -135,22 +151,17 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 	/* make sure it's page-aligned */
 	assert((paddr & PAGE_FRAME)==paddr);
 
-	for (i=0; i<NUM_TLB; i++) {
-		TLB_Read(&ehi, &elo, i);
-		if (elo & TLBLO_VALID) {
-			continue;
-		}
-		ehi = faultaddress;
-		elo = paddr | TLBLO_DIRTY | TLBLO_VALID;
-		DEBUG(DB_VM, "dumbvm: 0x%x -> 0x%x\n", faultaddress, paddr);
-		TLB_Write(ehi, elo, i);
-		splx(spl);
-		return 0;
-	}
-
-	kprintf("dumbvm: Ran out of TLB entries - cannot handle page fault\n");
+	/*
+	 * Entries of other address spaces stay in the TLB now (see
+	 * asid.c), so there are rarely free slots; just replace one.
+	 */
+	ehi = faultaddress | asid_hi();
+	elo = paddr | dirty | TLBLO_VALID;
+	DEBUG(DB_VM, "dumbvm: 0x%x -> 0x%x\n", faultaddress, paddr);
+	TLB_Random(ehi, elo);
+	curthread->t_ru.ru_minflt++;
 	splx(spl);
-	return EFAULT;
+	return 0;
 }
 
 struct addrspace *
@@ -161,6 +172,8 @@ as_create(void)
 		return NULL;
 	}
 
+	as->as_asid = 0;
+	as->as_asidgen = 0;
 	as->as_vbase1 = 0;
 	as->as_pbase1 = 0;
 	as->as_npages1 = 0;
@@ -181,17 +194,7 @@ as_destroy(struct addrspace *as)
 void
 as_activate(struct addrspace *as)
 {
-	int i, spl;
-
-	(void)as;
-
-	spl = splhigh();
-
-	for (i=0; i<NUM_TLB; i++) {
-		TLB_Write(TLBHI_INVALID(i), TLBLO_INVALID(), i);
-	}
-
-	splx(spl);
+	asid_activate(&as->as_asid, &as->as_asidgen);
 }
 
 int
@@ -274,6 +277,61 @@ as_define_stack(struct addrspace *as, vaddr_t *stackptr)
 	return 0;
 }
 
+/*
+ * dumbvm's segments are physically contiguous and allocated up
+ * front, so there's no heap to grow.
+ */
+int
+as_sbrk(struct addrspace *as, int amount, vaddr_t *oldbreak)
+{
+	(void)as;
+	(void)amount;
+	(void)oldbreak;
+	return ENOSYS;
+}
+
+/* Likewise, file mappings need demand paging. */
+int
+as_mmap(struct addrspace *as, size_t len, int prot, int flags,
+	struct vnode *v, off_t offset, vaddr_t *ret)
+{
+	(void)as;
+	(void)len;
+	(void)prot;
+	(void)flags;
+	(void)v;
+	(void)offset;
+	(void)ret;
+	return ENOSYS;
+}
+
+int
+as_munmap(struct addrspace *as, vaddr_t addr, size_t len)
+{
+	(void)as;
+	(void)addr;
+	(void)len;
+	return ENOSYS;
+}
+
+int
+as_msync(struct addrspace *as, vaddr_t addr, size_t len)
+{
+	(void)as;
+	(void)addr;
+	(void)len;
+	return ENOSYS;
+}
+
+int
+as_fsyncvnode(struct addrspace *as, struct vnode *v)
+{
+	/* No mappings, so nothing to do */
+	(void)as;
+	(void)v;
+	return 0;
+}
+
 int
 as_copy(struct addrspace *old, struct addrspace **ret)
 {
@@ -34,9 +34,9 @@
  * return code will restart the "syscall" instruction and the system
  * call will repeat forever.
  *
- * Since none of the OS/161 system calls have more than 4 arguments,
- * there should be no need to fetch additional arguments from the
- * user-level stack.
+ * Only mmap has more than 4 arguments; the rest are fetched from the
+ * user-level stack, starting at sp+16 (the caller reserves space
+ * there for the 4 register arguments).
  *
  * Watch out: if you make system calls that have 64-bit quantities as
  * arguments, they will get passed in pairs of registers, and not
@@ -50,6 +50,7 @@ mips_syscall(struct trapframe *tf)
 {
 	int callno;
 	int32_t retval;
+	int32_t stackargs[2];
 	int err;
 
 	assert(curspl==0);
@@ -92,6 +93,88 @@ mips_syscall(struct trapframe *tf)
 		err = sys_sleep((unsigned int)tf->tf_a0);
 		break;
 
+		case SYS_sbrk:
+		err = sys_sbrk((int)tf->tf_a0, &retval);
+		break;
+
+		case SYS_setpriority:
+		err = sys_setpriority((int)tf->tf_a0, &retval);
+		break;
+
+		case SYS_dmesg:
+		err = sys_dmesg((userptr_t)tf->tf_a0, tf->tf_a1, &retval);
+		break;
+
+		case SYS_getrusage:
+		err = sys_getrusage((int)tf->tf_a0, (userptr_t)tf->tf_a1);
+		break;
+
+		case SYS_threadinfo:
+		err = sys_threadinfo((userptr_t)tf->tf_a0, tf->tf_a1,
+				     &retval);
+		break;
+
+		case SYS_open:
+		err = sys_open((const_userptr_t)tf->tf_a0, tf->tf_a1, &retval);
+		break;
+
+		case SYS_pipe:
+		err = sys_pipe((userptr_t)tf->tf_a0);
+		break;
+
+		case SYS_close:
+		err = sys_close(tf->tf_a0);
+		break;
+
+		case SYS_fsync:
+		err = sys_fsync(tf->tf_a0);
+		break;
+
+		case SYS_mmap:
+		/* fd and offset are the 5th and 6th args, on the stack */
+		err = copyin((const_userptr_t)(tf->tf_sp + 16), stackargs,
+			     sizeof(stackargs));
+		if (err) {
+			break;
+		}
+		err = sys_mmap((userptr_t)tf->tf_a0, (size_t)tf->tf_a1,
+			       tf->tf_a2, tf->tf_a3, stackargs[0],
+			       (off_t)stackargs[1], &retval);
+		break;
+
+		case SYS_munmap:
+		err = sys_munmap((userptr_t)tf->tf_a0, (size_t)tf->tf_a1);
+		break;
+
+		case SYS_msync:
+		err = sys_msync((userptr_t)tf->tf_a0, (size_t)tf->tf_a1,
+				tf->tf_a2);
+		break;
+
+		case SYS_readv:
+		err = sys_readv(tf->tf_a0, (const_userptr_t)tf->tf_a1,
+				tf->tf_a2, &retval);
+		break;
+
+		case SYS_writev:
+		err = sys_writev(tf->tf_a0, (const_userptr_t)tf->tf_a1,
+				 tf->tf_a2, &retval);
+		break;
+
+		case SYS_fcopy:
+		err = sys_fcopy(tf->tf_a0, tf->tf_a1, (size_t)tf->tf_a2,
+				&retval);
+		break;
+
+		case SYS_fstat:
+		err = sys_fstat(tf->tf_a0, (userptr_t)tf->tf_a1);
+		break;
+
+		case SYS_getdirentries:
+		err = sys_getdirentries(tf->tf_a0, (userptr_t)tf->tf_a1,
+					(size_t)tf->tf_a2, &retval);
+		break;
+
 	    /* Add stuff here */
  
 	    default:
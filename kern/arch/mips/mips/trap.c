@@ -5,6 +5,7 @@
 #include <machine/pcb.h>
 #include <machine/spl.h>
 #include <vm.h>
+#include <softirq.h>
 #include <thread.h>
 #include <curthread.h>
 
@@ -77,15 +78,27 @@ mips_trap(struct trapframe *tf)
 
 	assert(code<NTRAPCODES);
 
+	/* Up to now the current thread was running in user mode */
+	if (!iskern) {
+		thread_chargeuser();
+	}
+
 	/* Make sure we haven't run off our stack */
 	if (curthread != NULL && curthread->t_stack != NULL) {
 		assert((vaddr_t)tf > (vaddr_t)curthread->t_stack);
 		assert((vaddr_t)tf < (vaddr_t)(curthread->t_stack+STACK_SIZE));
 	}
 
-	/* Interrupt? Call the interrupt handler and return. */
+	/*
+	 * Interrupt? Call the interrupt handler and return. If the
+	 * interrupted code had interrupts on, run the work the handler
+	 * deferred first, with interrupts back on.
+	 */
 	if (code == EX_IRQ) {
 		mips_interrupt(tf->tf_cause);
+		if (savespl == 0) {
+			softirq_irqexit();
+		}
 		goto done;
 	}
 
@@ -200,6 +213,11 @@ mips_trap(struct trapframe *tf)
 	/* Make sure interrupts are off */
 	splhigh();
 
+	/* And from here on it's back in user mode */
+	if (!iskern) {
+		thread_chargesys();
+	}
+
 	/*
 	 * Restore previous context's curspl value.
 	 *
@@ -247,6 +265,10 @@ mips_usermode(struct trapframe *tf)
 	 * explicitly to 0.
 	 */
 	splhigh();
+
+	/* Time until now was spent in the kernel */
+	thread_chargesys();
+
 	curspl = 0;
 
 	/*
@@ -18,6 +18,7 @@
 #include <lib.h>
 #include <synch.h>
 #include <array.h>
+#include <clock.h>
 #include <uio.h>
 #include <vfs.h>
 #include <emufs.h>
@@ -190,19 +191,18 @@ emu_open(struct emu_softc *sc, u_int32_t handle, const char *name,
  * Routine for closing a file we opened at the hardware level.
  * This is not necessarily called at VOP_CLOSE time; it's called
  * at VOP_RECLAIM time.
+ *
+ * The hardware-level routines below that end in _locked expect the
+ * caller to hold e_lock; the others take it themselves.
  */
 static
 int
-emu_close(struct emu_softc *sc, u_int32_t handle)
+emu_close_locked(struct emu_softc *sc, u_int32_t handle)
 {
 	int result;
-	int mine;
 	int retries=0;
 
-	mine = lock_do_i_hold(sc->e_lock);
-	if (!mine) {
-		lock_acquire(sc->e_lock);
-	}
+	assert(lock_do_i_hold(sc->e_lock));
 
 	while (1) {
 		/* Retry operation up to 10 times */
@@ -220,9 +220,18 @@ emu_close(struct emu_softc *sc, u_int32_t handle)
 		break;
 	}
 
-	if (!mine) {
-		lock_release(sc->e_lock);
-	}
+	return result;
+}
+
+static
+int
+emu_close(struct emu_softc *sc, u_int32_t handle)
+{
+	int result;
+
+	lock_acquire(sc->e_lock);
+	result = emu_close_locked(sc, handle);
+	lock_release(sc->e_lock);
 	return result;
 }
 
@@ -231,14 +240,13 @@ emu_close(struct emu_softc *sc, u_int32_t handle)
  */
 static
 int
-emu_doread(struct emu_softc *sc, u_int32_t handle, u_int32_t len,
-	   u_int32_t op, struct uio *uio)
+emu_doread_locked(struct emu_softc *sc, u_int32_t handle, u_int32_t len,
+		  u_int32_t op, struct uio *uio)
 {
 	int result;
 
 	assert(uio->uio_rw == UIO_READ);
-
-	lock_acquire(sc->e_lock);
+	assert(lock_do_i_hold(sc->e_lock));
 
 	emu_wreg(sc, REG_HANDLE, handle);
 	emu_wreg(sc, REG_IOLEN, len);
@@ -246,27 +254,39 @@ emu_doread(struct emu_softc *sc, u_int32_t handle, u_int32_t len,
 	emu_wreg(sc, REG_OPER, op);
 	result = emu_waitdone(sc);
 	if (result) {
-		goto out;
+		return result;
 	}
 	
 	result = uiomove(sc->e_iobuf, emu_rreg(sc, REG_IOLEN), uio);
 
 	uio->uio_offset = emu_rreg(sc, REG_OFFSET);
 
- out:
-	lock_release(sc->e_lock);
 	return result;
 }
 
 /*
- * Read from a hardware-level file handle.
+ * Read from a hardware-level file handle. The _locked version is for
+ * the emufs read buffer, which is filled with e_lock held.
  */
+static
+int
+emu_read_locked(struct emu_softc *sc, u_int32_t handle, u_int32_t len,
+		struct uio *uio)
+{
+	return emu_doread_locked(sc, handle, len, EMU_OP_READ, uio);
+}
+
 static
 int
 emu_read(struct emu_softc *sc, u_int32_t handle, u_int32_t len,
 	 struct uio *uio)
 {
-	return emu_doread(sc, handle, len, EMU_OP_READ, uio);
+	int result;
+
+	lock_acquire(sc->e_lock);
+	result = emu_doread_locked(sc, handle, len, EMU_OP_READ, uio);
+	lock_release(sc->e_lock);
+	return result;
 }
 
 /*
@@ -277,22 +297,27 @@ int
 emu_readdir(struct emu_softc *sc, u_int32_t handle, u_int32_t len,
 	    struct uio *uio)
 {
-	return emu_doread(sc, handle, len, EMU_OP_READDIR, uio);
+	int result;
+
+	lock_acquire(sc->e_lock);
+	result = emu_doread_locked(sc, handle, len, EMU_OP_READDIR, uio);
+	lock_release(sc->e_lock);
+	return result;
 }
 
 /*
- * Write to a hardware-level file handle.
+ * Write to a hardware-level file handle. emufs_write holds e_lock
+ * across a whole write, so there is only a _locked version.
  */
 static
 int
-emu_write(struct emu_softc *sc, u_int32_t handle, u_int32_t len,
-	  struct uio *uio)
+emu_write_locked(struct emu_softc *sc, u_int32_t handle, u_int32_t len,
+		 struct uio *uio)
 {
 	int result;
 
 	assert(uio->uio_rw == UIO_WRITE);
-
-	lock_acquire(sc->e_lock);
+	assert(lock_do_i_hold(sc->e_lock));
 
 	emu_wreg(sc, REG_HANDLE, handle);
 	emu_wreg(sc, REG_IOLEN, len);
@@ -300,27 +325,24 @@ emu_write(struct emu_softc *sc, u_int32_t handle, u_int32_t len,
 
 	result = uiomove(sc->e_iobuf, len, uio);
 	if (result) {
-		goto out;
+		return result;
 	}
 
 	emu_wreg(sc, REG_OPER, EMU_OP_WRITE);
-	result = emu_waitdone(sc);
-
- out:
-	lock_release(sc->e_lock);
-	return result;
+	return emu_waitdone(sc);
 }
 
 /*
  * Get the file size associated with a hardware-level file handle.
+ * Called with e_lock held, which also protects the cached size.
  */
 static
 int
-emu_getsize(struct emu_softc *sc, u_int32_t handle, off_t *retval)
+emu_getsize_locked(struct emu_softc *sc, u_int32_t handle, off_t *retval)
 {
 	int result;
 
-	lock_acquire(sc->e_lock);
+	assert(lock_do_i_hold(sc->e_lock));
 
 	emu_wreg(sc, REG_HANDLE, handle);
 	emu_wreg(sc, REG_OPER, EMU_OP_GETSIZE);
@@ -328,29 +350,23 @@ emu_getsize(struct emu_softc *sc, u_int32_t handle, off_t *retval)
 	if (result==0) {
 		*retval = emu_rreg(sc, REG_IOLEN);
 	}
-
-	lock_release(sc->e_lock);
 	return result;
 }
 
 /*
- * Truncate a hardware-level file handle.
+ * Truncate a hardware-level file handle. Called with e_lock held,
+ * like emu_getsize_locked.
  */
 static
 int
-emu_trunc(struct emu_softc *sc, u_int32_t handle, off_t len)
+emu_trunc_locked(struct emu_softc *sc, u_int32_t handle, off_t len)
 {
-	int result;
-
-	lock_acquire(sc->e_lock);
+	assert(lock_do_i_hold(sc->e_lock));
 
 	emu_wreg(sc, REG_HANDLE, handle);
 	emu_wreg(sc, REG_IOLEN, len);
 	emu_wreg(sc, REG_OPER, EMU_OP_TRUNC);
-	result = emu_waitdone(sc);
-
-	lock_release(sc->e_lock);
-	return result;
+	return emu_waitdone(sc);
 }
 
 //
@@ -366,6 +382,277 @@ emu_trunc(struct emu_softc *sc, u_int32_t handle, off_t len)
 static int emufs_loadvnode(struct emufs_fs *ef, u_int32_t handle, int isdir,
 			   struct emufs_vnode **ret);
 
+/*
+ * Lookup cache.
+ *
+ * Every lookup otherwise costs an EMU_OP_OPEN round trip, and running
+ * programs off emu0: looks up the same few names over and over. So we
+ * remember the last EMUFS_NCACHE (directory, name) -> vnode results.
+ * Each entry holds a reference to its vnode, which keeps the host
+ * handle open; that's what makes a hit free. Entries keyed by a
+ * directory are dropped when the directory is reclaimed. Misses are
+ * not cached, since files can appear on the host at any time.
+ *
+ * The host doesn't tell us when a file is renamed or removed behind
+ * our back, so a hit can name a file that's no longer there under
+ * that name. To bound that, entries expire EMUFS_NCTTL seconds after
+ * they were looked up; an expired entry counts as a miss and is
+ * replaced by the fresh lookup. The cache never holds more than
+ * EMUFS_NCACHE vnodes, and emufs_hostopen empties it if the host
+ * runs out of handles.
+ *
+ * All of this is protected by e_lock. Dropping a cached reference can
+ * call emufs_reclaim, which takes e_lock, so references that fall out
+ * of the cache are handed back to the caller to VOP_DECREF after
+ * releasing the lock.
+ */
+
+/*
+ * Find a cached lookup. Returns the vnode with a new reference, or
+ * NULL.
+ */
+static
+struct emufs_vnode *
+emufs_ncfind(struct emufs_fs *ef, struct emufs_vnode *dir, const char *name)
+{
+	struct emufs_name *en;
+	time_t now;
+	u_int32_t nsecs;
+	int i;
+
+	assert(lock_do_i_hold(ef->ef_emu->e_lock));
+
+	gettime(&now, &nsecs);
+
+	for (i=0; i<EMUFS_NCACHE; i++) {
+		en = &ef->ef_names[i];
+		if (en->en_vn != NULL && en->en_dir == dir &&
+		    !strcmp(en->en_name, name)) {
+			if (now - en->en_time >= EMUFS_NCTTL) {
+				/* Expired; emufs_ncenter will replace it */
+				return NULL;
+			}
+			en->en_stamp = ++ef->ef_namestamp;
+			VOP_INCREF(&en->en_vn->ev_v);
+			return en->en_vn;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Remember that NAME in DIR is EV. Takes a reference to EV. Returns
+ * a vnode whose cache reference the caller must drop, or NULL.
+ */
+static
+struct emufs_vnode *
+emufs_ncenter(struct emufs_fs *ef, struct emufs_vnode *dir, const char *name,
+	      struct emufs_vnode *ev)
+{
+	struct emufs_name *en, *victim;
+	struct emufs_vnode *old;
+	u_int32_t nsecs;
+	int i;
+
+	assert(lock_do_i_hold(ef->ef_emu->e_lock));
+
+	if (strlen(name)+1 > EMUFS_NAMELEN) {
+		return NULL;
+	}
+
+	victim = NULL;
+	for (i=0; i<EMUFS_NCACHE; i++) {
+		en = &ef->ef_names[i];
+		if (en->en_vn == NULL) {
+			if (victim == NULL || victim->en_vn != NULL) {
+				victim = en;
+			}
+			continue;
+		}
+		if (en->en_dir == dir && !strcmp(en->en_name, name)) {
+			victim = en;
+			break;
+		}
+		if (victim == NULL || (victim->en_vn != NULL &&
+				       en->en_stamp < victim->en_stamp)) {
+			victim = en;
+		}
+	}
+	assert(victim != NULL);
+
+	old = victim->en_vn;
+	VOP_INCREF(&ev->ev_v);
+	victim->en_dir = dir;
+	victim->en_vn = ev;
+	victim->en_stamp = ++ef->ef_namestamp;
+	gettime(&victim->en_time, &nsecs);
+	strcpy(victim->en_name, name);
+
+	return old;
+}
+
+/*
+ * Drop cache entries: those looked up in DIR, or all of them if DIR
+ * is NULL. The dropped vnodes are stored in OLD (EMUFS_NCACHE slots)
+ * for the caller to release; returns how many.
+ */
+static
+int
+emufs_ncpurge(struct emufs_fs *ef, struct emufs_vnode *dir,
+	      struct emufs_vnode **old)
+{
+	struct emufs_name *en;
+	int i, n=0;
+
+	assert(lock_do_i_hold(ef->ef_emu->e_lock));
+
+	for (i=0; i<EMUFS_NCACHE; i++) {
+		en = &ef->ef_names[i];
+		if (en->en_vn != NULL && (dir == NULL || en->en_dir == dir)) {
+			old[n++] = en->en_vn;
+			en->en_vn = NULL;
+			en->en_dir = NULL;
+		}
+	}
+	return n;
+}
+
+/*
+ * Release vnodes returned by emufs_ncpurge. Call without e_lock.
+ */
+static
+void
+emufs_ncrelease(struct emufs_vnode **old, int n)
+{
+	int i;
+	for (i=0; i<n; i++) {
+		VOP_DECREF(&old[i]->ev_v);
+	}
+}
+
+/*
+ * emu_open, but if the host is out of handles, give back the ones
+ * the lookup cache is sitting on and try once more.
+ */
+static
+int
+emufs_hostopen(struct emufs_fs *ef, struct emufs_vnode *dir, const char *name,
+	       int create, int excl, u_int32_t *newhandle, int *newisdir)
+{
+	struct emufs_vnode *old[EMUFS_NCACHE];
+	int result, n;
+
+	result = emu_open(ef->ef_emu, dir->ev_handle, name, create, excl,
+			  newhandle, newisdir);
+	if (result != ENFILE) {
+		return result;
+	}
+
+	lock_acquire(ef->ef_emu->e_lock);
+	n = emufs_ncpurge(ef, NULL, old);
+	lock_release(ef->ef_emu->e_lock);
+	if (n == 0) {
+		return result;
+	}
+	emufs_ncrelease(old, n);
+
+	return emu_open(ef->ef_emu, dir->ev_handle, name, create, excl,
+			newhandle, newisdir);
+}
+
+/*
+ * Enter a lookup result in the cache.
+ */
+static
+void
+emufs_nccache(struct emufs_fs *ef, struct emufs_vnode *dir, const char *name,
+	      struct emufs_vnode *ev)
+{
+	struct emufs_vnode *old;
+
+	lock_acquire(ef->ef_emu->e_lock);
+	old = emufs_ncenter(ef, dir, name, ev);
+	lock_release(ef->ef_emu->e_lock);
+
+	if (old != NULL) {
+		VOP_DECREF(&old->ev_v);
+	}
+}
+
+/*
+ * Read buffer.
+ *
+ * The ELF loader and most small programs read in pieces much smaller
+ * than the emulator's transfer buffer, and each piece is a round
+ * trip. Reads smaller than EMU_MAXIO are instead satisfied from a
+ * per-filesystem buffer that is always filled with a full EMU_MAXIO
+ * transfer. Writes and truncates through the owning vnode invalidate
+ * it. Protected by e_lock.
+ */
+static
+void
+emufs_rainval(struct emufs_fs *ef, struct emufs_vnode *ev)
+{
+	assert(lock_do_i_hold(ef->ef_emu->e_lock));
+	if (ef->ef_raowner == ev) {
+		ef->ef_raowner = NULL;
+	}
+}
+
+static
+int
+emufs_bufread(struct emufs_fs *ef, struct emufs_vnode *ev, struct uio *uio)
+{
+	struct uio ku;
+	u_int32_t skip, amt;
+	int result = 0;
+
+	lock_acquire(ef->ef_emu->e_lock);
+
+	while (uio->uio_resid > 0) {
+		if (ef->ef_raowner == ev &&
+		    uio->uio_offset >= ef->ef_rastart &&
+		    uio->uio_offset < ef->ef_rastart + EMU_MAXIO &&
+		    uio->uio_offset >= ef->ef_rastart + (off_t)ef->ef_ralen) {
+			/* Inside a short (EOF) buffer but past its end */
+			break;
+		}
+
+		if (ef->ef_raowner != ev ||
+		    uio->uio_offset < ef->ef_rastart ||
+		    uio->uio_offset >= ef->ef_rastart + (off_t)ef->ef_ralen) {
+			ef->ef_raowner = NULL;
+			mk_kuio(&ku, ef->ef_rabuf, EMU_MAXIO, uio->uio_offset,
+				UIO_READ);
+			result = emu_read_locked(ef->ef_emu, ev->ev_handle,
+						 EMU_MAXIO, &ku);
+			if (result) {
+				break;
+			}
+			ef->ef_raowner = ev;
+			ef->ef_rastart = uio->uio_offset;
+			ef->ef_ralen = EMU_MAXIO - ku.uio_resid;
+			if (ef->ef_ralen == 0) {
+				/* EOF */
+				break;
+			}
+		}
+
+		skip = uio->uio_offset - ef->ef_rastart;
+		amt = ef->ef_ralen - skip;
+		if (amt > uio->uio_resid) {
+			amt = uio->uio_resid;
+		}
+		result = uiomove(ef->ef_rabuf + skip, amt, uio);
+		if (result) {
+			break;
+		}
+	}
+
+	lock_release(ef->ef_emu->e_lock);
+	return result;
+}
+
 /*
  * VOP_OPEN on files
  */
@@ -435,7 +722,8 @@ emufs_reclaim(struct vnode *v)
 {
 	struct emufs_vnode *ev = v->vn_data;
 	struct emufs_fs *ef = v->vn_fs->fs_data;
-	int ix, i, num, result;
+	struct emufs_vnode *old[EMUFS_NCACHE];
+	int ix, i, num, n, result;
 
 	lock_acquire(ef->ef_emu->e_lock);
 	lock_acquire(ev->ev_v.vn_countlock);
@@ -452,8 +740,8 @@ emufs_reclaim(struct vnode *v)
 	 */
 	lock_release(ev->ev_v.vn_countlock);
 
-	/* emu_close retries on I/O error */
-	result = emu_close(ev->ev_emu, ev->ev_handle);
+	/* emu_close_locked retries on I/O error */
+	result = emu_close_locked(ev->ev_emu, ev->ev_handle);
 	if (result) {
 		lock_release(ef->ef_emu->e_lock);
 		return result;
@@ -474,14 +762,88 @@ emufs_reclaim(struct vnode *v)
 	}
 	array_remove(ef->ef_vnodes, ix);
 
+	/*
+	 * The lookup cache holds a reference to everything in it, so
+	 * we can only be there as a directory.
+	 */
+	n = emufs_ncpurge(ef, ev, old);
+	emufs_rainval(ef, ev);
+
 	lock_release(ef->ef_emu->e_lock);
 
+	emufs_ncrelease(old, n);
+
 	VOP_KILL(&ev->ev_v);
 
 	kfree(ev);
 	return 0;
 }
 
+/*
+ * User I/O.
+ *
+ * Copying between the device buffers and user memory with e_lock held
+ * is not safe once user pages are loaded on demand: the copy can
+ * fault, and the fault may need to read the executable from this
+ * same device. So transfers to and from user space are staged
+ * through a kernel buffer, and only kernel-space uios get near the
+ * device. ONCE is for getdirentry, which returns one name per call.
+ */
+static
+int
+emufs_userio(struct vnode *v, struct uio *uio,
+	     int (*op)(struct vnode *, struct uio *), int once)
+{
+	struct uio ku;
+	char *kbuf;
+	size_t amt, got;
+	int result = 0;
+
+	amt = uio->uio_resid < EMU_MAXIO ? uio->uio_resid : EMU_MAXIO;
+	kbuf = kmalloc(amt > 0 ? amt : 1);
+	if (kbuf == NULL) {
+		return ENOMEM;
+	}
+
+	while (uio->uio_resid > 0) {
+		amt = uio->uio_resid < EMU_MAXIO ? uio->uio_resid : EMU_MAXIO;
+
+		if (uio->uio_rw == UIO_WRITE) {
+			/* Consume only what was actually written */
+			mk_kuio(&ku, kbuf, amt, uio->uio_offset, UIO_WRITE);
+			result = uiopeek(kbuf, amt, uio);
+			if (result) {
+				break;
+			}
+			result = op(v, &ku);
+			uioskip(amt - ku.uio_resid, uio);
+			if (result || ku.uio_resid > 0) {
+				break;
+			}
+		}
+		else {
+			mk_kuio(&ku, kbuf, amt, uio->uio_offset, UIO_READ);
+			result = op(v, &ku);
+			if (result) {
+				break;
+			}
+			got = amt - ku.uio_resid;
+			result = uiomove(kbuf, got, uio);
+			if (result) {
+				break;
+			}
+			/* not necessarily a byte count (getdirentry) */
+			uio->uio_offset = ku.uio_offset;
+			if (once || got < amt) {
+				break;
+			}
+		}
+	}
+
+	kfree(kbuf);
+	return result;
+}
+
 /*
  * VOP_READ
  */
@@ -490,12 +852,21 @@ int
 emufs_read(struct vnode *v, struct uio *uio)
 {
 	struct emufs_vnode *ev = v->vn_data;
+	struct emufs_fs *ef = v->vn_fs->fs_data;
 	u_int32_t amt;
 	size_t oldresid;
 	int result;
 
 	assert(uio->uio_rw==UIO_READ);
 
+	if (uio->uio_segflg != UIO_SYSSPACE) {
+		return emufs_userio(v, uio, emufs_read, 0);
+	}
+
+	if (uio->uio_resid < EMU_MAXIO) {
+		return emufs_bufread(ef, ev, uio);
+	}
+
 	while (uio->uio_resid > 0) {
 		amt = uio->uio_resid;
 		if (amt > EMU_MAXIO) {
@@ -530,6 +901,10 @@ emufs_getdirentry(struct vnode *v, struct uio *uio)
 
 	assert(uio->uio_rw==UIO_READ);
 
+	if (uio->uio_segflg != UIO_SYSSPACE) {
+		return emufs_userio(v, uio, emufs_getdirentry, 1);
+	}
+
 	amt = uio->uio_resid;
 	if (amt > EMU_MAXIO) {
 		amt = EMU_MAXIO;
@@ -546,12 +921,24 @@ int
 emufs_write(struct vnode *v, struct uio *uio)
 {
 	struct emufs_vnode *ev = v->vn_data;
+	struct emufs_fs *ef = v->vn_fs->fs_data;
 	u_int32_t amt;
 	size_t oldresid;
-	int result;
+	int result = 0;
 
 	assert(uio->uio_rw==UIO_WRITE);
 
+	if (uio->uio_segflg != UIO_SYSSPACE) {
+		return emufs_userio(v, uio, emufs_write, 0);
+	}
+
+	/*
+	 * Hold e_lock across the whole write so nobody can refill the
+	 * read buffer or the cached size from a half-written file.
+	 */
+	lock_acquire(ev->ev_emu->e_lock);
+	emufs_rainval(ef, ev);
+
 	while (uio->uio_resid > 0) {
 		amt = uio->uio_resid;
 		if (amt > EMU_MAXIO) {
@@ -560,9 +947,16 @@ emufs_write(struct vnode *v, struct uio *uio)
 
 		oldresid = uio->uio_resid;
 
-		result = emu_write(ev->ev_emu, ev->ev_handle, amt, uio);
+		result = emu_write_locked(ev->ev_emu, ev->ev_handle, amt,
+					  uio);
 		if (result) {
-			return result;
+			/* don't know how much got there */
+			ev->ev_sizevalid = 0;
+			break;
+		}
+
+		if (ev->ev_sizevalid && uio->uio_offset > ev->ev_size) {
+			ev->ev_size = uio->uio_offset;
 		}
 
 		if (uio->uio_resid == oldresid) {
@@ -571,7 +965,8 @@ emufs_write(struct vnode *v, struct uio *uio)
 		}
 	}
 
-	return 0;
+	lock_release(ev->ev_emu->e_lock);
+	return result;
 }
 
 /*
@@ -611,10 +1006,28 @@ emufs_stat(struct vnode *v, struct stat *statbuf)
 
 	statbuf->st_nlink = 1;  /* might be a lie, but doesn't matter much */
 
-	result = emu_getsize(ev->ev_emu, ev->ev_handle, &statbuf->st_size);
-	if (result) {
-		return result;
+	/*
+	 * File sizes are cached; writes and truncates through this
+	 * vnode keep the cached value current. Directory sizes change
+	 * under us on every create, so always ask for those.
+	 */
+	lock_acquire(ev->ev_emu->e_lock);
+	if (ev->ev_sizevalid) {
+		statbuf->st_size = ev->ev_size;
+	}
+	else {
+		result = emu_getsize_locked(ev->ev_emu, ev->ev_handle,
+					    &statbuf->st_size);
+		if (result) {
+			lock_release(ev->ev_emu->e_lock);
+			return result;
+		}
+		if (statbuf->st_mode == S_IFREG) {
+			ev->ev_size = statbuf->st_size;
+			ev->ev_sizevalid = 1;
+		}
 	}
+	lock_release(ev->ev_emu->e_lock);
 
 	statbuf->st_blocks = 0;  /* almost certainly a lie */
 
@@ -673,6 +1086,20 @@ emufs_fsync(struct vnode *v)
 	return 0;
 }
 
+/*
+ * VOP_MMAP
+ *
+ * The VM system's page cache does the work through VOP_READ and
+ * VOP_WRITE, so files can always be mapped.
+ */
+static
+int
+emufs_mmap(struct vnode *v)
+{
+	(void)v;
+	return 0;
+}
+
 /*
  * VOP_TRUNCATE
  */
@@ -681,7 +1108,17 @@ int
 emufs_truncate(struct vnode *v, off_t len)
 {
 	struct emufs_vnode *ev = v->vn_data;
-	return emu_trunc(ev->ev_emu, ev->ev_handle, len);
+	struct emufs_fs *ef = v->vn_fs->fs_data;
+	int result;
+
+	lock_acquire(ev->ev_emu->e_lock);
+	emufs_rainval(ef, ev);
+	result = emu_trunc_locked(ev->ev_emu, ev->ev_handle, len);
+	ev->ev_size = len;
+	ev->ev_sizevalid = (result == 0);
+	lock_release(ev->ev_emu->e_lock);
+
+	return result;
 }
 
 /*
@@ -698,8 +1135,17 @@ emufs_creat(struct vnode *dir, const char *name, int excl, struct vnode **ret)
 	int result;
 	int isdir;
 
-	result = emu_open(ev->ev_emu, ev->ev_handle, name, 1, excl, 
-			  &handle, &isdir);
+	if (!excl) {
+		lock_acquire(ev->ev_emu->e_lock);
+		newguy = emufs_ncfind(ef, ev, name);
+		lock_release(ev->ev_emu->e_lock);
+		if (newguy != NULL) {
+			*ret = &newguy->ev_v;
+			return 0;
+		}
+	}
+
+	result = emufs_hostopen(ef, ev, name, 1, excl, &handle, &isdir);
 	if (result) {
 		return result;
 	}
@@ -710,6 +1156,8 @@ emufs_creat(struct vnode *dir, const char *name, int excl, struct vnode **ret)
 		return result;
 	}
 
+	emufs_nccache(ef, ev, name, newguy);
+
 	*ret = &newguy->ev_v;
 	return 0;
 }
@@ -728,8 +1176,15 @@ emufs_lookup(struct vnode *dir, char *pathname, struct vnode **ret)
 	int result;
 	int isdir;
 
-	result = emu_open(ev->ev_emu, ev->ev_handle, pathname, 0, 0,
-			  &handle, &isdir);
+	lock_acquire(ev->ev_emu->e_lock);
+	newguy = emufs_ncfind(ef, ev, pathname);
+	lock_release(ev->ev_emu->e_lock);
+	if (newguy != NULL) {
+		*ret = &newguy->ev_v;
+		return 0;
+	}
+
+	result = emufs_hostopen(ef, ev, pathname, 0, 0, &handle, &isdir);
 	if (result) {
 		return result;
 	}
@@ -740,6 +1195,8 @@ emufs_lookup(struct vnode *dir, char *pathname, struct vnode **ret)
 		return result;
 	}
 
+	emufs_nccache(ef, ev, pathname, newguy);
+
 	*ret = &newguy->ev_v;
 	return 0;
 }
@@ -847,13 +1304,14 @@ static const struct vnode_ops emufs_fileops = {
 	emufs_read,
 	NOTDIR,  /* readlink */
 	NOTDIR,  /* getdirentry */
+	NOTDIR,  /* getdirentries */
 	emufs_write,
 	emufs_ioctl,
 	emufs_stat,
 	emufs_file_gettype,
 	emufs_tryseek,
 	emufs_fsync,
-	UNIMP,   /* mmap */
+	emufs_mmap,
 	emufs_truncate,
 	NOTDIR,  /* namefile */
 
@@ -882,6 +1340,7 @@ static const struct vnode_ops emufs_dirops = {
 	ISDIR,   /* read */
 	ISDIR,   /* readlink */
 	emufs_getdirentry,
+	UNIMP,   /* getdirentries */
 	ISDIR,   /* write */
 	emufs_ioctl,
 	emufs_stat,
@@ -941,6 +1400,8 @@ emufs_loadvnode(struct emufs_fs *ef, u_int32_t handle, int isdir,
 
 	ev->ev_emu = ef->ef_emu;
 	ev->ev_handle = handle;
+	ev->ev_size = 0;
+	ev->ev_sizevalid = 0;
 
 	result = VOP_INIT(&ev->ev_v, isdir ? &emufs_dirops : &emufs_fileops,
 			   &ef->ef_fs, ev);
@@ -1061,8 +1522,22 @@ emufs_addtovfs(struct emu_softc *sc, const char *devname)
 		return ENOMEM;
 	}
 
+	bzero(ef->ef_names, sizeof(ef->ef_names));
+	ef->ef_namestamp = 0;
+	ef->ef_raowner = NULL;
+	ef->ef_rastart = 0;
+	ef->ef_ralen = 0;
+	ef->ef_rabuf = kmalloc(EMU_MAXIO);
+	if (ef->ef_rabuf == NULL) {
+		array_destroy(ef->ef_vnodes);
+		kfree(ef);
+		return ENOMEM;
+	}
+
 	result = emufs_loadvnode(ef, EMU_ROOTHANDLE, 1, &ef->ef_root);
 	if (result) {
+		kfree(ef->ef_rabuf);
+		array_destroy(ef->ef_vnodes);
 		kfree(ef);
 		return result;
 	}
@@ -66,14 +66,26 @@ int lhd_code_to_errno(struct lhd_softc *lh, int code)
 }
 
 /*
- * Record that an I/O has completed: save the result and poke the
- * completion semaphore.
+ * Record that an I/O has completed: save the result, and poke the
+ * completion semaphore once we're out of the interrupt handler.
  */
 static
 void
 lhd_iodone(struct lhd_softc *lh, int err)
 {
 	lh->lh_result = err;
+	softirq_raise(&lh->lh_softirq);
+}
+
+/*
+ * Deferred part of completion: wake up the thread waiting for the I/O.
+ */
+static
+void
+lhd_softirq(void *vlh)
+{
+	struct lhd_softc *lh = vlh;
+
 	V(lh->lh_done);
 }
 
@@ -272,6 +284,9 @@ config_lhd(struct lhd_softc *lh, int lhdno)
 		return ENOMEM;
 	}
 
+	/* Set up deferred completion. */
+	softirq_init(&lh->lh_softirq, name, lhd_softirq, lh);
+
 	/* Set up the VFS device structure. */
 	lh->lh_dev.d_open = lhd_open;
 	lh->lh_dev.d_close = lhd_close;
@@ -2,6 +2,7 @@
 #define _LAMEBUS_LHD_H_
 
 #include <dev.h>
+#include <softirq.h>
 
 /*
  * Our sector size
@@ -25,6 +26,7 @@ struct lhd_softc {
 	int lh_result;			/* Result from I/O operation */
 	struct semaphore *lh_clear;	/* Synchronization */
 	struct semaphore *lh_done;
+	struct softirq lh_softirq;	/* Completion, after the interrupt */
 
 	struct device lh_dev;		/* VFS device structure */
 };
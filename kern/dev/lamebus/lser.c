@@ -14,14 +14,17 @@
 #define LSER_IRQ_ENABLE  1
 #define LSER_IRQ_ACTIVE  2
 
+/*
+ * Interrupt handler. Acknowledge the device and save the character
+ * read, if any; calling up into the attached driver is left for
+ * lser_softirq.
+ */
 void
 lser_irq(void *vsc)
 {
 	struct lser_softc *sc = vsc;
 	u_int32_t x;
-	int clear_to_write=0;
-	int got_a_read=0;
-	u_int32_t ch = 0;
+	u_int32_t ch;
 
 	assert(curspl>0);
 
@@ -29,9 +32,10 @@ lser_irq(void *vsc)
 	if (x & LSER_IRQ_ACTIVE) {
 		x = LSER_IRQ_ENABLE;
 		sc->ls_wbusy = 0;
-		clear_to_write = 1;
+		sc->ls_wdone = 1;
 		bus_write_register(sc->ls_busdata, sc->ls_buspos,
 				   LSER_REG_WIRQ, x);
+		softirq_raise(&sc->ls_softirq);
 	}
 
 	x = bus_read_register(sc->ls_busdata, sc->ls_buspos, LSER_REG_RIRQ);
@@ -39,16 +43,52 @@ lser_irq(void *vsc)
 		x = LSER_IRQ_ENABLE;
 		ch = bus_read_register(sc->ls_busdata, sc->ls_buspos,
 				       LSER_REG_CHAR);
-		got_a_read = 1;
+		/* If the ring is full, the character is lost */
+		if (sc->ls_incount < LSER_INBUF) {
+			sc->ls_inbuf[(sc->ls_inhead + sc->ls_incount)
+				     % LSER_INBUF] = ch;
+			sc->ls_incount++;
+		}
 		bus_write_register(sc->ls_busdata, sc->ls_buspos, 
 				   LSER_REG_RIRQ, x);
+		softirq_raise(&sc->ls_softirq);
 	}
+}
+
+/*
+ * Deferred part of the interrupt: tell the attached driver it can
+ * write again, and hand it the characters that came in, in order.
+ */
+static
+void
+lser_softirq(void *vsc)
+{
+	struct lser_softc *sc = vsc;
+	int spl, ch, wdone;
+
+	spl = splhigh();
+	wdone = sc->ls_wdone;
+	sc->ls_wdone = 0;
+	splx(spl);
 
-	if (clear_to_write && sc->ls_start != NULL) {
+	if (wdone && sc->ls_start != NULL) {
 		sc->ls_start(sc->ls_devdata);
 	}
-	if (got_a_read && sc->ls_input != NULL) {
-		sc->ls_input(sc->ls_devdata, ch);
+
+	for (;;) {
+		spl = splhigh();
+		if (sc->ls_incount == 0) {
+			splx(spl);
+			break;
+		}
+		ch = sc->ls_inbuf[sc->ls_inhead];
+		sc->ls_inhead = (sc->ls_inhead + 1) % LSER_INBUF;
+		sc->ls_incount--;
+		splx(spl);
+
+		if (sc->ls_input != NULL) {
+			sc->ls_input(sc->ls_devdata, ch);
+		}
 	}
 }
 
@@ -129,13 +169,19 @@ lser_writepolled(void *vsc, int ch)
 int
 config_lser(struct lser_softc *sc, int lserno)
 {
-	(void)lserno;
+	char name[16];
 
 	/*
 	 * Enable interrupting.
 	 */
 
 	sc->ls_wbusy = 0;
+	sc->ls_wdone = 0;
+	sc->ls_inhead = 0;
+	sc->ls_incount = 0;
+
+	snprintf(name, sizeof(name), "lser%d", lserno);
+	softirq_init(&sc->ls_softirq, name, lser_softirq, sc);
 
 	bus_write_register(sc->ls_busdata, sc->ls_buspos,
 			   LSER_REG_RIRQ, LSER_IRQ_ENABLE);
@@ -1,9 +1,19 @@
 #ifndef _LAMEBUS_LSER_H_
 #define _LAMEBUS_LSER_H_
 
+#include <softirq.h>
+
+/* Characters read in interrupts and not yet passed on */
+#define LSER_INBUF  32
+
 struct lser_softc {
 	/* Initialized by config function; synchronized with spl */
 	volatile int ls_wbusy;     /* true if write in progress */
+	int ls_wdone;              /* write finished, ls_start not called */
+	unsigned char ls_inbuf[LSER_INBUF]; /* input ring */
+	unsigned ls_inhead;        /* first character in ls_inbuf */
+	unsigned ls_incount;       /* characters in ls_inbuf */
+	struct softirq ls_softirq; /* runs ls_start and ls_input */
 
 	/* Initialized by lower-level attachment function */
 	void *ls_busdata;
@@ -35,6 +35,7 @@ config_ltimer(struct ltimer_softc *lt, int ltimerno)
 	if (!haveclock) {
 		haveclock = 1;
 		lt->lt_hardclock = 1;
+		hardclock_bootstrap();
 
 		/*
 		 * Arm the timer to go off HZ times a second, and set
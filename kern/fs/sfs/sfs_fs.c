@@ -20,8 +20,8 @@
 
 /*
  * Routine for doing I/O (reads or writes) on the free block bitmap.
- * We always do the whole bitmap at once; writing individual sectors
- * might or might not be a worthwhile optimization.
+ * We read the whole bitmap at once, but only write the sectors that
+ * sfs_mapdirty has marked as changed.
  *
  * The free block bitmap consists of SFS_BITBLOCKS 512-byte sectors of
  * bits, one bit for each sector on the filesystem. The number of
@@ -60,8 +60,14 @@ sfs_mapio(struct sfs_fs *sfs, enum uio_rw rw)
 		if (rw == UIO_READ) {
 			result = sfs_rblock(sfs, ptr, SFS_MAP_LOCATION+j);
 		}
-		else {
+		else if (bitmap_isset(sfs->sfs_mapblkdirty, j)) {
 			result = sfs_wblock(sfs, ptr, SFS_MAP_LOCATION+j);
+			if (result == 0) {
+				bitmap_unmark(sfs->sfs_mapblkdirty, j);
+			}
+		}
+		else {
+			result = 0;
 		}
 
 		/* If we failed, stop. */
@@ -72,6 +78,21 @@ sfs_mapio(struct sfs_fs *sfs, enum uio_rw rw)
 	return 0;
 }
 
+/*
+ * Record that the freemap bit for BLOCK has changed, so the sector
+ * of the bitmap it lives in needs to be written.
+ */
+void
+sfs_mapdirty(struct sfs_fs *sfs, u_int32_t block)
+{
+	u_int32_t mapblock = block / SFS_BLOCKBITS;
+
+	if (!bitmap_isset(sfs->sfs_mapblkdirty, mapblock)) {
+		bitmap_mark(sfs->sfs_mapblkdirty, mapblock);
+	}
+	sfs->sfs_freemapdirty = 1;
+}
+
 /*
  * Sync routine. This is what gets invoked if you do FS_SYNC on the
  * sfs filesystem structure.
@@ -116,6 +137,14 @@ sfs_sync(struct fs *fs)
 
 	sfs = fs->fs_data;
 
+	/*
+	 * With a journal, one commit takes care of the inodes, the
+	 * freemap, and the superblock together.
+	 */
+	if (sfs->sfs_jbuf != NULL) {
+		return sfs_jcommit(sfs);
+	}
+
 	/* Go over the array of loaded vnodes, syncing as we go. */
 	num = array_getnum(sfs->sfs_vnodes);
 	for (i=0; i<num; i++) {
@@ -178,8 +207,13 @@ sfs_unmount(struct fs *fs)
 	assert(sfs->sfs_freemapdirty==0);
 
 	/* Once we start nuking stuff we can't fail. */
+	sfs_junmount(sfs);
 	array_destroy(sfs->sfs_vnodes);
 	bitmap_destroy(sfs->sfs_freemap);
+	bitmap_destroy(sfs->sfs_mapblkdirty);
+	if (sfs->sfs_rabuf != NULL) {
+		kfree(sfs->sfs_rabuf);
+	}
 	
 	/* The vfs layer takes care of the device for us */
 	(void)sfs->sfs_device;
@@ -270,6 +304,19 @@ sfs_domount(void *options, struct device *dev, struct fs **ret)
 		return EINVAL;
 	}
 	
+	if (sfs->sfs_super.sp_version > SFS_VERSION) {
+		kprintf("sfs: Unknown on-disk version %u (we support up to %u)\n",
+			sfs->sfs_super.sp_version, SFS_VERSION);
+		array_destroy(sfs->sfs_vnodes);
+		kfree(sfs);
+		return EINVAL;
+	}
+
+	if (sfs->sfs_super.sp_version < SFS_VERSION_BIGFILE) {
+		kprintf("sfs: old-format volume; files limited to %u "
+			"blocks\n", SFS_NDIRECT + SFS_DBPERIDB);
+	}
+
 	if (sfs->sfs_super.sp_nblocks > dev->d_blocks) {
 		kprintf("sfs: warning - fs has %u blocks, device has %u\n",
 			sfs->sfs_super.sp_nblocks, dev->d_blocks);
@@ -278,16 +325,39 @@ sfs_domount(void *options, struct device *dev, struct fs **ret)
 	/* Ensure null termination of the volume name */
 	sfs->sfs_super.sp_volname[sizeof(sfs->sfs_super.sp_volname)-1] = 0;
 
+	/*
+	 * Set up the journal, if there is one. This replays any
+	 * committed transaction, so must come before reading the
+	 * freemap.
+	 */
+	result = sfs_jmount(sfs);
+	if (result) {
+		array_destroy(sfs->sfs_vnodes);
+		kfree(sfs);
+		return result;
+	}
+
 	/* Load free space bitmap */
 	sfs->sfs_freemap = bitmap_create(SFS_FS_BITMAPSIZE(sfs));
 	if (sfs->sfs_freemap == NULL) {
+		sfs_junmount(sfs);
+		array_destroy(sfs->sfs_vnodes);
+		kfree(sfs);
+		return ENOMEM;
+	}
+	sfs->sfs_mapblkdirty = bitmap_create(SFS_FS_BITBLOCKS(sfs));
+	if (sfs->sfs_mapblkdirty == NULL) {
+		bitmap_destroy(sfs->sfs_freemap);
+		sfs_junmount(sfs);
 		array_destroy(sfs->sfs_vnodes);
 		kfree(sfs);
 		return ENOMEM;
 	}
 	result = sfs_mapio(sfs, UIO_READ);
 	if (result) {
+		bitmap_destroy(sfs->sfs_mapblkdirty);
 		bitmap_destroy(sfs->sfs_freemap);
+		sfs_junmount(sfs);
 		array_destroy(sfs->sfs_vnodes);
 		kfree(sfs);
 		return result;
@@ -304,6 +374,17 @@ sfs_domount(void *options, struct device *dev, struct fs **ret)
 	sfs->sfs_superdirty = 0;
 	sfs->sfs_freemapdirty = 0;
 
+	/*
+	 * Read-ahead buffer. If we can't get one, we just run
+	 * without read-ahead.
+	 */
+	sfs->sfs_rabuf = kmalloc(SFS_RAMAX * SFS_BLOCKSIZE);
+	sfs->sfs_raowner = NULL;
+	sfs->sfs_rastart = 0;
+	sfs->sfs_racount = 0;
+	sfs->sfs_rausers = 0;
+	bzero(sfs->sfs_idblock, sizeof(sfs->sfs_idblock));
+
 	/* Hand back the abstract fs */
 	*ret = &sfs->sfs_absfs;
 
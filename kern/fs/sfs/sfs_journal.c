@@ -0,0 +1,573 @@
+/*
+ * SFS filesystem
+ *
+ * Metadata journal.
+ *
+ * Metadata writes (inodes, indirect blocks, directory blocks, the
+ * freemap, and the superblock) don't go to disk directly. Instead
+ * sfs_jwblock copies the block into the running transaction, which
+ * is kept in sfs_jbuf laid out exactly as it will appear in the
+ * on-disk journal (see kern/sfs.h): header, images, commit block.
+ * Writing the same block again just updates its image, so a burst of
+ * creates or unlinks in one directory costs one image of each block
+ * touched, no matter how many operations there were.
+ *
+ * The transaction is committed (group commit) by sync and fsync, or
+ * when the next operation might not fit in it. Committing writes the whole transaction to the
+ * journal with one device request, writes each image to its home
+ * location (checkpointing), and then zeroes the journal header.
+ *
+ * Blocks that are freed are not returned to the freemap until the
+ * transaction that stops them being used commits; otherwise they
+ * could be reallocated and overwritten while the old metadata on disk
+ * still points at them.
+ *
+ * A transaction must hold whole operations, and the commit adds dirty
+ * inodes, freemap blocks and the superblock on top of the images
+ * already in it; if it ran out of room partway, the part that went
+ * out could point at blocks the on-disk freemap still calls free.
+ * So each operation is bracketed by sfs_jbegin and sfs_jend, and
+ * sfs_jbegin first reserves room for the most the operation could
+ * add, committing beforehand if there isn't enough. sfs_jreserved
+ * counts everything reserved since the last commit plus what the
+ * commit itself may need, so it never exceeds sfs_jmax.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <kern/errno.h>
+#include <array.h>
+#include <bitmap.h>
+#include <uio.h>
+#include <dev.h>
+#include <sfs.h>
+
+/* Shortcuts for the size macros in kern/sfs.h */
+#define SFS_FS_BITBLOCKS(sfs)   SFS_BITBLOCKS((sfs)->sfs_super.sp_nblocks)
+
+/* Parts of the journal buffer */
+#define JHEADER(sfs)     ((struct sfs_jheader *)(sfs)->sfs_jbuf)
+#define JIMAGE(sfs, i)   ((sfs)->sfs_jbuf + ((i)+1)*SFS_BLOCKSIZE)
+
+/*
+ * Journal statistics, for all sfs volumes together.
+ */
+static struct {
+	u_int32_t j_commits;	/* transactions committed */
+	u_int32_t j_images;	/* block images committed */
+	u_int32_t j_absorbed;	/* metadata writes absorbed by an image */
+	u_int32_t j_revoked;	/* images dropped because the block was freed */
+	u_int32_t j_mapblocks;	/* freemap blocks written */
+	u_int32_t j_replays;	/* transactions replayed at mount */
+} sfs_jstats;
+
+/*
+ * Images any commit may need whatever the operations did: every
+ * freemap block, and the superblock.
+ */
+static
+u_int32_t
+sfs_jbase(struct sfs_fs *sfs)
+{
+	return SFS_FS_BITBLOCKS(sfs) + 1;
+}
+
+/*
+ * Sum of the words in the images of the running transaction; stored
+ * in the commit block so replay can tell a torn journal write.
+ */
+static
+u_int32_t
+sfs_jsum(struct sfs_fs *sfs, u_int32_t nblocks)
+{
+	u_int32_t *words = (u_int32_t *)JIMAGE(sfs, 0);
+	u_int32_t nwords = nblocks * (SFS_BLOCKSIZE/sizeof(u_int32_t));
+	u_int32_t i, sum = 0;
+
+	for (i=0; i<nwords; i++) {
+		sum += words[i];
+	}
+	return sum;
+}
+
+/*
+ * Write the images of the running transaction to their home
+ * locations, then zero the journal header so replay won't do it
+ * again.
+ */
+static
+int
+sfs_jcheckpoint(struct sfs_fs *sfs, u_int32_t nblocks)
+{
+	struct sfs_jheader *jh = JHEADER(sfs);
+	u_int32_t i;
+	int result;
+
+	for (i=0; i<nblocks; i++) {
+		result = sfs_wblock(sfs, JIMAGE(sfs, i), jh->jh_home[i]);
+		if (result) {
+			return result;
+		}
+	}
+
+	bzero(jh, SFS_BLOCKSIZE);
+	return sfs_wblock(sfs, jh, sfs->sfs_super.sp_jstart);
+}
+
+/*
+ * Write out the running transaction: journal, then checkpoint.
+ * Unlike sfs_jcommit this doesn't gather up anything else first.
+ */
+static
+int
+sfs_jflush(struct sfs_fs *sfs)
+{
+	struct sfs_jheader *jh = JHEADER(sfs);
+	struct sfs_jcommit *jc;
+	u_int32_t nblocks = sfs->sfs_jnblocks;
+	struct uio ku;
+	int result;
+
+	if (nblocks == 0) {
+		return 0;
+	}
+
+	jh->jh_magic = SFS_JMAGIC;
+	jh->jh_seq = sfs->sfs_jseq;
+	jh->jh_nblocks = nblocks;
+
+	jc = (struct sfs_jcommit *)JIMAGE(sfs, nblocks);
+	bzero(jc, sizeof(*jc));
+	jc->jc_magic = SFS_JCOMMITMAGIC;
+	jc->jc_seq = sfs->sfs_jseq;
+	jc->jc_nblocks = nblocks;
+	jc->jc_sum = sfs_jsum(sfs, nblocks);
+
+	/* The whole transaction goes out in one request */
+	mk_kuio(&ku, sfs->sfs_jbuf, (nblocks+2)*SFS_BLOCKSIZE,
+		((off_t)sfs->sfs_super.sp_jstart)*SFS_BLOCKSIZE, UIO_WRITE);
+	result = sfs_rwblock(sfs, &ku);
+	if (result) {
+		return result;
+	}
+
+	/* It's committed; now put everything where it belongs */
+	result = sfs_jcheckpoint(sfs, nblocks);
+	if (result) {
+		return result;
+	}
+
+	sfs_jstats.j_commits++;
+	sfs_jstats.j_images += nblocks;
+
+	sfs->sfs_jnblocks = 0;
+	sfs->sfs_jseq++;
+	return 0;
+}
+
+/*
+ * Find the image of BLOCK in the running transaction, if it has one.
+ */
+static
+int
+sfs_jindex(struct sfs_fs *sfs, u_int32_t block)
+{
+	struct sfs_jheader *jh = JHEADER(sfs);
+	u_int32_t i;
+
+	for (i=0; i<sfs->sfs_jnblocks; i++) {
+		if (jh->jh_home[i] == block) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+/*
+ * Return a pointer to the pending contents of BLOCK, or NULL if the
+ * running transaction doesn't have it (or there's no journal).
+ */
+void *
+sfs_jfind(struct sfs_fs *sfs, u_int32_t block)
+{
+	int ix;
+
+	if (sfs->sfs_jbuf == NULL) {
+		return NULL;
+	}
+	ix = sfs_jindex(sfs, block);
+	return ix < 0 ? NULL : JIMAGE(sfs, ix);
+}
+
+/*
+ * Read a metadata block, seeing any change not yet checkpointed.
+ */
+int
+sfs_jrblock(struct sfs_fs *sfs, void *data, u_int32_t block)
+{
+	void *image = sfs_jfind(sfs, block);
+
+	if (image != NULL) {
+		memcpy(data, image, SFS_BLOCKSIZE);
+		return 0;
+	}
+	return sfs_rblock(sfs, data, block);
+}
+
+/*
+ * Write a metadata block. Without a journal this is just sfs_wblock.
+ */
+int
+sfs_jwblock(struct sfs_fs *sfs, const void *data, u_int32_t block)
+{
+	struct sfs_jheader *jh;
+	int ix;
+
+	if (sfs->sfs_jbuf == NULL) {
+		return sfs_wblock(sfs, (void *)data, block);
+	}
+	jh = JHEADER(sfs);
+
+	ix = sfs_jindex(sfs, block);
+	if (ix >= 0) {
+		sfs_jstats.j_absorbed++;
+	}
+	else {
+		if (sfs->sfs_jnblocks == sfs->sfs_jmax) {
+			/* sfs_jbegin should have made sure of room */
+			panic("sfs: %s: journal transaction overflow\n",
+			      sfs->sfs_super.sp_volname);
+		}
+		ix = sfs->sfs_jnblocks++;
+		jh->jh_home[ix] = block;
+	}
+
+	memcpy(JIMAGE(sfs, ix), data, SFS_BLOCKSIZE);
+	return 0;
+}
+
+/*
+ * Free BLOCK. Any pending image of it is dropped, since its contents
+ * no longer matter, and the freemap is updated at the next commit.
+ */
+void
+sfs_jfree(struct sfs_fs *sfs, u_int32_t block)
+{
+	int ix;
+
+	if (sfs->sfs_jbuf == NULL) {
+		bitmap_unmark(sfs->sfs_freemap, block);
+		sfs_mapdirty(sfs, block);
+		return;
+	}
+
+	ix = sfs_jindex(sfs, block);
+	if (ix >= 0) {
+		/* Move the last image into its place */
+		u_int32_t last = sfs->sfs_jnblocks - 1;
+		struct sfs_jheader *jh = JHEADER(sfs);
+
+		if ((u_int32_t)ix != last) {
+			jh->jh_home[ix] = jh->jh_home[last];
+			memcpy(JIMAGE(sfs, ix), JIMAGE(sfs, last),
+			       SFS_BLOCKSIZE);
+		}
+		sfs->sfs_jnblocks--;
+		sfs_jstats.j_revoked++;
+	}
+
+	bitmap_mark(sfs->sfs_jfreed, block);
+	sfs->sfs_jnfreed++;
+}
+
+/*
+ * Commit everything: write every dirty inode into the transaction,
+ * release the blocks freed since the last commit, add the modified
+ * freemap blocks and the superblock, and flush. sfs_jbegin has made
+ * sure it all fits in one transaction.
+ *
+ * Normally called between operations. (The exception is sfs_balloc
+ * running out of space with frees pending; a commit in the middle of
+ * an operation can at worst leak the blocks it has allocated so far,
+ * since everything in memory, freemap included, goes out together.)
+ */
+int
+sfs_jcommit(struct sfs_fs *sfs)
+{
+	char *bitdata;
+	u_int32_t i, num, mapsize;
+	int result;
+
+	if (sfs->sfs_jbuf == NULL) {
+		return 0;
+	}
+
+	num = array_getnum(sfs->sfs_vnodes);
+	for (i=0; i<num; i++) {
+		struct sfs_vnode *sv = array_getguy(sfs->sfs_vnodes, i);
+		result = sfs_sync_inode(sv);
+		if (result) {
+			return result;
+		}
+	}
+
+	if (sfs->sfs_jnfreed > 0) {
+		for (i=0; i<sfs->sfs_super.sp_nblocks; i++) {
+			if (bitmap_isset(sfs->sfs_jfreed, i)) {
+				bitmap_unmark(sfs->sfs_jfreed, i);
+				bitmap_unmark(sfs->sfs_freemap, i);
+				sfs_mapdirty(sfs, i);
+			}
+		}
+		sfs->sfs_jnfreed = 0;
+	}
+
+	if (sfs->sfs_freemapdirty) {
+		mapsize = SFS_FS_BITBLOCKS(sfs);
+		bitdata = bitmap_getdata(sfs->sfs_freemap);
+		for (i=0; i<mapsize; i++) {
+			if (!bitmap_isset(sfs->sfs_mapblkdirty, i)) {
+				continue;
+			}
+			result = sfs_jwblock(sfs, bitdata + i*SFS_BLOCKSIZE,
+					     SFS_MAP_LOCATION+i);
+			if (result) {
+				return result;
+			}
+			bitmap_unmark(sfs->sfs_mapblkdirty, i);
+			sfs_jstats.j_mapblocks++;
+		}
+		sfs->sfs_freemapdirty = 0;
+	}
+
+	if (sfs->sfs_superdirty) {
+		result = sfs_jwblock(sfs, &sfs->sfs_super, SFS_SB_LOCATION);
+		if (result) {
+			return result;
+		}
+		sfs->sfs_superdirty = 0;
+	}
+
+	result = sfs_jflush(sfs);
+	if (result) {
+		return result;
+	}
+
+	/* Whatever's running keeps its reservation */
+	sfs->sfs_jreserved = sfs_jbase(sfs) + sfs->sfs_jopres;
+	return 0;
+}
+
+/*
+ * Start an operation that may add up to NIMAGES images to the running
+ * transaction, not counting freemap blocks and the superblock. If
+ * they might not fit, commit first, so the operation goes out whole
+ * in one transaction. Operations started inside another one (a
+ * directory write as part of a create) are covered by the outer one's
+ * reservation.
+ */
+int
+sfs_jbegin(struct sfs_fs *sfs, u_int32_t nimages)
+{
+	int result;
+
+	if (sfs->sfs_jbuf == NULL) {
+		return 0;
+	}
+	if (sfs->sfs_jdepth++ > 0) {
+		return 0;
+	}
+
+	/* sfs_jmount checked the journal is big enough */
+	assert(sfs_jbase(sfs) + nimages <= sfs->sfs_jmax);
+
+	if (sfs->sfs_jreserved + nimages > sfs->sfs_jmax) {
+		result = sfs_jcommit(sfs);
+		if (result) {
+			sfs->sfs_jdepth--;
+			return result;
+		}
+	}
+
+	sfs->sfs_jreserved += nimages;
+	sfs->sfs_jopres = nimages;
+	return 0;
+}
+
+/*
+ * End an operation started with sfs_jbegin.
+ */
+void
+sfs_jend(struct sfs_fs *sfs)
+{
+	if (sfs->sfs_jbuf == NULL) {
+		return;
+	}
+	assert(sfs->sfs_jdepth > 0);
+	sfs->sfs_jdepth--;
+	if (sfs->sfs_jdepth == 0) {
+		sfs->sfs_jopres = 0;
+	}
+}
+
+/*
+ * Look at the journal on disk, and if it holds a committed
+ * transaction, write the images home. sfs_jbuf must be allocated.
+ */
+static
+int
+sfs_jreplay(struct sfs_fs *sfs)
+{
+	struct sfs_jheader *jh = JHEADER(sfs);
+	struct sfs_jcommit *jc;
+	u_int32_t nblocks;
+	struct uio ku;
+	int result;
+
+	result = sfs_rblock(sfs, jh, sfs->sfs_super.sp_jstart);
+	if (result) {
+		return result;
+	}
+
+	if (jh->jh_magic != SFS_JMAGIC) {
+		/* Clean */
+		sfs->sfs_jseq = 0;
+		return 0;
+	}
+
+	sfs->sfs_jseq = jh->jh_seq + 1;
+	nblocks = jh->jh_nblocks;
+
+	if (nblocks == 0 || nblocks > sfs->sfs_jmax) {
+		kprintf("sfs: %s: journal header is corrupt; ignoring it\n",
+			sfs->sfs_super.sp_volname);
+		goto discard;
+	}
+
+	mk_kuio(&ku, JIMAGE(sfs, 0), (nblocks+1)*SFS_BLOCKSIZE,
+		((off_t)sfs->sfs_super.sp_jstart+1)*SFS_BLOCKSIZE, UIO_READ);
+	result = sfs_rwblock(sfs, &ku);
+	if (result) {
+		return result;
+	}
+
+	jc = (struct sfs_jcommit *)JIMAGE(sfs, nblocks);
+	if (jc->jc_magic != SFS_JCOMMITMAGIC || jc->jc_seq != jh->jh_seq ||
+	    jc->jc_nblocks != nblocks || jc->jc_sum != sfs_jsum(sfs, nblocks)) {
+		/* Never committed; it didn't happen */
+		kprintf("sfs: %s: discarding incomplete journal "
+			"transaction %u\n", sfs->sfs_super.sp_volname,
+			jh->jh_seq);
+		goto discard;
+	}
+
+	kprintf("sfs: %s: replaying journal transaction %u (%u blocks)\n",
+		sfs->sfs_super.sp_volname, jh->jh_seq, nblocks);
+	sfs_jstats.j_replays++;
+	return sfs_jcheckpoint(sfs, nblocks);
+
+ discard:
+	bzero(jh, SFS_BLOCKSIZE);
+	return sfs_wblock(sfs, jh, sfs->sfs_super.sp_jstart);
+}
+
+/*
+ * Set up the journal at mount time, replaying it if necessary. Must
+ * be called after the superblock is loaded and before the freemap
+ * is, since replay may change the freemap.
+ */
+int
+sfs_jmount(struct sfs_fs *sfs)
+{
+	struct sfs_super *sp = &sfs->sfs_super;
+	int result;
+
+	sfs->sfs_jbuf = NULL;
+	sfs->sfs_jmax = 0;
+	sfs->sfs_jnblocks = 0;
+	sfs->sfs_jseq = 0;
+	sfs->sfs_jfreed = NULL;
+	sfs->sfs_jnfreed = 0;
+	sfs->sfs_jreserved = 0;
+	sfs->sfs_jopres = 0;
+	sfs->sfs_jdepth = 0;
+
+	if (sp->sp_version < SFS_VERSION_JOURNAL || sp->sp_jblocks == 0) {
+		/* No journal; metadata is written in place */
+		return 0;
+	}
+
+	/* Need at least a header, one image, and a commit block */
+	if (sp->sp_jblocks < 3 || sp->sp_jstart <= SFS_MAP_LOCATION ||
+	    sp->sp_jstart >= sp->sp_nblocks ||
+	    sp->sp_jblocks > sp->sp_nblocks - sp->sp_jstart) {
+		kprintf("sfs: %s: bad journal location %u+%u\n",
+			sp->sp_volname, sp->sp_jstart, sp->sp_jblocks);
+		return EINVAL;
+	}
+
+	sfs->sfs_jmax = sp->sp_jblocks - 2;
+	if (sfs->sfs_jmax > SFS_JMAXHOME) {
+		sfs->sfs_jmax = SFS_JMAXHOME;
+	}
+
+	/* Room for the commit overhead and the biggest operation */
+	if (sfs->sfs_jmax < sfs_jbase(sfs) + SFS_JOPIMAGES) {
+		kprintf("sfs: %s: journal of %u blocks is too small\n",
+			sp->sp_volname, sp->sp_jblocks);
+		return EINVAL;
+	}
+	sfs->sfs_jreserved = sfs_jbase(sfs);
+
+	sfs->sfs_jbuf = kmalloc((sfs->sfs_jmax+2)*SFS_BLOCKSIZE);
+	if (sfs->sfs_jbuf == NULL) {
+		return ENOMEM;
+	}
+
+	sfs->sfs_jfreed = bitmap_create(sp->sp_nblocks);
+	if (sfs->sfs_jfreed == NULL) {
+		kfree(sfs->sfs_jbuf);
+		sfs->sfs_jbuf = NULL;
+		return ENOMEM;
+	}
+
+	result = sfs_jreplay(sfs);
+	if (result) {
+		sfs_junmount(sfs);
+		return result;
+	}
+
+	return 0;
+}
+
+/*
+ * Release the journal's memory at unmount. Everything should have
+ * been committed by the sync that precedes unmounting.
+ */
+void
+sfs_junmount(struct sfs_fs *sfs)
+{
+	if (sfs->sfs_jbuf == NULL) {
+		return;
+	}
+	assert(sfs->sfs_jnblocks == 0);
+	assert(sfs->sfs_jnfreed == 0);
+
+	kfree(sfs->sfs_jbuf);
+	bitmap_destroy(sfs->sfs_jfreed);
+	sfs->sfs_jbuf = NULL;
+	sfs->sfs_jfreed = NULL;
+}
+
+/*
+ * Print the journal statistics.
+ */
+void
+sfs_jprintstats(void)
+{
+	kprintf("sfs journal: %u commits, %u images, %u writes absorbed, "
+		"%u revoked\n", sfs_jstats.j_commits, sfs_jstats.j_images,
+		sfs_jstats.j_absorbed, sfs_jstats.j_revoked);
+	kprintf("    %u freemap blocks written, %u transactions replayed\n",
+		sfs_jstats.j_mapblocks, sfs_jstats.j_replays);
+}
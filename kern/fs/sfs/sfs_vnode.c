@@ -11,15 +11,34 @@
 #include <kern/stat.h>
 #include <kern/errno.h>
 #include <kern/unistd.h>
+#include <kern/dirent.h>
 #include <uio.h>
+#include <vfs.h>
 #include <dev.h>
 #include <sfs.h>
+#include <machine/spl.h>
 
 /* At bottom of file */
 static int 
 sfs_loadvnode(struct sfs_fs *sfs, u_int32_t ino, int type,
 		 struct sfs_vnode **ret);
 
+/* Directory entries per block */
+#define SFS_DIRPERBLOCK  (SFS_BLOCKSIZE / sizeof(struct sfs_dir))
+
+/*
+ * Read-ahead statistics, for all sfs volumes together.
+ */
+static struct {
+	u_int32_t ra_hits;	/* blocks read out of the read-ahead buffer */
+	u_int32_t ra_misses;	/* blocks that weren't there */
+	u_int32_t ra_fills;	/* times the read-ahead buffer was loaded */
+	u_int32_t ra_blocks;	/* blocks loaded into it */
+	u_int32_t ra_ios;	/* device requests needed to load them */
+	u_int32_t id_hits;	/* indirect block lookups that were cached */
+	u_int32_t id_misses;	/* indirect block lookups that weren't */
+} sfs_stats;
+
 ////////////////////////////////////////////////////////////
 //
 // Simple stuff
@@ -34,14 +53,16 @@ sfs_clearblock(struct sfs_fs *sfs, u_int32_t block)
 	return sfs_wblock(sfs, zeros, block);
 }
 
-/* Write an on-disk inode structure back out to disk. */
-static
+/*
+ * Write an on-disk inode structure back out to disk (or into the
+ * journal transaction, if there is a journal).
+ */
 int
 sfs_sync_inode(struct sfs_vnode *sv)
 {
 	if (sv->sv_dirty) {
 		struct sfs_fs *sfs = sv->sv_v.vn_fs->fs_data;
-		int result = sfs_wblock(sfs, &sv->sv_i, sv->sv_ino);
+		int result = sfs_jwblock(sfs, &sv->sv_i, sv->sv_ino);
 		if (result) {
 			return result;
 		}
@@ -50,6 +71,23 @@ sfs_sync_inode(struct sfs_vnode *sv)
 	return 0;
 }
 
+/*
+ * Forget that sfs_bmap has a copy of BLOCK, because it's being freed
+ * or rewritten from somewhere else.
+ */
+static
+void
+sfs_idforget(struct sfs_fs *sfs, u_int32_t block)
+{
+	int i;
+
+	for (i=0; i<3; i++) {
+		if (sfs->sfs_idblock[i] == block) {
+			sfs->sfs_idblock[i] = 0;
+		}
+	}
+}
+
 ////////////////////////////////////////////////////////////
 //
 // Space allocation
@@ -64,10 +102,18 @@ sfs_balloc(struct sfs_fs *sfs, u_int32_t *diskblock)
 	int result;
 
 	result = bitmap_alloc(sfs->sfs_freemap, diskblock);
+	if (result == ENOSPC && sfs->sfs_jnfreed > 0) {
+		/* Blocks freed since the last commit come back at commit */
+		result = sfs_jcommit(sfs);
+		if (result) {
+			return result;
+		}
+		result = bitmap_alloc(sfs->sfs_freemap, diskblock);
+	}
 	if (result) {
 		return result;
 	}
-	sfs->sfs_freemapdirty = 1;
+	sfs_mapdirty(sfs, *diskblock);
 
 	if (*diskblock >= sfs->sfs_super.sp_nblocks) {
 		panic("sfs: balloc: invalid block %u\n", *diskblock);
@@ -78,14 +124,15 @@ sfs_balloc(struct sfs_fs *sfs, u_int32_t *diskblock)
 }
 
 /*
- * Free a block.
+ * Free a block. (With a journal, it doesn't actually become free
+ * until the next commit.)
  */
 static
 void
 sfs_bfree(struct sfs_fs *sfs, u_int32_t diskblock)
 {
-	bitmap_unmark(sfs->sfs_freemap, diskblock);
-	sfs->sfs_freemapdirty = 1;
+	sfs_idforget(sfs, diskblock);
+	sfs_jfree(sfs, diskblock);
 }
 
 /*
@@ -106,6 +153,198 @@ sfs_bused(struct sfs_fs *sfs, u_int32_t diskblock)
 //
 // Block mapping/inode maintenance
 
+/*
+ * Number of file blocks mapped by each entry of an indirect block at
+ * indirection level LEVEL (1 = single, 2 = double, 3 = triple).
+ */
+static
+u_int32_t
+sfs_idspan(int level)
+{
+	u_int32_t span = 1;
+
+	while (level > 1) {
+		span *= SFS_DBPERIDB;
+		level--;
+	}
+	return span;
+}
+
+/*
+ * Figure out which of the inode's indirect block pointers covers
+ * FILEBLOCK. Hands back a pointer to that slot in the inode, the
+ * indirection level, and the first file block mapped through it.
+ * Returns EINVAL if the block is past the largest file the inode
+ * can describe (or, on a legacy volume, past the single indirect
+ * block).
+ */
+static
+int
+sfs_idslot(struct sfs_vnode *sv, u_int32_t fileblock,
+	   u_int32_t **slot, int *level, u_int32_t *baseblock)
+{
+	struct sfs_fs *sfs = sv->sv_v.vn_fs->fs_data;
+	u_int32_t base = SFS_NDIRECT;
+
+	assert(fileblock >= SFS_NDIRECT);
+
+	if (fileblock - base < SFS_DBPERIDB) {
+		*slot = &sv->sv_i.sfi_indirect;
+		*level = 1;
+		*baseblock = base;
+		return 0;
+	}
+	base += SFS_DBPERIDB;
+
+	/* Old volumes don't know about the double/triple indirect blocks */
+	if (sfs->sfs_super.sp_version < SFS_VERSION_BIGFILE) {
+		return EINVAL;
+	}
+
+	if (fileblock - base < SFS_DBPERDIDB) {
+		*slot = &sv->sv_i.sfi_dindirect;
+		*level = 2;
+		*baseblock = base;
+		return 0;
+	}
+	base += SFS_DBPERDIDB;
+
+	if (fileblock - base < SFS_DBPERTIDB) {
+		*slot = &sv->sv_i.sfi_tindirect;
+		*level = 3;
+		*baseblock = base;
+		return 0;
+	}
+
+	return EINVAL;
+}
+
+/*
+ * Walk one indirect block for sfs_bmap. IDSLOT points at the place
+ * (in the inode or in the parent indirect block) where the number of
+ * an indirect block of level LEVEL is kept, and OFFSET is the file
+ * block relative to the first block that indirect block maps.
+ *
+ * If we have to allocate the indirect block, *IDSLOT is updated and
+ * *SLOTDIRTY is set so the caller knows to write the slot back.
+ */
+static
+int
+sfs_bmap_indirect(struct sfs_vnode *sv, u_int32_t *idslot, int *slotdirty,
+		  int level, u_int32_t offset, int doalloc,
+		  u_int32_t *diskblock)
+{
+	struct sfs_fs *sfs = sv->sv_v.vn_fs->fs_data;
+	u_int32_t *idbuf;
+	u_int32_t span, idoff;
+	u_int32_t idblock, block;
+	int result, iddirty;
+
+	/*
+	 * The indirect block buffers live in the sfs_fs, one per
+	 * level so the parent's copy survives while we walk the
+	 * child. Each remembers which block it holds, so a sequential
+	 * walk through a file only reads each indirect block once.
+	 */
+	assert(level >= 1 && level <= 3);
+	assert(sizeof(sfs->sfs_idbuf[0])==SFS_BLOCKSIZE);
+	idbuf = sfs->sfs_idbuf[level-1];
+
+	/* Which entry of this indirect block, and the offset below it */
+	span = sfs_idspan(level);
+	idoff = offset / span;
+	offset = offset % span;
+	assert(idoff < SFS_DBPERIDB);
+
+	idblock = *idslot;
+
+	if (idblock==0 && !doalloc) {
+		/*
+		 * There's no indirect block allocated. We weren't
+		 * asked to allocate anything, so pretend the indirect
+		 * block was filled with all zeros.
+		 */
+		*diskblock = 0;
+		return 0;
+	}
+	else if (idblock==0) {
+		/*
+		 * We need to allocate an indirect block to hold the
+		 * block number we're about to allocate.
+		 */
+		result = sfs_balloc(sfs, &idblock);
+		if (result) {
+			return result;
+		}
+
+		/* Remember the block we just allocated */
+		*idslot = idblock;
+		*slotdirty = 1;
+
+		/* Clear the indirect block buffer */
+		bzero(idbuf, SFS_BLOCKSIZE);
+		sfs->sfs_idblock[level-1] = idblock;
+	}
+	else if (sfs->sfs_idblock[level-1] == idblock) {
+		/* Still have it from last time */
+		sfs_stats.id_hits++;
+	}
+	else {
+		/*
+		 * We already have an indirect block allocated; load it.
+		 */
+		sfs_stats.id_misses++;
+		sfs->sfs_idblock[level-1] = 0;
+		result = sfs_jrblock(sfs, idbuf, idblock);
+		if (result) {
+			return result;
+		}
+		sfs->sfs_idblock[level-1] = idblock;
+	}
+
+	if (level > 1) {
+		/*
+		 * Entries here point at more indirect blocks. Recurse,
+		 * and if the child allocated a block whose number lives
+		 * in our buffer, write our buffer back.
+		 */
+		iddirty = 0;
+		result = sfs_bmap_indirect(sv, &idbuf[idoff], &iddirty,
+					   level-1, offset, doalloc,
+					   diskblock);
+		if (iddirty) {
+			int result2 = sfs_jwblock(sfs, idbuf, idblock);
+			if (result == 0) {
+				result = result2;
+			}
+		}
+		return result;
+	}
+
+	/* Get the block out of the indirect block buffer */
+	block = idbuf[idoff];
+
+	/* If there's no block there, allocate one */
+	if (block==0 && doalloc) {
+		result = sfs_balloc(sfs, &block);
+		if (result) {
+			return result;
+		}
+
+		/* Remember the block we allocated */
+		idbuf[idoff] = block;
+
+		/* The indirect block is now dirty; write it back */
+		result = sfs_jwblock(sfs, idbuf, idblock);
+		if (result) {
+			return result;
+		}
+	}
+
+	*diskblock = block;
+	return 0;
+}
+
 /*
  * Look up the disk block number (from 0 up to the number of blocks on
  * the disk) given a file and the logical block number within that
@@ -117,23 +356,13 @@ int
 sfs_bmap(struct sfs_vnode *sv, u_int32_t fileblock, int doalloc,
 	    u_int32_t *diskblock)
 {
-	/*
-	 * I/O buffer for handling indirect blocks.
-	 *
-	 * Note: in real life (and when you've done the fs assignment)
-	 * you would get space from the disk buffer cache for this,
-	 * not use a static area.
-	 */
-	static u_int32_t idbuf[SFS_DBPERIDB];
-
 	struct sfs_fs *sfs = sv->sv_v.vn_fs->fs_data;
 	u_int32_t block;
-	u_int32_t idblock;
-	u_int32_t idnum, idoff;
+	u_int32_t *idslot;
+	u_int32_t baseblock;
+	int level;
 	int result;
 
-	assert(sizeof(idbuf)==SFS_BLOCKSIZE);
-
 	/*
 	 * If the block we want is one of the direct blocks...
 	 */
@@ -169,97 +398,261 @@ sfs_bmap(struct sfs_vnode *sv, u_int32_t fileblock, int doalloc,
 	}
 
 	/*
-	 * It's not a direct block; it must be in the indirect block.
-	 * Subtract off the number of direct blocks, so FILEBLOCK is
-	 * now the offset into the indirect block space.
+	 * It's not a direct block; find out which indirect block
+	 * (single, double, or triple) it hangs off, and walk down.
 	 */
+	result = sfs_idslot(sv, fileblock, &idslot, &level, &baseblock);
+	if (result) {
+		return result;
+	}
+
+	result = sfs_bmap_indirect(sv, idslot, &sv->sv_dirty, level,
+				   fileblock - baseblock, doalloc, &block);
+	if (result) {
+		return result;
+	}
 
-	fileblock -= SFS_NDIRECT;
+	/* Hand back the result and return. */
+	if (block != 0 && !sfs_bused(sfs, block)) {
+		panic("sfs: Data block %u (block %u of file %u) marked free\n",
+		      block, fileblock, sv->sv_ino);
+	}
+	*diskblock = block;
+	return 0;
+}
 
-	/* Get the indirect block number and offset w/i that indirect block */
-	idnum = fileblock / SFS_DBPERIDB;
-	idoff = fileblock % SFS_DBPERIDB;
+////////////////////////////////////////////////////////////
+//
+// Read-ahead
+//
+// Each sfs_fs has one buffer of SFS_RAMAX blocks, which holds a run
+// of consecutive file blocks belonging to one vnode. When a vnode is
+// being read sequentially and the block it wants isn't in the
+// buffer, we load the buffer with that block and the rest of the
+// vnode's read-ahead window in as few device requests as the block
+// layout allows. Later reads of those blocks are then just copies.
+//
+// The device interface is synchronous, so this doesn't overlap the
+// reads with the caller's processing; what it saves is the per-block
+// bmap and device request overhead, and in particular re-reading the
+// indirect block for every data block.
 
-	/*
-	 * We only have one indirect block. If the offset we were asked for
-	 * is too large, we can't handle it, so fail.
-	 */
-	if (idnum > 0) {
-		return EINVAL;
+/*
+ * Throw away anything in the read-ahead buffer that belongs to SV.
+ * Called when SV is written, truncated, or reclaimed.
+ */
+static
+void
+sfs_rainval(struct sfs_vnode *sv)
+{
+	struct sfs_fs *sfs = sv->sv_v.vn_fs->fs_data;
+
+	if (sfs->sfs_raowner == sv) {
+		sfs->sfs_raowner = NULL;
+		sfs->sfs_racount = 0;
 	}
+}
+
+/*
+ * Load the read-ahead buffer with file blocks of SV starting at
+ * FILEBLOCK, as many as the vnode's current window allows without
+ * going past EOF. Runs of blocks that are consecutive on disk are
+ * read with a single request. The caller has the buffer to itself
+ * (see sfs_raread) and has already invalidated it.
+ */
+static
+int
+sfs_rafill(struct sfs_vnode *sv, u_int32_t fileblock)
+{
+	struct sfs_fs *sfs = sv->sv_v.vn_fs->fs_data;
+	u_int32_t diskblocks[SFS_RAMAX];
+	u_int32_t eofblock, nblocks, i, run;
+	struct uio ku;
+	int result;
 
-	/* Get the disk block number of the indirect block. */
-	idblock = sv->sv_i.sfi_indirect;
+	eofblock = DIVROUNDUP(sv->sv_i.sfi_size, SFS_BLOCKSIZE);
+	assert(fileblock < eofblock);
 
-	if (idblock==0 && !doalloc) {
-		/*
-		 * There's no indirect block allocated. We weren't
-		 * asked to allocate anything, so pretend the indirect
-		 * block was filled with all zeros.
-		 */
-		*diskblock = 0;
-		return 0;
+	nblocks = sv->sv_rawindow;
+	if (nblocks > eofblock - fileblock) {
+		nblocks = eofblock - fileblock;
 	}
-	else if (idblock==0) {
-		/*
-		 * There's no indirect block allocated, but we need to
-		 * allocate a block whose number needs to be stored in
-		 * the indirect block. Thus, we need to allocate an
-		 * indirect block.
-		 */
-		result = sfs_balloc(sfs, &idblock);
+	assert(nblocks > 0 && nblocks <= SFS_RAMAX);
+
+	for (i=0; i<nblocks; i++) {
+		result = sfs_bmap(sv, fileblock+i, 0, &diskblocks[i]);
 		if (result) {
 			return result;
 		}
+	}
 
-		/* Remember the block we just allocated */
-		sv->sv_i.sfi_indirect = idblock;
+	for (i=0; i<nblocks; i+=run) {
+		char *ptr = sfs->sfs_rabuf + i*SFS_BLOCKSIZE;
 
-		/* Mark the inode dirty */
-		sv->sv_dirty = 1;
+		if (diskblocks[i] == 0) {
+			/* Hole in the file */
+			bzero(ptr, SFS_BLOCKSIZE);
+			run = 1;
+			continue;
+		}
 
-		/* Clear the indirect block buffer */
-		bzero(idbuf, sizeof(idbuf));
-	}
-	else {
-		/*
-		 * We already have an indirect block allocated; load it.
-		 */
-		result = sfs_rblock(sfs, idbuf, idblock);
+		/* Find how many blocks after this one follow it on disk */
+		for (run=1; i+run < nblocks; run++) {
+			if (diskblocks[i+run] != diskblocks[i]+run) {
+				break;
+			}
+		}
+
+		mk_kuio(&ku, ptr, run*SFS_BLOCKSIZE,
+			((off_t)diskblocks[i])*SFS_BLOCKSIZE, UIO_READ);
+		result = sfs_rwblock(sfs, &ku);
 		if (result) {
 			return result;
 		}
+		sfs_stats.ra_ios++;
 	}
 
-	/* Get the block out of the indirect block buffer */
-	block = idbuf[idoff];
+	/* Directory blocks may have newer contents in the journal */
+	if (sv->sv_i.sfi_type == SFS_TYPE_DIR) {
+		for (i=0; i<nblocks; i++) {
+			void *image;
 
-	/* If there's no block there, allocate one */
-	if (block==0 && doalloc) {
-		result = sfs_balloc(sfs, &block);
-		if (result) {
-			return result;
+			if (diskblocks[i] == 0) {
+				continue;
+			}
+			image = sfs_jfind(sfs, diskblocks[i]);
+			if (image != NULL) {
+				memcpy(sfs->sfs_rabuf + i*SFS_BLOCKSIZE,
+				       image, SFS_BLOCKSIZE);
+			}
 		}
+	}
 
-		/* Remember the block we allocated */
-		idbuf[idoff] = block;
+	sfs->sfs_raowner = sv;
+	sfs->sfs_rastart = fileblock;
+	sfs->sfs_racount = nblocks;
 
-		/* The indirect block is now dirty; write it back */
-		result = sfs_wblock(sfs, idbuf, idblock);
-		if (result) {
-			return result;
+	sfs_stats.ra_fills++;
+	sfs_stats.ra_blocks += nblocks;
+
+	return 0;
+}
+
+/*
+ * Done with a block sfs_raread handed back.
+ */
+static
+void
+sfs_radone(struct sfs_fs *sfs)
+{
+	int spl;
+
+	spl = splhigh();
+	assert(sfs->sfs_rausers > 0);
+	sfs->sfs_rausers--;
+	splx(spl);
+}
+
+/*
+ * Called for each block of SV that's read. Updates the sequential
+ * access detection, and if the block is (or, because the vnode is
+ * being read sequentially, now is) in the read-ahead buffer, hands
+ * back a pointer to it. Otherwise hands back NULL and the caller
+ * does the I/O itself.
+ *
+ * The caller copies out of the buffer with uiomove, which can fault
+ * or be preempted, so a pointer handed back counts as a user of the
+ * buffer until the caller calls sfs_radone. The buffer is only
+ * refilled when nobody is using it; a reader that would refill it
+ * while it's in use does its own I/O instead.
+ */
+static
+int
+sfs_raread(struct sfs_vnode *sv, u_int32_t fileblock, char **ret)
+{
+	struct sfs_fs *sfs = sv->sv_v.vn_fs->fs_data;
+	int sequential;
+	int result, spl;
+
+	/*
+	 * Reading the block we expected next is sequential; so is
+	 * reading the same block again (small reads, directory
+	 * entries). Anything else resets the window.
+	 */
+	sequential = (fileblock == sv->sv_ranext ||
+		      fileblock + 1 == sv->sv_ranext);
+	if (!sequential) {
+		sv->sv_rawindow = 0;
+	}
+	sv->sv_ranext = fileblock + 1;
+
+	spl = splhigh();
+	if (sfs->sfs_raowner == sv &&
+	    fileblock >= sfs->sfs_rastart &&
+	    fileblock - sfs->sfs_rastart < sfs->sfs_racount) {
+		sfs->sfs_rausers++;
+		splx(spl);
+		sfs_stats.ra_hits++;
+		*ret = sfs->sfs_rabuf +
+			(fileblock - sfs->sfs_rastart)*SFS_BLOCKSIZE;
+		return 0;
+	}
+
+	sfs_stats.ra_misses++;
+
+	if (!sequential || sfs->sfs_rabuf == NULL || sfs->sfs_rausers > 0) {
+		splx(spl);
+		*ret = NULL;
+		return 0;
+	}
+
+	/* Take the buffer; invalidate first, in case the fill fails */
+	sfs->sfs_rausers++;
+	sfs->sfs_raowner = NULL;
+	sfs->sfs_racount = 0;
+	splx(spl);
+
+	/* Grow the window each time a sequential reader runs off the end */
+	if (sv->sv_rawindow == 0) {
+		sv->sv_rawindow = SFS_RAMIN;
+	}
+	else if (sv->sv_rawindow < SFS_RAMAX) {
+		sv->sv_rawindow *= 2;
+		if (sv->sv_rawindow > SFS_RAMAX) {
+			sv->sv_rawindow = SFS_RAMAX;
 		}
 	}
 
-	/* Hand back the result and return. */
-	if (block != 0 && !sfs_bused(sfs, block)) {
-		panic("sfs: Data block %u (block %u of file %u) marked free\n",
-		      block, fileblock, sv->sv_ino);
+	result = sfs_rafill(sv, fileblock);
+	if (result) {
+		sfs_radone(sfs);
+		return result;
 	}
-	*diskblock = block;
+
+	*ret = sfs->sfs_rabuf;
 	return 0;
 }
 
+/*
+ * Print the read-ahead statistics.
+ */
+void
+sfs_printstats(void)
+{
+	u_int32_t total = sfs_stats.ra_hits + sfs_stats.ra_misses;
+	u_int32_t idtotal = sfs_stats.id_hits + sfs_stats.id_misses;
+
+	kprintf("sfs read-ahead: %u hits, %u misses (%u%% hit rate)\n",
+		sfs_stats.ra_hits, sfs_stats.ra_misses,
+		total ? (sfs_stats.ra_hits * 100) / total : 0);
+	kprintf("    %u fills, %u blocks prefetched in %u requests\n",
+		sfs_stats.ra_fills, sfs_stats.ra_blocks, sfs_stats.ra_ios);
+	kprintf("sfs indirect blocks: %u cached, %u read (%u%% hit rate)\n",
+		sfs_stats.id_hits, sfs_stats.id_misses,
+		idtotal ? (sfs_stats.id_hits * 100) / idtotal : 0);
+	sfs_jprintstats();
+}
+
 ////////////////////////////////////////////////////////////
 //
 // File-level I/O
@@ -301,6 +694,21 @@ sfs_partialio(struct sfs_vnode *sv, struct uio *uio,
 	/* Compute the block offset of this block in the file */
 	fileblock = uio->uio_offset / SFS_BLOCKSIZE;
 
+	/* If reading, see if read-ahead already has it */
+	if (uio->uio_rw == UIO_READ) {
+		char *rablock;
+
+		result = sfs_raread(sv, fileblock, &rablock);
+		if (result) {
+			return result;
+		}
+		if (rablock != NULL) {
+			result = uiomove(rablock+skipstart, len, uio);
+			sfs_radone(sfs);
+			return result;
+		}
+	}
+
 	/* Get the disk block number */
 	result = sfs_bmap(sv, fileblock, doalloc, &diskblock);
 	if (result) {
@@ -317,9 +725,15 @@ sfs_partialio(struct sfs_vnode *sv, struct uio *uio,
 	}
 	else {
 		/*
-		 * Read the block.
+		 * Read the block. (Directory blocks are metadata, and
+		 * may have a newer version in the journal.)
 		 */
-		result = sfs_rblock(sfs, iobuf, diskblock);
+		if (sv->sv_i.sfi_type == SFS_TYPE_DIR) {
+			result = sfs_jrblock(sfs, iobuf, diskblock);
+		}
+		else {
+			result = sfs_rblock(sfs, iobuf, diskblock);
+		}
 		if (result) {
 			return result;
 		}
@@ -337,7 +751,12 @@ sfs_partialio(struct sfs_vnode *sv, struct uio *uio,
 	 * If it was a write, write back the modified block.
 	 */
 	if (uio->uio_rw == UIO_WRITE) {
-		result = sfs_wblock(sfs, iobuf, diskblock);
+		if (sv->sv_i.sfi_type == SFS_TYPE_DIR) {
+			result = sfs_jwblock(sfs, iobuf, diskblock);
+		}
+		else {
+			result = sfs_wblock(sfs, iobuf, diskblock);
+		}
 		if (result) {
 			return result;
 		}
@@ -363,9 +782,32 @@ sfs_blockio(struct sfs_vnode *sv, struct uio *uio)
 	off_t saveres;
 	off_t diskres;
 
+	/*
+	 * Directory blocks are metadata and go through the journal,
+	 * so they can't be transferred directly to or from the uio.
+	 */
+	if (sv->sv_i.sfi_type == SFS_TYPE_DIR) {
+		return sfs_partialio(sv, uio, 0, SFS_BLOCKSIZE);
+	}
+
 	/* Get the block number within the file */
 	fileblock = uio->uio_offset / SFS_BLOCKSIZE;
 
+	/* If reading, see if read-ahead already has it */
+	if (uio->uio_rw == UIO_READ) {
+		char *rablock;
+
+		result = sfs_raread(sv, fileblock, &rablock);
+		if (result) {
+			return result;
+		}
+		if (rablock != NULL) {
+			result = uiomove(rablock, SFS_BLOCKSIZE, uio);
+			sfs_radone(sfs);
+			return result;
+		}
+	}
+
 	/* Look up the disk block number */
 	result = sfs_bmap(sv, fileblock, doalloc, &diskblock);
 	if (result) {
@@ -411,6 +853,42 @@ sfs_blockio(struct sfs_vnode *sv, struct uio *uio)
 	return result;
 }
 
+/*
+ * Do I/O to one block of a file: LEN bytes starting SKIPSTART bytes
+ * into it. Writing a block is a journal operation of its own, unless
+ * it's part of a bigger one (a directory update), so a long write may
+ * be committed in several transactions but never partway through a
+ * block.
+ */
+static
+int
+sfs_ioblock(struct sfs_vnode *sv, struct uio *uio,
+	    u_int32_t skipstart, u_int32_t len)
+{
+	struct sfs_fs *sfs = sv->sv_v.vn_fs->fs_data;
+	int result;
+
+	if (uio->uio_rw == UIO_WRITE) {
+		result = sfs_jbegin(sfs, SFS_JBLOCKIMAGES);
+		if (result) {
+			return result;
+		}
+	}
+
+	if (len == SFS_BLOCKSIZE) {
+		assert(skipstart == 0);
+		result = sfs_blockio(sv, uio);
+	}
+	else {
+		result = sfs_partialio(sv, uio, skipstart, len);
+	}
+
+	if (uio->uio_rw == UIO_WRITE) {
+		sfs_jend(sfs);
+	}
+	return result;
+}
+
 /*
  * Do I/O of a whole region of data, whether or not it's block-aligned.
  */
@@ -443,6 +921,10 @@ sfs_io(struct sfs_vnode *sv, struct uio *uio)
 			uio->uio_resid -= extraresid;
 		}
 	}
+	else {
+		/* Writing; anything we read ahead may now be stale */
+		sfs_rainval(sv);
+	}
 
 	/*
 	 * First, do any leading partial block.
@@ -461,7 +943,7 @@ sfs_io(struct sfs_vnode *sv, struct uio *uio)
 		}
 
 		/* Call sfs_partialio() to do it. */
-		result = sfs_partialio(sv, uio, skip, len);
+		result = sfs_ioblock(sv, uio, skip, len);
 		if (result) {
 			goto out;
 		}
@@ -478,7 +960,7 @@ sfs_io(struct sfs_vnode *sv, struct uio *uio)
 	assert(uio->uio_offset % SFS_BLOCKSIZE == 0);
 	nblocks = uio->uio_resid / SFS_BLOCKSIZE;
 	for (i=0; i<nblocks; i++) {
-		result = sfs_blockio(sv, uio);
+		result = sfs_ioblock(sv, uio, 0, SFS_BLOCKSIZE);
 		if (result) {
 			goto out;
 		}
@@ -490,7 +972,7 @@ sfs_io(struct sfs_vnode *sv, struct uio *uio)
 	assert(uio->uio_resid < SFS_BLOCKSIZE);
 
 	if (uio->uio_resid > 0) {
-		result = sfs_partialio(sv, uio, 0, uio->uio_resid);
+		result = sfs_ioblock(sv, uio, 0, uio->uio_resid);
 		if (result) {
 			goto out;
 		}
@@ -844,8 +1326,11 @@ static
 int
 sfs_close(struct vnode *v)
 {
-	/* Sync it. */
-	return VOP_FSYNC(v);
+	/*
+	 * Sync it. With a journal, this just puts the inode in the
+	 * running transaction, so that many closes share one commit.
+	 */
+	return sfs_sync_inode(v->vn_data);
 }
 
 /*
@@ -878,11 +1363,16 @@ sfs_reclaim(struct vnode *v)
 	}
 	lock_release(v->vn_countlock);
 	
+	result = sfs_jbegin(sfs, SFS_JOPIMAGES);
+	if (result) {
+		return result;
+	}
 
 	/* If there are no on-disk references to the file either, erase it. */
 	if (sv->sv_i.sfi_linkcount==0) {
 		result = VOP_TRUNCATE(&sv->sv_v, 0);
 		if (result) {
+			sfs_jend(sfs);
 			return result;
 		}
 	}
@@ -890,6 +1380,7 @@ sfs_reclaim(struct vnode *v)
 	/* Sync the inode to disk */
 	result = sfs_sync_inode(sv);
 	if (result) {
+		sfs_jend(sfs);
 		return result;
 	}
 
@@ -898,6 +1389,8 @@ sfs_reclaim(struct vnode *v)
 		sfs_bfree(sfs, sv->sv_ino);
 	}
 
+	sfs_jend(sfs);
+
 	/* Remove the vnode structure from the table in the struct sfs_fs. */
 	ix = -1;
 	num = array_getnum(sfs->sfs_vnodes);
@@ -914,6 +1407,8 @@ sfs_reclaim(struct vnode *v)
 	}
 	array_remove(sfs->sfs_vnodes, ix);
 
+	sfs_rainval(sv);
+
 	VOP_KILL(&sv->sv_v);
 
 	/* Release the storage for the vnode structure itself. */
@@ -1043,48 +1538,139 @@ int
 sfs_fsync(struct vnode *v)
 {
 	struct sfs_vnode *sv = v->vn_data;
+	struct sfs_fs *sfs = v->vn_fs->fs_data;
+
+	if (sfs->sfs_jbuf != NULL) {
+		/* Commits everyone else's pending changes along with ours */
+		return sfs_jcommit(sfs);
+	}
 	return sfs_sync_inode(sv);
 }
 
 /*
- * Called for mmap().
+ * Called for mmap(). Mapped pages are read and written through
+ * VOP_READ/VOP_WRITE by the VM system's page cache, so any file can
+ * be mapped.
  */
 static
 int
-sfs_mmap(struct vnode *v   /* add stuff as needed */)
+sfs_mmap(struct vnode *v)
 {
 	(void)v;
-	return EUNIMP;
+	return 0;
 }
 
 /*
- * Called for ftruncate() and from sfs_reclaim.
+ * Discard everything mapped through an indirect block of level LEVEL
+ * that lies at or past file block BLOCKLEN. IDSLOT points at the
+ * place the indirect block's number is kept, and BASEBLOCK is the
+ * first file block it maps. If the indirect block ends up empty it
+ * is freed too, *IDSLOT is cleared, and *SLOTDIRTY is set.
  */
 static
 int
-sfs_truncate(struct vnode *v, off_t len)
+sfs_truncate_indirect(struct sfs_fs *sfs, u_int32_t *idslot, int *slotdirty,
+		      int level, u_int32_t baseblock, u_int32_t blocklen)
 {
 	/*
-	 * I/O buffer for handling the indirect block.
+	 * I/O buffers for handling indirect blocks, one per level.
 	 *
 	 * Note: in real life (and when you've done the fs assignment)
 	 * you would get space from the disk buffer cache for this,
 	 * not use a static area.
 	 */
-	static u_int32_t idbuf[SFS_DBPERIDB];
+	static u_int32_t idbufs[3][SFS_DBPERIDB];
+
+	u_int32_t *idbuf;
+	u_int32_t idblock, span, j;
+	int result;
+	int hasnonzero, iddirty;
+
+	assert(level >= 1 && level <= 3);
+	assert(sizeof(idbufs[0])==SFS_BLOCKSIZE);
+	idbuf = idbufs[level-1];
+
+	idblock = *idslot;
+	span = sfs_idspan(level);
+
+	if (idblock == 0 || blocklen >= baseblock + span*SFS_DBPERIDB) {
+		/* Nothing allocated, or all of it is before the new EOF */
+		return 0;
+	}
 
+	/* We're past the proposed EOF; read the indirect block */
+	result = sfs_jrblock(sfs, idbuf, idblock);
+	if (result) {
+		return result;
+	}
+
+	hasnonzero = 0;
+	iddirty = 0;
+	for (j=0; j<SFS_DBPERIDB; j++) {
+		u_int32_t first = baseblock + j*span;
+
+		if (idbuf[j] != 0 && level > 1) {
+			/* Trim (and maybe free) the lower indirect block */
+			result = sfs_truncate_indirect(sfs, &idbuf[j], &iddirty,
+						       level-1, first,
+						       blocklen);
+			if (result) {
+				return result;
+			}
+		}
+		else if (idbuf[j] != 0 && first >= blocklen) {
+			/* Discard data blocks that are past the new EOF */
+			sfs_bfree(sfs, idbuf[j]);
+			idbuf[j] = 0;
+			iddirty = 1;
+		}
+
+		/* Remember if we see any nonzero blocks in here */
+		if (idbuf[j]!=0) {
+			hasnonzero=1;
+		}
+	}
+
+	if (!hasnonzero) {
+		/* The whole indirect block is empty now; free it */
+		sfs_bfree(sfs, idblock);
+		*idslot = 0;
+		*slotdirty = 1;
+	}
+	else if (iddirty) {
+		/* The indirect block is dirty; write it back */
+		sfs_idforget(sfs, idblock);
+		result = sfs_jwblock(sfs, idbuf, idblock);
+		if (result) {
+			return result;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Called for ftruncate() and from sfs_reclaim.
+ */
+static
+int
+sfs_truncate(struct vnode *v, off_t len)
+{
 	struct sfs_vnode *sv = v->vn_data;
 	struct sfs_fs *sfs = sv->sv_v.vn_fs->fs_data;
 
 	/* Length in blocks (divide rounding up) */
 	u_int32_t blocklen = DIVROUNDUP(len, SFS_BLOCKSIZE);
 
-	u_int32_t i, j, block;
-	u_int32_t idblock, baseblock, highblock;
+	u_int32_t i, block, baseblock;
 	int result;
-	int hasnonzero, iddirty;
 
-	assert(sizeof(idbuf)==SFS_BLOCKSIZE);
+	sfs_rainval(sv);
+
+	result = sfs_jbegin(sfs, SFS_JOPIMAGES);
+	if (result) {
+		return result;
+	}
 
 	/*
 	 * Go through the direct blocks. Discard any that are
@@ -1099,51 +1685,32 @@ sfs_truncate(struct vnode *v, off_t len)
 		}
 	}
 
-	/* Indirect block number */
-	idblock = sv->sv_i.sfi_indirect;
-
-	/* The lowest block in the indirect block */
+	/* Then the single, double, and triple indirect trees, in order */
 	baseblock = SFS_NDIRECT;
+	result = sfs_truncate_indirect(sfs, &sv->sv_i.sfi_indirect,
+				       &sv->sv_dirty, 1, baseblock, blocklen);
+	if (result) {
+		sfs_jend(sfs);
+		return result;
+	}
 
-	/* The highest block in the indirect block */
-	highblock = baseblock + SFS_DBPERIDB - 1;
-
-	if (blocklen < highblock && idblock != 0) {
-		/* We're past the proposed EOF; may need to free stuff */
-
-		/* Read the indirect block */
-		result = sfs_rblock(sfs, idbuf, idblock);
+	if (sfs->sfs_super.sp_version >= SFS_VERSION_BIGFILE) {
+		baseblock += SFS_DBPERIDB;
+		result = sfs_truncate_indirect(sfs, &sv->sv_i.sfi_dindirect,
+					       &sv->sv_dirty, 2, baseblock,
+					       blocklen);
 		if (result) {
+			sfs_jend(sfs);
 			return result;
 		}
-		
-		hasnonzero = 0;
-		iddirty = 0;
-		for (j=0; j<SFS_DBPERIDB; j++) {
-			/* Discard any blocks that are past the new EOF */
-			if (blocklen < baseblock+j && idbuf[j] != 0) {
-				sfs_bfree(sfs, idbuf[j]);
-				idbuf[j] = 0;
-				iddirty = 1;
-			}
-			/* Remember if we see any nonzero blocks in here */
-			if (idbuf[j]!=0) {
-				hasnonzero=1;
-			}
-		}
 
-		if (!hasnonzero) {
-			/* The whole indirect block is empty now; free it */
-			sfs_bfree(sfs, idblock);
-			sv->sv_i.sfi_indirect = 0;
-			sv->sv_dirty = 1;
-		}
-		else if (iddirty) {
-			/* The indirect block is dirty; write it back */
-			result = sfs_wblock(sfs, idbuf, idblock);
-			if (result) {
-				return result;
-			}
+		baseblock += SFS_DBPERDIDB;
+		result = sfs_truncate_indirect(sfs, &sv->sv_i.sfi_tindirect,
+					       &sv->sv_dirty, 3, baseblock,
+					       blocklen);
+		if (result) {
+			sfs_jend(sfs);
+			return result;
 		}
 	}
 
@@ -1152,7 +1719,8 @@ sfs_truncate(struct vnode *v, off_t len)
 
 	/* Mark the inode dirty */
 	sv->sv_dirty = 1;
-	
+
+	sfs_jend(sfs);
 	return 0;
 }
 
@@ -1176,6 +1744,95 @@ sfs_namefile(struct vnode *vv, struct uio *uio)
 	return 0;
 }
 
+/*
+ * Read as many directory entries as fit into UIO. The offset in the
+ * uio is the slot number to start at.
+ *
+ * Rather than going through sfs_readdir a slot at a time, read the
+ * rest of each directory block in one go; a block holds eight
+ * entries. The type of each entry comes from its inode.
+ */
+static
+int
+sfs_getdirentries(struct vnode *v, struct uio *uio)
+{
+	struct sfs_vnode *sv = v->vn_data;
+	struct sfs_fs *sfs = v->vn_fs->fs_data;
+	struct sfs_vnode *ent;
+	struct sfs_dir *sds;
+	struct uio ku;
+	int nentries, slot, n, i, type, any;
+	int result;
+
+	if (uio->uio_offset < 0) {
+		return EINVAL;
+	}
+
+	sds = kmalloc(SFS_BLOCKSIZE);
+	if (sds == NULL) {
+		return ENOMEM;
+	}
+
+	nentries = sfs_dir_nentries(sv);
+	slot = uio->uio_offset;
+	any = 0;
+	result = 0;
+
+	while (slot < nentries) {
+		/* From this slot to the end of its block */
+		n = SFS_DIRPERBLOCK - slot % SFS_DIRPERBLOCK;
+		if (n > nentries - slot) {
+			n = nentries - slot;
+		}
+
+		mk_kuio(&ku, sds, n * sizeof(struct sfs_dir),
+			slot * sizeof(struct sfs_dir), UIO_READ);
+		result = sfs_io(sv, &ku);
+		if (result) {
+			goto done;
+		}
+		if (ku.uio_resid > 0) {
+			panic("sfs: getdirentries: Short read (inode %u)\n",
+			      sv->sv_ino);
+		}
+
+		for (i=0; i<n; i++) {
+			if (sds[i].sfd_ino == SFS_NOINO) {
+				slot++;
+				continue;
+			}
+			sds[i].sfd_name[sizeof(sds[i].sfd_name)-1] = 0;
+
+			result = sfs_loadvnode(sfs, sds[i].sfd_ino,
+					       SFS_TYPE_INVAL, &ent);
+			if (result) {
+				goto done;
+			}
+			type = ent->sv_i.sfi_type == SFS_TYPE_DIR ?
+				DT_DIR : DT_REG;
+			VOP_DECREF(&ent->sv_v);
+
+			result = vfs_direntout(uio, sds[i].sfd_ino, type,
+					       sds[i].sfd_name);
+			if (result == ERANGE) {
+				/* Full; this entry starts the next call */
+				result = any ? 0 : EINVAL;
+				goto done;
+			}
+			if (result) {
+				goto done;
+			}
+			any = 1;
+			slot++;
+		}
+	}
+
+ done:
+	kfree(sds);
+	uio->uio_offset = slot;
+	return result;
+}
+
 /*
  * Create a file. If EXCL is set, insist that the filename not already
  * exist; otherwise, if it already exists, just open it.
@@ -1212,8 +1869,14 @@ sfs_creat(struct vnode *v, const char *name, int excl, struct vnode **ret)
 	}
 
 	/* Didn't exist - create it */
+	result = sfs_jbegin(sfs, SFS_JOPIMAGES);
+	if (result) {
+		return result;
+	}
+
 	result = sfs_makeobj(sfs, SFS_TYPE_FILE, &newguy);
 	if (result) {
+		sfs_jend(sfs);
 		return result;
 	}
 
@@ -1221,6 +1884,7 @@ sfs_creat(struct vnode *v, const char *name, int excl, struct vnode **ret)
 	result = sfs_dir_link(sv, name, newguy->sv_ino, NULL);
 	if (result) {
 		VOP_DECREF(&newguy->sv_v);
+		sfs_jend(sfs);
 		return result;
 	}
 
@@ -1230,6 +1894,8 @@ sfs_creat(struct vnode *v, const char *name, int excl, struct vnode **ret)
 	/* and consequently mark it dirty. */
 	newguy->sv_dirty = 1;
 
+	sfs_jend(sfs);
+
 	*ret = &newguy->sv_v;
 	
 	return 0;
@@ -1244,15 +1910,22 @@ static
 int
 sfs_link(struct vnode *dir, const char *name, struct vnode *file)
 {
+	struct sfs_fs *sfs = dir->vn_fs->fs_data;
 	struct sfs_vnode *sv = dir->vn_data;
 	struct sfs_vnode *f = file->vn_data;
 	int result;
 
 	assert(file->vn_fs == dir->vn_fs);
 
+	result = sfs_jbegin(sfs, SFS_JOPIMAGES);
+	if (result) {
+		return result;
+	}
+
 	/* Just create a link */
 	result = sfs_dir_link(sv, name, f->sv_ino, NULL);
 	if (result) {
+		sfs_jend(sfs);
 		return result;
 	}
 
@@ -1260,6 +1933,7 @@ sfs_link(struct vnode *dir, const char *name, struct vnode *file)
 	f->sv_i.sfi_linkcount++;
 	f->sv_dirty = 1;
 
+	sfs_jend(sfs);
 	return 0;
 }
 
@@ -1270,6 +1944,7 @@ static
 int
 sfs_remove(struct vnode *dir, const char *name)
 {
+	struct sfs_fs *sfs = dir->vn_fs->fs_data;
 	struct sfs_vnode *sv = dir->vn_data;
 	struct sfs_vnode *victim;
 	int slot;
@@ -1281,6 +1956,16 @@ sfs_remove(struct vnode *dir, const char *name)
 		return result;
 	}
 
+	/*
+	 * One operation, including the truncate when the last
+	 * reference goes away below.
+	 */
+	result = sfs_jbegin(sfs, SFS_JOPIMAGES);
+	if (result) {
+		VOP_DECREF(&victim->sv_v);
+		return result;
+	}
+
 	/* Erase its directory entry. */
 	result = sfs_dir_unlink(sv, slot);
 	if (result==0) {
@@ -1293,6 +1978,7 @@ sfs_remove(struct vnode *dir, const char *name)
 	/* Discard the reference that sfs_lookonce got us */
 	VOP_DECREF(&victim->sv_v);
 
+	sfs_jend(sfs);
 	return result;
 }
 
@@ -1307,6 +1993,7 @@ int
 sfs_rename(struct vnode *d1, const char *n1, 
 	   struct vnode *d2, const char *n2)
 {
+	struct sfs_fs *sfs = d1->vn_fs->fs_data;
 	struct sfs_vnode *sv = d1->vn_data;
 	struct sfs_vnode *g1;
 	int slot1, slot2;
@@ -1324,6 +2011,12 @@ sfs_rename(struct vnode *d1, const char *n1,
 	/* We don't support subdirectories */
 	assert(g1->sv_i.sfi_type == SFS_TYPE_FILE);
 
+	result = sfs_jbegin(sfs, SFS_JOPIMAGES);
+	if (result) {
+		VOP_DECREF(&g1->sv_v);
+		return result;
+	}
+
 	/*
 	 * Link it under the new name.
 	 *
@@ -1358,6 +2051,7 @@ sfs_rename(struct vnode *d1, const char *n1,
 	/* Let go of the reference to g1 */
 	VOP_DECREF(&g1->sv_v);
 
+	sfs_jend(sfs);
 	return 0;
 
  puke_harder:
@@ -1375,6 +2069,7 @@ sfs_rename(struct vnode *d1, const char *n1,
  puke:
 	/* Let go of the reference to g1 */
 	VOP_DECREF(&g1->sv_v);
+	sfs_jend(sfs);
 	return result;
 }
 
@@ -1481,6 +2176,7 @@ static const struct vnode_ops sfs_fileops = {
 	sfs_read,
 	NOTDIR,  /* readlink */
 	NOTDIR,  /* getdirentry */
+	NOTDIR,  /* getdirentries */
 	sfs_write,
 	sfs_ioctl,
 	sfs_stat,
@@ -1516,6 +2212,7 @@ static const struct vnode_ops sfs_dirops = {
 	ISDIR,   /* read */
 	ISDIR,   /* readlink */
 	UNIMP,   /* getdirentry */
+	sfs_getdirentries,
 	ISDIR,   /* write */
 	sfs_ioctl,
 	sfs_stat,
@@ -1591,7 +2288,7 @@ sfs_loadvnode(struct sfs_fs *sfs, u_int32_t ino, int forcetype,
 	}
 
 	/* Read the block the inode is in */
-	result = sfs_rblock(sfs, &sv->sv_i, ino);
+	result = sfs_jrblock(sfs, &sv->sv_i, ino);
 	if (result) {
 		kfree(sv);
 		return result;
@@ -1600,6 +2297,10 @@ sfs_loadvnode(struct sfs_fs *sfs, u_int32_t ino, int forcetype,
 	/* Not dirty yet */
 	sv->sv_dirty = 0;
 
+	/* No reads yet; a first read of block 0 counts as sequential */
+	sv->sv_ranext = 0;
+	sv->sv_rawindow = 0;
+
 	/*
 	 * FORCETYPE is set if we're creating a new file, because the
 	 * block on disk will have been zeroed out and thus the type
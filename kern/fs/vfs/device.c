@@ -203,15 +203,15 @@ null_fsync(struct vnode *v)
 }
 
 /*
- * For mmap. If you want this to do anything, you have to write it
- * yourself. Some devices may not make sense to map. Others do.
+ * For mmap. The VM system maps files through a page cache that isn't
+ * coherent with direct device I/O, so devices can't be mapped.
  */
 static
 int
-dev_mmap(struct vnode *v  /* add stuff as needed */)
+dev_mmap(struct vnode *v)
 {
 	(void)v;
-	return EUNIMP;
+	return ENODEV;
 }
 
 /*
@@ -371,6 +371,7 @@ static const struct vnode_ops dev_vnode_ops = {
 	dev_read,
 	null_io,      /* readlink */
 	null_io,      /* getdirentry */
+	null_io,      /* getdirentries */
 	dev_write,
 	dev_ioctl,
 	dev_stat,
@@ -0,0 +1,42 @@
+/*
+ * Support for getdirentries: packing directory entries into the
+ * caller's buffer.
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/dirent.h>
+#include <lib.h>
+#include <uio.h>
+#include <vfs.h>
+
+/*
+ * Append one record for NAME to UIO. Fails with ERANGE, moving
+ * nothing, if the whole record doesn't fit. UIO's offset is advanced
+ * by the record's length like any other uiomove; filesystems that use
+ * the offset as a directory position need to put it back afterwards.
+ */
+int
+vfs_direntout(struct uio *uio, u_int32_t ino, int type, const char *name)
+{
+	struct dirent d;
+	size_t namlen, reclen;
+
+	namlen = strlen(name);
+	if (namlen > sizeof(d.d_name) - 1) {
+		return ENAMETOOLONG;
+	}
+	reclen = DIRENT_RECLEN(namlen);
+	if (uio->uio_resid < reclen) {
+		return ERANGE;
+	}
+
+	d.d_ino = ino;
+	d.d_reclen = reclen;
+	d.d_type = type;
+	d.d_namlen = namlen;
+	/* Zero the padding along with the terminator */
+	bzero(d.d_name + namlen, reclen - 8 - namlen);
+	memcpy(d.d_name, name, namlen);
+
+	return uiomove(&d, reclen, uio);
+}
@@ -0,0 +1,508 @@
+/*
+ * Pipes.
+ *
+ * A pipe is a pair of vnodes, one for each end, sharing a struct pipe
+ * that holds a one-page ring buffer. Readers block while the buffer
+ * is empty and writers while it's full; each wakes one thread on the
+ * other side when it makes progress, rather than all of them.
+ *
+ * When the buffer is empty and a reader is blocked, a writer doesn't
+ * go through the buffer at all: the waiting reader leaves its uio in
+ * p_rwait, and the writer copies straight from its own buffer into
+ * the reader's with uiomove_uio, then wakes it. That needs the
+ * reader's buffer to be reachable from the writer, so it's done only
+ * when the reader's buffer is in the kernel or in the writer's own
+ * address space (threads of one process); otherwise the data goes
+ * through the ring as usual. If the handoff faults, the writer
+ * falls back to the ring, so the error ends up with whichever side
+ * owns the bad buffer.
+ *
+ * Writes of up to PIPE_SIZE bytes that find room are atomic. Larger
+ * writes may be interleaved with other writers' data.
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/stat.h>
+#include <lib.h>
+#include <synch.h>
+#include <thread.h>
+#include <curthread.h>
+#include <uio.h>
+#include <vfs.h>
+#include <vnode.h>
+#include <machine/spl.h>
+#include <machine/vm.h>
+
+/* Size of the ring buffer */
+#define PIPE_SIZE  PAGE_SIZE
+
+struct pipe {
+	struct lock *p_lock;		/* protects the rest */
+	char *p_buf;			/* ring buffer */
+	unsigned p_head;		/* offset of the first byte in p_buf */
+	unsigned p_count;		/* bytes in p_buf */
+	int p_rclosed;			/* read end closed */
+	int p_wclosed;			/* write end closed */
+	int p_ends;			/* ends not yet reclaimed */
+	struct uio *p_rwait;		/* blocked reader, for handoff */
+	struct vnode p_rv;		/* read end */
+	struct vnode p_wv;		/* write end */
+};
+
+/*
+ * Sleep channels. The reader in p_rwait sleeps on its own uio, so
+ * the writer that fills it can wake exactly that thread.
+ */
+#define PIPE_READQ(p)   ((const void *)&(p)->p_rv)
+#define PIPE_WRITEQ(p)  ((const void *)&(p)->p_wv)
+
+/*
+ * Release the pipe's lock and sleep on CHAN, atomically with respect
+ * to wakeups, which are only done with the lock held.
+ */
+static
+void
+pipe_sleep(struct pipe *p, const void *chan)
+{
+	int spl;
+
+	spl = splhigh();
+	lock_release(p->p_lock);
+	thread_sleep(chan);
+	splx(spl);
+	lock_acquire(p->p_lock);
+}
+
+static
+void
+pipe_wakeone(const void *chan)
+{
+	int spl;
+
+	spl = splhigh();
+	mono_thread_wakeup(chan);
+	splx(spl);
+}
+
+static
+void
+pipe_wakeall(const void *chan)
+{
+	int spl;
+
+	spl = splhigh();
+	thread_wakeup(chan);
+	splx(spl);
+}
+
+/*
+ * Can the current thread copy straight into uio U?
+ */
+static
+int
+pipe_canhandoff(struct uio *u)
+{
+	return u->uio_segflg == UIO_SYSSPACE ||
+		u->uio_space == curthread->t_vmspace;
+}
+
+static
+int
+pipe_open(struct vnode *v, int flags)
+{
+	(void)v;
+	(void)flags;
+	return 0;
+}
+
+/*
+ * Called when the last descriptor for one end goes away. Wake up the
+ * other side so it sees EOF or EPIPE.
+ */
+static
+int
+pipe_close(struct vnode *v)
+{
+	struct pipe *p = v->vn_data;
+
+	lock_acquire(p->p_lock);
+	if (v == &p->p_rv) {
+		p->p_rclosed = 1;
+		pipe_wakeall(PIPE_WRITEQ(p));
+	}
+	else {
+		p->p_wclosed = 1;
+		pipe_wakeall(PIPE_READQ(p));
+		if (p->p_rwait != NULL) {
+			pipe_wakeall(p->p_rwait);
+		}
+	}
+	lock_release(p->p_lock);
+	return 0;
+}
+
+/*
+ * Free the pipe once both ends are gone.
+ */
+static
+int
+pipe_reclaim(struct vnode *v)
+{
+	struct pipe *p = v->vn_data;
+	int ends;
+
+	lock_acquire(p->p_lock);
+	VOP_KILL(v);
+	ends = --p->p_ends;
+	lock_release(p->p_lock);
+
+	if (ends == 0) {
+		lock_destroy(p->p_lock);
+		kfree(p->p_buf);
+		kfree(p);
+	}
+	return 0;
+}
+
+/*
+ * Copy up to LEN bytes out of the ring into U.
+ */
+static
+int
+pipe_ringout(struct pipe *p, struct uio *u, size_t len)
+{
+	size_t amt;
+	int result;
+
+	while (len > 0) {
+		amt = PIPE_SIZE - p->p_head;
+		if (amt > len) {
+			amt = len;
+		}
+		result = uiomove(p->p_buf + p->p_head, amt, u);
+		if (result) {
+			return result;
+		}
+		p->p_head = (p->p_head + amt) % PIPE_SIZE;
+		p->p_count -= amt;
+		len -= amt;
+	}
+	return 0;
+}
+
+/*
+ * Copy up to LEN bytes from U into the ring.
+ */
+static
+int
+pipe_ringin(struct pipe *p, struct uio *u, size_t len)
+{
+	size_t amt, tail;
+	int result;
+
+	while (len > 0) {
+		tail = (p->p_head + p->p_count) % PIPE_SIZE;
+		amt = PIPE_SIZE - tail;
+		if (amt > len) {
+			amt = len;
+		}
+		result = uiomove(p->p_buf + tail, amt, u);
+		if (result) {
+			return result;
+		}
+		p->p_count += amt;
+		len -= amt;
+	}
+	return 0;
+}
+
+/*
+ * Read whatever is there, up to the size of the request; block only
+ * if there's nothing at all.
+ */
+static
+int
+pipe_read(struct vnode *v, struct uio *uio)
+{
+	struct pipe *p = v->vn_data;
+	size_t resid = uio->uio_resid, amt;
+	int result = 0;
+
+	if (v != &p->p_rv) {
+		return EBADF;
+	}
+	if (resid == 0) {
+		return 0;
+	}
+
+	lock_acquire(p->p_lock);
+
+	while (p->p_count == 0 && uio->uio_resid == resid && !p->p_wclosed) {
+		if (p->p_rwait == NULL) {
+			/* Let a writer hand data straight to us */
+			p->p_rwait = uio;
+			pipe_sleep(p, uio);
+			if (p->p_rwait == uio) {
+				p->p_rwait = NULL;
+			}
+			/* Someone else can wait for the handoff now */
+			pipe_wakeone(PIPE_READQ(p));
+		}
+		else {
+			pipe_sleep(p, PIPE_READQ(p));
+		}
+	}
+
+	/* Take what's in the ring, if we didn't get a handoff */
+	if (uio->uio_resid == resid && p->p_count > 0) {
+		amt = p->p_count < resid ? p->p_count : resid;
+		result = pipe_ringout(p, uio, amt);
+		pipe_wakeone(PIPE_WRITEQ(p));
+		if (p->p_count > 0) {
+			/* Leftovers for the next reader */
+			pipe_wakeone(PIPE_READQ(p));
+		}
+	}
+
+	lock_release(p->p_lock);
+
+	/* Like files, report an error only if nothing got read */
+	return uio->uio_resid < resid ? 0 : result;
+}
+
+static
+int
+pipe_write(struct vnode *v, struct uio *uio)
+{
+	struct pipe *p = v->vn_data;
+	struct uio *r;
+	size_t resid = uio->uio_resid, amt;
+	int result = 0;
+
+	if (v != &p->p_wv) {
+		return EBADF;
+	}
+
+	lock_acquire(p->p_lock);
+
+	while (uio->uio_resid > 0) {
+		if (p->p_rclosed) {
+			result = EPIPE;
+			break;
+		}
+
+		/* Direct handoff to a waiting reader */
+		r = p->p_rwait;
+		if (p->p_count == 0 && r != NULL && pipe_canhandoff(r)) {
+			p->p_rwait = NULL;
+			result = uiomove_uio(r, uio, r->uio_resid);
+			pipe_wakeall(r);
+			if (result == 0) {
+				continue;
+			}
+			/*
+			 * One of the two buffers is bad, and we can't
+			 * tell which. Put the rest through the ring:
+			 * if it's ours, pipe_ringin fails and we get
+			 * the error; if it's the reader's, the reader
+			 * gets it copying out of the ring, and the
+			 * data stays there for the next read.
+			 */
+		}
+
+		if (p->p_count == PIPE_SIZE) {
+			pipe_sleep(p, PIPE_WRITEQ(p));
+			continue;
+		}
+
+		amt = PIPE_SIZE - p->p_count;
+		if (amt > uio->uio_resid) {
+			amt = uio->uio_resid;
+		}
+		result = pipe_ringin(p, uio, amt);
+
+		/* Wake the reader waiting for a handoff, or else any one */
+		if (p->p_rwait != NULL) {
+			pipe_wakeall(p->p_rwait);
+		}
+		else {
+			pipe_wakeone(PIPE_READQ(p));
+		}
+		if (result) {
+			break;
+		}
+	}
+
+	/* Room left over is for the next writer */
+	if (p->p_count < PIPE_SIZE) {
+		pipe_wakeone(PIPE_WRITEQ(p));
+	}
+
+	lock_release(p->p_lock);
+
+	return uio->uio_resid < resid ? 0 : result;
+}
+
+static
+int
+pipe_stat(struct vnode *v, struct stat *statbuf)
+{
+	struct pipe *p = v->vn_data;
+
+	bzero(statbuf, sizeof(struct stat));
+	statbuf->st_mode = S_IFIFO;
+	statbuf->st_nlink = 1;
+	statbuf->st_size = p->p_count;
+	return 0;
+}
+
+static
+int
+pipe_gettype(struct vnode *v, u_int32_t *ret)
+{
+	(void)v;
+	*ret = S_IFIFO;
+	return 0;
+}
+
+static
+int
+pipe_ioctl(struct vnode *v, int op, userptr_t data)
+{
+	(void)v;
+	(void)op;
+	(void)data;
+	return EIOCTL;
+}
+
+static
+int
+pipe_fsync(struct vnode *v)
+{
+	(void)v;
+	return 0;
+}
+
+static
+int
+pipe_espipe(void)
+{
+	return ESPIPE;
+}
+
+static
+int
+pipe_notdir(void)
+{
+	return ENOTDIR;
+}
+
+static
+int
+pipe_inval(void)
+{
+	return EINVAL;
+}
+
+static
+int
+pipe_nodev(void)
+{
+	return ENODEV;
+}
+
+/* Casting through void * prevents warnings; see sfs_vnode.c. */
+#define ESPIPE_OP ((void *)pipe_espipe)
+#define NOTDIR ((void *)pipe_notdir)
+#define INVAL ((void *)pipe_inval)
+#define NODEV ((void *)pipe_nodev)
+
+/*
+ * Function table for both ends of a pipe.
+ */
+static const struct vnode_ops pipe_vnode_ops = {
+	VOP_MAGIC,	/* mark this a valid vnode ops table */
+
+	pipe_open,
+	pipe_close,
+	pipe_reclaim,
+
+	pipe_read,
+	INVAL,   /* readlink */
+	NOTDIR,  /* getdirentry */
+	NOTDIR,  /* getdirentries */
+	pipe_write,
+	pipe_ioctl,
+	pipe_stat,
+	pipe_gettype,
+	ESPIPE_OP, /* tryseek */
+	pipe_fsync,
+	NODEV,   /* mmap */
+	INVAL,   /* truncate */
+	INVAL,   /* namefile */
+
+	NOTDIR,  /* creat */
+	NOTDIR,  /* symlink */
+	NOTDIR,  /* mkdir */
+	NOTDIR,  /* link */
+	NOTDIR,  /* remove */
+	NOTDIR,  /* rmdir */
+	NOTDIR,  /* rename */
+
+	NOTDIR,  /* lookup */
+	NOTDIR,  /* lookparent */
+};
+
+/*
+ * Create a pipe. Both ends come back opened, as if by vfs_open.
+ */
+int
+pipe_create(struct vnode **readend, struct vnode **writeend)
+{
+	struct pipe *p;
+	int result;
+
+	p = kmalloc(sizeof(struct pipe));
+	if (p == NULL) {
+		return ENOMEM;
+	}
+	p->p_buf = kmalloc(PIPE_SIZE);
+	if (p->p_buf == NULL) {
+		kfree(p);
+		return ENOMEM;
+	}
+	p->p_lock = lock_create("pipe");
+	if (p->p_lock == NULL) {
+		kfree(p->p_buf);
+		kfree(p);
+		return ENOMEM;
+	}
+	p->p_head = 0;
+	p->p_count = 0;
+	p->p_rclosed = 0;
+	p->p_wclosed = 0;
+	p->p_ends = 2;
+	p->p_rwait = NULL;
+
+	result = VOP_INIT(&p->p_rv, &pipe_vnode_ops, NULL, p);
+	if (result) {
+		goto fail;
+	}
+	result = VOP_INIT(&p->p_wv, &pipe_vnode_ops, NULL, p);
+	if (result) {
+		VOP_KILL(&p->p_rv);
+		goto fail;
+	}
+
+	VOP_INCOPEN(&p->p_rv);
+	VOP_INCOPEN(&p->p_wv);
+	*readend = &p->p_rv;
+	*writeend = &p->p_wv;
+	return 0;
+
+ fail:
+	lock_destroy(p->p_lock);
+	kfree(p->p_buf);
+	kfree(p);
+	return result;
+}
@@ -6,6 +6,7 @@
 #include <lib.h>
 #include <synch.h>
 #include <vnode.h>
+#include <vm.h>
 
 /*
  * Initialize an abstract vnode.
@@ -27,6 +28,7 @@ vnode_init(struct vnode *vn, const struct vnode_ops *ops,
 	}
 	vn->vn_fs = fs;
 	vn->vn_data = fsdata;
+	vn->vn_vmobj = NULL;
 	return 0;
 }
 
@@ -41,6 +43,13 @@ vnode_kill(struct vnode *vn)
 	assert(vn->vn_opencount==0);
 	assert(vn->vn_countlock!=NULL);
 
+#if !OPT_DUMBVM
+	/* Drop any pages the VM system cached for us */
+	if (vn->vn_vmobj != NULL) {
+		vmobj_destroy(vn->vn_vmobj);
+	}
+#endif
+
 	lock_destroy(vn->vn_countlock);
 
 	vn->vn_ops = NULL;
@@ -49,6 +58,7 @@ vnode_kill(struct vnode *vn)
 	vn->vn_countlock = NULL;
 	vn->vn_fs = NULL;
 	vn->vn_data = NULL;
+	vn->vn_vmobj = NULL;
 }
 
 
@@ -5,6 +5,11 @@
 
 struct vnode;
 
+/* Two-level page table: 1024 PTEs per page table page */
+#define AS_PTSHIFT   22
+#define AS_PTPAGES   1024
+#define AS_NPTDIR    (USERTOP >> AS_PTSHIFT)
+
 /* 
  * Address space - data structure associated with the virtual memory
  * space of a process.
@@ -13,6 +18,8 @@ struct vnode;
  */
 
 struct addrspace {
+	u_int32_t as_asid;		/* TLB address space ID */
+	u_int32_t as_asidgen;		/* generation as_asid belongs to */
 #if OPT_DUMBVM
 	vaddr_t as_vbase1;
 	paddr_t as_pbase1;
@@ -22,10 +29,42 @@ struct addrspace {
 	size_t as_npages2;
 	paddr_t as_stackpbase;
 #else
-	/* Put stuff here for your VM system */
+	struct array *as_regions;	/* struct vm_region *'s */
+	u_int32_t *as_pt[AS_NPTDIR];	/* page table pages, or NULL */
+	struct vm_region *as_heap;	/* sbrk region (in as_regions), or NULL */
 #endif
 };
 
+#if !OPT_DUMBVM
+/*
+ * A region of an address space. Pages in [vr_start, vr_end) are
+ * created on first touch: those holding bytes from [vr_fstart,
+ * vr_fend) are read from vr_vnode starting at vr_foffset, everything
+ * else is zero-filled.
+ *
+ * If vr_shared is set, the region is file-aligned, and pages that hold
+ * only file data come from the vnode's page cache and are shared with
+ * every other address space mapping the same file. Such a region is
+ * read-only unless it was made by mmap: then writes go to the shared
+ * page if vr_mmap is MAP_SHARED, and to a private copy of it if
+ * vr_mmap is MAP_PRIVATE.
+ */
+struct vm_region {
+	vaddr_t vr_start;		/* first page */
+	vaddr_t vr_end;			/* end of last page */
+	int vr_prot;			/* VM_PROT_* */
+	struct vnode *vr_vnode;		/* backing file (referenced), or NULL */
+	off_t vr_foffset;		/* file offset of vr_fstart */
+	vaddr_t vr_fstart;		/* first byte that comes from the file */
+	vaddr_t vr_fend;		/* end of bytes that come from the file */
+	vaddr_t vr_mend;		/* end of the segment proper */
+	int vr_shared;			/* use the vnode page cache */
+	int vr_mmap;			/* MAP_SHARED/MAP_PRIVATE, or 0 */
+	paddr_t vr_page;		/* the one page backing the region
+					   (the time page), or 0 */
+};
+#endif
+
 /*
  * Functions in addrspace.c:
  *
@@ -58,6 +97,21 @@ struct addrspace {
  *    as_define_stack - set up the stack region in the address space.
  *                (Normally called *after* as_complete_load().) Hands
  *                back the initial stack pointer for the new process.
+ *                Also maps the time page.
+ *
+ *    as_sbrk   - move the end of the heap ("break") by AMOUNT bytes,
+ *                which may be negative. Hands back the old break.
+ *
+ *    as_mmap   - map LEN bytes of vnode V starting at OFFSET. Picks
+ *                the address and hands it back.
+ *
+ *    as_munmap - remove the mappings in [ADDR, ADDR+LEN), writing
+ *                back changes to shared ones.
+ *
+ *    as_msync  - write back changes to shared mappings in
+ *                [ADDR, ADDR+LEN).
+ *
+ *    as_fsyncvnode - same for every shared mapping of vnode V.
  */
 
 struct addrspace *as_create(void);
@@ -73,6 +127,32 @@ int               as_define_region(struct addrspace *as,
 int		  as_prepare_load(struct addrspace *as);
 int		  as_complete_load(struct addrspace *as);
 int               as_define_stack(struct addrspace *as, vaddr_t *initstackptr);
+int               as_sbrk(struct addrspace *as, int amount, vaddr_t *oldbreak);
+int               as_mmap(struct addrspace *as, size_t len, int prot,
+			  int flags, struct vnode *v, off_t offset,
+			  vaddr_t *ret);
+int               as_munmap(struct addrspace *as, vaddr_t addr, size_t len);
+int               as_msync(struct addrspace *as, vaddr_t addr, size_t len);
+int               as_fsyncvnode(struct addrspace *as, struct vnode *v);
+
+#if !OPT_DUMBVM
+/*
+ * Additional functions in addrspace.c:
+ *
+ *    as_define_file - like as_define_region, but the first FILESZ bytes
+ *                at VADDR come from vnode V at offset OFFSET. Nothing
+ *                is read now; pages are filled in by as_fault.
+ *
+ *    as_fault  - resolve a fault at page VADDR. On success returns the
+ *                page table entry to load into the TLB.
+ */
+int               as_define_file(struct addrspace *as, vaddr_t vaddr,
+				 size_t memsz, struct vnode *v, off_t offset,
+				 size_t filesz, int readable, int writeable,
+				 int executable);
+int               as_fault(struct addrspace *as, int faulttype,
+			   vaddr_t vaddr, u_int32_t *ret);
+#endif
 
 /*
  * Functions in loadelf.c
@@ -20,6 +20,7 @@
 #define HZ  100
 #endif
 
+void hardclock_bootstrap(void);
 void hardclock(void);
 
 void gettime(time_t *seconds, u_int32_t *nanoseconds);
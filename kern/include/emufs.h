@@ -7,6 +7,15 @@
 #include <vnode.h>
 #include <fs.h>
 
+/*
+ * Name cache size. Each entry holds a reference on its vnode, and so
+ * also keeps a host-level handle open. Entries are trusted for at
+ * most EMUFS_NCTTL seconds.
+ */
+#define EMUFS_NCACHE	16		/* number of cached lookups */
+#define EMUFS_NAMELEN	64		/* longest cached name, incl. NUL */
+#define EMUFS_NCTTL	2		/* seconds an entry stays valid */
+
 /*
  * Our structures
  */
@@ -15,6 +24,16 @@ struct emufs_vnode {
 	struct vnode ev_v;		/* abstract vnode structure */
 	struct emu_softc *ev_emu;	/* device */
 	u_int32_t ev_handle;		/* file handle */
+	off_t ev_size;			/* cached file size */
+	int ev_sizevalid;		/* nonzero if ev_size is current */
+};
+
+struct emufs_name {
+	struct emufs_vnode *en_dir;	/* directory looked up in */
+	struct emufs_vnode *en_vn;	/* result (referenced) */
+	u_int32_t en_stamp;		/* last use, for LRU replacement */
+	time_t en_time;			/* when entered, for EMUFS_NCTTL */
+	char en_name[EMUFS_NAMELEN];	/* name looked up */
 };
 
 struct emufs_fs {
@@ -22,6 +41,16 @@ struct emufs_fs {
 	struct emu_softc *ef_emu;	/* device */
 	struct emufs_vnode *ef_root;	/* root vnode */
 	struct array *ef_vnodes;	/* table of loaded vnodes */
+
+	/* Lookup cache; protected by the device's e_lock */
+	struct emufs_name ef_names[EMUFS_NCACHE];
+	u_int32_t ef_namestamp;		/* LRU clock for ef_names */
+
+	/* Read buffer for small reads; also protected by e_lock */
+	char *ef_rabuf;			/* EMU_MAXIO bytes */
+	struct emufs_vnode *ef_raowner;	/* vnode whose data is in ef_rabuf */
+	off_t ef_rastart;		/* file offset of ef_rabuf[0] */
+	u_int32_t ef_ralen;		/* valid bytes in ef_rabuf */
 };
 
 #endif /* _EMUFS_H_ */
@@ -0,0 +1,50 @@
+#ifndef _FILE_H_
+#define _FILE_H_
+
+/*
+ * Open files and the per-thread file table.
+ */
+
+#include <kern/limits.h>
+
+struct vnode;
+
+/*
+ * An open file: the vnode, the open mode, and the seek position.
+ */
+struct openfile {
+	struct vnode *of_vnode;
+	int of_flags;			/* flags passed to open */
+	off_t of_offset;		/* current position */
+};
+
+/*
+ * The file table, hung off t_filetable. Descriptors 0-2 are the
+ * console (see sys_read and sys_write) and are never in the table.
+ */
+struct filetable {
+	struct openfile *ft_files[OPEN_MAX];
+};
+
+/* First descriptor handed out by open */
+#define FILE_FIRSTFD  3
+
+/*
+ * Functions in file.c:
+ *
+ *    filetable_destroy - close everything and free the table. Called
+ *                        by thread_exit.
+ *
+ *    file_get  - look up descriptor FD of the current thread. Fails
+ *                with EBADF if it isn't open.
+ *
+ *    file_read, file_write - read or write an open file at its
+ *                position, from or to user buffer BUF. Return the
+ *                byte count in RETVAL.
+ */
+void filetable_destroy(struct filetable *ft);
+int  file_get(int fd, struct openfile **ret);
+int  file_read(int fd, userptr_t buf, size_t len, int32_t *retval);
+int  file_write(int fd, const_userptr_t buf, size_t len, int32_t *retval);
+
+#endif /* _FILE_H_ */
@@ -41,6 +41,17 @@
 #define SYS_stat         30
 #define SYS_lstat        31
 #define SYS_sleep        32
+#define SYS_mmap         33
+#define SYS_munmap       34
+#define SYS_msync        35
+#define SYS_readv        36
+#define SYS_writev       37
+#define SYS_fcopy        38
+#define SYS_getdirentries 39
+#define SYS_setpriority  40
+#define SYS_dmesg        41
+#define SYS_getrusage    42
+#define SYS_threadinfo   43
 /*CALLEND*/
 
 
@@ -0,0 +1,32 @@
+#ifndef _KERN_DIRENT_H_
+#define _KERN_DIRENT_H_
+
+/*
+ * Directory entry records returned by getdirentries.
+ *
+ * Records are packed one after another in the caller's buffer. Each
+ * is d_reclen bytes long, always a multiple of 4, and only as long as
+ * its name needs: d_name is declared at its largest size, but only
+ * d_namlen bytes plus a null terminator are actually there.
+ */
+
+struct dirent {
+	u_int32_t d_ino;		/* inode number, or 0 if unknown */
+	u_int16_t d_reclen;		/* length of this record */
+	u_int8_t  d_type;		/* DT_* */
+	u_int8_t  d_namlen;		/* length of d_name, not counting NUL */
+	char      d_name[255+1];	/* NAME_MAX + 1 */
+};
+
+/* Values for d_type */
+#define DT_UNKNOWN  0		/* filesystem doesn't say */
+#define DT_REG      1		/* regular file */
+#define DT_DIR      2		/* directory */
+#define DT_LNK      3		/* symbolic link */
+#define DT_CHR      4		/* character device */
+#define DT_BLK      5		/* block device */
+
+/* Record length for a name of length NAMLEN */
+#define DIRENT_RECLEN(namlen)  ((8 + (namlen) + 1 + 3) & ~3)
+
+#endif /* _KERN_DIRENT_H_ */
@@ -38,6 +38,7 @@ const char *const sys_errlist[] = {
 	"Argument list too long",     /* E2BIG */
 	"Bad file number",            /* EBADF */
 	"Deadlock would occur",       /* EDEADLK */
+	"Broken pipe",                /* EPIPE */
 };
 
 /*
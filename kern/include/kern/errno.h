@@ -37,5 +37,6 @@
 #define E2BIG        25     /* Argument list too long */
 #define EBADF        26     /* Bad file number */
 #define EDEADLK      27     /* Deadlock would occur */
+#define EPIPE        28     /* Broken pipe */
 
 #endif /* _KERN_ERRNO_H_ */
@@ -7,5 +7,11 @@
 /* Longest full path name */
 #define PATH_MAX   1024
 
+/* Most files a process can have open at once (including the console) */
+#define OPEN_MAX   32
+
+/* Most buffers in one readv or writev */
+#define IOV_MAX    16
+
 
 #endif /* _KERN_LIMITS_H_ */
@@ -0,0 +1,22 @@
+#ifndef _KERN_MMAN_H_
+#define _KERN_MMAN_H_
+
+/*
+ * Constants for mmap, munmap and msync.
+ */
+
+/* Protection for mmap: PROT_NONE, or any of the others or'd together */
+#define PROT_NONE     0      /* (not supported) */
+#define PROT_READ     1      /* Pages may be read */
+#define PROT_WRITE    2      /* Pages may be written */
+#define PROT_EXEC     4      /* Pages may be executed */
+
+/* Flags for mmap: exactly one of these */
+#define MAP_SHARED    1      /* Writes go to the file */
+#define MAP_PRIVATE   2      /* Writes go to a private copy */
+
+/* Flags for msync */
+#define MS_ASYNC      1      /* (treated like MS_SYNC) */
+#define MS_SYNC       2      /* Write back before returning */
+
+#endif /* _KERN_MMAN_H_ */
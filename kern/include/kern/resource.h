@@ -0,0 +1,49 @@
+#ifndef _KERN_RESOURCE_H_
+#define _KERN_RESOURCE_H_
+
+/*
+ * Resource usage, for getrusage() and threadinfo().
+ *
+ * Times are charged at context switches and at every trap to and from
+ * user mode, from the real-time clock. Processes have one thread
+ * each, so a process's usage is its thread's.
+ */
+struct rusage {
+	time_t    ru_utime_sec;    /* time spent in user mode */
+	u_int32_t ru_utime_nsec;
+	time_t    ru_stime_sec;    /* time spent in the kernel */
+	u_int32_t ru_stime_nsec;
+	u_int32_t ru_minflt;       /* page faults handled without I/O,
+				      counting TLB refills */
+	u_int32_t ru_majflt;       /* page faults that read a file */
+	u_int32_t ru_nvcsw;        /* switches away by sleeping/yielding */
+	u_int32_t ru_nivcsw;       /* switches away by being preempted */
+};
+
+/* Codes for getrusage() */
+#define RUSAGE_SELF      0
+
+/* Thread states in struct threadinfo */
+#define TI_RUN     'O'     /* on the processor (the caller) */
+#define TI_READY   'R'     /* runnable, waiting for the processor */
+#define TI_SLEEP   'S'     /* sleeping */
+#define TI_ZOMB    'Z'     /* exited, waiting to be joined */
+
+/* Longer thread names are truncated */
+#define TI_NAMELEN  32
+
+/*
+ * One thread, as reported by threadinfo(). ti_id is unique for the
+ * life of the system; ti_user is set for user processes (threads
+ * with an address space).
+ */
+struct threadinfo {
+	u_int32_t ti_id;
+	char      ti_name[TI_NAMELEN];
+	char      ti_state;
+	char      ti_user;
+	short     ti_pri;          /* effective priority */
+	struct rusage ti_ru;
+};
+
+#endif /* _KERN_RESOURCE_H_ */
@@ -2,15 +2,21 @@
 #define _KERN_SFS_H_
 
 #define SFS_MAGIC         0xabadf001    /* magic number identifying us */
+#define SFS_VERSION       2             /* current on-disk format version */
 #define SFS_BLOCKSIZE     512           /* size of our blocks */
 #define SFS_VOLNAME_SIZE  32            /* max length of volume name */
 #define SFS_NDIRECT       15            /* # of direct blocks in inode */
 #define SFS_DBPERIDB      128           /* # direct blks per indirect blk */
+#define SFS_DBPERDIDB     (SFS_DBPERIDB*SFS_DBPERIDB)  /* ...per dbl indir */
+#define SFS_DBPERTIDB     (SFS_DBPERDIDB*SFS_DBPERIDB) /* ...per tpl indir */
 #define SFS_NAMELEN       60            /* max length of filename */
 #define SFS_SB_LOCATION    0            /* block the superblock lives in */
 #define SFS_ROOT_LOCATION  1            /* loc'n of the root dir inode */
 #define SFS_MAP_LOCATION   2            /* 1st block of the freemap */
 #define SFS_NOINO          0            /* inode # for free dir entry */
+#define SFS_JDEFBLOCKS    64            /* default journal size (mksfs) */
+#define SFS_JMAGIC        0x4a524e4c    /* journal transaction header */
+#define SFS_JCOMMITMAGIC  0x434d4954    /* journal commit block */
 
 /* Number of bits in a block */
 #define SFS_BLOCKBITS (SFS_BLOCKSIZE * CHAR_BIT)
@@ -24,6 +30,19 @@
 /* Size of bitmap (in blocks) */
 #define SFS_BITBLOCKS(nblocks)  (SFS_BITMAPSIZE(nblocks)/SFS_BLOCKBITS)
 
+/*
+ * On-disk format versions (sp_version).
+ *
+ * Version 0 volumes predate the version field; their inodes only
+ * have the single indirect block. They still mount, but files on
+ * them can't grow past SFS_NDIRECT+SFS_DBPERIDB blocks. Version 1
+ * adds the double and triple indirect blocks. Version 2 adds the
+ * metadata journal (which is still optional: sp_jblocks may be 0).
+ */
+#define SFS_VERSION_LEGACY   0
+#define SFS_VERSION_BIGFILE  1
+#define SFS_VERSION_JOURNAL  2
+
 /* File types for dfi_type */
 #define SFS_TYPE_INVAL    0       /* Should not appear on disk */
 #define SFS_TYPE_FILE     1
@@ -36,7 +55,10 @@ struct sfs_super {
 	u_int32_t sp_magic;       /* Magic number, should be SFS_MAGIC */
 	u_int32_t sp_nblocks;     /* Number of blocks in fs */
 	char sp_volname[SFS_VOLNAME_SIZE];  /* Name of this volume */
-	u_int32_t reserved[118];
+	u_int32_t sp_version;     /* On-disk format, SFS_VERSION_* */
+	u_int32_t sp_jstart;      /* First block of the journal */
+	u_int32_t sp_jblocks;     /* Size of the journal (0 = none) */
+	u_int32_t reserved[115];
 };
 
 /*
@@ -48,7 +70,37 @@ struct sfs_inode {
 	u_int16_t sfi_linkcount;   /* Number of hard links to this file */
 	u_int32_t sfi_direct[SFS_NDIRECT];	/* Direct blocks */
 	u_int32_t sfi_indirect;			/* Indirect block */
-	u_int32_t sfi_waste[128-3-SFS_NDIRECT]; /* unused space */
+	u_int32_t sfi_dindirect;		/* Double indirect block */
+	u_int32_t sfi_tindirect;		/* Triple indirect block */
+	u_int32_t sfi_waste[128-5-SFS_NDIRECT]; /* unused space */
+};
+
+/*
+ * On-disk journal.
+ *
+ * The journal holds at most one transaction: a header block, then
+ * jh_nblocks metadata block images, then a commit block, written
+ * together starting at sp_jstart. The images are then written to
+ * their home locations and the header is zeroed. If the system goes
+ * down in between, mount finds a header with a matching commit block
+ * and writes the images home again; without the commit block the
+ * transaction never happened.
+ */
+#define SFS_JMAXHOME  ((SFS_BLOCKSIZE/sizeof(u_int32_t)) - 3)
+
+struct sfs_jheader {
+	u_int32_t jh_magic;             /* SFS_JMAGIC */
+	u_int32_t jh_seq;               /* transaction sequence number */
+	u_int32_t jh_nblocks;           /* number of block images */
+	u_int32_t jh_home[SFS_JMAXHOME]; /* where each image belongs */
+};
+
+struct sfs_jcommit {
+	u_int32_t jc_magic;             /* SFS_JCOMMITMAGIC */
+	u_int32_t jc_seq;               /* same as jh_seq */
+	u_int32_t jc_nblocks;           /* same as jh_nblocks */
+	u_int32_t jc_sum;               /* sum of all words of the images */
+	u_int32_t jc_waste[128-4];      /* unused space */
 };
 
 /*
@@ -0,0 +1,24 @@
+#ifndef _KERN_TIMEPAGE_H_
+#define _KERN_TIMEPAGE_H_
+
+/*
+ * The time page: one read-only page, mapped at TIMEPAGE in every user
+ * address space, that the kernel rewrites with the time of day on
+ * every clock tick. Reading it doesn't trap, so it's much cheaper
+ * than __time, but it's only as fine-grained as the clock tick.
+ *
+ * tp_seq is odd while the kernel is updating the page and is bumped
+ * again when it's done. To read, fetch tp_seq, then the time, then
+ * tp_seq again, and start over if it was odd or changed. It's zero
+ * until the first tick.
+ */
+struct timepage {
+	volatile u_int32_t tp_seq;
+	volatile time_t    tp_secs;
+	volatile u_int32_t tp_nsecs;
+};
+
+/* Where it's mapped: below the stack, with a gap */
+#define TIMEPAGE  0x7fe00000
+
+#endif /* _KERN_TIMEPAGE_H_ */
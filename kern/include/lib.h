@@ -137,15 +137,27 @@ void beep(void);
  * resets the system.
  * kgets is like gets, only with a buffer size argument.
  *
- * kprintf_init sets up a lock for kprintf and should be called during boot
- * once malloc is available and before any additional threads are created.
+ * kprintf_bootstrap sets up a lock for kprintf and starts the thread
+ * that writes kprintf's log buffer to the console; it should be called
+ * during boot once malloc is available and before any additional
+ * threads are created. Before then, and after kprintf_sync (called at
+ * shutdown and panic), kprintf writes to the console synchronously.
+ *
+ * kprintf_getlog copies the most recent LEN bytes of the log into BUF
+ * and returns the number copied; kprintf_printlog prints the log on
+ * the console, like dmesg.
  */
 int kprintf(const char *fmt, ...) __PF(1,2);
 void panic(const char *fmt, ...) __PF(1,2);
 
 void kgets(char *buf, size_t maxbuflen);
 
+#define KPRINTF_LOGSIZE  16384	/* size of the log buffer; power of 2 */
+
 void kprintf_bootstrap(void);
+void kprintf_sync(void);
+size_t kprintf_getlog(char *buf, size_t len);
+void kprintf_printlog(void);
 
 /*
  * Byte swap functions for the kernel.
@@ -176,6 +188,9 @@ u_int64_t htonll(u_int64_t);
  * returns the actual length of string found in GOT. DEST is always
  * null-terminated on success. LEN and GOT include the null terminator.
  *
+ * copyuser copies LEN bytes from one user-space address to another,
+ * both in the current address space.
+ *
  * All of these functions return 0 on success, EFAULT if a memory
  * addressing error was encountered, or (for the string versions)
  * ENAMETOOLONG if the space available was insufficient.
@@ -190,6 +205,7 @@ int copyin(const_userptr_t usersrc, void *dest, size_t len);
 int copyout(const void *src, userptr_t userdest, size_t len);
 int copyinstr(const_userptr_t usersrc, char *dest, size_t len, size_t *got);
 int copyoutstr(const char *src, userptr_t userdest, size_t len, size_t *got);
+int copyuser(const_userptr_t usersrc, userptr_t userdest, size_t len);
 
 /*
  * Simple timing hooks.
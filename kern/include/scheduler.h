@@ -8,6 +8,10 @@
  *     make_runnable - add the specified thread to the run queue. If it's
  *                     already on the run queue or sleeping, weird things
  *                     may happen. Returns an error code.
+ *     scheduler_reprioritize - move a runnable thread whose priority
+ *                     has changed to the right run queue. 
+ *     scheduler_toppri - highest priority of any runnable thread, or
+ *                     -1 if there are none.
  *
  *     print_run_queue - dump the run queue to the console for debugging.
  *
@@ -22,6 +26,8 @@ struct thread;
 
 struct thread *scheduler(void);
 int make_runnable(struct thread *t);
+void scheduler_reprioritize(struct thread *t);
+int scheduler_toppri(void);
 
 void print_run_queue(void);
 
@@ -13,11 +13,22 @@
  */
 #include <kern/sfs.h>
 
+/*
+ * Read-ahead window limits, in blocks. A vnode being read
+ * sequentially starts with a window of SFS_RAMIN and doubles it on
+ * each refill, up to SFS_RAMAX (which is also the size of the
+ * per-filesystem read-ahead buffer).
+ */
+#define SFS_RAMIN  4
+#define SFS_RAMAX  16
+
 struct sfs_vnode {
 	struct vnode sv_v;              /* abstract vnode structure */
 	struct sfs_inode sv_i;		/* on-disk inode */
 	u_int32_t sv_ino;               /* inode number */
 	int sv_dirty;                   /* true if sv_i modified */
+	u_int32_t sv_ranext;            /* next block if reading sequentially */
+	u_int32_t sv_rawindow;          /* read-ahead window (0 = random) */
 };
 
 struct sfs_fs {
@@ -28,6 +39,29 @@ struct sfs_fs {
 	struct array *sfs_vnodes;       /* vnodes loaded into memory */
 	struct bitmap *sfs_freemap;     /* blocks in use are marked 1 */
 	int sfs_freemapdirty;           /* true if freemap modified */
+	struct bitmap *sfs_mapblkdirty; /* which freemap blocks are modified */
+
+	/* Read-ahead buffer, shared by the vnodes on this fs */
+	char *sfs_rabuf;                /* SFS_RAMAX blocks of file data */
+	struct sfs_vnode *sfs_raowner;  /* vnode whose data is in sfs_rabuf */
+	u_int32_t sfs_rastart;          /* first file block in sfs_rabuf */
+	u_int32_t sfs_racount;          /* number of valid blocks */
+	u_int32_t sfs_rausers;          /* threads using sfs_rabuf */
+
+	/* Indirect blocks last walked by sfs_bmap, one per level */
+	u_int32_t sfs_idbuf[3][SFS_DBPERIDB];
+	u_int32_t sfs_idblock[3];       /* block in each sfs_idbuf, or 0 */
+
+	/* Metadata journal (sfs_journal.c); sfs_jbuf is NULL if none */
+	char *sfs_jbuf;                 /* header, images, commit block */
+	u_int32_t sfs_jmax;             /* max images per transaction */
+	u_int32_t sfs_jnblocks;         /* images in running transaction */
+	u_int32_t sfs_jseq;             /* sequence number of next commit */
+	struct bitmap *sfs_jfreed;      /* blocks to free at next commit */
+	u_int32_t sfs_jnfreed;          /* number of bits set in sfs_jfreed */
+	u_int32_t sfs_jreserved;        /* most images the next commit holds */
+	u_int32_t sfs_jopres;           /* reserved by the operation running */
+	int sfs_jdepth;                 /* nesting of sfs_jbegin */
 };
 
 /*
@@ -52,4 +86,37 @@ int sfs_wblock(struct sfs_fs *sfs, void *data, u_int32_t block);
 /* Get root vnode */
 struct vnode *sfs_getroot(struct fs *fs);
 
+/* Write an in-memory inode out (to the journal, if there is one) */
+int sfs_sync_inode(struct sfs_vnode *sv);
+
+/* Note that the freemap bit for BLOCK has changed */
+void sfs_mapdirty(struct sfs_fs *sfs, u_int32_t block);
+
+/*
+ * Most images one journal operation (see sfs_jbegin) can add to a
+ * transaction, freemap blocks and the superblock aside. Writing one
+ * file block touches the inode, up to three indirect blocks, and the
+ * block itself if it belongs to a directory. Namespace operations and
+ * truncates touch a directory block or two, the indirect blocks of a
+ * growing directory, and a couple of inodes, or the indirect blocks
+ * along the cut; SFS_JOPIMAGES is a generous bound on those.
+ */
+#define SFS_JBLOCKIMAGES  5
+#define SFS_JOPIMAGES     12
+
+/* Metadata journal */
+int sfs_jmount(struct sfs_fs *sfs);
+void sfs_junmount(struct sfs_fs *sfs);
+void *sfs_jfind(struct sfs_fs *sfs, u_int32_t block);
+int sfs_jrblock(struct sfs_fs *sfs, void *data, u_int32_t block);
+int sfs_jwblock(struct sfs_fs *sfs, const void *data, u_int32_t block);
+void sfs_jfree(struct sfs_fs *sfs, u_int32_t block);
+int sfs_jcommit(struct sfs_fs *sfs);
+int sfs_jbegin(struct sfs_fs *sfs, u_int32_t nimages);
+void sfs_jend(struct sfs_fs *sfs);
+
+/* Print read-ahead and journal statistics */
+void sfs_printstats(void);
+void sfs_jprintstats(void);
+
 #endif /* _SFS_H_ */
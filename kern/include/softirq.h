@@ -0,0 +1,69 @@
+#ifndef _SOFTIRQ_H_
+#define _SOFTIRQ_H_
+
+/*
+ * Deferred interrupt work ("soft interrupts").
+ *
+ * A device's interrupt handler should only acknowledge the device and
+ * save whatever it has to read off it; the rest - waking up threads,
+ * handing input to the console, and so on - goes in a work function
+ * that the handler schedules with softirq_raise. Pending work runs
+ * with interrupts on, on the way out of the interrupt; what's left
+ * over after SOFTIRQ_BATCH items is finished by the softirqd thread.
+ * When the processor is idle the scheduler runs pending work itself.
+ *
+ * Work functions run in interrupt context as far as everything else
+ * is concerned (in_interrupt is set): they may not sleep.
+ *
+ * Raising a source that's already pending doesn't queue it twice; the
+ * work function runs once and should handle everything that came in.
+ *
+ * Functions:
+ *     softirq_init      - set up a source. Call before its device can
+ *                         interrupt.
+ *     softirq_raise     - schedule a source's work. Interrupts must be
+ *                         off.
+ *     softirq_irqexit   - run pending work on return from an interrupt
+ *                         that came in with interrupts on.
+ *     softirq_idle      - run pending work from the idle loop. Returns
+ *                         nonzero if it did anything.
+ *     softirq_yield     - have the interrupted thread yield once the
+ *                         pending work has run.
+ *     softirq_bootstrap - start softirqd.
+ *     softirq_printstats - print per-source counts and latencies.
+ */
+
+/* Items run on return from interrupt before handing off to softirqd */
+#define SOFTIRQ_BATCH  8
+
+struct softirq {
+	char si_name[16];
+	void (*si_func)(void *data);
+	void *si_data;
+
+	/* Synchronized with spl */
+	int si_pending;			/* on the pending queue */
+	time_t si_raisesecs;		/* when it was raised */
+	u_int32_t si_raisensecs;
+	struct softirq *si_next;	/* next pending source */
+
+	struct softirq *si_allnext;	/* next registered source */
+
+	/* Stats */
+	u_int32_t si_irqs;		/* times raised */
+	u_int32_t si_runs;		/* times the work function ran */
+	u_int32_t si_nlat;		/* runs whose latency was measured */
+	u_int32_t si_totlat;		/* total raise-to-run latency (us) */
+	u_int32_t si_maxlat;		/* worst raise-to-run latency (us) */
+};
+
+void softirq_init(struct softirq *si, const char *name,
+		  void (*func)(void *data), void *data);
+void softirq_raise(struct softirq *si);
+void softirq_irqexit(void);
+int softirq_idle(void);
+void softirq_yield(void);
+void softirq_bootstrap(void);
+void softirq_printstats(void);
+
+#endif /* _SOFTIRQ_H_ */
@@ -54,6 +54,11 @@ struct lock {
 
 	char * owner;
 	volatile u_int32_t thread_id;
+
+	// For priority inheritance: the thread holding the lock, and
+	// the next lock in that thread's t_heldlocks list
+	struct thread *holder;
+	struct lock *nextheld;
 	
 	// add what you need here
 	// (don't forget to mark things volatile as needed)
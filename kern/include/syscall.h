@@ -22,4 +22,31 @@ time_t sys___time(time_t *seconds, unsigned long *nanoseconds, int32_t* retval);
 // Adding the sleep() code
 unsigned int sys_sleep(unsigned int seconds);
 
+// Adding the sbrk() code; returns the old break in retval
+int sys_sbrk(int amount, int32_t* retval);
+
+// Sets the calling thread's priority; returns the old one in retval
+int sys_setpriority(int pri, int32_t* retval);
+int sys_dmesg(userptr_t buf, size_t len, int32_t *retval);
+int sys_getrusage(int who, userptr_t usage);
+int sys_threadinfo(userptr_t buf, size_t nbuf, int32_t *retval);
+
+/*
+ * File descriptor calls, in userprog/file.c. Descriptors 0-2 are the
+ * console; sys_read and sys_write hand anything else to file.c.
+ */
+int sys_open(const_userptr_t path, int flags, int32_t *retval);
+int sys_pipe(userptr_t fds);
+int sys_close(int fd);
+int sys_fsync(int fd);
+int sys_mmap(userptr_t addr, size_t len, int prot, int flags, int fd,
+	     off_t offset, int32_t *retval);
+int sys_munmap(userptr_t addr, size_t len);
+int sys_msync(userptr_t addr, size_t len, int flags);
+int sys_readv(int fd, const_userptr_t iov, int iovcnt, int32_t *retval);
+int sys_writev(int fd, const_userptr_t iov, int iovcnt, int32_t *retval);
+int sys_fcopy(int fromfd, int tofd, size_t len, int32_t *retval);
+int sys_fstat(int fd, userptr_t statbuf);
+int sys_getdirentries(int fd, userptr_t buf, size_t buflen, int32_t *retval);
+
 #endif /* _SYSCALL_H_ */
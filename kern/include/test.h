@@ -24,9 +24,11 @@ int queuetest(int, char **);
 int threadtest(int, char **);
 int threadtest2(int, char **);
 int threadtest3(int, char **);
+int threadtest4(int, char **);
 int semtest(int, char **);
 int locktest(int, char **);
 int cvtest(int, char **);
+int invtest(int, char **);
 
 /* filesystem tests */
 int fstest(int, char **);
@@ -34,6 +36,7 @@ int readstress(int, char **);
 int writestress(int, char **);
 int writestress2(int, char **);
 int createstress(int, char **);
+int pipetest(int, char **);
 int printfile(int, char **);
 
 /* other tests */
@@ -41,6 +44,10 @@ int malloctest(int, char **);
 int mallocstress(int, char **);
 int nettest(int, char **);
 
+/* benchmarks */
+int kbench(int, char **);
+int kbenchfs(int, char **);
+
 /* Kernel menu system */
 void menu(char *argstr);
 
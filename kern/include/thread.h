@@ -8,8 +8,21 @@
 /* Get machine-dependent stuff */
 #include <machine/pcb.h>
 
+#include <kern/resource.h>
+
 
 struct addrspace;
+struct filetable;
+struct lock;
+
+/* Longer thread names are truncated, here and in threadinfo() */
+#define THREAD_NAMELEN  TI_NAMELEN
+
+/* Priorities. Higher numbers run first. */
+#define THREAD_PRI_MIN      0
+#define THREAD_PRI_DEFAULT  3
+#define THREAD_PRI_MAX      7
+#define THREAD_NPRI         (THREAD_PRI_MAX+1)
 
 struct thread {
 	/**********************************************************/
@@ -17,9 +30,31 @@ struct thread {
 	/**********************************************************/
 	
 	struct pcb t_pcb;
-	char *t_name;
+	char t_name[THREAD_NAMELEN];
 	const void *t_sleepaddr;
 	char *t_stack;
+
+	int t_joinable;			/* kept after exit until joined */
+	int t_exited;			/* has been through thread_exit */
+	int t_njoiners;			/* threads waiting in thread_join */
+	struct thread *t_joining;	/* thread we're waiting for, if any */
+
+	int t_basepri;			/* priority, as set */
+	int t_pri;			/* effective priority: t_basepri, or
+					   higher if inherited through a lock */
+	int t_rqpri;			/* run queue we're on, or -1 */
+	struct thread *t_rqnext;	/* run queue links (scheduler.c) */
+	struct thread *t_rqprev;
+	struct lock *t_waitlock;	/* lock we're blocked on, if any */
+	struct lock *t_heldlocks;	/* locks we hold, through nextheld */
+
+	u_int32_t t_id;			/* unique id, for threadinfo */
+	struct thread *t_allnext;	/* list of all threads */
+	struct thread *t_allprev;
+	int t_preempted;		/* switching out involuntarily */
+	struct rusage t_ru;		/* resource usage */
+	time_t t_marksecs;		/* when t_ru's times were last */
+	u_int32_t t_marknsecs;		/*   brought up to date */
 	
 	/**********************************************************/
 	/* Public thread members - can be used by other code      */
@@ -37,11 +72,20 @@ struct thread {
 	 * and is manipulated by the virtual filesystem (VFS) code.
 	 */
 	struct vnode *t_cwd;
+
+	/*
+	 * Open files (see file.h); NULL until the thread first opens
+	 * one. Not inherited by thread_fork.
+	 */
+	struct filetable *t_filetable;
 };
 
 /* Call once during startup to allocate data structures. */
 struct thread *thread_bootstrap(void);
 
+/* Print thread structure cache statistics. */
+void thread_printstats(void);
+
 /* Call during panic to stop other threads in their tracks */
 void thread_panic(void);
 
@@ -56,10 +100,10 @@ int thread_count(void);
  * "data" arguments (one pointer, one integer) are passed to the
  * function.  The current thread is used as a prototype for creating
  * the new one. If "ret" is non-null, the thread structure for the new
- * thread is handed back. (Note that using said thread structure from
- * the parent thread should be done only with caution, because in
- * general the child thread might exit at any time.) Returns an error
- * code.
+ * thread is handed back, and the thread is joinable: when it exits,
+ * its structure is kept until it's joined or detached, so the pointer
+ * stays valid until then. Otherwise the thread is detached from the
+ * start. Returns an error code.
  */
 int thread_fork(const char *name, 
 		void *data1, unsigned long data2, 
@@ -68,10 +112,22 @@ int thread_fork(const char *name,
 
 /*
  * Suspend execution of the calling thread until the target thread 
- * terminates, unless the target thread has already terminated.
+ * terminates, unless the target thread has already terminated. The
+ * target must be joinable. Several threads may join the same target;
+ * it's disposed of when the last of them returns, after which the
+ * pointer must not be used again. Returns EDEADLK if the target is
+ * the caller or is itself (perhaps indirectly) waiting to join the
+ * caller, and EINVAL if the target isn't joinable.
  */
 int thread_join(struct thread * thread);
 
+/*
+ * Give up the right to join a joinable thread; it's disposed of as
+ * soon as it exits, or now if it already has. Fails with EINVAL if
+ * the thread isn't joinable or someone is already joining it.
+ */
+int thread_detach(struct thread *thread);
+
 /*
  * Cause the current thread to exit.
  * Interrupts need not be disabled.
@@ -108,6 +164,56 @@ void mono_thread_wakeup (const void * addr);
  */
 int thread_hassleepers(const void *addr);
 
+/*
+ * Priorities.
+ *
+ *     thread_setpriority - set a thread's base priority. Fails with
+ *                     EINVAL if it's out of range. The thread may run
+ *                     at a higher priority while it holds a lock that
+ *                     a higher-priority thread is waiting for.
+ *     thread_getpriority - return a thread's base priority.
+ *
+ * For the lock code (synch.c), with interrupts off:
+ *
+ *     thread_donatepri - raise T, and whatever T is waiting on in
+ *                     turn, to at least PRI.
+ *     thread_updatepri - recompute T's effective priority from its
+ *                     base priority and the waiters on the locks it
+ *                     holds, and pass any change along.
+ *     thread_sleeperpri - the highest priority of the threads
+ *                     sleeping on ADDR, or -1 if there are none.
+ */
+int thread_setpriority(struct thread *t, int pri);
+int thread_getpriority(struct thread *t);
+void thread_donatepri(struct thread *t, int pri);
+void thread_updatepri(struct thread *t);
+int thread_sleeperpri(const void *addr);
+
+/*
+ * Accounting.
+ *
+ *     thread_clockstart - start charging time to threads. Call once
+ *                     the clock is attached.
+ *     thread_chargeuser - on entry to the kernel from user mode: the
+ *                     time since the last charge was user time.
+ *     thread_chargesys - on the way back to user mode: the time since
+ *                     the last charge was system time.
+ *     thread_preempt - like thread_yield, but counted as involuntary.
+ *                     For the timer.
+ *     thread_getrusage - current thread's resource usage, up to now.
+ *     thread_getinfo - describe up to MAX threads in TI. Returns the
+ *                     total number of threads.
+ *
+ * thread_chargeuser and thread_chargesys are called with interrupts
+ * off.
+ */
+void thread_clockstart(void);
+void thread_chargeuser(void);
+void thread_chargesys(void);
+void thread_preempt(void);
+void thread_getrusage(struct rusage *ru);
+int thread_getinfo(struct threadinfo *ti, int max);
+
 
 /*
  * Private thread functions.
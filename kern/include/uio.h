@@ -2,8 +2,7 @@
 #define _UIO_H_
 
 /*
- * Like BSD uio, but simplified a bit. (In BSD, there can be more than one
- * iovec in a uio.)
+ * Like BSD uio, but simplified a bit.
  */
 
 enum uio_rw {
@@ -27,13 +26,22 @@ struct iovec {
 #define iov_kbase  iov_un.un_kbase
 #define iov_ubase  iov_un.un_ubase
 
+/*
+ * A uio describes a list of buffers (iovecs), transferred in order.
+ * uio_iov is the cursor: it points at the current iovec, and uiomove
+ * advances it as each one is used up. Transfers of a single buffer
+ * (mk_kuio, mk_uuio) use uio_iovec for storage, so don't copy a uio
+ * set up that way.
+ */
 struct uio {
-	struct iovec      uio_iovec;       /* Data block */
+	struct iovec     *uio_iov;         /* Data blocks */
+	unsigned          uio_iovcnt;      /* Number of blocks left */
 	off_t             uio_offset;      /* desired offset into object */
 	size_t            uio_resid;       /* Remaining amt of data to xfer */
 	enum uio_seg      uio_segflg;      /* what kind of pointer we have */
 	enum uio_rw       uio_rw;          /* whether op is a read or write */
 	struct addrspace *uio_space;       /* address space for user pointer */
+	struct iovec      uio_iovec;       /* storage for a single block */
 };
 
 
@@ -43,7 +51,8 @@ struct uio {
  * fields as well.
  *
  * Before calling this, you should
- *   (1) set up uio_iovec to point to the buffer you want to transfer to;
+ *   (1) set up uio_iov and uio_iovcnt to point to the buffers you want
+ *       to transfer to (for one buffer, point uio_iov at uio_iovec);
  *   (2) initialize uio_offset as desired;
  *   (3) initialize uio_resid to the total amount of data that can be 
  *       transferred through this uio;
@@ -53,8 +62,8 @@ struct uio {
  *       should be found.
  *
  * After calling, 
- *   (1) the contents of uio_iovec may be altered and should not be 
- *       interpreted;
+ *   (1) uio_iov, uio_iovcnt and the iovecs may be altered and should
+ *       not be interpreted;
  *   (2) uio_offset will have been incremented by the amount transferred;
  *   (3) uio_resid will have been decremented by the amount transferred;
  *   (4) uio_segflg, uio_rw, and uio_space will be unchanged.
@@ -79,8 +88,28 @@ int uiomove(void *kbuffer, size_t len, struct uio *uio);
 int uiomovezeros(size_t len, struct uio *uio);
 
 /*
- * Initialize uio for I/O from a kernel buffer.
+ * Move up to LEN bytes straight from one uio (a UIO_WRITE, the
+ * source) into another (a UIO_READ, the destination), with no kernel
+ * buffer in between. Both are advanced as with uiomove, and both must
+ * be usable from the address space presently in context.
+ */
+int uiomove_uio(struct uio *to, struct uio *from, size_t len);
+
+/*
+ * For writers that may not consume everything they're given: uiopeek
+ * copies LEN bytes out of a UIO_WRITE uio without advancing it, and
+ * uioskip advances a uio by LEN bytes without copying anything. So a
+ * short write can account for just the bytes that got written.
+ */
+int uiopeek(void *kbuffer, size_t len, struct uio *uio);
+void uioskip(size_t len, struct uio *uio);
+
+/*
+ * Initialize uio for I/O from a kernel buffer, or from a user buffer
+ * in the current address space.
  */
 void mk_kuio(struct uio *, void *kbuf, size_t len, off_t pos, enum uio_rw rw);
+void mk_uuio(struct uio *, userptr_t ubuf, size_t len, off_t pos,
+	     enum uio_rw rw);
 
 #endif /* _UIO_H_ */
@@ -146,4 +146,22 @@ int vfs_mount(const char *devname, void *data,
 int vfs_unmount(const char *devname);
 int vfs_unmountall(void);
 
+/*
+ * For filesystems implementing vop_getdirentries:
+ *
+ *    vfs_direntout - Append a struct dirent (kern/dirent.h) for NAME to
+ *                    a uio. Returns ERANGE if it doesn't fit.
+ */
+
+int vfs_direntout(struct uio *uio, u_int32_t ino, int type, const char *name);
+
+/*
+ * Pipes, in pipe.c:
+ *
+ *    pipe_create   - Make a pipe and hand back its read and write ends,
+ *                    already open; vfs_close each when done.
+ */
+
+int pipe_create(struct vnode **readend, struct vnode **writeend);
+
 #endif /* _VFS_H_ */
@@ -27,4 +27,105 @@ int vm_fault(int faulttype, vaddr_t faultaddress);
 vaddr_t alloc_kpages(int npages);
 void free_kpages(vaddr_t addr);
 
+/*
+ * The time page (see <kern/timepage.h>). Allocated by vm_bootstrap,
+ * written by hardclock, and mapped read-only at TIMEPAGE in every user
+ * address space. 0 until vm_bootstrap.
+ */
+extern paddr_t vm_timepage;
+
+#if !OPT_DUMBVM
+
+struct vnode;
+struct vm_object;
+
+/*
+ * Page table entries. The page frame is kept in the same position as
+ * in TLBLO_PPAGE so an entry converts to a TLB entry by masking.
+ */
+#define PTE_FRAME    0xfffff000   /* physical page */
+#define PTE_VALID    0x00000001   /* page is present */
+#define PTE_WRITE    0x00000002   /* page may be written (TLBLO_DIRTY) */
+#define PTE_OBJ      0x00000004   /* page belongs to a vm_object */
+
+/* Region protection bits, as passed to as_define_region */
+#define VM_PROT_READ   0x1
+#define VM_PROT_WRITE  0x2
+#define VM_PROT_EXEC   0x4
+
+/* User stack size limit; pages are allocated as they are touched */
+#define VM_STACKPAGES  256
+
+/* User heap (sbrk) size limit; also lazily allocated */
+#define VM_HEAPMAX     (16*1024*1024)
+
+/*
+ * Physical page allocator (coremap), in vm.c.
+ *
+ *    page_alloc  - allocate one user page with a reference count of
+ *                  one. Contents are undefined. Returns 0 if out of
+ *                  memory.
+ *    page_zalloc - same, but the page is zero-filled. Comes from
+ *                  the pre-zeroed pool when it can.
+ *    page_incref - add a reference to a user page.
+ *    page_decref - drop a reference; the page is freed at zero.
+ */
+paddr_t page_alloc(void);
+paddr_t page_zalloc(void);
+void page_incref(paddr_t pa);
+void page_decref(paddr_t pa);
+
+/* One zero-filled kernel page, freed with kfree/free_kpages */
+vaddr_t alloc_kzpage(void);
+
+/* Idle-loop hook that keeps a pool of pre-zeroed pages (scheduler.c) */
+int vm_idlezero(void);
+
+/*
+ * Per-vnode page cache, in vmobj.c. Read-only file pages and pages
+ * of shared file mappings are shared between all address spaces
+ * that map them.
+ *
+ *    vmobj_getpage - get the page holding file offset OFFSET (page
+ *                    aligned) of vnode V, reading it if necessary.
+ *                    Returns it with a reference for the caller.
+ *    vmobj_dirty   - note that the cached page at OFFSET has been
+ *                    (or is about to be) written through a mapping.
+ *                    Each call counts one writable mapping.
+ *    vmobj_wprotect - note that one of those mappings has lost its
+ *                    write access (or gone away).
+ *    vmobj_sync    - write dirty cached pages in [OFFSET, OFFSET+LEN)
+ *                    back to the file.
+ *    vmobj_destroy - drop all cached pages; called when the vnode
+ *                    is reclaimed.
+ */
+int vmobj_getpage(struct vnode *v, off_t offset, paddr_t *ret);
+void vmobj_dirty(struct vnode *v, off_t offset);
+void vmobj_wprotect(struct vnode *v, off_t offset);
+int vmobj_sync(struct vnode *v, off_t offset, off_t len);
+void vmobj_destroy(struct vm_object *vo);
+
+/* Print VM statistics (menu command) */
+void vm_printstats(void);
+
+/* Counters, in vm.c */
+struct vm_stats {
+	u_int32_t vs_faults;       /* all faults handled */
+	u_int32_t vs_zerofill;     /* zero-filled page faults */
+	u_int32_t vs_fileread;     /* private pages read from a file */
+	u_int32_t vs_objhit;       /* shared pages found in the page cache */
+	u_int32_t vs_objmiss;      /* shared pages read into the page cache */
+	u_int32_t vs_zhit;         /* zeroed pages taken from the pool */
+	u_int32_t vs_zmiss;        /* ... or zeroed on the spot */
+	u_int32_t vs_zeroed;       /* pages zeroed by the idle loop */
+	u_int32_t vs_heapgrow;     /* sbrk calls that grew a heap */
+	u_int32_t vs_heapshrink;   /* sbrk calls that shrank one */
+	u_int32_t vs_heapfreed;    /* touched heap pages freed by shrinking */
+	u_int32_t vs_cow;          /* private mapping pages copied on write */
+	u_int32_t vs_objsync;      /* dirty shared pages written back */
+};
+extern struct vm_stats vm_stats;
+
+#endif /* !OPT_DUMBVM */
+
 #endif /* _VM_H_ */
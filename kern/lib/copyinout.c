@@ -174,6 +174,48 @@ copyout(const void *src, userptr_t userdest, size_t len)
 	return 0;
 }
 
+/*
+ * copyuser
+ *
+ * Copy a block of memory of length LEN from user-level address USERSRC
+ * to user-level address USERDEST, without going through a kernel
+ * buffer. Both are checked as for copyin and copyout.
+ */
+int
+copyuser(const_userptr_t usersrc, userptr_t userdest, size_t len)
+{
+	int result;
+	size_t stoplen;
+
+	result = copycheck(usersrc, len, &stoplen);
+	if (result) {
+		return result;
+	}
+	if (stoplen != len) {
+		return EFAULT;
+	}
+	result = copycheck(userdest, len, &stoplen);
+	if (result) {
+		return result;
+	}
+	if (stoplen != len) {
+		return EFAULT;
+	}
+
+	curthread->t_pcb.pcb_badfaultfunc = copyfail;
+
+	result = setjmp(curthread->t_pcb.pcb_copyjmp);
+	if (result) {
+		curthread->t_pcb.pcb_badfaultfunc = NULL;
+		return EFAULT;
+	}
+
+	memmove((void *)userdest, (const void *)usersrc, len);
+
+	curthread->t_pcb.pcb_badfaultfunc = NULL;
+	return 0;
+}
+
 /*
  * Common string copying function that behaves the way that's desired
  * for copyinstr and copyoutstr.
@@ -5,13 +5,14 @@
 #include <synch.h>
 #include <vfs.h>          // for vfs_sync()
 #include <thread.h>       // for thread_panic();
+#include <curthread.h>
 #include <machine/pcb.h>  // for md_panic()
 #include <machine/spl.h>
 
 /* Flags word for DEBUG() macro. */
 u_int32_t dbflags = 0;
 
-/* Lock for non-polled kprintfs */
+/* Lock for non-polled console output */
 static struct lock *kprintf_lock;
 
 /*
@@ -19,6 +20,50 @@ static struct lock *kprintf_lock;
  * interrupts are disabled.
  */
 
+/*
+ * Log buffer.
+ *
+ * kprintf formats into a ring of KPRINTF_LOGSIZE bytes, with
+ * interrupts off, and doesn't wait for the console. A thread running
+ * at THREAD_PRI_MIN (kprintfd) copies new text out to the console in
+ * chunks whenever nothing more important wants the CPU. If the
+ * backlog passes KMSG_HIWAT, a kprintf that's allowed to sleep
+ * drains it itself rather than let the ring overwrite text that was
+ * never printed; from an interrupt handler the oldest text is lost
+ * instead, and the console says so.
+ *
+ * Until kprintfd is running, and from the moment the system starts
+ * to shut down or panic (kprintf_sync), kprintf writes through to
+ * the console as it always did.
+ *
+ * kmsg_end and kmsg_sent count the bytes ever logged and ever sent to
+ * the console; byte N lives at kmsg_buf[N % KPRINTF_LOGSIZE]. Both
+ * are changed only with interrupts off.
+ */
+#define KMSG_HIWAT	(KPRINTF_LOGSIZE / 2)
+#define KMSG_CHUNK	128
+
+static char kmsg_buf[KPRINTF_LOGSIZE];
+static u_int32_t kmsg_end;
+static u_int32_t kmsg_sent;
+static int kmsg_async;		/* kprintfd is running */
+static int kmsg_sync;		/* shutting down: don't defer output */
+
+/* Append to the log. Call with interrupts off. */
+static
+void
+kmsg_send(void *junk, const char *data, size_t len)
+{
+	size_t i;
+
+	(void)junk;
+
+	for (i=0; i<len; i++) {
+		kmsg_buf[kmsg_end % KPRINTF_LOGSIZE] = data[i];
+		kmsg_end++;
+	}
+}
+
 
 /* Send characters to the console. */
 static
@@ -34,35 +79,222 @@ console_send(void *junk, const char *data, size_t len)
 	}
 }
 
-/* Create the kprintf lock. Must be called before creating a second thread. */
+/*
+ * Take up to LEN bytes of unsent log text into BUF. If the writers
+ * lapped us, skip what was overwritten and count it in *LOST.
+ */
+static
+size_t
+kmsg_take(char *buf, size_t len, u_int32_t *lost)
+{
+	u_int32_t pending;
+	size_t i;
+	int spl;
+
+	spl = splhigh();
+
+	pending = kmsg_end - kmsg_sent;
+	if (pending > KPRINTF_LOGSIZE) {
+		*lost += pending - KPRINTF_LOGSIZE;
+		kmsg_sent = kmsg_end - KPRINTF_LOGSIZE;
+		pending = KPRINTF_LOGSIZE;
+	}
+	if (len > pending) {
+		len = pending;
+	}
+	for (i=0; i<len; i++) {
+		buf[i] = kmsg_buf[(kmsg_sent + i) % KPRINTF_LOGSIZE];
+	}
+	kmsg_sent += len;
+
+	splx(spl);
+	return len;
+}
+
+/*
+ * Send all unsent log text to the console. Call with kprintf_lock
+ * held, when it can be used, so chunks come out in order.
+ */
+static
+void
+kmsg_drain(void)
+{
+	char chunk[KMSG_CHUNK];
+	u_int32_t lost;
+	size_t len;
+
+	for (;;) {
+		lost = 0;
+		len = kmsg_take(chunk, sizeof(chunk), &lost);
+		if (lost > 0) {
+			char msg[64];
+			snprintf(msg, sizeof(msg),
+				 "\n[kprintf: %lu bytes lost]\n",
+				 (unsigned long)lost);
+			console_send(NULL, msg, strlen(msg));
+		}
+		if (len == 0) {
+			break;
+		}
+		console_send(NULL, chunk, len);
+	}
+}
+
+/* Drain the log, taking the lock if we're allowed to sleep. */
+static
+void
+kmsg_flush(void)
+{
+	if (kprintf_lock != NULL && !in_interrupt && curspl==0) {
+		lock_acquire(kprintf_lock);
+		kmsg_drain();
+		lock_release(kprintf_lock);
+	}
+	else {
+		kmsg_drain();
+	}
+}
+
+/*
+ * The flusher thread. It runs at the lowest priority, so it only
+ * prints when nothing else is ready to run - or when someone waiting
+ * for kprintf_lock lends it their priority.
+ */
+static
+void
+kprintf_thread(void *junk, unsigned long num)
+{
+	int spl;
+
+	(void)junk;
+	(void)num;
+
+	thread_setpriority(curthread, THREAD_PRI_MIN);
+
+	for (;;) {
+		spl = splhigh();
+		while (kmsg_sent == kmsg_end) {
+			thread_sleep(&kmsg_end);
+		}
+		splx(spl);
+
+		lock_acquire(kprintf_lock);
+		kmsg_drain();
+		lock_release(kprintf_lock);
+	}
+}
+
+/*
+ * Create the kprintf lock and start the flusher thread. Must be
+ * called before creating a second thread.
+ */
 void
 kprintf_bootstrap(void)
 {
+	int result;
+
 	assert(kprintf_lock == NULL);
 
 	kprintf_lock = lock_create("kprintf_lock");
 	if (kprintf_lock == NULL) {
 		panic("Could not create kprintf lock\n");
 	}
+
+	result = thread_fork("kprintfd", NULL, 0, kprintf_thread, NULL);
+	if (result) {
+		panic("Could not start kprintf thread: %s\n",
+		      strerror(result));
+	}
+	kmsg_async = 1;
+}
+
+/*
+ * Stop deferring output: flush the log, and have kprintf write
+ * through to the console from now on. For shutdown and panic, after
+ * which kprintfd may never run again.
+ */
+void
+kprintf_sync(void)
+{
+	kmsg_sync = 1;
+	kmsg_flush();
+}
+
+/*
+ * Copy the most recent log text, up to LEN bytes, into BUF. Returns
+ * the number of bytes copied.
+ */
+size_t
+kprintf_getlog(char *buf, size_t len)
+{
+	u_int32_t have, start;
+	size_t i;
+	int spl;
+
+	spl = splhigh();
+
+	have = kmsg_end < KPRINTF_LOGSIZE ? kmsg_end : KPRINTF_LOGSIZE;
+	if (len > have) {
+		len = have;
+	}
+	start = kmsg_end - len;
+	for (i=0; i<len; i++) {
+		buf[i] = kmsg_buf[(start + i) % KPRINTF_LOGSIZE];
+	}
+
+	splx(spl);
+	return len;
 }
 
-/* Printf to the console. */
+/*
+ * Print the log on the console, as dmesg would. This goes straight
+ * to the console, so the log doesn't end up containing itself.
+ */
+void
+kprintf_printlog(void)
+{
+	char *buf;
+	size_t len;
+
+	buf = kmalloc(KPRINTF_LOGSIZE);
+	if (buf == NULL) {
+		kprintf("kprintf_printlog: Out of memory\n");
+		return;
+	}
+	len = kprintf_getlog(buf, KPRINTF_LOGSIZE);
+
+	lock_acquire(kprintf_lock);
+	kmsg_drain();
+	console_send(NULL, buf, len);
+	lock_release(kprintf_lock);
+
+	kfree(buf);
+}
+
+/* Printf to the console, by way of the log. */
 int
 kprintf(const char *fmt, ...)
 {
-	int chars;
+	int chars, spl;
+	u_int32_t backlog;
 	va_list ap;
 
-	if (kprintf_lock != NULL && !in_interrupt && curspl==0) {
-		lock_acquire(kprintf_lock);
-	}
-
+	/* Format the whole message at once so it isn't interleaved */
+	spl = splhigh();
 	va_start(ap, fmt);
-	chars = __vprintf(console_send, NULL, fmt, ap);
+	chars = __vprintf(kmsg_send, NULL, fmt, ap);
 	va_end(ap);
+	backlog = kmsg_end - kmsg_sent;
+	if (kmsg_async && !kmsg_sync) {
+		thread_wakeup(&kmsg_end);
+	}
+	splx(spl);
 
-	if (kprintf_lock != NULL && !in_interrupt && curspl==0) {
-		lock_release(kprintf_lock);
+	if (!kmsg_async || kmsg_sync) {
+		kmsg_flush();
+	}
+	else if (backlog >= KMSG_HIWAT && !in_interrupt && curspl==0) {
+		kmsg_flush();
 	}
 
 	return chars;
@@ -106,26 +338,36 @@ panic(const char *fmt, ...)
 	if (evil==1) {
 		evil = 2;
 
-		thread_panic();
+		/*
+		 * Get out whatever the log is still holding; it may
+		 * explain the panic.
+		 */
+		kprintf_sync();
 	}
 
 	if (evil==2) {
 		evil = 3;
 
+		thread_panic();
+	}
+
+	if (evil==3) {
+		evil = 4;
+
 		kprintf("panic: ");
 		va_start(ap, fmt);
 		__vprintf(console_send, NULL, fmt, ap);
 		va_end(ap);
 	}
 
-	if (evil==3) {
-		evil = 4;
+	if (evil==4) {
+		evil = 5;
 
 		vfs_sync();
 	}
 
-	if (evil==4) {
-		evil = 5;
+	if (evil==5) {
+		evil = 6;
 
 		md_panic();
 	}
@@ -14,9 +14,13 @@
 #include <dev.h>
 #include <vfs.h>
 #include <vm.h>
+#include <addrspace.h>
+#include <curthread.h>
+#include <file.h>
 #include <syscall.h>
 #include <version.h>
 #include <clock.h>
+#include <softirq.h>
 
 /*
  * These two pieces of data are maintained by the makefiles and build system.
@@ -76,8 +80,10 @@ boot(void)
 	thread_bootstrap();
 	vfs_bootstrap();
 	dev_bootstrap();
+	thread_clockstart();
 	vm_bootstrap();
 	kprintf_bootstrap();
+	softirq_bootstrap();
 
 	/* Default bootfs - but ignore failure, in case emu0 doesn't exist */
 	vfs_setbootfs("emu0");
@@ -104,6 +110,9 @@ shutdown(void)
 	vfs_clearcurdir();
 	vfs_unmountall();
 
+	/* The log flusher won't get to run again */
+	kprintf_sync();
+
 	splhigh();
 
 	scheduler_shutdown();
@@ -165,6 +174,9 @@ int sys_write(int filehandle, const void *buf, size_t size, int32_t* retval){
 	The values 0, 1, 2 for filehandle can also be given, for standard input, standard output 
 	& standard error, respectively. 
 	*/
+	if (filehandle >= FILE_FIRSTFD){
+		return file_write(filehandle, buf, size, retval);
+	}
 	if (filehandle == 1 || filehandle == 2){
 		char* kernel_dest = kmalloc(size + 1);
 		kernel_dest[size] = '\0';
@@ -189,6 +201,9 @@ int sys_read(int fd, void *buf, size_t buflen, int32_t* retval){
 		*retval = -1;
 		return EFAULT;
 	}
+	if (fd >= FILE_FIRSTFD){
+		return file_read(fd, buf, buflen, retval);
+	}
 	if (fd != 0){
 		*retval = -1;
 		return EBADF;
@@ -259,6 +274,119 @@ unsigned int sys_sleep(unsigned int seconds){
 	return 0;
 }
 
+int sys_sbrk(int amount, int32_t* retval){
+	vaddr_t oldbreak;
+	int result;
+
+	if (curthread->t_vmspace == NULL){
+		return EINVAL;
+	}
+	result = as_sbrk(curthread->t_vmspace, amount, &oldbreak);
+	if (result){
+		return result;
+	}
+	*retval = (int32_t) oldbreak;
+	return 0;
+}
+
+/*
+ * User programs may lower their priority but not raise it past the
+ * default: the scheduler is strict priority, so a program above the
+ * menu thread that never blocks would lock the system up.
+ */
+int sys_setpriority(int pri, int32_t* retval){
+	int old, result;
+
+	if (pri > THREAD_PRI_DEFAULT) {
+		return EINVAL;
+	}
+
+	old = thread_getpriority(curthread);
+	result = thread_setpriority(curthread, pri);
+	if (result){
+		return result;
+	}
+	*retval = old;
+	return 0;
+}
+
+/*
+ * dmesg() system call: copy the most recent kernel log text, up to
+ * LEN bytes, into BUF. Returns the number of bytes copied.
+ */
+int
+sys_dmesg(userptr_t buf, size_t len, int32_t *retval)
+{
+	char *kbuf;
+	int result;
+
+	if (len > KPRINTF_LOGSIZE) {
+		len = KPRINTF_LOGSIZE;
+	}
+	kbuf = kmalloc(len > 0 ? len : 1);
+	if (kbuf == NULL) {
+		return ENOMEM;
+	}
+
+	len = kprintf_getlog(kbuf, len);
+	result = copyout(kbuf, buf, len);
+	kfree(kbuf);
+	if (result) {
+		return result;
+	}
+
+	*retval = len;
+	return 0;
+}
+
+/*
+ * getrusage() system call. Only RUSAGE_SELF is supported: there are
+ * no child processes to report on.
+ */
+int
+sys_getrusage(int who, userptr_t usage)
+{
+	struct rusage ru;
+
+	if (who != RUSAGE_SELF) {
+		return EINVAL;
+	}
+	thread_getrusage(&ru);
+	return copyout(&ru, usage, sizeof(ru));
+}
+
+/*
+ * threadinfo() system call: describe up to NBUF threads in BUF.
+ * Returns the total number of threads, which may be more than NBUF.
+ */
+int
+sys_threadinfo(userptr_t buf, size_t nbuf, int32_t *retval)
+{
+	struct threadinfo *kbuf;
+	int result, n, total;
+
+	/* Allocate room for what's there now, and no more */
+	total = thread_getinfo(NULL, 0);
+	if (nbuf > (size_t)total) {
+		nbuf = total;
+	}
+	kbuf = kmalloc(nbuf > 0 ? nbuf * sizeof(struct threadinfo) : 1);
+	if (kbuf == NULL) {
+		return ENOMEM;
+	}
+
+	total = thread_getinfo(kbuf, nbuf);
+	n = (size_t)total < nbuf ? total : (int)nbuf;
+	result = copyout(kbuf, buf, n * sizeof(struct threadinfo));
+	kfree(kbuf);
+	if (result) {
+		return result;
+	}
+
+	*retval = total;
+	return 0;
+}
+
 /*
  * Kernel main. Boot up, then fork the menu thread; wait for a reboot
  * request, and then shut down.
@@ -9,10 +9,13 @@
 #include <lib.h>
 #include <clock.h>
 #include <thread.h>
+#include <softirq.h>
 #include <syscall.h> 
 #include <uio.h>
 #include <vfs.h>
 #include <sfs.h>
+#include <vm.h>
+#include <machine/tlb.h>
 #include <test.h>
 #include "opt-synchprobs.h"
 #include "opt-sfs.h"
@@ -96,14 +99,9 @@ cmd_progthread(void *ptr, unsigned long nargs)
 /*
  * Common code for cmd_prog and cmd_shell.
  *
- * Note that this does not wait for the subprogram to finish, but
- * returns immediately to the menu. This is usually not what you want,
- * so you should have it call your system-calls-assignment waitpid
- * code after forking.
- *
- * Also note that because the subprogram's thread uses the "args"
- * array and strings, until you do this a race condition exists
- * between that code and the menu input code.
+ * This waits for the subprogram's thread to finish with thread_join
+ * before returning to the menu, which also keeps the "args" array and
+ * strings, which that thread uses, alive until it's done with them.
  */
 static
 int
@@ -402,6 +400,21 @@ cmd_sync(int nargs, char **args)
 	return 0;
 }
 
+/*
+ * Command for printing the kernel log.
+ */
+static
+int
+cmd_dmesg(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	kprintf_printlog();
+
+	return 0;
+}
+
 /*
  * Command for doing an intentional panic.
  */
@@ -539,6 +552,70 @@ cmd_kheapstats(int nargs, char **args)
 	return 0;
 }
 
+#if OPT_SFS
+static
+int
+cmd_sfsstats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	sfs_printstats();
+
+	return 0;
+}
+#endif
+
+static
+int
+cmd_threadstats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	thread_printstats();
+
+	return 0;
+}
+
+static
+int
+cmd_softirqstats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	softirq_printstats();
+
+	return 0;
+}
+
+static
+int
+cmd_tlbstats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	tlb_printstats();
+
+	return 0;
+}
+
+#if !OPT_DUMBVM
+static
+int
+cmd_vmstats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	vm_printstats();
+
+	return 0;
+}
+#endif
+
 ////////////////////////////////////////
 //
 // Menus.
@@ -579,6 +656,7 @@ static const char *opsmenu[] = {
 	"[cd]      Change directory          ",
 	"[pwd]     Print current directory   ",
 	"[sync]    Sync filesystems          ",
+	"[dmesg]   Print the kernel log      ",
 	"[panic]   Intentional panic         ",
 	"[q]       Quit and shut down        ",
 	NULL
@@ -640,17 +718,22 @@ static const char *testmenu[] = {
 	"[tt1] Thread test 1                 ",
 	"[tt2] Thread test 2                 ",
 	"[tt3] Thread test 3                 ",
+	"[tt4] Thread join test              ",
 #if OPT_NET
 	"[net] Network test                  ",
 #endif
 	"[sy1] Semaphore test                ",
 	"[sy2] Lock test             (1)     ",
 	"[sy3] CV test               (1)     ",
+	"[sy4] Priority inversion test       ",
 	"[fs1] Filesystem test               ",
 	"[fs2] FS read stress        (4)     ",
 	"[fs3] FS write stress       (4)     ",
 	"[fs4] FS write stress 2     (4)     ",
 	"[fs5] FS create stress      (4)     ",
+	"[pt]  Pipe test                     ",
+	"[kb]  Kernel microbenchmarks        ",
+	"[kbfs] FS block I/O benchmarks  (4) ",
 	NULL
 };
 
@@ -680,6 +763,14 @@ static const char *mainmenu[] = {
 	"[1c] Stoplight                      ",
 #endif
 	"[kh] Kernel heap stats              ",
+#if OPT_SFS
+	"[ra] SFS read-ahead stats           ",
+#endif
+#if !OPT_DUMBVM
+	"[vm] VM stats                       ",
+#endif
+	"[tlb] TLB and ASID stats            ",
+	"[si] Deferred interrupt work stats  ",
 	"[q] Quit and shut down              ",
 	NULL
 };
@@ -724,6 +815,7 @@ static struct {
 	{ "cd",		cmd_chdir },
 	{ "pwd",	cmd_pwd },
 	{ "sync",	cmd_sync },
+	{ "dmesg",	cmd_dmesg },
 	{ "panic",	cmd_panic },
 	{ "q",		cmd_quit },
 	{ "exit",	cmd_quit },
@@ -738,6 +830,15 @@ static struct {
 
 	/* stats */
 	{ "kh",         cmd_kheapstats },
+#if OPT_SFS
+	{ "ra",         cmd_sfsstats },
+#endif
+#if !OPT_DUMBVM
+	{ "vm",         cmd_vmstats },
+#endif
+	{ "tlb",        cmd_tlbstats },
+	{ "th",         cmd_threadstats },
+	{ "si",         cmd_softirqstats },
 
 	/* base system tests */
 	{ "at",		arraytest },
@@ -751,11 +852,13 @@ static struct {
 	{ "tt1",	threadtest },
 	{ "tt2",	threadtest2 },
 	{ "tt3",	threadtest3 },
+	{ "tt4",	threadtest4 },
 	{ "sy1",	semtest },
 
 	/* synchronization assignment tests */
 	{ "sy2",	locktest },
 	{ "sy3",	cvtest },
+	{ "sy4",	invtest },
 
 	/* file system assignment tests */
 	{ "fs1",	fstest },
@@ -763,6 +866,11 @@ static struct {
 	{ "fs3",	writestress },
 	{ "fs4",	writestress2 },
 	{ "fs5",	createstress },
+	{ "pt",		pipetest },
+
+	/* benchmarks */
+	{ "kb",		kbench },
+	{ "kbfs",	kbenchfs },
 
 	{ NULL, NULL }
 };
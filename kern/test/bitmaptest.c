@@ -72,6 +72,8 @@ bitmaptest(int nargs, char **args)
 		assert(data[i]==0);
 	}
 
+	bitmap_destroy(b);
+
 	kprintf("Bitmap test complete\n");
 	return 0;
 }
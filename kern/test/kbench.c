@@ -0,0 +1,787 @@
+/*
+ * kbench - kernel microbenchmarks.
+ *
+ * Each benchmark is an operation run in batches. After one untimed
+ * warmup batch, BENCH_SAMPLES batches are timed with gettime, and
+ * the per-operation cost of each is recorded; the report gives the
+ * minimum, median and maximum over the samples, one line per
+ * benchmark, as
+ *
+ *    kbench: name=NAME samples=S iters=N min_ns=A med_ns=B max_ns=C
+ *
+ * so that runs of different kernel builds can be collected with grep
+ * and compared. Timing whole batches rather than single operations
+ * keeps the cost of reading the clock out of the numbers.
+ *
+ * "kb" runs the in-memory benchmarks (all of them, or those named
+ * on the command line); "kbfs" runs the block I/O benchmarks on a
+ * file on the named filesystem.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/unistd.h>
+#include <lib.h>
+#include <array.h>
+#include <bitmap.h>
+#include <queue.h>
+#include <synch.h>
+#include <thread.h>
+#include <clock.h>
+#include <uio.h>
+#include <vnode.h>
+#include <vfs.h>
+#include <test.h>
+
+#define BENCH_SAMPLES   11	/* timed batches per benchmark */
+#define BENCH_MAXSAMPLES 101	/* most samples the -s option allows */
+#define BENCH_BLOCKSIZE 512	/* I/O size for the fs benchmarks */
+#define BENCH_FILE      "kbench.tmp"
+
+struct bench {
+	const char *b_name;
+	unsigned b_iters;		/* operations per batch */
+	unsigned long b_arg;		/* passed to the functions below */
+	int (*b_setup)(unsigned long arg);	/* may be NULL */
+	void (*b_run)(unsigned long arg, unsigned iters);
+	void (*b_cleanup)(unsigned long arg);	/* may be NULL */
+};
+
+/* State shared by the benchmarks that need a partner thread. */
+static volatile int bench_stop;
+static volatile int bench_turn;
+static struct semaphore *bench_done;
+static struct semaphore *bench_sem1, *bench_sem2;
+static struct lock *bench_lock;
+static struct cv *bench_cv;
+
+/* Scratch objects for the library benchmarks. */
+static struct queue *bench_queue;
+static struct array *bench_array;
+static struct bitmap *bench_bitmap;
+
+/* State for the fs benchmarks. */
+static struct vnode *bench_vn;
+static char bench_block[BENCH_BLOCKSIZE];
+static u_int32_t bench_seed;
+
+/*
+ * Small linear congruential generator, so random I/O patterns are the
+ * same from run to run.
+ */
+static
+u_int32_t
+bench_random(void)
+{
+	bench_seed = bench_seed * 1103515245 + 12345;
+	return bench_seed >> 8;
+}
+
+static
+int
+bench_fork(const char *name, void (*func)(void *, unsigned long))
+{
+	int result;
+
+	bench_stop = 0;
+	result = thread_fork(name, NULL, 0, func, NULL);
+	if (result) {
+		kprintf("kbench: thread_fork: %s\n", strerror(result));
+	}
+	return result;
+}
+
+////////////////////////////////////////////////////////////
+// context switch
+
+static
+void
+yield_partner(void *junk, unsigned long num)
+{
+	(void)junk;
+	(void)num;
+
+	while (!bench_stop) {
+		thread_yield();
+	}
+	V(bench_done);
+}
+
+static
+int
+yield_setup(unsigned long arg)
+{
+	(void)arg;
+	return bench_fork("kbench-yield", yield_partner);
+}
+
+/* One operation is a round trip: two context switches. */
+static
+void
+yield_run(unsigned long arg, unsigned iters)
+{
+	unsigned i;
+
+	(void)arg;
+	for (i=0; i<iters; i++) {
+		thread_yield();
+	}
+}
+
+static
+void
+yield_cleanup(unsigned long arg)
+{
+	(void)arg;
+	bench_stop = 1;
+	P(bench_done);
+}
+
+////////////////////////////////////////////////////////////
+// semaphores
+
+static
+void
+sem_partner(void *junk, unsigned long num)
+{
+	(void)junk;
+	(void)num;
+
+	for (;;) {
+		P(bench_sem1);
+		if (bench_stop) {
+			break;
+		}
+		V(bench_sem2);
+	}
+	V(bench_done);
+}
+
+static
+int
+sem_setup(unsigned long pingpong)
+{
+	int result;
+
+	bench_sem1 = sem_create("kbench1", 0);
+	bench_sem2 = sem_create("kbench2", 0);
+	if (bench_sem1 == NULL || bench_sem2 == NULL) {
+		if (bench_sem1 != NULL) {
+			sem_destroy(bench_sem1);
+		}
+		if (bench_sem2 != NULL) {
+			sem_destroy(bench_sem2);
+		}
+		return ENOMEM;
+	}
+	if (pingpong) {
+		result = bench_fork("kbench-sem", sem_partner);
+		if (result) {
+			sem_destroy(bench_sem1);
+			sem_destroy(bench_sem2);
+			return result;
+		}
+	}
+	return 0;
+}
+
+/*
+ * With a partner, one operation is a handoff there and back;
+ * without, a V and P that never block.
+ */
+static
+void
+sem_run(unsigned long pingpong, unsigned iters)
+{
+	unsigned i;
+
+	if (pingpong) {
+		for (i=0; i<iters; i++) {
+			V(bench_sem1);
+			P(bench_sem2);
+		}
+	}
+	else {
+		for (i=0; i<iters; i++) {
+			V(bench_sem1);
+			P(bench_sem1);
+		}
+	}
+}
+
+static
+void
+sem_cleanup(unsigned long pingpong)
+{
+	if (pingpong) {
+		bench_stop = 1;
+		V(bench_sem1);
+		P(bench_done);
+	}
+	sem_destroy(bench_sem1);
+	sem_destroy(bench_sem2);
+}
+
+////////////////////////////////////////////////////////////
+// locks and CVs
+
+static
+int
+lock_setup(unsigned long arg)
+{
+	(void)arg;
+	bench_lock = lock_create("kbench");
+	return bench_lock == NULL ? ENOMEM : 0;
+}
+
+/* Uncontended acquire and release. */
+static
+void
+lock_run(unsigned long arg, unsigned iters)
+{
+	unsigned i;
+
+	(void)arg;
+	for (i=0; i<iters; i++) {
+		lock_acquire(bench_lock);
+		lock_release(bench_lock);
+	}
+}
+
+static
+void
+lock_cleanup(unsigned long arg)
+{
+	(void)arg;
+	lock_destroy(bench_lock);
+}
+
+static
+void
+cv_partner(void *junk, unsigned long num)
+{
+	(void)junk;
+	(void)num;
+
+	lock_acquire(bench_lock);
+	for (;;) {
+		while (bench_turn != 1 && !bench_stop) {
+			cv_wait(bench_cv, bench_lock);
+		}
+		if (bench_stop) {
+			break;
+		}
+		bench_turn = 0;
+		cv_signal(bench_cv, bench_lock);
+	}
+	lock_release(bench_lock);
+	V(bench_done);
+}
+
+static
+int
+cv_setup(unsigned long arg)
+{
+	int result;
+
+	result = lock_setup(arg);
+	if (result) {
+		return result;
+	}
+	bench_cv = cv_create("kbench");
+	if (bench_cv == NULL) {
+		lock_destroy(bench_lock);
+		return ENOMEM;
+	}
+	bench_turn = 0;
+	result = bench_fork("kbench-cv", cv_partner);
+	if (result) {
+		cv_destroy(bench_cv);
+		lock_destroy(bench_lock);
+	}
+	return result;
+}
+
+/* One operation is a handoff of the lock there and back, by CV. */
+static
+void
+cv_run(unsigned long arg, unsigned iters)
+{
+	unsigned i;
+
+	(void)arg;
+
+	lock_acquire(bench_lock);
+	for (i=0; i<iters; i++) {
+		bench_turn = 1;
+		cv_signal(bench_cv, bench_lock);
+		while (bench_turn != 0) {
+			cv_wait(bench_cv, bench_lock);
+		}
+	}
+	lock_release(bench_lock);
+}
+
+static
+void
+cv_cleanup(unsigned long arg)
+{
+	(void)arg;
+
+	lock_acquire(bench_lock);
+	bench_stop = 1;
+	cv_signal(bench_cv, bench_lock);
+	lock_release(bench_lock);
+	P(bench_done);
+
+	cv_destroy(bench_cv);
+	lock_destroy(bench_lock);
+}
+
+////////////////////////////////////////////////////////////
+// thread_fork and thread_exit
+
+static
+void
+fork_child(void *junk, unsigned long num)
+{
+	(void)junk;
+	(void)num;
+	V(bench_done);
+}
+
+/* One operation is forking a thread and waiting for it to run. */
+static
+void
+fork_run(unsigned long arg, unsigned iters)
+{
+	unsigned i;
+	int result;
+
+	(void)arg;
+	for (i=0; i<iters; i++) {
+		result = thread_fork("kbench-fork", NULL, 0, fork_child, NULL);
+		if (result) {
+			panic("kbench: thread_fork: %s\n", strerror(result));
+		}
+		P(bench_done);
+	}
+}
+
+////////////////////////////////////////////////////////////
+// kmalloc
+
+/* One operation is a kmalloc of ARG bytes and its kfree. */
+static
+void
+kmalloc_run(unsigned long size, unsigned iters)
+{
+	unsigned i;
+	void *p;
+
+	for (i=0; i<iters; i++) {
+		p = kmalloc(size);
+		if (p == NULL) {
+			panic("kbench: kmalloc(%lu) failed\n", size);
+		}
+		kfree(p);
+	}
+}
+
+////////////////////////////////////////////////////////////
+// library data structures
+
+static
+int
+queue_setup(unsigned long arg)
+{
+	(void)arg;
+	bench_queue = q_create(16);
+	return bench_queue == NULL ? ENOMEM : 0;
+}
+
+/* One operation is an add at the tail and a remove from the head. */
+static
+void
+queue_run(unsigned long arg, unsigned iters)
+{
+	unsigned i;
+
+	(void)arg;
+	for (i=0; i<iters; i++) {
+		if (q_addtail(bench_queue, bench_block)) {
+			panic("kbench: q_addtail failed\n");
+		}
+		q_remhead(bench_queue);
+	}
+}
+
+static
+void
+queue_cleanup(unsigned long arg)
+{
+	(void)arg;
+	q_destroy(bench_queue);
+}
+
+static
+int
+array_setup(unsigned long arg)
+{
+	(void)arg;
+	bench_array = array_create();
+	if (bench_array == NULL) {
+		return ENOMEM;
+	}
+	if (array_preallocate(bench_array, 16)) {
+		array_destroy(bench_array);
+		return ENOMEM;
+	}
+	return 0;
+}
+
+/* One operation is an add at the end and a remove of the first. */
+static
+void
+array_run(unsigned long arg, unsigned iters)
+{
+	unsigned i;
+
+	(void)arg;
+	for (i=0; i<iters; i++) {
+		if (array_add(bench_array, bench_block)) {
+			panic("kbench: array_add failed\n");
+		}
+		array_remove(bench_array, 0);
+	}
+}
+
+static
+void
+array_cleanup(unsigned long arg)
+{
+	(void)arg;
+	array_destroy(bench_array);
+}
+
+static
+int
+bitmap_setup(unsigned long nbits)
+{
+	u_int32_t i;
+
+	bench_bitmap = bitmap_create(nbits);
+	if (bench_bitmap == NULL) {
+		return ENOMEM;
+	}
+	/* Fill all but the last bit, so each alloc has to search */
+	for (i=0; i<nbits-1; i++) {
+		bitmap_mark(bench_bitmap, i);
+	}
+	return 0;
+}
+
+/* One operation is allocating the one free bit and freeing it. */
+static
+void
+bitmap_run(unsigned long arg, unsigned iters)
+{
+	unsigned i;
+	u_int32_t ix;
+
+	(void)arg;
+	for (i=0; i<iters; i++) {
+		if (bitmap_alloc(bench_bitmap, &ix)) {
+			panic("kbench: bitmap_alloc failed\n");
+		}
+		bitmap_unmark(bench_bitmap, ix);
+	}
+}
+
+static
+void
+bitmap_cleanup(unsigned long arg)
+{
+	(void)arg;
+	bitmap_destroy(bench_bitmap);
+}
+
+////////////////////////////////////////////////////////////
+// filesystem block I/O
+
+#define BENCH_SEQ	0
+#define BENCH_RANDOM	1
+
+/*
+ * One operation is one block read or written, at the next block
+ * (modulo the batch size, so each batch covers the same blocks) or
+ * at a random one. The file is written in full first, by
+ * fs_seqwrite, which is therefore run first.
+ */
+static
+void
+fsio_run(unsigned long how, unsigned iters, enum uio_rw rw)
+{
+	struct uio ku;
+	unsigned i;
+	off_t pos;
+	int result;
+
+	for (i=0; i<iters; i++) {
+		if (how == BENCH_RANDOM) {
+			pos = (off_t)(bench_random() % iters) * BENCH_BLOCKSIZE;
+		}
+		else {
+			pos = (off_t)i * BENCH_BLOCKSIZE;
+		}
+		mk_kuio(&ku, bench_block, BENCH_BLOCKSIZE, pos, rw);
+		result = (rw == UIO_READ) ? VOP_READ(bench_vn, &ku)
+			: VOP_WRITE(bench_vn, &ku);
+		if (result) {
+			panic("kbench: fs %s: %s\n",
+			      rw == UIO_READ ? "read" : "write",
+			      strerror(result));
+		}
+	}
+}
+
+static
+void
+fsread_run(unsigned long how, unsigned iters)
+{
+	fsio_run(how, iters, UIO_READ);
+}
+
+static
+void
+fswrite_run(unsigned long how, unsigned iters)
+{
+	fsio_run(how, iters, UIO_WRITE);
+}
+
+////////////////////////////////////////////////////////////
+// tables
+
+static const struct bench membench[] = {
+	{ "yield",		1000, 0,  yield_setup,  yield_run,  yield_cleanup },
+	{ "sem_pingpong",	1000, 1,  sem_setup,    sem_run,    sem_cleanup },
+	{ "sem_uncontended",	1000, 0,  sem_setup,    sem_run,    sem_cleanup },
+	{ "lock_uncontended",	1000, 0,  lock_setup,   lock_run,   lock_cleanup },
+	{ "cv_pingpong",	1000, 0,  cv_setup,     cv_run,     cv_cleanup },
+	{ "fork_exit",		100,  0,  NULL,         fork_run,   NULL },
+	{ "kmalloc_16",		1000, 16,   NULL,       kmalloc_run, NULL },
+	{ "kmalloc_64",		1000, 64,   NULL,       kmalloc_run, NULL },
+	{ "kmalloc_256",	1000, 256,  NULL,       kmalloc_run, NULL },
+	{ "kmalloc_1024",	1000, 1024, NULL,       kmalloc_run, NULL },
+	{ "kmalloc_4096",	1000, 4096, NULL,       kmalloc_run, NULL },
+	{ "kmalloc_16384",	100,  16384, NULL,      kmalloc_run, NULL },
+	{ "queue",		1000, 0,  queue_setup,  queue_run,  queue_cleanup },
+	{ "array",		1000, 0,  array_setup,  array_run,  array_cleanup },
+	{ "bitmap_1024",	1000, 1024, bitmap_setup, bitmap_run, bitmap_cleanup },
+	{ NULL, 0, 0, NULL, NULL, NULL }
+};
+
+static const struct bench fsbench[] = {
+	{ "fs_seqwrite",	256, BENCH_SEQ,    NULL, fswrite_run, NULL },
+	{ "fs_seqread",		256, BENCH_SEQ,    NULL, fsread_run,  NULL },
+	{ "fs_randread",	256, BENCH_RANDOM, NULL, fsread_run,  NULL },
+	{ "fs_randwrite",	256, BENCH_RANDOM, NULL, fswrite_run, NULL },
+	{ NULL, 0, 0, NULL, NULL, NULL }
+};
+
+////////////////////////////////////////////////////////////
+// harness
+
+/*
+ * Nanoseconds per operation for a batch of ITERS that took SECS and
+ * NSECS. Computed piecewise to stay within 32 bits.
+ */
+static
+u_int32_t
+bench_perop(time_t secs, u_int32_t nsecs, unsigned iters)
+{
+	return secs * (1000000000 / iters) + nsecs / iters;
+}
+
+static
+void
+bench_sort(u_int32_t *v, unsigned n)
+{
+	unsigned i, j;
+	u_int32_t t;
+
+	for (i=1; i<n; i++) {
+		t = v[i];
+		for (j=i; j>0 && v[j-1] > t; j--) {
+			v[j] = v[j-1];
+		}
+		v[j] = t;
+	}
+}
+
+static
+int
+bench_one(const struct bench *b, unsigned nsamples)
+{
+	u_int32_t samples[BENCH_MAXSAMPLES];
+	time_t secs1, secs2, rsecs;
+	u_int32_t nsecs1, nsecs2, rnsecs;
+	unsigned i;
+	int result;
+
+	assert(nsamples > 0 && nsamples <= BENCH_MAXSAMPLES);
+
+	if (b->b_setup != NULL) {
+		result = b->b_setup(b->b_arg);
+		if (result) {
+			kprintf("kbench: %s: setup failed: %s\n",
+				b->b_name, strerror(result));
+			return result;
+		}
+	}
+
+	bench_seed = 1;
+
+	/* warm up caches, the heap and the run queue */
+	b->b_run(b->b_arg, b->b_iters);
+
+	for (i=0; i<nsamples; i++) {
+		gettime(&secs1, &nsecs1);
+		b->b_run(b->b_arg, b->b_iters);
+		gettime(&secs2, &nsecs2);
+		getinterval(secs1, nsecs1, secs2, nsecs2, &rsecs, &rnsecs);
+		samples[i] = bench_perop(rsecs, rnsecs, b->b_iters);
+	}
+
+	if (b->b_cleanup != NULL) {
+		b->b_cleanup(b->b_arg);
+	}
+
+	bench_sort(samples, nsamples);
+	kprintf("kbench: name=%s samples=%u iters=%u "
+		"min_ns=%lu med_ns=%lu max_ns=%lu\n",
+		b->b_name, nsamples, b->b_iters,
+		(unsigned long)samples[0],
+		(unsigned long)samples[nsamples/2],
+		(unsigned long)samples[nsamples-1]);
+	return 0;
+}
+
+/*
+ * Parse "-s N" off the front of the arguments. Returns the index of
+ * the first remaining argument, or -1 on error.
+ */
+static
+int
+bench_getsamples(int nargs, char **args, unsigned *nsamples)
+{
+	int n;
+
+	*nsamples = BENCH_SAMPLES;
+	if (nargs > 2 && !strcmp(args[1], "-s")) {
+		n = atoi(args[2]);
+		if (n < 1 || n > BENCH_MAXSAMPLES) {
+			kprintf("kbench: samples must be 1 to %d\n",
+				BENCH_MAXSAMPLES);
+			return -1;
+		}
+		*nsamples = n;
+		return 3;
+	}
+	return 1;
+}
+
+int
+kbench(int nargs, char **args)
+{
+	unsigned nsamples;
+	int first, i, j, found, result = 0;
+
+	first = bench_getsamples(nargs, args, &nsamples);
+	if (first < 0) {
+		return EINVAL;
+	}
+
+	if (bench_done == NULL) {
+		bench_done = sem_create("kbench", 0);
+		if (bench_done == NULL) {
+			return ENOMEM;
+		}
+	}
+
+	if (first == nargs) {
+		for (i=0; membench[i].b_name != NULL; i++) {
+			result = bench_one(&membench[i], nsamples);
+			if (result) {
+				return result;
+			}
+		}
+		return 0;
+	}
+
+	for (j=first; j<nargs; j++) {
+		found = 0;
+		for (i=0; membench[i].b_name != NULL; i++) {
+			if (!strcmp(membench[i].b_name, args[j])) {
+				found = 1;
+				result = bench_one(&membench[i], nsamples);
+				if (result) {
+					return result;
+				}
+			}
+		}
+		if (!found) {
+			kprintf("kbench: no benchmark named %s\n", args[j]);
+			return EINVAL;
+		}
+	}
+	return 0;
+}
+
+int
+kbenchfs(int nargs, char **args)
+{
+	char name[64], buf[64];
+	unsigned nsamples;
+	int first, i, result = 0;
+	size_t len;
+
+	first = bench_getsamples(nargs, args, &nsamples);
+	if (first < 0) {
+		return EINVAL;
+	}
+	if (nargs != first+1) {
+		kprintf("Usage: kbfs [-s samples] filesystem\n");
+		return EINVAL;
+	}
+
+	/* Allow (but do not require) colon after device name */
+	len = strlen(args[first]);
+	if (len > 0 && args[first][len-1] == ':') {
+		args[first][len-1] = 0;
+	}
+	snprintf(name, sizeof(name), "%s:%s", args[first], BENCH_FILE);
+
+	/* vfs_open destroys the string it's passed */
+	strcpy(buf, name);
+	result = vfs_open(buf, O_RDWR|O_CREAT|O_TRUNC, &bench_vn);
+	if (result) {
+		kprintf("kbench: %s: %s\n", name, strerror(result));
+		return result;
+	}
+
+	for (i=0; fsbench[i].b_name != NULL; i++) {
+		result = bench_one(&fsbench[i], nsamples);
+		if (result) {
+			break;
+		}
+	}
+
+	vfs_close(bench_vn);
+	bench_vn = NULL;
+
+	strcpy(buf, name);
+	vfs_remove(buf);
+
+	return result;
+}
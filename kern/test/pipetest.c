@@ -0,0 +1,213 @@
+/*
+ * pipetest - kernel-thread pipe test
+ *
+ * The menu thread reads from a pipe while a second thread writes to
+ * it. The writer waits a tick first, so the reader is already blocked
+ * and the writer hands its data straight to the reader's uio. Covers
+ * a plain handoff, a write bigger than the reader's buffer (the rest
+ * goes through the ring), and bad buffers on either side: the side
+ * with the bad buffer should get EFAULT, and the data should survive.
+ *
+ * Kernel threads have no address space, so a user-space uio pointing
+ * at a kernel address is a handy buffer that always faults.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <synch.h>
+#include <thread.h>
+#include <clock.h>
+#include <vnode.h>
+#include <vfs.h>
+#include <uio.h>
+#include <test.h>
+
+#define BADPTR   ((userptr_t)0x80000000)
+
+static struct vnode *readend, *writeend;
+static struct semaphore *donesem;
+static int failures;
+
+static
+void
+pipetest_fail(const char *what, int result, size_t got)
+{
+	kprintf("pipetest: %s: result %d (%s), %lu bytes\n", what,
+		result, result ? strerror(result) : "ok", (unsigned long)got);
+	failures++;
+}
+
+/*
+ * Write LEN bytes of STR, or from BADPTR if STR is NULL, and expect
+ * EXPECT back.
+ */
+static
+void
+pipetest_write(const char *str, size_t len, int expect)
+{
+	struct uio ku;
+	int result;
+
+	if (str != NULL) {
+		mk_kuio(&ku, (char *)str, len, 0, UIO_WRITE);
+	}
+	else {
+		mk_uuio(&ku, BADPTR, len, 0, UIO_WRITE);
+	}
+	result = VOP_WRITE(writeend, &ku);
+	if (result != expect || (result == 0 && ku.uio_resid != 0)) {
+		pipetest_fail("write", result, len - ku.uio_resid);
+	}
+}
+
+/*
+ * Read into a LEN-byte buffer, or into BADPTR if BAD is set, and
+ * expect EXPECT back, along with the string WANT on success.
+ */
+static
+void
+pipetest_read(size_t len, int bad, int expect, const char *want)
+{
+	char buf[17];
+	struct uio ku;
+	size_t got;
+	int result;
+
+	assert(len < sizeof(buf));
+	if (!bad) {
+		mk_kuio(&ku, buf, len, 0, UIO_READ);
+	}
+	else {
+		mk_uuio(&ku, BADPTR, len, 0, UIO_READ);
+	}
+	result = VOP_READ(readend, &ku);
+	got = len - ku.uio_resid;
+	if (result != expect) {
+		pipetest_fail("read", result, got);
+		return;
+	}
+	buf[got] = 0;
+	if (want != NULL && strcmp(buf, want) != 0) {
+		pipetest_fail("read: wrong data", result, got);
+	}
+}
+
+static
+void
+pipewriter(void *junk, unsigned long step)
+{
+	(void)junk;
+
+	/* Give the reader time to block */
+	clocksleep(1);
+
+	switch (step) {
+	    case 0:
+		/* Plain handoff */
+		pipetest_write("hello", 5, 0);
+		break;
+	    case 1:
+		/* Handoff fills the reader; the rest goes in the ring */
+		pipetest_write("0123456789", 10, 0);
+		break;
+	    case 2:
+		/* Reader's buffer is bad; the data stays in the ring */
+		pipetest_write("abcdefgh", 8, 0);
+		break;
+	    case 3:
+		/* Our buffer is bad; the reader keeps waiting */
+		pipetest_write(NULL, 8, EFAULT);
+		pipetest_write("xy", 2, 0);
+		break;
+	    case 4:
+		/* Both are bad (copyuser) */
+		pipetest_write(NULL, 8, EFAULT);
+		pipetest_write("pq", 2, 0);
+		break;
+	}
+	V(donesem);
+}
+
+static
+void
+pipetest_step(unsigned long step)
+{
+	int result;
+
+	result = thread_fork("pipewriter", NULL, step, pipewriter, NULL);
+	if (result) {
+		panic("pipetest: thread_fork failed: %s\n", strerror(result));
+	}
+
+	switch (step) {
+	    case 0:
+		pipetest_read(16, 0, 0, "hello");
+		break;
+	    case 1:
+		pipetest_read(4, 0, 0, "0123");
+		break;
+	    case 2:
+	    case 4:
+		pipetest_read(8, 1, EFAULT, NULL);
+		break;
+	    case 3:
+		pipetest_read(8, 0, 0, "xy");
+		break;
+	}
+	P(donesem);
+
+	/* Pick up what's left in the ring */
+	switch (step) {
+	    case 1:
+		pipetest_read(16, 0, 0, "456789");
+		break;
+	    case 2:
+		pipetest_read(16, 0, 0, "abcdefgh");
+		break;
+	    case 4:
+		pipetest_read(16, 0, 0, "pq");
+		break;
+	}
+}
+
+int
+pipetest(int nargs, char **args)
+{
+	unsigned long step;
+	int result;
+
+	(void)nargs;
+	(void)args;
+
+	if (donesem == NULL) {
+		donesem = sem_create("pipetest", 0);
+		if (donesem == NULL) {
+			panic("pipetest: sem_create failed\n");
+		}
+	}
+
+	result = pipe_create(&readend, &writeend);
+	if (result) {
+		kprintf("pipetest: pipe_create: %s\n", strerror(result));
+		return result;
+	}
+
+	kprintf("Starting pipe test...\n");
+	failures = 0;
+	for (step = 0; step < 5; step++) {
+		pipetest_step(step);
+	}
+
+	/* EOF once the write end is gone */
+	vfs_close(writeend);
+	pipetest_read(16, 0, 0, "");
+	vfs_close(readend);
+
+	if (failures) {
+		kprintf("Pipe test failed\n");
+		return EINVAL;
+	}
+	kprintf("Pipe test done.\n");
+	return 0;
+}
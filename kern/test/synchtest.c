@@ -6,6 +6,7 @@
 #include <lib.h>
 #include <synch.h>
 #include <thread.h>
+#include <curthread.h>
 #include <test.h>
 #include <clock.h>
 
@@ -273,3 +274,129 @@ cvtest(int nargs, char **args)
 
 	return 0;
 }
+
+/*
+ * Priority inversion test.
+ *
+ * A low-priority thread takes testlock and works for a while; a
+ * high-priority thread then wants the lock, while several
+ * medium-priority threads spin. Without priority inheritance the
+ * holder never runs until the spinners give up, and the high thread
+ * waits for all of them. With it, the holder is boosted and the wait
+ * is only the holder's own work.
+ */
+
+#define NINVSPIN	4		/* medium-priority spinners */
+#define INVWORK		200000		/* holder's work, in loop iterations */
+#define INVTIMEOUT	3		/* spinners give up after this, seconds */
+
+static volatile int invdone;
+
+static
+void
+invlowthread(void *junk, unsigned long num)
+{
+	volatile unsigned long i;
+
+	(void)junk;
+	(void)num;
+
+	thread_setpriority(curthread, THREAD_PRI_MIN);
+	lock_acquire(testlock);
+	V(donesem);
+	for (i=0; i<INVWORK; i++);
+	lock_release(testlock);
+	V(donesem);
+}
+
+static
+void
+invspinthread(void *junk, unsigned long num)
+{
+	time_t secs, now;
+	u_int32_t nsecs;
+
+	(void)junk;
+	(void)num;
+
+	thread_setpriority(curthread, THREAD_PRI_DEFAULT+1);
+	gettime(&secs, &nsecs);
+	now = secs;
+	while (!invdone && now - secs < INVTIMEOUT) {
+		gettime(&now, &nsecs);
+	}
+	V(donesem);
+}
+
+static
+void
+invhighthread(void *junk, unsigned long num)
+{
+	time_t secs1, secs2, rsecs;
+	u_int32_t nsecs1, nsecs2, rnsecs;
+
+	(void)junk;
+	(void)num;
+
+	gettime(&secs1, &nsecs1);
+	lock_acquire(testlock);
+	gettime(&secs2, &nsecs2);
+	lock_release(testlock);
+	invdone = 1;
+
+	getinterval(secs1, nsecs1, secs2, nsecs2, &rsecs, &rnsecs);
+	kprintf("High-priority thread waited %lu.%09lu seconds for the lock\n",
+		(unsigned long)rsecs, (unsigned long)rnsecs);
+	if (rsecs >= INVTIMEOUT) {
+		kprintf("Priority inheritance isn't working.\n");
+	}
+	V(donesem);
+}
+
+int
+invtest(int nargs, char **args)
+{
+	int i, result, oldpri;
+
+	(void)nargs;
+	(void)args;
+
+	inititems();
+	kprintf("Starting priority inversion test...\n");
+
+	/*
+	 * Run at the top priority while setting up, so the spinners
+	 * don't starve us before the high thread exists.
+	 */
+	oldpri = thread_getpriority(curthread);
+	thread_setpriority(curthread, THREAD_PRI_MAX);
+	invdone = 0;
+
+	result = thread_fork("invlow", NULL, 0, invlowthread, NULL);
+	if (result) {
+		panic("invtest: thread_fork failed: %s\n", strerror(result));
+	}
+	/* wait until it holds the lock */
+	P(donesem);
+
+	for (i=0; i<NINVSPIN; i++) {
+		result = thread_fork("invspin", NULL, i, invspinthread, NULL);
+		if (result) {
+			panic("invtest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	result = thread_fork("invhigh", NULL, 0, invhighthread, NULL);
+	if (result) {
+		panic("invtest: thread_fork failed: %s\n", strerror(result));
+	}
+
+	for (i=0; i<NINVSPIN+2; i++) {
+		P(donesem);
+	}
+
+	thread_setpriority(curthread, oldpri);
+	kprintf("Priority inversion test done\n");
+
+	return 0;
+}
@@ -2,9 +2,11 @@
  * Thread test code.
  */
 #include <types.h>
+#include <kern/errno.h>
 #include <lib.h>
 #include <synch.h>
 #include <thread.h>
+#include <curthread.h>
 #include <test.h>
 
 #define NTHREADS  8
@@ -88,6 +90,42 @@ runthreads(int doloud)
 }
 
 
+/*
+ * For the join test: spin for a while, proportional to NUM, then
+ * exit.
+ */
+static
+void
+jointhread(void *junk, unsigned long num)
+{
+	volatile int i;
+
+	(void)junk;
+
+	for (i=0; i<(int)num*20000; i++);
+}
+
+/*
+ * For the join test: join the thread passed in. The main test joins
+ * this one, so its own attempt to join back must fail.
+ */
+static
+struct thread *jointest_main;
+
+static
+void
+joinbackthread(void *target, unsigned long junk)
+{
+	(void)junk;
+
+	if (thread_join(jointest_main) != EDEADLK) {
+		panic("threadtest4: join cycle not detected\n");
+	}
+	if (thread_join(target)) {
+		panic("threadtest4: join of sibling failed\n");
+	}
+}
+
 int
 threadtest(int nargs, char **args)
 {
@@ -115,3 +153,79 @@ threadtest2(int nargs, char **args)
 
 	return 0;
 }
+
+int
+threadtest4(int nargs, char **args)
+{
+	struct thread *t[NTHREADS], *t2;
+	char name[16];
+	int i, result;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting thread join test...\n");
+
+	/* Join threads that finish in all sorts of orders */
+	for (i=0; i<NTHREADS; i++) {
+		snprintf(name, sizeof(name), "jointest%d", i);
+		result = thread_fork(name, NULL, (i*5) % NTHREADS,
+				     jointhread, &t[i]);
+		if (result) {
+			panic("threadtest4: thread_fork failed %s)\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<NTHREADS; i++) {
+		result = thread_join(t[i]);
+		if (result) {
+			panic("threadtest4: thread_join: %s\n",
+			      strerror(result));
+		}
+	}
+
+	/* Joining a thread that's long gone should just return */
+	result = thread_fork("jointest-early", NULL, 0, jointhread, &t[0]);
+	if (result) {
+		panic("threadtest4: thread_fork failed %s)\n",
+		      strerror(result));
+	}
+	clocksleep(1);
+	if (thread_join(t[0])) {
+		panic("threadtest4: join of exited thread failed\n");
+	}
+
+	/* Deadlock: ourselves, and a thread joining back */
+	if (thread_join(curthread) != EDEADLK) {
+		panic("threadtest4: self-join not detected\n");
+	}
+	jointest_main = curthread;
+	result = thread_fork("jointest-target", NULL, NTHREADS,
+			     jointhread, &t[0]);
+	if (result == 0) {
+		result = thread_fork("jointest-back", t[0], 0,
+				     joinbackthread, &t2);
+	}
+	if (result) {
+		panic("threadtest4: thread_fork failed %s)\n",
+		      strerror(result));
+	}
+	if (thread_join(t2)) {
+		panic("threadtest4: join failed\n");
+	}
+
+	/* Detached threads clean up after themselves */
+	result = thread_fork("jointest-detach", NULL, NTHREADS,
+			     jointhread, &t[0]);
+	if (result) {
+		panic("threadtest4: thread_fork failed %s)\n",
+		      strerror(result));
+	}
+	if (thread_detach(t[0])) {
+		panic("threadtest4: thread_detach failed\n");
+	}
+
+	kprintf("Thread join test done.\n");
+
+	return 0;
+}
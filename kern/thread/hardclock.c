@@ -1,8 +1,11 @@
 #include <types.h>
+#include <kern/timepage.h>
 #include <lib.h>
 #include <machine/spl.h>
 #include <thread.h>
 #include <clock.h>
+#include <softirq.h>
+#include <vm.h>
 
 /* 
  * The address of lbolt has thread_wakeup called on it once a second.
@@ -11,8 +14,63 @@ int lbolt;
 
 static int lbolt_counter;
 
+/* Wakes up the lbolt sleepers, after the interrupt */
+static struct softirq lbolt_softirq;
+
+static
+void
+lbolt_wakeup(void *junk)
+{
+	int spl;
+
+	(void)junk;
+
+	spl = splhigh();
+	thread_wakeup(&lbolt);
+	splx(spl);
+}
+
+/*
+ * Set up hardclock's deferred work. Called by the timer device that
+ * drives hardclock, before it starts ticking.
+ */
+void
+hardclock_bootstrap(void)
+{
+	softirq_init(&lbolt_softirq, "lbolt", lbolt_wakeup, NULL);
+}
+
+/*
+ * Put the current time in the time page, if there is one yet.
+ * Interrupts are off, so nothing in the kernel sees it half done;
+ * user code that's reading it when the tick comes in sees tp_seq
+ * change and tries again.
+ */
+static
+void
+timepage_update(void)
+{
+	struct timepage *tp;
+	time_t secs;
+	u_int32_t nsecs;
+
+	if (vm_timepage == 0) {
+		return;
+	}
+	tp = (struct timepage *)PADDR_TO_KVADDR(vm_timepage);
+
+	gettime(&secs, &nsecs);
+	tp->tp_seq++;
+	tp->tp_secs = secs;
+	tp->tp_nsecs = nsecs;
+	tp->tp_seq++;
+}
+
 /*
  * This is called HZ times a second by the timer device setup.
+ *
+ * Waking up the lbolt sleepers and the forced context switch both
+ * happen on the way out of the interrupt, after other deferred work.
  */
 
 void
@@ -22,14 +80,15 @@ hardclock(void)
 	 * Collect statistics here as desired.
 	 */
 
+	timepage_update();
 
 	lbolt_counter++;
 	if (lbolt_counter >= HZ) {
 		lbolt_counter = 0;
-		thread_wakeup(&lbolt);
+		softirq_raise(&lbolt_softirq);
 	}
 
-	thread_yield();
+	softirq_yield();
 }
 
 /*
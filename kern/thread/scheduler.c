@@ -1,23 +1,78 @@
 /*
  * Scheduler.
  *
- * The default scheduler is very simple, just a round-robin run queue.
- * You'll want to improve it.
+ * Strict priority: one round-robin run queue per priority level
+ * (THREAD_PRI_MIN through THREAD_PRI_MAX), and the scheduler always
+ * takes from the highest nonempty one. The queues are linked through
+ * the threads themselves, so a thread whose priority changes while
+ * it's runnable can be moved to its new queue, and making a thread
+ * runnable can't fail.
  */
 
 #include <types.h>
 #include <lib.h>
 #include <scheduler.h>
+#include <softirq.h>
 #include <thread.h>
 #include <machine/spl.h>
-#include <queue.h>
+#include <vm.h>
 
 /*
  *  Scheduler data
  */
 
-// Queue of runnable threads
-static struct queue *runqueue;
+struct runqueue {
+	struct thread *rq_head;
+	struct thread *rq_tail;
+};
+
+// Queues of runnable threads, by priority
+static struct runqueue runqueues[THREAD_NPRI];
+
+// Number of runnable threads, over all queues
+static int numrunnable;
+
+static
+void
+rq_add(struct thread *t, int pri)
+{
+	struct runqueue *rq = &runqueues[pri];
+
+	t->t_rqpri = pri;
+	t->t_rqnext = NULL;
+	t->t_rqprev = rq->rq_tail;
+	if (rq->rq_tail != NULL) {
+		rq->rq_tail->t_rqnext = t;
+	}
+	else {
+		rq->rq_head = t;
+	}
+	rq->rq_tail = t;
+	numrunnable++;
+}
+
+static
+void
+rq_remove(struct thread *t)
+{
+	struct runqueue *rq = &runqueues[t->t_rqpri];
+
+	if (t->t_rqprev != NULL) {
+		t->t_rqprev->t_rqnext = t->t_rqnext;
+	}
+	else {
+		rq->rq_head = t->t_rqnext;
+	}
+	if (t->t_rqnext != NULL) {
+		t->t_rqnext->t_rqprev = t->t_rqprev;
+	}
+	else {
+		rq->rq_tail = t->t_rqprev;
+	}
+	t->t_rqnext = t->t_rqprev = NULL;
+	t->t_rqpri = -1;
+	numrunnable--;
+}
 
 /*
  * Setup function
@@ -25,24 +80,25 @@ static struct queue *runqueue;
 void
 scheduler_bootstrap(void)
 {
-	runqueue = q_create(32);
-	if (runqueue == NULL) {
-		panic("scheduler: Could not create run queue\n");
+	int i;
+
+	for (i=0; i<THREAD_NPRI; i++) {
+		runqueues[i].rq_head = runqueues[i].rq_tail = NULL;
 	}
+	numrunnable = 0;
 }
 
 /*
  * Ensure space for handling at least NTHREADS threads.
- * This is done only to ensure that make_runnable() does not fail -
- * if you change the scheduler to not require space outside the 
- * thread structure, for instance, this function can reasonably
- * do nothing.
+ * The run queues live in the thread structures, so there's nothing
+ * to do.
  */
 int
 scheduler_preallocate(int nthreads)
 {
 	assert(curspl>0);
-	return q_preallocate(runqueue, nthreads);
+	(void)nthreads;
+	return 0;
 }
 
 /*
@@ -54,10 +110,16 @@ scheduler_preallocate(int nthreads)
 void
 scheduler_killall(void)
 {
+	int i;
+
 	assert(curspl>0);
-	while (!q_empty(runqueue)) {
-		struct thread *t = q_remhead(runqueue);
-		kprintf("scheduler: Dropping thread %s.\n", t->t_name);
+	for (i=0; i<THREAD_NPRI; i++) {
+		while (runqueues[i].rq_head != NULL) {
+			struct thread *t = runqueues[i].rq_head;
+			rq_remove(t);
+			kprintf("scheduler: Dropping thread %s.\n",
+				t->t_name);
+		}
 	}
 }
 
@@ -74,8 +136,6 @@ scheduler_shutdown(void)
 	scheduler_killall();
 
 	assert(curspl>0);
-	q_destroy(runqueue);
-	runqueue = NULL;
 }
 
 /*
@@ -87,10 +147,23 @@ scheduler_shutdown(void)
 struct thread *
 scheduler(void)
 {
+	struct thread *t;
+	int i;
+
 	// meant to be called with interrupts off
 	assert(curspl>0);
 	
-	while (q_empty(runqueue)) {
+	while (numrunnable == 0) {
+		/* Deferred interrupt work may make something runnable */
+		if (softirq_idle()) {
+			continue;
+		}
+#if !OPT_DUMBVM
+		/* Use idle time to zero free pages, a page at a time */
+		if (vm_idlezero()) {
+			continue;
+		}
+#endif
 		cpu_idle();
 	}
 
@@ -100,21 +173,64 @@ scheduler(void)
 	// prohibitive.
 	// 
 	//print_run_queue();
-	
-	return q_remhead(runqueue);
+
+	for (i=THREAD_PRI_MAX; i>=THREAD_PRI_MIN; i--) {
+		t = runqueues[i].rq_head;
+		if (t != NULL) {
+			rq_remove(t);
+			return t;
+		}
+	}
+	panic("scheduler: runnable threads not on any queue\n");
+	return NULL;
 }
 
 /* 
- * Make a thread runnable.
- * With the base scheduler, just add it to the end of the run queue.
+ * Make a thread runnable: add it to the end of the run queue for its
+ * (effective) priority.
  */
 int
 make_runnable(struct thread *t)
 {
 	// meant to be called with interrupts off
+	assert(curspl>0);
+	assert(t->t_rqpri < 0);
+
+	rq_add(t, t->t_pri);
+	return 0;
+}
+
+/*
+ * T's priority has changed. If it's waiting to run, move it to the
+ * right queue.
+ */
+void
+scheduler_reprioritize(struct thread *t)
+{
+	assert(curspl>0);
+
+	if (t->t_rqpri >= 0 && t->t_rqpri != t->t_pri) {
+		rq_remove(t);
+		rq_add(t, t->t_pri);
+	}
+}
+
+/*
+ * Return the highest priority of any runnable thread, or -1.
+ */
+int
+scheduler_toppri(void)
+{
+	int i;
+
 	assert(curspl>0);
 
-	return q_addtail(runqueue, t);
+	for (i=THREAD_PRI_MAX; i>=THREAD_PRI_MIN; i--) {
+		if (runqueues[i].rq_head != NULL) {
+			return i;
+		}
+	}
+	return -1;
 }
 
 /*
@@ -127,13 +243,14 @@ print_run_queue(void)
 	int spl = splhigh();
 
 	int i,k=0;
-	i = q_getstart(runqueue);
-	
-	while (i!=q_getend(runqueue)) {
-		struct thread *t = q_getguy(runqueue, i);
-		kprintf("  %2d: %s %p\n", k, t->t_name, t->t_sleepaddr);
-		i=(i+1)%q_getsize(runqueue);
-		k++;
+	struct thread *t;
+
+	for (i=THREAD_PRI_MAX; i>=THREAD_PRI_MIN; i--) {
+		for (t = runqueues[i].rq_head; t != NULL; t = t->t_rqnext) {
+			kprintf("  %2d: [%d] %s %p\n", k, i, t->t_name,
+				t->t_sleepaddr);
+			k++;
+		}
 	}
 	
 	splx(spl);
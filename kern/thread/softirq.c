@@ -0,0 +1,304 @@
+/*
+ * Deferred interrupt work. See softirq.h.
+ *
+ * Pending sources are kept on a FIFO queue linked through the sources
+ * themselves, so raising one from an interrupt handler never
+ * allocates and never fails.
+ *
+ * Only one context runs pending work at a time (softirq_running): an
+ * interrupt that arrives while work is running from the return path
+ * of an earlier one just queues its own work, and the outer loop
+ * picks it up. Work functions can't sleep, so there's never a context
+ * switch while softirq_running is set.
+ */
+#include <types.h>
+#include <lib.h>
+#include <clock.h>
+#include <softirq.h>
+#include <thread.h>
+#include <curthread.h>
+#include <machine/spl.h>
+
+/* Every source, for stats */
+static struct softirq *softirq_all;
+
+/* Pending sources, oldest first */
+static struct softirq *softirq_head;
+static struct softirq *softirq_tail;
+
+/* Someone is running pending work */
+static int softirq_running;
+
+/* Yield once pending work has run (see softirq_yield) */
+static int softirq_wantyield;
+
+/* The clock is up, so latencies can be measured */
+static int softirq_timed;
+
+void
+softirq_init(struct softirq *si, const char *name,
+	     void (*func)(void *data), void *data)
+{
+	int spl;
+
+	snprintf(si->si_name, sizeof(si->si_name), "%s", name);
+	si->si_func = func;
+	si->si_data = data;
+	si->si_pending = 0;
+	si->si_raisesecs = 0;
+	si->si_raisensecs = 0;
+	si->si_next = NULL;
+	si->si_irqs = 0;
+	si->si_runs = 0;
+	si->si_nlat = 0;
+	si->si_totlat = 0;
+	si->si_maxlat = 0;
+
+	spl = splhigh();
+	si->si_allnext = softirq_all;
+	softirq_all = si;
+	splx(spl);
+}
+
+void
+softirq_raise(struct softirq *si)
+{
+	assert(curspl>0);
+
+	si->si_irqs++;
+	if (si->si_pending) {
+		/* Already queued; its work function will see this too */
+		return;
+	}
+
+	si->si_pending = 1;
+	if (softirq_timed) {
+		gettime(&si->si_raisesecs, &si->si_raisensecs);
+	}
+
+	si->si_next = NULL;
+	if (softirq_tail != NULL) {
+		softirq_tail->si_next = si;
+	}
+	else {
+		softirq_head = si;
+	}
+	softirq_tail = si;
+}
+
+/*
+ * Charge the time SI spent on the queue to its stats. Interrupts off.
+ */
+static
+void
+softirq_account(struct softirq *si)
+{
+	time_t secs;
+	u_int32_t nsecs, lat;
+
+	si->si_runs++;
+	if (!softirq_timed || si->si_raisesecs == 0) {
+		return;
+	}
+
+	gettime(&secs, &nsecs);
+	getinterval(si->si_raisesecs, si->si_raisensecs, secs, nsecs,
+		    &secs, &nsecs);
+	if (secs >= 4000) {
+		lat = 0xffffffff;
+	}
+	else {
+		lat = secs*1000000 + nsecs/1000;
+	}
+
+	si->si_nlat++;
+	si->si_totlat += lat;
+	if (lat > si->si_maxlat) {
+		si->si_maxlat = lat;
+	}
+}
+
+/*
+ * Run up to MAX pending sources, at the caller's spl. Returns nonzero
+ * if there's still work pending afterwards.
+ */
+static
+int
+softirq_work(int max)
+{
+	struct softirq *si;
+	int spl, n, old_in, more;
+
+	assert(softirq_running);
+
+	/* Work functions count as interrupt handlers; they can't sleep */
+	old_in = in_interrupt;
+	in_interrupt = 1;
+
+	for (n=0; n<max; n++) {
+		spl = splhigh();
+		si = softirq_head;
+		if (si == NULL) {
+			splx(spl);
+			break;
+		}
+		softirq_head = si->si_next;
+		if (softirq_head == NULL) {
+			softirq_tail = NULL;
+		}
+		si->si_next = NULL;
+		si->si_pending = 0;
+		softirq_account(si);
+		splx(spl);
+
+		si->si_func(si->si_data);
+	}
+
+	in_interrupt = old_in;
+
+	spl = splhigh();
+	more = softirq_head != NULL;
+	splx(spl);
+
+	return more;
+}
+
+/*
+ * Called by the trap code on the way out of an interrupt that came in
+ * with interrupts on. Interrupts are off, and stay off on return.
+ */
+void
+softirq_irqexit(void)
+{
+	int more;
+
+	assert(curspl>0);
+
+	if (softirq_running) {
+		/* Nested in the work loop of an earlier interrupt */
+		return;
+	}
+
+	if (softirq_head != NULL) {
+		softirq_running = 1;
+		spl0();
+		more = softirq_work(SOFTIRQ_BATCH);
+		splhigh();
+		softirq_running = 0;
+
+		if (more) {
+			/* Too much for one interrupt; let softirqd finish */
+			thread_wakeup(&softirq_head);
+		}
+	}
+
+	/*
+	 * No thread to preempt if the tick came in while the scheduler
+	 * was idle (vm_idlezero runs with interrupts on).
+	 */
+	if (softirq_wantyield) {
+		softirq_wantyield = 0;
+		if (curthread != NULL) {
+			thread_preempt();
+		}
+	}
+}
+
+/*
+ * Called by the scheduler, with interrupts off, when there's nothing
+ * to run. The interrupts that wake an idle processor come in at
+ * splhigh, so their work doesn't get run on the way out; run it here,
+ * or the thread it would wake up never gets to run.
+ */
+int
+softirq_idle(void)
+{
+	assert(curspl>0);
+
+	if (softirq_running || softirq_head == NULL) {
+		return 0;
+	}
+
+	softirq_running = 1;
+	softirq_work(SOFTIRQ_BATCH);
+	softirq_running = 0;
+	return 1;
+}
+
+/*
+ * Ask for the interrupted thread to yield once pending work has run.
+ * For hardclock, so that deferred work isn't left waiting behind a
+ * time slice.
+ */
+void
+softirq_yield(void)
+{
+	assert(curspl>0);
+	softirq_wantyield = 1;
+}
+
+/*
+ * Thread that finishes work the return-from-interrupt path didn't get
+ * to. It runs at top priority: it's doing what would otherwise have
+ * been done in the interrupt handler.
+ */
+static
+void
+softirq_thread(void *junk, unsigned long num)
+{
+	int spl;
+
+	(void)junk;
+	(void)num;
+
+	thread_setpriority(curthread, THREAD_PRI_MAX);
+
+	for (;;) {
+		spl = splhigh();
+		while (softirq_head == NULL || softirq_running) {
+			thread_sleep(&softirq_head);
+		}
+		softirq_running = 1;
+		splx(spl);
+
+		while (softirq_work(SOFTIRQ_BATCH)) {
+			/* keep going */
+		}
+
+		spl = splhigh();
+		softirq_running = 0;
+		splx(spl);
+	}
+}
+
+/*
+ * Start softirqd. Must be called after the clock is attached.
+ */
+void
+softirq_bootstrap(void)
+{
+	int result;
+
+	softirq_timed = 1;
+
+	result = thread_fork("softirqd", NULL, 0, softirq_thread, NULL);
+	if (result) {
+		panic("Could not start softirq thread: %s\n",
+		      strerror(result));
+	}
+}
+
+void
+softirq_printstats(void)
+{
+	struct softirq *si;
+
+	kprintf("softirq: %-12s %8s %8s %8s %8s\n",
+		"source", "irqs", "runs", "avg_us", "max_us");
+	for (si = softirq_all; si != NULL; si = si->si_allnext) {
+		kprintf("softirq: %-12s %8u %8u %8u %8u\n", si->si_name,
+			si->si_irqs, si->si_runs,
+			si->si_nlat ? si->si_totlat / si->si_nlat : 0,
+			si->si_maxlat);
+	}
+}
@@ -133,6 +133,8 @@ lock_create(const char *name)
 	// No one holds the lock initially
 	lock->flag = 0;
 	lock->owner = NULL;
+	lock->holder = NULL;
+	lock->nextheld = NULL;
 	
 	return lock;
 }
@@ -168,11 +170,22 @@ lock_acquire(struct lock *lock)
 	spl = splhigh();
 
 	while (lock->flag == 1){
+		// Lend our priority to the holder, and whoever it's
+		// waiting for, while we wait
+		curthread->t_waitlock = lock;
+		thread_donatepri(lock->holder, curthread->t_pri);
 		thread_sleep(lock);
+		curthread->t_waitlock = NULL;
 	}
 	
 	lock->flag = 1;
 	lock->owner = curthread->t_name;
+	lock->holder = curthread;
+	lock->nextheld = curthread->t_heldlocks;
+	curthread->t_heldlocks = lock;
+
+	// Anyone still waiting lends us their priority now
+	thread_updatepri(curthread);
 	//kprintf("\nI captured the lock %s\n", lock->name);
 
 	splx(spl);
@@ -183,16 +196,43 @@ lock_acquire(struct lock *lock)
 void
 lock_release(struct lock *lock)
 {
-	int spl;
+	struct thread *holder;
+	struct lock **lp;
+	int spl, waiterpri;
 	spl = splhigh();
 
 	// Check if lock exists
 	assert(lock != NULL);
+
+	// Take it off the holder's list and give back what was lent
+	holder = lock->holder;
+	if (holder != NULL) {
+		for (lp = &holder->t_heldlocks; *lp != NULL;
+		     lp = &(*lp)->nextheld) {
+			if (*lp == lock) {
+				*lp = lock->nextheld;
+				break;
+			}
+		}
+		lock->nextheld = NULL;
+		lock->holder = NULL;
+		thread_updatepri(holder);
+	}
+
 	lock->flag = 0;
 	lock->owner = NULL;
+	waiterpri = thread_sleeperpri(lock);
 	thread_wakeup(lock);
 
 	splx(spl);
+
+	// Let a more important waiter have it right away. Not if the
+	// caller had interrupts off: it may be about to sleep (cv_wait,
+	// pipe_sleep) and counts on nobody running until it does, or it
+	// would miss the wakeup.
+	if (waiterpri > curthread->t_pri && in_interrupt == 0 && spl == 0) {
+		thread_yield();
+	}
 }
 
 int
@@ -5,13 +5,16 @@
 #include <lib.h>
 #include <kern/errno.h>
 #include <array.h>
+#include <clock.h>
 #include <machine/spl.h>
 #include <machine/pcb.h>
+#include <synch.h>
 #include <thread.h>
 #include <curthread.h>
 #include <scheduler.h>
 #include <addrspace.h>
 #include <vnode.h>
+#include <file.h>
 #include "opt-synchprobs.h"
 
 /* States a thread can be in. */
@@ -34,6 +37,35 @@ static struct array *zombies;
 /* Total number of outstanding threads. Does not count zombies[]. */
 static int numthreads;
 
+/*
+ * Every thread structure in use, including zombies not yet disposed
+ * of, linked through t_allnext/t_allprev; and how many there are.
+ * Only touched at splhigh.
+ */
+static struct thread *allthreads;
+static struct thread *allthreads_tail;
+static int numallthreads;
+static u_int32_t lastthreadid;
+
+/* The clock is up, so CPU time can be charged */
+static int thread_timed;
+
+/*
+ * Cache of dead threads' structures, each with its stack still
+ * attached and the stack's magic number still in place, for
+ * thread_fork to reuse without going to kmalloc. Only touched at
+ * splhigh.
+ */
+#define THREAD_CACHEMAX  16
+static struct thread *threadcache[THREAD_CACHEMAX];
+static int threadcache_num;
+
+static struct {
+	u_int32_t tc_hits;	/* forks served from the cache */
+	u_int32_t tc_misses;	/* forks that had to allocate */
+	u_int32_t tc_frees;	/* dead threads freed, cache being full */
+} thread_stats;
+
 /*
  * Returns number of active threads
  */
@@ -45,10 +77,54 @@ thread_count(void)
 }
 
 /*
- * Create a thread. This is used both to create the first thread's 
- * thread structure and to create subsequent threads.
+ * Set up a thread structure, fresh or from the cache. The stack is
+ * left alone.
  */
+static
+void
+thread_init(struct thread *thread, const char *name)
+{
+	int i;
+
+	for (i=0; i<THREAD_NAMELEN-1 && name[i]; i++) {
+		thread->t_name[i] = name[i];
+	}
+	thread->t_name[i] = 0;
+	thread->t_sleepaddr = NULL;
+	thread->t_joinable = 0;
+	thread->t_exited = 0;
+	thread->t_njoiners = 0;
+	thread->t_joining = NULL;
+	thread->t_basepri = THREAD_PRI_DEFAULT;
+	thread->t_pri = THREAD_PRI_DEFAULT;
+	thread->t_rqpri = -1;
+	thread->t_rqnext = NULL;
+	thread->t_rqprev = NULL;
+	thread->t_waitlock = NULL;
+	thread->t_heldlocks = NULL;
+
+	thread->t_id = 0;
+	thread->t_allnext = NULL;
+	thread->t_allprev = NULL;
+	thread->t_preempted = 0;
+	bzero(&thread->t_ru, sizeof(thread->t_ru));
+	thread->t_marksecs = 0;
+	thread->t_marknsecs = 0;
+	
+	thread->t_vmspace = NULL;
+
+	thread->t_cwd = NULL;
 
+	thread->t_filetable = NULL;
+	
+	// If you add things to the thread structure, be sure to initialize
+	// them here.
+}
+
+/*
+ * Create a thread with no stack. This is used to create the first
+ * thread's thread structure.
+ */
 static
 struct thread *
 thread_create(const char *name)
@@ -57,24 +133,139 @@ thread_create(const char *name)
 	if (thread==NULL) {
 		return NULL;
 	}
-	thread->t_name = kstrdup(name);
-	if (thread->t_name==NULL) {
+	thread_init(thread, name);
+	thread->t_stack = NULL;
+	return thread;
+}
+
+/*
+ * Get a thread with a stack, for thread_fork: from the cache if
+ * there's one there, otherwise freshly allocated.
+ */
+static
+struct thread *
+thread_create_stacked(const char *name)
+{
+	struct thread *thread;
+	int s;
+
+	s = splhigh();
+	if (threadcache_num > 0) {
+		thread = threadcache[--threadcache_num];
+		thread_stats.tc_hits++;
+	}
+	else {
+		thread = NULL;
+		thread_stats.tc_misses++;
+	}
+	splx(s);
+
+	if (thread != NULL) {
+		thread_init(thread, name);
+		return thread;
+	}
+
+	thread = thread_create(name);
+	if (thread==NULL) {
+		return NULL;
+	}
+	thread->t_stack = kmalloc(STACK_SIZE);
+	if (thread->t_stack==NULL) {
 		kfree(thread);
 		return NULL;
 	}
-	thread->t_sleepaddr = NULL;
-	thread->t_stack = NULL;
-	
-	thread->t_vmspace = NULL;
 
-	thread->t_cwd = NULL;
-	
-	// If you add things to the thread structure, be sure to initialize
-	// them here.
-	
+	/* stick a magic number on the bottom end of the stack */
+	thread->t_stack[0] = 0xae;
+	thread->t_stack[1] = 0x11;
+	thread->t_stack[2] = 0xda;
+	thread->t_stack[3] = 0x33;
+
 	return thread;
 }
 
+/*
+ * Add a thread to the list of all threads, giving it an id.
+ */
+static
+void
+thread_link(struct thread *thread)
+{
+	int s;
+
+	s = splhigh();
+	thread->t_id = ++lastthreadid;
+	thread->t_allnext = NULL;
+	thread->t_allprev = allthreads_tail;
+	if (allthreads_tail != NULL) {
+		allthreads_tail->t_allnext = thread;
+	}
+	else {
+		allthreads = thread;
+	}
+	allthreads_tail = thread;
+	numallthreads++;
+	splx(s);
+}
+
+static
+void
+thread_unlink(struct thread *thread)
+{
+	int s;
+
+	s = splhigh();
+	if (thread->t_allprev != NULL) {
+		thread->t_allprev->t_allnext = thread->t_allnext;
+	}
+	else {
+		allthreads = thread->t_allnext;
+	}
+	if (thread->t_allnext != NULL) {
+		thread->t_allnext->t_allprev = thread->t_allprev;
+	}
+	else {
+		allthreads_tail = thread->t_allprev;
+	}
+	thread->t_allnext = thread->t_allprev = NULL;
+	numallthreads--;
+	splx(s);
+}
+
+/*
+ * Put a thread structure in the cache, or free it if the cache is
+ * full or it has no stack.
+ */
+static
+void
+thread_free(struct thread *thread)
+{
+	int s;
+
+	s = splhigh();
+	if (thread->t_stack != NULL && threadcache_num < THREAD_CACHEMAX) {
+		threadcache[threadcache_num++] = thread;
+		splx(s);
+		return;
+	}
+	thread_stats.tc_frees++;
+	splx(s);
+
+	if (thread->t_stack) {
+		kfree(thread->t_stack);
+	}
+	kfree(thread);
+}
+
+void
+thread_printstats(void)
+{
+	kprintf("thread: %u forks from cache, %u allocated, "
+		"%u freed; %d cached\n",
+		thread_stats.tc_hits, thread_stats.tc_misses,
+		thread_stats.tc_frees, threadcache_num);
+}
+
 /*
  * Destroy a thread.
  *
@@ -93,13 +284,10 @@ thread_destroy(struct thread *thread)
 	// These things are cleaned up in thread_exit.
 	assert(thread->t_vmspace==NULL);
 	assert(thread->t_cwd==NULL);
-	
-	if (thread->t_stack) {
-		kfree(thread->t_stack);
-	}
+	assert(thread->t_filetable==NULL);
 
-	kfree(thread->t_name);
-	kfree(thread);
+	thread_unlink(thread);
+	thread_free(thread);
 }
 
 
@@ -211,6 +399,7 @@ thread_bootstrap(void)
 
 	/* Set curthread */
 	curthread = me;
+	thread_link(me);
 
 	/* Number of threads starts at 1 */
 	numthreads = 1;
@@ -247,25 +436,14 @@ thread_fork(const char *name,
 	struct thread *newguy;
 	int s, result;
 
-	/* Allocate a thread */
-	newguy = thread_create(name);
+	/* Get a thread and stack, usually from the cache */
+	newguy = thread_create_stacked(name);
 	if (newguy==NULL) {
 		return ENOMEM;
 	}
 
-	/* Allocate a stack */
-	newguy->t_stack = kmalloc(STACK_SIZE);
-	if (newguy->t_stack==NULL) {
-		kfree(newguy->t_name);
-		kfree(newguy);
-		return ENOMEM;
-	}
-
-	/* stick a magic number on the bottom end of the stack */
-	newguy->t_stack[0] = 0xae;
-	newguy->t_stack[1] = 0x11;
-	newguy->t_stack[2] = 0xda;
-	newguy->t_stack[3] = 0x33;
+	/* Inherit the (base) priority */
+	newguy->t_basepri = newguy->t_pri = curthread->t_basepri;
 
 	/* Inherit the current directory */
 	if (curthread->t_cwd != NULL) {
@@ -298,11 +476,17 @@ thread_fork(const char *name,
 		goto fail;
 	}
 
+	/* Threads whose creator keeps a pointer to them are joinable */
+	if (ret != NULL) {
+		newguy->t_joinable = 1;
+	}
+
 	/* Make the new thread runnable */
 	result = make_runnable(newguy);
 	if (result != 0) {
 		goto fail;
 	}
+	thread_link(newguy);
 
 	/*
 	 * Increment the thread counter. This must be done atomically
@@ -332,9 +516,7 @@ thread_fork(const char *name,
 	if (newguy->t_cwd != NULL) {
 		VOP_DECREF(newguy->t_cwd);
 	}
-	kfree(newguy->t_stack);
-	kfree(newguy->t_name);
-	kfree(newguy);
+	thread_free(newguy);
 
 	return result;
 }
@@ -342,13 +524,115 @@ thread_fork(const char *name,
 /*
  * Suspend execution of curthread until thread terminates. 
  * Return zero on success, EDEADLK if deadlock would occur.
+ *
+ * A joinable thread that exits stays off the zombie list, so it's
+ * still here however late the join comes. Joiners sleep on the
+ * target's t_exited, which thread_exit wakes.
+ */
+int
+thread_join(struct thread *thread)
+{
+	struct thread *t;
+	int s;
+
+	s = splhigh();
+
+	/* Deadlock if the target is waiting, directly or not, for us */
+	for (t = thread; t != NULL; t = t->t_joining) {
+		if (t == curthread) {
+			splx(s);
+			return EDEADLK;
+		}
+	}
+
+	if (!thread->t_joinable) {
+		splx(s);
+		return EINVAL;
+	}
+
+	thread->t_njoiners++;
+	curthread->t_joining = thread;
+	while (!thread->t_exited) {
+		thread_sleep(&thread->t_exited);
+	}
+	curthread->t_joining = NULL;
+	thread->t_njoiners--;
+
+	/*
+	 * The last joiner out disposes of the thread. It's already
+	 * switched off its stack for good: it set t_exited at splhigh
+	 * right before doing so.
+	 */
+	if (thread->t_njoiners == 0) {
+		thread_destroy(thread);
+	}
+
+	splx(s);
+	return 0;
+}
+
+int
+thread_detach(struct thread *thread)
+{
+	int s;
+
+	s = splhigh();
+
+	if (!thread->t_joinable || thread->t_njoiners > 0) {
+		splx(s);
+		return EINVAL;
+	}
+
+	thread->t_joinable = 0;
+	if (thread->t_exited) {
+		thread_destroy(thread);
+	}
+
+	splx(s);
+	return 0;
+}
+
+/*
+ * Add an interval to a time in an rusage.
+ */
+static
+void
+rusage_addtime(time_t *secs, u_int32_t *nsecs, time_t dsecs, u_int32_t dnsecs)
+{
+	*secs += dsecs;
+	*nsecs += dnsecs;
+	if (*nsecs >= 1000000000) {
+		*nsecs -= 1000000000;
+		(*secs)++;
+	}
+}
+
+/*
+ * Charge the time since T's last mark to its user or system time, and
+ * move the mark to SECS/NSECS. A thread that has no mark yet (the
+ * clock wasn't up when it last ran) just gets one.
  */
-int thread_join(struct thread * thread)
+static
+void
+thread_charge(struct thread *t, int user, time_t secs, u_int32_t nsecs)
 {
-        // Replace this
-        clocksleep(5);
-        (void)thread;  // suppress warning until code gets written
-        return 0;
+	time_t dsecs;
+	u_int32_t dnsecs;
+
+	if (t->t_marksecs != 0) {
+		getinterval(t->t_marksecs, t->t_marknsecs, secs, nsecs,
+			    &dsecs, &dnsecs);
+		if (user) {
+			rusage_addtime(&t->t_ru.ru_utime_sec,
+				       &t->t_ru.ru_utime_nsec, dsecs, dnsecs);
+		}
+		else {
+			rusage_addtime(&t->t_ru.ru_stime_sec,
+				       &t->t_ru.ru_stime_nsec, dsecs, dnsecs);
+		}
+	}
+	t->t_marksecs = secs;
+	t->t_marknsecs = nsecs;
 }
 
 /*
@@ -359,6 +643,8 @@ void
 mi_switch(threadstate_t nextstate)
 {
 	struct thread *cur, *next;
+	time_t secs;
+	u_int32_t nsecs;
 	int result;
 	
 	/* Interrupts should already be off. */
@@ -389,6 +675,24 @@ mi_switch(threadstate_t nextstate)
 	cur = curthread;
 	curthread = NULL;
 
+	/* Charge the time it ran, and count the switch */
+	if (thread_timed) {
+		gettime(&secs, &nsecs);
+		thread_charge(cur, 0, secs, nsecs);
+	}
+	if (nextstate==S_SLEEP) {
+		cur->t_ru.ru_nvcsw++;
+	}
+	else if (nextstate==S_READY) {
+		if (cur->t_preempted) {
+			cur->t_ru.ru_nivcsw++;
+		}
+		else {
+			cur->t_ru.ru_nvcsw++;
+		}
+	}
+	cur->t_preempted = 0;
+
 	/*
 	 * Stash the current thread on whatever list it's supposed to go on.
 	 * Because we preallocate during thread_fork, this should not fail.
@@ -406,7 +710,13 @@ mi_switch(threadstate_t nextstate)
 	}
 	else {
 		assert(nextstate==S_ZOMB);
-		result = array_add(zombies, cur);
+		if (cur->t_joinable) {
+			/* Left for thread_join or thread_detach */
+			result = 0;
+		}
+		else {
+			result = array_add(zombies, cur);
+		}
 	}
 	assert(result==0);
 
@@ -416,6 +726,11 @@ mi_switch(threadstate_t nextstate)
 
 	next = scheduler();
 
+	/* Its time starts now, not counting any spent idle */
+	if (thread_timed) {
+		gettime(&next->t_marksecs, &next->t_marknsecs);
+	}
+
 	/* update curthread */
 	curthread = next;
 	
@@ -464,23 +779,36 @@ thread_exit(void)
 		assert(curthread->t_stack[3] == (char)0x33);
 	}
 
-	splhigh();
-
 	if (curthread->t_vmspace) {
 		/*
 		 * Do this carefully to avoid race condition with
-		 * context switch code.
+		 * context switch code. This is done before going to
+		 * splhigh because as_destroy may have to write back
+		 * shared file mappings.
 		 */
 		struct addrspace *as = curthread->t_vmspace;
 		curthread->t_vmspace = NULL;
 		as_destroy(as);
 	}
 
+	if (curthread->t_filetable) {
+		filetable_destroy(curthread->t_filetable);
+		curthread->t_filetable = NULL;
+	}
+
+	splhigh();
+
 	if (curthread->t_cwd) {
 		VOP_DECREF(curthread->t_cwd);
 		curthread->t_cwd = NULL;
 	}
 
+	/* Wake anyone joining us */
+	curthread->t_exited = 1;
+	if (curthread->t_njoiners > 0) {
+		thread_wakeup(&curthread->t_exited);
+	}
+
 	assert(numthreads>0);
 	numthreads--;
 	mi_switch(S_ZOMB);
@@ -503,6 +831,22 @@ thread_yield(void)
 	splx(spl);
 }
 
+/*
+ * Yield the cpu because the current thread's time is up. The same as
+ * thread_yield but for accounting.
+ */
+void
+thread_preempt(void)
+{
+	int spl = splhigh();
+
+	assert(sleepers != NULL);
+
+	curthread->t_preempted = 1;
+	mi_switch(S_READY);
+	splx(spl);
+}
+
 /*
  * Yield the cpu to another process, and go to sleep, on "sleep
  * address" ADDR. Subsequent calls to thread_wakeup with the same
@@ -610,6 +954,87 @@ thread_hassleepers(const void *addr)
 	return 0;
 }
 
+int
+thread_setpriority(struct thread *t, int pri)
+{
+	int s;
+
+	if (pri < THREAD_PRI_MIN || pri > THREAD_PRI_MAX) {
+		return EINVAL;
+	}
+
+	s = splhigh();
+	t->t_basepri = pri;
+	thread_updatepri(t);
+
+	/* Step aside if we're no longer the most important */
+	if (t == curthread && in_interrupt == 0 &&
+	    scheduler_toppri() > curthread->t_pri) {
+		mi_switch(S_READY);
+	}
+	splx(s);
+	return 0;
+}
+
+int
+thread_getpriority(struct thread *t)
+{
+	return t->t_basepri;
+}
+
+void
+thread_donatepri(struct thread *t, int pri)
+{
+	assert(curspl>0);
+
+	while (t != NULL && t->t_pri < pri) {
+		t->t_pri = pri;
+		scheduler_reprioritize(t);
+		t = t->t_waitlock != NULL ? t->t_waitlock->holder : NULL;
+	}
+}
+
+void
+thread_updatepri(struct thread *t)
+{
+	struct lock *l;
+	int pri, p;
+
+	assert(curspl>0);
+
+	while (t != NULL) {
+		pri = t->t_basepri;
+		for (l = t->t_heldlocks; l != NULL; l = l->nextheld) {
+			p = thread_sleeperpri(l);
+			if (p > pri) {
+				pri = p;
+			}
+		}
+		if (pri == t->t_pri) {
+			break;
+		}
+		t->t_pri = pri;
+		scheduler_reprioritize(t);
+		t = t->t_waitlock != NULL ? t->t_waitlock->holder : NULL;
+	}
+}
+
+int
+thread_sleeperpri(const void *addr)
+{
+	int i, pri = -1;
+
+	assert(curspl>0);
+
+	for (i=0; i<array_getnum(sleepers); i++) {
+		struct thread *t = array_getguy(sleepers, i);
+		if (t->t_sleepaddr == addr && t->t_pri > pri) {
+			pri = t->t_pri;
+		}
+	}
+	return pri;
+}
+
 /*
  * New threads actually come through here on the way to the function
  * they're supposed to start in. This is so when that function exits,
@@ -644,3 +1069,86 @@ mi_threadstart(void *data1, unsigned long data2,
 	/* Done. */
 	thread_exit();
 }
+
+/*
+ * Accounting.
+ */
+
+void
+thread_clockstart(void)
+{
+	thread_timed = 1;
+}
+
+void
+thread_chargeuser(void)
+{
+	time_t secs;
+	u_int32_t nsecs;
+
+	assert(curspl>0);
+	if (thread_timed && curthread != NULL) {
+		gettime(&secs, &nsecs);
+		thread_charge(curthread, 1, secs, nsecs);
+	}
+}
+
+void
+thread_chargesys(void)
+{
+	time_t secs;
+	u_int32_t nsecs;
+
+	assert(curspl>0);
+	if (thread_timed && curthread != NULL) {
+		gettime(&secs, &nsecs);
+		thread_charge(curthread, 0, secs, nsecs);
+	}
+}
+
+void
+thread_getrusage(struct rusage *ru)
+{
+	int s;
+
+	s = splhigh();
+	thread_chargesys();
+	*ru = curthread->t_ru;
+	splx(s);
+}
+
+int
+thread_getinfo(struct threadinfo *ti, int max)
+{
+	struct thread *t;
+	int s, n, total;
+
+	s = splhigh();
+
+	thread_chargesys();
+
+	for (t = allthreads, n = 0; t != NULL && n < max;
+	     t = t->t_allnext, n++) {
+		ti[n].ti_id = t->t_id;
+		strcpy(ti[n].ti_name, t->t_name);
+		if (t == curthread) {
+			ti[n].ti_state = TI_RUN;
+		}
+		else if (t->t_exited) {
+			ti[n].ti_state = TI_ZOMB;
+		}
+		else if (t->t_rqpri >= 0) {
+			ti[n].ti_state = TI_READY;
+		}
+		else {
+			ti[n].ti_state = TI_SLEEP;
+		}
+		ti[n].ti_user = t->t_vmspace != NULL;
+		ti[n].ti_pri = t->t_pri;
+		ti[n].ti_ru = t->t_ru;
+	}
+	total = numallthreads;
+
+	splx(s);
+	return total;
+}
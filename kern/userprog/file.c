@@ -0,0 +1,634 @@
+/*
+ * File descriptor system calls: open, pipe, close, fsync, fstat,
+ * readv, writev, fcopy, getdirentries, and the file half of read and
+ * write; plus mmap, munmap and msync, which map open files.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/limits.h>
+#include <kern/unistd.h>
+#include <kern/stat.h>
+#include <kern/mman.h>
+#include <kern/dirent.h>
+#include <lib.h>
+#include <uio.h>
+#include <thread.h>
+#include <curthread.h>
+#include <vfs.h>
+#include <vnode.h>
+#include <addrspace.h>
+#include <file.h>
+#include <syscall.h>
+
+/*
+ * The table is created on the first open. There's no fork or dup2,
+ * so each open file belongs to exactly one descriptor of one thread.
+ */
+
+void
+filetable_destroy(struct filetable *ft)
+{
+	int fd;
+
+	for (fd=0; fd<OPEN_MAX; fd++) {
+		if (ft->ft_files[fd] != NULL) {
+			vfs_close(ft->ft_files[fd]->of_vnode);
+			kfree(ft->ft_files[fd]);
+		}
+	}
+	kfree(ft);
+}
+
+int
+file_get(int fd, struct openfile **ret)
+{
+	struct filetable *ft = curthread->t_filetable;
+
+	if (ft == NULL || fd < 0 || fd >= OPEN_MAX ||
+	    ft->ft_files[fd] == NULL) {
+		return EBADF;
+	}
+	*ret = ft->ft_files[fd];
+	return 0;
+}
+
+/*
+ * Do the I/O described by U (everything but the offset) on open file
+ * FD, at the file's position.
+ */
+static
+int
+file_rw(int fd, struct uio *u, int32_t *retval)
+{
+	struct openfile *of;
+	struct stat st;
+	size_t len = u->uio_resid;
+	int result;
+
+	result = file_get(fd, &of);
+	if (result) {
+		return result;
+	}
+
+	if (u->uio_rw == UIO_READ) {
+		if ((of->of_flags & O_ACCMODE) == O_WRONLY) {
+			return EBADF;
+		}
+	}
+	else {
+		if ((of->of_flags & O_ACCMODE) == O_RDONLY) {
+			return EBADF;
+		}
+		if (of->of_flags & O_APPEND) {
+			result = VOP_STAT(of->of_vnode, &st);
+			if (result) {
+				return result;
+			}
+			of->of_offset = st.st_size;
+		}
+	}
+
+	u->uio_offset = of->of_offset;
+	if (u->uio_rw == UIO_READ) {
+		result = VOP_READ(of->of_vnode, u);
+	}
+	else {
+		result = VOP_WRITE(of->of_vnode, u);
+	}
+	if (result) {
+		return result;
+	}
+
+	of->of_offset = u->uio_offset;
+	*retval = len - u->uio_resid;
+	return 0;
+}
+
+int
+file_read(int fd, userptr_t buf, size_t len, int32_t *retval)
+{
+	struct uio u;
+
+	mk_uuio(&u, buf, len, 0, UIO_READ);
+	return file_rw(fd, &u, retval);
+}
+
+int
+file_write(int fd, const_userptr_t buf, size_t len, int32_t *retval)
+{
+	struct uio u;
+
+	mk_uuio(&u, (userptr_t)buf, len, 0, UIO_WRITE);
+	return file_rw(fd, &u, retval);
+}
+
+/*
+ * readv and writev. Files get a single uio over all the buffers. The
+ * console is done a buffer at a time with sys_read and sys_write,
+ * which is still only one trip into the kernel.
+ */
+static
+int
+file_rwv(int fd, const_userptr_t uiov, int iovcnt, enum uio_rw rw,
+	 int32_t *retval)
+{
+	struct iovec iov[IOV_MAX];
+	struct uio u;
+	size_t total;
+	int32_t got;
+	int i, result;
+
+	if (iovcnt <= 0 || iovcnt > IOV_MAX) {
+		return EINVAL;
+	}
+	result = copyin(uiov, iov, iovcnt * sizeof(struct iovec));
+	if (result) {
+		return result;
+	}
+
+	total = 0;
+	for (i=0; i<iovcnt; i++) {
+		if (total + iov[i].iov_len < total ||
+		    total + iov[i].iov_len > 0x7fffffff) {
+			return EINVAL;
+		}
+		total += iov[i].iov_len;
+	}
+
+	if (fd < FILE_FIRSTFD) {
+		*retval = 0;
+		for (i=0; i<iovcnt; i++) {
+			if (iov[i].iov_len == 0) {
+				continue;
+			}
+			if (rw == UIO_READ) {
+				result = sys_read(fd, (void *)iov[i].iov_ubase,
+						  iov[i].iov_len, &got);
+			}
+			else {
+				result = sys_write(fd,
+						   (const void *)iov[i].iov_ubase,
+						   iov[i].iov_len, &got);
+			}
+			if (result) {
+				/* Report what got done, if anything */
+				return *retval > 0 ? 0 : result;
+			}
+			*retval += got;
+			if ((size_t)got < iov[i].iov_len) {
+				break;
+			}
+		}
+		return 0;
+	}
+
+	u.uio_iov = iov;
+	u.uio_iovcnt = iovcnt;
+	u.uio_offset = 0;
+	u.uio_resid = total;
+	u.uio_segflg = UIO_USERSPACE;
+	u.uio_rw = rw;
+	u.uio_space = curthread->t_vmspace;
+
+	return file_rw(fd, &u, retval);
+}
+
+int
+sys_readv(int fd, const_userptr_t iov, int iovcnt, int32_t *retval)
+{
+	return file_rwv(fd, iov, iovcnt, UIO_READ, retval);
+}
+
+int
+sys_writev(int fd, const_userptr_t iov, int iovcnt, int32_t *retval)
+{
+	return file_rwv(fd, iov, iovcnt, UIO_WRITE, retval);
+}
+
+/*
+ * Largest chunk fcopy moves at once. A multiple of any filesystem's
+ * block size, so after the first chunk reads are block-aligned.
+ */
+#define FILE_COPYMAX  (32*1024)
+
+/*
+ * Copy up to LEN bytes from FROMFD to TOFD, starting at and advancing
+ * both files' positions, without the data going through user space.
+ * Stops early at end of file. Returns the number of bytes copied.
+ */
+int
+sys_fcopy(int fromfd, int tofd, size_t len, int32_t *retval)
+{
+	struct openfile *from, *to;
+	struct uio u;
+	char *kbuf;
+	size_t bufsize, amt, got, done;
+	int result;
+
+	result = file_get(fromfd, &from);
+	if (result) {
+		return result;
+	}
+	result = file_get(tofd, &to);
+	if (result) {
+		return result;
+	}
+	if ((from->of_flags & O_ACCMODE) == O_WRONLY ||
+	    (to->of_flags & O_ACCMODE) == O_RDONLY ||
+	    (to->of_flags & O_APPEND)) {
+		return EBADF;
+	}
+	if (from->of_vnode == to->of_vnode) {
+		return EINVAL;
+	}
+	if (len > 0x7fffffff) {
+		len = 0x7fffffff;
+	}
+
+	bufsize = len < FILE_COPYMAX ? len : FILE_COPYMAX;
+	kbuf = kmalloc(bufsize > 0 ? bufsize : 1);
+	if (kbuf == NULL) {
+		return ENOMEM;
+	}
+
+	done = 0;
+	while (done < len) {
+		/* Line chunks up with the source's blocks */
+		amt = FILE_COPYMAX - from->of_offset % FILE_COPYMAX;
+		if (amt > bufsize) {
+			amt = bufsize;
+		}
+		if (amt > len - done) {
+			amt = len - done;
+		}
+
+		mk_kuio(&u, kbuf, amt, from->of_offset, UIO_READ);
+		result = VOP_READ(from->of_vnode, &u);
+		if (result) {
+			break;
+		}
+		got = amt - u.uio_resid;
+		if (got == 0) {
+			/* EOF */
+			break;
+		}
+
+		mk_kuio(&u, kbuf, got, to->of_offset, UIO_WRITE);
+		result = VOP_WRITE(to->of_vnode, &u);
+		from->of_offset += got - u.uio_resid;
+		to->of_offset = u.uio_offset;
+		done += got - u.uio_resid;
+		if (result) {
+			break;
+		}
+		if (u.uio_resid > 0 || got < amt) {
+			break;
+		}
+	}
+
+	kfree(kbuf);
+
+	/* Like read and write, report an error only if nothing got done */
+	if (result && done == 0) {
+		return result;
+	}
+	*retval = done;
+	return 0;
+}
+
+/*
+ * Find a free descriptor, creating the table if need be. The slot
+ * stays free until file_install.
+ */
+static
+int
+file_newfd(int *ret)
+{
+	struct filetable *ft = curthread->t_filetable;
+	int fd;
+
+	if (ft == NULL) {
+		ft = kmalloc(sizeof(struct filetable));
+		if (ft == NULL) {
+			return ENOMEM;
+		}
+		for (fd=0; fd<OPEN_MAX; fd++) {
+			ft->ft_files[fd] = NULL;
+		}
+		curthread->t_filetable = ft;
+	}
+
+	for (fd=FILE_FIRSTFD; fd<OPEN_MAX; fd++) {
+		if (ft->ft_files[fd] == NULL) {
+			*ret = fd;
+			return 0;
+		}
+	}
+	return EMFILE;
+}
+
+/*
+ * Put open vnode V in descriptor FD, from file_newfd.
+ */
+static
+int
+file_install(int fd, struct vnode *v, int flags)
+{
+	struct openfile *of;
+
+	of = kmalloc(sizeof(struct openfile));
+	if (of == NULL) {
+		return ENOMEM;
+	}
+	of->of_vnode = v;
+	of->of_flags = flags;
+	of->of_offset = 0;
+
+	curthread->t_filetable->ft_files[fd] = of;
+	return 0;
+}
+
+int
+sys_open(const_userptr_t path, int flags, int32_t *retval)
+{
+	struct vnode *v;
+	char *kpath;
+	int fd, result;
+
+	result = file_newfd(&fd);
+	if (result) {
+		return result;
+	}
+
+	kpath = kmalloc(PATH_MAX);
+	if (kpath == NULL) {
+		return ENOMEM;
+	}
+	result = copyinstr(path, kpath, PATH_MAX, NULL);
+	if (result) {
+		kfree(kpath);
+		return result;
+	}
+
+	/* vfs_open may destroy the path */
+	result = vfs_open(kpath, flags, &v);
+	kfree(kpath);
+	if (result) {
+		return result;
+	}
+
+	result = file_install(fd, v, flags);
+	if (result) {
+		vfs_close(v);
+		return result;
+	}
+
+	*retval = fd;
+	return 0;
+}
+
+/*
+ * Make a pipe; FDS gets the read end and then the write end.
+ */
+int
+sys_pipe(userptr_t fds)
+{
+	struct vnode *rv, *wv;
+	int kfds[2];
+	int result;
+
+	result = pipe_create(&rv, &wv);
+	if (result) {
+		return result;
+	}
+
+	result = file_newfd(&kfds[0]);
+	if (result) {
+		goto fail;
+	}
+	result = file_install(kfds[0], rv, O_RDONLY);
+	if (result) {
+		goto fail;
+	}
+	result = file_newfd(&kfds[1]);
+	if (result == 0) {
+		result = file_install(kfds[1], wv, O_WRONLY);
+	}
+	if (result) {
+		/* Closes the read end */
+		sys_close(kfds[0]);
+		vfs_close(wv);
+		return result;
+	}
+
+	result = copyout(kfds, fds, sizeof(kfds));
+	if (result) {
+		sys_close(kfds[0]);
+		sys_close(kfds[1]);
+		return result;
+	}
+	return 0;
+
+ fail:
+	vfs_close(rv);
+	vfs_close(wv);
+	return result;
+}
+
+int
+sys_close(int fd)
+{
+	struct openfile *of;
+	int result;
+
+	result = file_get(fd, &of);
+	if (result) {
+		return result;
+	}
+
+	/* Mappings hold their own vnode reference and stay valid */
+	curthread->t_filetable->ft_files[fd] = NULL;
+	vfs_close(of->of_vnode);
+	kfree(of);
+	return 0;
+}
+
+int
+sys_fsync(int fd)
+{
+	struct openfile *of;
+	int result;
+
+	result = file_get(fd, &of);
+	if (result) {
+		return result;
+	}
+
+	/* Changes made through shared mappings go first */
+	result = as_fsyncvnode(curthread->t_vmspace, of->of_vnode);
+	if (result) {
+		return result;
+	}
+	return VOP_FSYNC(of->of_vnode);
+}
+
+int
+sys_fstat(int fd, userptr_t statbuf)
+{
+	struct openfile *of;
+	struct stat st;
+	int result;
+
+	if (fd >= 0 && fd < FILE_FIRSTFD) {
+		/* The console */
+		bzero(&st, sizeof(st));
+		st.st_mode = S_IFCHR;
+	}
+	else {
+		result = file_get(fd, &of);
+		if (result) {
+			return result;
+		}
+		result = VOP_STAT(of->of_vnode, &st);
+		if (result) {
+			return result;
+		}
+	}
+	return copyout(&st, statbuf, sizeof(st));
+}
+
+/*
+ * getdirentries for filesystems that only have vop_getdirentry: one
+ * name per call, with no inode number or type. POS is the directory
+ * position and is left at the first entry not returned.
+ */
+static
+int
+file_getdirentries_slow(struct vnode *v, struct uio *u, off_t *pos)
+{
+	char name[NAME_MAX+1];
+	struct uio ku;
+	int any = 0;
+	int result;
+
+	while (1) {
+		mk_kuio(&ku, name, sizeof(name)-1, *pos, UIO_READ);
+		result = VOP_GETDIRENTRY(v, &ku);
+		if (result) {
+			break;
+		}
+		if (ku.uio_resid == sizeof(name)-1) {
+			/* end of directory */
+			break;
+		}
+		name[sizeof(name)-1 - ku.uio_resid] = 0;
+
+		result = vfs_direntout(u, 0, DT_UNKNOWN, name);
+		if (result == ERANGE) {
+			result = any ? 0 : EINVAL;
+			break;
+		}
+		if (result) {
+			break;
+		}
+		*pos = ku.uio_offset;
+		any = 1;
+	}
+
+	/* Like read, report an error only if nothing got done */
+	return any ? 0 : result;
+}
+
+/*
+ * Fill BUF with struct dirent records for as many entries of directory
+ * FD as fit, from its current position. Returns the number of bytes
+ * used; 0 at the end of the directory.
+ */
+int
+sys_getdirentries(int fd, userptr_t buf, size_t buflen, int32_t *retval)
+{
+	struct openfile *of;
+	struct uio u;
+	off_t pos;
+	int result;
+
+	result = file_get(fd, &of);
+	if (result) {
+		return result;
+	}
+	if (buflen > 0x7fffffff) {
+		buflen = 0x7fffffff;
+	}
+
+	mk_uuio(&u, buf, buflen, of->of_offset, UIO_READ);
+	result = VOP_GETDIRENTRIES(of->of_vnode, &u);
+	if (result == EUNIMP) {
+		mk_uuio(&u, buf, buflen, 0, UIO_READ);
+		pos = of->of_offset;
+		result = file_getdirentries_slow(of->of_vnode, &u, &pos);
+		u.uio_offset = pos;
+	}
+	if (result) {
+		return result;
+	}
+
+	of->of_offset = u.uio_offset;
+	*retval = buflen - u.uio_resid;
+	return 0;
+}
+
+/*
+ * mmap takes six arguments; FD and OFFSET arrive on the user stack.
+ * ADDR is a hint and is ignored.
+ */
+int
+sys_mmap(userptr_t addr, size_t len, int prot, int flags, int fd,
+	 off_t offset, int32_t *retval)
+{
+	struct openfile *of;
+	vaddr_t va;
+	int result;
+
+	(void)addr;
+
+	result = file_get(fd, &of);
+	if (result) {
+		return result;
+	}
+
+	/*
+	 * Any mapping reads the file. Writing it through a shared
+	 * mapping needs write access too; a private mapping doesn't.
+	 */
+	if ((of->of_flags & O_ACCMODE) == O_WRONLY) {
+		return EBADF;
+	}
+	if (flags == MAP_SHARED && (prot & PROT_WRITE) &&
+	    (of->of_flags & O_ACCMODE) != O_RDWR) {
+		return EBADF;
+	}
+
+	result = as_mmap(curthread->t_vmspace, len, prot, flags,
+			 of->of_vnode, offset, &va);
+	if (result) {
+		return result;
+	}
+	*retval = (int32_t) va;
+	return 0;
+}
+
+int
+sys_munmap(userptr_t addr, size_t len)
+{
+	return as_munmap(curthread->t_vmspace, (vaddr_t)addr, len);
+}
+
+int
+sys_msync(userptr_t addr, size_t len, int flags)
+{
+	if ((flags & ~(MS_SYNC|MS_ASYNC)) != 0) {
+		return EINVAL;
+	}
+	return as_msync(curthread->t_vmspace, (vaddr_t)addr, len);
+}
@@ -1,11 +1,11 @@
 /*
  * Code to load an ELF-format executable into the current address space.
  *
- * Right now it just copies into userspace and hopes the addresses are
- * mappable to real memory. This works with dumbvm; however, when you
- * write a real VM system, you will need to either (1) add code that 
- * makes the address range used for load valid, or (2) if you implement
- * memory-mapped files, map each segment instead of copying it into RAM.
+ * With dumbvm, this just copies into userspace and hopes the addresses
+ * are mappable to real memory. With the real VM system, each segment
+ * is mapped from the file instead: pages are read when first touched,
+ * and read-only pages are shared through the vnode's page cache with
+ * every other process running the same executable.
  */
 
 #include <types.h>
@@ -18,6 +18,7 @@
 #include <curthread.h>
 #include <vnode.h>
 
+#if OPT_DUMBVM
 /*
  * Load a segment at virtual address VADDR. The segment in memory
  * extends from VADDR up to (but not including) VADDR+MEMSIZE. The
@@ -52,6 +53,8 @@ load_segment(struct vnode *v, off_t offset, vaddr_t vaddr,
 
 	u.uio_iovec.iov_ubase = (userptr_t)vaddr;
 	u.uio_iovec.iov_len = memsize;   // length of the memory space
+	u.uio_iov = &u.uio_iovec;
+	u.uio_iovcnt = 1;
 	u.uio_resid = filesize;          // amount to actually read
 	u.uio_offset = offset;
 	u.uio_segflg = is_executable ? UIO_USERISPACE : UIO_USERSPACE;
@@ -80,6 +83,7 @@ load_segment(struct vnode *v, off_t offset, vaddr_t vaddr,
 	
 	return result;
 }
+#endif /* OPT_DUMBVM */
 
 /*
  * Load an ELF executable user program into the current address space.
@@ -175,11 +179,24 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 			return ENOEXEC;
 		}
 
+#if OPT_DUMBVM
 		result = as_define_region(curthread->t_vmspace,
 					  ph.p_vaddr, ph.p_memsz,
 					  ph.p_flags & PF_R,
 					  ph.p_flags & PF_W,
 					  ph.p_flags & PF_X);
+#else
+		if (ph.p_filesz > ph.p_memsz) {
+			kprintf("ELF: warning: segment filesize > "
+				"segment memsize\n");
+		}
+		result = as_define_file(curthread->t_vmspace,
+					ph.p_vaddr, ph.p_memsz,
+					v, ph.p_offset, ph.p_filesz,
+					ph.p_flags & PF_R,
+					ph.p_flags & PF_W,
+					ph.p_flags & PF_X);
+#endif
 		if (result) {
 			return result;
 		}
@@ -190,6 +207,7 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 		return result;
 	}
 
+#if OPT_DUMBVM
 	/*
 	 * Now actually load each segment.
 	 */
@@ -227,6 +245,7 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 			return result;
 		}
 	}
+#endif /* OPT_DUMBVM */
 
 	result = as_complete_load(curthread->t_vmspace);
 	if (result) {
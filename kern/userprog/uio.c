@@ -26,20 +26,25 @@ uiomove(void *ptr, size_t n, struct uio *uio)
 	}
 
 	while (n > 0 && uio->uio_resid > 0) {
-		iov = &uio->uio_iovec;
-		size = iov->iov_len;
-
-		if (size > n) {
-			size = n;
+		/* Skip to the next block with room in it */
+		while (uio->uio_iovcnt > 0 && uio->uio_iov->iov_len == 0) {
+			uio->uio_iov++;
+			uio->uio_iovcnt--;
 		}
-
-		if (size==0) {
+		if (uio->uio_iovcnt == 0) {
 			/* 
 			 * This should only happen if you set uio_resid
 			 * incorrectly (to more than the total length of
 			 * buffers the uio points to). 
 			 */
-			panic("uiomove: size reached 0\n");
+			panic("uiomove: ran out of iovecs\n");
+		}
+
+		iov = uio->uio_iov;
+		size = iov->iov_len;
+
+		if (size > n) {
+			size = n;
 		}
 
 		switch (uio->uio_segflg) {
@@ -107,6 +112,167 @@ uiomovezeros(size_t n, struct uio *uio)
 	return 0;
 }
 
+/*
+ * Advance UIO past its empty blocks and return the current one.
+ */
+static
+struct iovec *
+uio_curiov(struct uio *uio)
+{
+	while (uio->uio_iovcnt > 0 && uio->uio_iov->iov_len == 0) {
+		uio->uio_iov++;
+		uio->uio_iovcnt--;
+	}
+	if (uio->uio_iovcnt == 0) {
+		panic("uio_curiov: ran out of iovecs\n");
+	}
+	return uio->uio_iov;
+}
+
+/*
+ * Account for SIZE bytes moved through UIO's current block.
+ */
+static
+void
+uio_advance(struct uio *uio, size_t size)
+{
+	struct iovec *iov = uio->uio_iov;
+
+	if (uio->uio_segflg == UIO_SYSSPACE) {
+		iov->iov_kbase = ((char *)iov->iov_kbase + size);
+	}
+	else {
+		iov->iov_ubase += size;
+	}
+	iov->iov_len -= size;
+	uio->uio_resid -= size;
+	uio->uio_offset += size;
+}
+
+int
+uiomove_uio(struct uio *to, struct uio *from, size_t n)
+{
+	struct iovec *tiov, *fiov;
+	size_t size;
+	int result;
+
+	assert(to->uio_rw == UIO_READ);
+	assert(from->uio_rw == UIO_WRITE);
+	if (to->uio_segflg != UIO_SYSSPACE) {
+		assert(to->uio_space == curthread->t_vmspace);
+	}
+	if (from->uio_segflg != UIO_SYSSPACE) {
+		assert(from->uio_space == curthread->t_vmspace);
+	}
+
+	while (n > 0 && to->uio_resid > 0 && from->uio_resid > 0) {
+		tiov = uio_curiov(to);
+		fiov = uio_curiov(from);
+
+		size = tiov->iov_len;
+		if (size > fiov->iov_len) {
+			size = fiov->iov_len;
+		}
+		if (size > n) {
+			size = n;
+		}
+
+		if (to->uio_segflg == UIO_SYSSPACE) {
+			if (from->uio_segflg == UIO_SYSSPACE) {
+				memmove(tiov->iov_kbase, fiov->iov_kbase, size);
+				result = 0;
+			}
+			else {
+				result = copyin(fiov->iov_ubase,
+						tiov->iov_kbase, size);
+			}
+		}
+		else {
+			if (from->uio_segflg == UIO_SYSSPACE) {
+				result = copyout(fiov->iov_kbase,
+						 tiov->iov_ubase, size);
+			}
+			else {
+				result = copyuser(fiov->iov_ubase,
+						  tiov->iov_ubase, size);
+			}
+		}
+		if (result) {
+			return result;
+		}
+
+		uio_advance(to, size);
+		uio_advance(from, size);
+		n -= size;
+	}
+
+	return 0;
+}
+
+int
+uiopeek(void *ptr, size_t n, struct uio *uio)
+{
+	struct iovec *iov = uio->uio_iov;
+	int iovcnt = uio->uio_iovcnt;
+	size_t size;
+	int result;
+
+	assert(uio->uio_rw == UIO_WRITE);
+	assert(n <= uio->uio_resid);
+	if (uio->uio_segflg==UIO_SYSSPACE) {
+		assert(uio->uio_space == NULL);
+	}
+	else {
+		assert(uio->uio_space == curthread->t_vmspace);
+	}
+
+	while (n > 0) {
+		if (iovcnt == 0) {
+			panic("uiopeek: ran out of iovecs\n");
+		}
+		size = iov->iov_len;
+		if (size > n) {
+			size = n;
+		}
+
+		if (uio->uio_segflg == UIO_SYSSPACE) {
+			memmove(ptr, iov->iov_kbase, size);
+		}
+		else {
+			result = copyin(iov->iov_ubase, ptr, size);
+			if (result) {
+				return result;
+			}
+		}
+
+		ptr = ((char *)ptr + size);
+		n -= size;
+		iov++;
+		iovcnt--;
+	}
+
+	return 0;
+}
+
+void
+uioskip(size_t n, struct uio *uio)
+{
+	struct iovec *iov;
+	size_t size;
+
+	assert(n <= uio->uio_resid);
+
+	while (n > 0) {
+		iov = uio_curiov(uio);
+		size = iov->iov_len;
+		if (size > n) {
+			size = n;
+		}
+		uio_advance(uio, size);
+		n -= size;
+	}
+}
+
 /*
  * Convenience function to cons up a uio for kernel I/O.
  */
@@ -115,9 +281,29 @@ mk_kuio(struct uio *uio, void *kbuf, size_t len, off_t pos, enum uio_rw rw)
 {
 	uio->uio_iovec.iov_kbase = kbuf;
 	uio->uio_iovec.iov_len = len;
+	uio->uio_iov = &uio->uio_iovec;
+	uio->uio_iovcnt = 1;
 	uio->uio_offset = pos;
 	uio->uio_resid = len;
 	uio->uio_segflg = UIO_SYSSPACE;
 	uio->uio_rw = rw;
 	uio->uio_space = NULL;
 }
+
+/*
+ * Same, for a user buffer in the current address space.
+ */
+void
+mk_uuio(struct uio *uio, userptr_t ubuf, size_t len, off_t pos,
+	enum uio_rw rw)
+{
+	uio->uio_iovec.iov_ubase = ubuf;
+	uio->uio_iovec.iov_len = len;
+	uio->uio_iov = &uio->uio_iovec;
+	uio->uio_iovcnt = 1;
+	uio->uio_offset = pos;
+	uio->uio_resid = len;
+	uio->uio_segflg = UIO_USERSPACE;
+	uio->uio_rw = rw;
+	uio->uio_space = curthread->t_vmspace;
+}
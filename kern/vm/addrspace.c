@@ -1,8 +1,17 @@
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/mman.h>
+#include <kern/timepage.h>
 #include <lib.h>
+#include <array.h>
+#include <uio.h>
+#include <vnode.h>
+#include <thread.h>
+#include <curthread.h>
 #include <addrspace.h>
 #include <vm.h>
+#include <machine/spl.h>
+#include <machine/tlb.h>
 
 /*
  * Note! If OPT_DUMBVM is set, as is the case until you start the VM
@@ -10,122 +19,926 @@
  * used. The cheesy hack versions in dumbvm.c are used instead.
  */
 
+/*
+ * An address space is a list of regions plus a two-level page table.
+ * Nothing is allocated or read until it is touched: as_fault fills
+ * in pages on demand, either zero-filled, read from the region's
+ * file, or taken from the file's page cache if the region is shared
+ * read-only text.
+ */
+
 struct addrspace *
 as_create(void)
 {
 	struct addrspace *as = kmalloc(sizeof(struct addrspace));
+	unsigned i;
+
 	if (as==NULL) {
 		return NULL;
 	}
 
-	/*
-	 * Initialize as needed.
-	 */
+	as->as_regions = array_create();
+	if (as->as_regions == NULL) {
+		kfree(as);
+		return NULL;
+	}
+
+	as->as_asid = 0;
+	as->as_asidgen = 0;
+	as->as_heap = NULL;
+
+	for (i=0; i<AS_NPTDIR; i++) {
+		as->as_pt[i] = NULL;
+	}
 
 	return as;
 }
 
-int
-as_copy(struct addrspace *old, struct addrspace **ret)
+/*
+ * Find the region containing VADDR, or NULL.
+ */
+static
+struct vm_region *
+as_findregion(struct addrspace *as, vaddr_t vaddr)
 {
-	struct addrspace *newas;
+	struct vm_region *r;
+	int i, num;
 
-	newas = as_create();
-	if (newas==NULL) {
-		return ENOMEM;
+	num = array_getnum(as->as_regions);
+	for (i=0; i<num; i++) {
+		r = array_getguy(as->as_regions, i);
+		if (vaddr >= r->vr_start && vaddr < r->vr_end) {
+			return r;
+		}
 	}
+	return NULL;
+}
 
-	/*
-	 * Write this.
-	 */
+/*
+ * Get a pointer to the page table entry for VADDR. If the page table
+ * page isn't there, create it if CREATE is set, otherwise return NULL.
+ * Also returns NULL if out of memory.
+ */
+static
+u_int32_t *
+as_pte(struct addrspace *as, vaddr_t vaddr, int create)
+{
+	u_int32_t dir = vaddr >> AS_PTSHIFT;
+	u_int32_t ix = (vaddr >> 12) & (AS_PTPAGES-1);
 
-	(void)old;
-	
-	*ret = newas;
-	return 0;
+	assert(dir < AS_NPTDIR);
+
+	if (as->as_pt[dir] == NULL) {
+		if (!create) {
+			return NULL;
+		}
+		assert(AS_PTPAGES * sizeof(u_int32_t) == PAGE_SIZE);
+		as->as_pt[dir] = (u_int32_t *) alloc_kzpage();
+		if (as->as_pt[dir] == NULL) {
+			return NULL;
+		}
+	}
+	return &as->as_pt[dir][ix];
 }
 
-void
-as_destroy(struct addrspace *as)
+/*
+ * Common code for the as_define_* functions and as_mmap. MAPFLAGS is
+ * 0 except for mmap'd regions.
+ */
+static
+int
+as_addregion(struct addrspace *as, vaddr_t vaddr, size_t memsz, int prot,
+	     struct vnode *v, off_t offset, size_t filesz, int mapflags)
 {
+	struct vm_region *r, *other;
+	vaddr_t start, end;
+	int i, num, result;
+
+	if (vaddr + memsz < vaddr || vaddr + memsz > USERTOP || memsz == 0) {
+		return EINVAL;
+	}
+
+	start = vaddr & PAGE_FRAME;
+	end = (vaddr + memsz + PAGE_SIZE - 1) & PAGE_FRAME;
+
+	/* Regions may not share pages */
+	num = array_getnum(as->as_regions);
+	for (i=0; i<num; i++) {
+		other = array_getguy(as->as_regions, i);
+		if (start < other->vr_end && end > other->vr_start) {
+			kprintf("vm: region 0x%x-0x%x overlaps 0x%x-0x%x\n",
+				start, end, other->vr_start, other->vr_end);
+			return EINVAL;
+		}
+	}
+
+	r = kmalloc(sizeof(struct vm_region));
+	if (r == NULL) {
+		return ENOMEM;
+	}
+
+	if (filesz > memsz) {
+		filesz = memsz;
+	}
+
+	r->vr_start = start;
+	r->vr_end = end;
+	r->vr_prot = prot;
+	r->vr_vnode = v;
+	r->vr_foffset = offset;
+	r->vr_fstart = vaddr;
+	r->vr_fend = vaddr + filesz;
+	r->vr_mend = vaddr + memsz;
+
 	/*
-	 * Clean up as needed.
+	 * Read-only file pages can come straight from the page cache
+	 * if the file is laid out page for page like memory. (The ELF
+	 * spec requires this congruence, but check anyway.)
 	 */
-	
-	kfree(as);
+	r->vr_shared = v != NULL &&
+		((prot & VM_PROT_WRITE) == 0 || mapflags != 0) &&
+		(offset & ~PAGE_FRAME) == (off_t)(vaddr & ~PAGE_FRAME);
+	r->vr_mmap = mapflags;
+	r->vr_page = 0;
+
+	result = array_add(as->as_regions, r);
+	if (result) {
+		kfree(r);
+		return result;
+	}
+
+	if (v != NULL) {
+		VOP_INCREF(v);
+	}
+	return 0;
 }
 
-void
-as_activate(struct addrspace *as)
+static
+int
+as_prot(int readable, int writeable, int executable)
 {
-	/*
-	 * Write this.
-	 */
-
-	(void)as;  // suppress warning until code gets written
+	return (readable ? VM_PROT_READ : 0) |
+		(writeable ? VM_PROT_WRITE : 0) |
+		(executable ? VM_PROT_EXEC : 0);
 }
 
 /*
  * Set up a segment at virtual address VADDR of size MEMSIZE. The
  * segment in memory extends from VADDR up to (but not including)
- * VADDR+MEMSIZE.
+ * VADDR+MEMSIZE. It is zero-filled on demand.
  *
- * The READABLE, WRITEABLE, and EXECUTABLE flags are set if read,
- * write, or execute permission should be set on the segment. At the
- * moment, these are ignored. When you write the VM system, you may
- * want to implement them.
+ * The MIPS TLB can't make a page unreadable or non-executable, so
+ * only the WRITEABLE flag is enforced.
  */
 int
 as_define_region(struct addrspace *as, vaddr_t vaddr, size_t sz,
 		 int readable, int writeable, int executable)
 {
-	/*
-	 * Write this.
-	 */
+	return as_addregion(as, vaddr, sz,
+			    as_prot(readable, writeable, executable),
+			    NULL, 0, 0, 0);
+}
 
-	(void)as;
-	(void)vaddr;
-	(void)sz;
-	(void)readable;
-	(void)writeable;
-	(void)executable;
-	return EUNIMP;
+/*
+ * Set up a segment whose first FILESZ bytes are the contents of V at
+ * OFFSET. Used by load_elf.
+ */
+int
+as_define_file(struct addrspace *as, vaddr_t vaddr, size_t memsz,
+	       struct vnode *v, off_t offset, size_t filesz,
+	       int readable, int writeable, int executable)
+{
+	return as_addregion(as, vaddr, memsz,
+			    as_prot(readable, writeable, executable),
+			    v, offset, filesz, 0);
 }
 
 int
 as_prepare_load(struct addrspace *as)
 {
+	/* Nothing is loaded up front. */
+	(void)as;
+	return 0;
+}
+
+/*
+ * Create the (empty) heap region at page HEAPBASE.
+ */
+static
+int
+as_defineheap(struct addrspace *as, vaddr_t heapbase)
+{
+	struct vm_region *r;
+	int result;
+
+	assert(as->as_heap == NULL);
+	assert((heapbase & PAGE_FRAME) == heapbase);
+
+	r = kmalloc(sizeof(struct vm_region));
+	if (r == NULL) {
+		return ENOMEM;
+	}
+
 	/*
-	 * Write this.
+	 * Zero-fill, with the break in vr_mend. While the heap is
+	 * empty vr_start == vr_end, so as_findregion never finds it.
 	 */
+	r->vr_start = r->vr_end = heapbase;
+	r->vr_prot = VM_PROT_READ | VM_PROT_WRITE;
+	r->vr_vnode = NULL;
+	r->vr_foffset = 0;
+	r->vr_fstart = r->vr_fend = heapbase;
+	r->vr_mend = heapbase;
+	r->vr_shared = 0;
+	r->vr_mmap = 0;
+	r->vr_page = 0;
 
-	(void)as;
+	result = array_add(as->as_regions, r);
+	if (result) {
+		kfree(r);
+		return result;
+	}
+	as->as_heap = r;
+	return 0;
+}
+
+/*
+ * Map the time page, read-only, at TIMEPAGE.
+ */
+static
+int
+as_definetimepage(struct addrspace *as)
+{
+	struct vm_region *r;
+	int result;
+
+	assert(vm_timepage != 0);
+	assert(TIMEPAGE + PAGE_SIZE <= USERSTACK - VM_STACKPAGES * PAGE_SIZE);
+
+	result = as_addregion(as, TIMEPAGE, PAGE_SIZE, VM_PROT_READ,
+			      NULL, 0, 0, 0);
+	if (result) {
+		return result;
+	}
+	r = array_getguy(as->as_regions, array_getnum(as->as_regions) - 1);
+	r->vr_page = vm_timepage;
 	return 0;
 }
 
+/*
+ * Once the executable is loaded, the heap starts at the first page
+ * past the highest segment.
+ */
 int
 as_complete_load(struct addrspace *as)
 {
+	struct vm_region *r;
+	vaddr_t top = 0;
+	int i, num;
+
+	num = array_getnum(as->as_regions);
+	for (i=0; i<num; i++) {
+		r = array_getguy(as->as_regions, i);
+		if (r->vr_end > top) {
+			top = r->vr_end;
+		}
+	}
+
+	return as_defineheap(as, top);
+}
+
+int
+as_define_stack(struct addrspace *as, vaddr_t *stackptr)
+{
+	int result;
+
+	result = as_define_region(as, USERSTACK - VM_STACKPAGES * PAGE_SIZE,
+				  VM_STACKPAGES * PAGE_SIZE, 1, 1, 0);
+	if (result) {
+		return result;
+	}
+
+	result = as_definetimepage(as);
+	if (result) {
+		return result;
+	}
+
+	/* Initial user-level stack pointer */
+	*stackptr = USERSTACK;
+
+	return 0;
+}
+
+/*
+ * Drop the pages of [start, end), which must be in the current
+ * address space, along with any TLB entries for them. Returns the
+ * number of pages dropped.
+ */
+static
+u_int32_t
+as_unmap(struct addrspace *as, vaddr_t start, vaddr_t end)
+{
+	u_int32_t *pte, n = 0;
+	vaddr_t va;
+
+	for (va = start; va < end; va += PAGE_SIZE) {
+		pte = as_pte(as, va, 0);
+		if (pte == NULL || (*pte & PTE_VALID)==0) {
+			continue;
+		}
+		tlb_invalidate(va);
+		page_decref(*pte & PTE_FRAME);
+		*pte = 0;
+		n++;
+	}
+	return n;
+}
+
+/*
+ * Move the break. Growing only moves the end of the heap region;
+ * pages are zero-filled by as_fault when first touched. Shrinking
+ * frees the pages that are no longer in the heap at all.
+ */
+int
+as_sbrk(struct addrspace *as, int amount, vaddr_t *oldbreak)
+{
+	struct vm_region *heap = as->as_heap, *r;
+	vaddr_t newbreak, newend;
+	int i, num;
+
+	if (heap == NULL) {
+		/* No program loaded */
+		return EINVAL;
+	}
+
+	*oldbreak = heap->vr_mend;
+	if (amount == 0) {
+		return 0;
+	}
+
+	newbreak = heap->vr_mend + amount;
+	if (amount < 0) {
+		if (newbreak > heap->vr_mend || newbreak < heap->vr_fstart) {
+			return EINVAL;
+		}
+	}
+	else {
+		if (newbreak < heap->vr_mend ||
+		    newbreak - heap->vr_fstart > VM_HEAPMAX) {
+			return ENOMEM;
+		}
+	}
+
+	newend = (newbreak + PAGE_SIZE - 1) & PAGE_FRAME;
+
+	if (newend > heap->vr_end) {
+		/* Don't run into the stack or anything else */
+		num = array_getnum(as->as_regions);
+		for (i=0; i<num; i++) {
+			r = array_getguy(as->as_regions, i);
+			if (r != heap && heap->vr_end < r->vr_end &&
+			    newend > r->vr_start) {
+				return ENOMEM;
+			}
+		}
+	}
+	else if (newend < heap->vr_end) {
+		vm_stats.vs_heapfreed += as_unmap(as, newend, heap->vr_end);
+	}
+
+	if (amount > 0) {
+		vm_stats.vs_heapgrow++;
+	}
+	else {
+		vm_stats.vs_heapshrink++;
+	}
+
+	heap->vr_end = newend;
+	heap->vr_mend = newbreak;
+	return 0;
+}
+
+/*
+ * Produce the page at VADDR in region R. Returns the physical page
+ * and the PTE flags to go with it.
+ */
+static
+int
+as_fillpage(struct vm_region *r, vaddr_t vaddr, paddr_t *retpa,
+	    u_int32_t *retflags)
+{
+	struct uio ku;
+	vaddr_t lo, hi;
+	paddr_t pa;
+	int result;
+
+	if (r->vr_page != 0) {
+		page_incref(r->vr_page);
+		*retpa = r->vr_page;
+		*retflags = PTE_OBJ;
+		return 0;
+	}
+
 	/*
-	 * Write this.
+	 * Shared pages must hold nothing but file data: pages that
+	 * straddle the end of the file part of a segment that goes on
+	 * to zero-filled memory (.data followed by .bss) are private.
 	 */
+	if (r->vr_shared &&
+	    (vaddr + PAGE_SIZE <= r->vr_fend || r->vr_fend == r->vr_mend)) {
+		result = vmobj_getpage(r->vr_vnode,
+				       r->vr_foffset + ((off_t)vaddr -
+							(off_t)r->vr_fstart),
+				       &pa);
+		if (result) {
+			return result;
+		}
+		*retpa = pa;
+		*retflags = PTE_OBJ;
+		return 0;
+	}
 
-	(void)as;
+	pa = page_zalloc();
+	if (pa == 0) {
+		return ENOMEM;
+	}
+
+	lo = vaddr > r->vr_fstart ? vaddr : r->vr_fstart;
+	hi = vaddr + PAGE_SIZE < r->vr_fend ? vaddr + PAGE_SIZE : r->vr_fend;
+
+	if (r->vr_vnode != NULL && lo < hi) {
+		mk_kuio(&ku, (void *)(PADDR_TO_KVADDR(pa) + (lo - vaddr)),
+			hi - lo, r->vr_foffset + (lo - r->vr_fstart),
+			UIO_READ);
+		result = VOP_READ(r->vr_vnode, &ku);
+		if (result) {
+			page_decref(pa);
+			return result;
+		}
+		/* Past EOF reads as zeros, as with dumbvm's uiomovezeros */
+		vm_stats.vs_fileread++;
+		curthread->t_ru.ru_majflt++;
+	}
+	else {
+		vm_stats.vs_zerofill++;
+	}
+
+	*retpa = pa;
+	*retflags = (r->vr_prot & VM_PROT_WRITE) ? PTE_WRITE : 0;
 	return 0;
 }
 
+/*
+ * Make the page at VADDR, which *PTE maps from the page cache,
+ * writable. For shared mappings this dirties the cached page; for
+ * private ones it's copy-on-write.
+ */
+static
 int
-as_define_stack(struct addrspace *as, vaddr_t *stackptr)
+as_writepage(struct vm_region *r, vaddr_t vaddr, u_int32_t *pte)
+{
+	off_t offset;
+	paddr_t pa;
+
+	if ((*pte & PTE_OBJ)==0 || r->vr_mmap == 0) {
+		/* shouldn't happen: other pages of writable regions are */
+		return EFAULT;
+	}
+
+	if (r->vr_mmap == MAP_SHARED) {
+		offset = r->vr_foffset + ((off_t)vaddr - (off_t)r->vr_fstart);
+		vmobj_dirty(r->vr_vnode, offset);
+		*pte |= PTE_WRITE;
+		return 0;
+	}
+
+	pa = page_alloc();
+	if (pa == 0) {
+		return ENOMEM;
+	}
+	memmove((void *)PADDR_TO_KVADDR(pa),
+		(const void *)PADDR_TO_KVADDR(*pte & PTE_FRAME), PAGE_SIZE);
+	page_decref(*pte & PTE_FRAME);
+	*pte = pa | PTE_VALID | PTE_WRITE;
+	vm_stats.vs_cow++;
+	return 0;
+}
+
+/*
+ * Handle a fault at page VADDR. On success, hands back the PTE to
+ * load into the TLB.
+ */
+int
+as_fault(struct addrspace *as, int faulttype, vaddr_t vaddr, u_int32_t *ret)
+{
+	struct vm_region *r;
+	u_int32_t *pte, flags;
+	paddr_t pa;
+	int result;
+
+	assert((vaddr & PAGE_FRAME) == vaddr);
+
+	r = as_findregion(as, vaddr);
+	if (r == NULL) {
+		return EFAULT;
+	}
+
+	if (faulttype != VM_FAULT_READ && (r->vr_prot & VM_PROT_WRITE)==0) {
+		return EFAULT;
+	}
+
+	pte = as_pte(as, vaddr, 1);
+	if (pte == NULL) {
+		return ENOMEM;
+	}
+
+	if ((*pte & PTE_VALID)==0) {
+		result = as_fillpage(r, vaddr, &pa, &flags);
+		if (result) {
+			return result;
+		}
+		*pte = pa | PTE_VALID | flags;
+	}
+
+	if (faulttype != VM_FAULT_READ && (*pte & PTE_WRITE)==0) {
+		result = as_writepage(r, vaddr, pte);
+		if (result) {
+			return result;
+		}
+	}
+
+	*ret = *pte;
+	return 0;
+}
+
+/*
+ * Take away write access to the pages of shared mapping R in
+ * [start, end), and tell the page cache, so it knows when no mapping
+ * can write a page behind its back any more. FLUSH is set if AS is
+ * the current address space and the TLB needs updating too.
+ */
+static
+void
+as_wprotect(struct addrspace *as, struct vm_region *r,
+	    vaddr_t start, vaddr_t end, int flush)
+{
+	u_int32_t *pte;
+	vaddr_t va;
+
+	for (va = start; va < end; va += PAGE_SIZE) {
+		pte = as_pte(as, va, 0);
+		if (pte != NULL && (*pte & PTE_WRITE)) {
+			*pte &= ~PTE_WRITE;
+			if (flush) {
+				tlb_invalidate(va);
+			}
+			vmobj_wprotect(r->vr_vnode, r->vr_foffset +
+				       ((off_t)va - (off_t)r->vr_fstart));
+		}
+	}
+}
+
+/*
+ * Write back the part of mapping R in [start, end). The caller's
+ * PTEs are write-protected first, so the next write through them
+ * faults and dirties the page again. Pages that other address
+ * spaces still have writable stay dirty in the page cache (see
+ * vmobj.c), so their later writes are not lost.
+ */
+static
+int
+as_syncregion(struct addrspace *as, struct vm_region *r,
+	      vaddr_t start, vaddr_t end)
+{
+	if (r->vr_mmap != MAP_SHARED || (r->vr_prot & VM_PROT_WRITE)==0) {
+		return 0;
+	}
+
+	if (start < r->vr_start) {
+		start = r->vr_start;
+	}
+	if (end > r->vr_end) {
+		end = r->vr_end;
+	}
+	if (start >= end) {
+		return 0;
+	}
+
+	as_wprotect(as, r, start, end, 1);
+
+	return vmobj_sync(r->vr_vnode,
+			  r->vr_foffset + ((off_t)start - (off_t)r->vr_fstart),
+			  end - start);
+}
+
+/*
+ * Map a file. Mappings are placed top-down below the stack, leaving
+ * room for the heap to grow to VM_HEAPMAX.
+ */
+int
+as_mmap(struct addrspace *as, size_t len, int prot, int flags,
+	struct vnode *v, off_t offset, vaddr_t *ret)
+{
+	struct vm_region *r;
+	vaddr_t top, addr, lo, hi;
+	size_t size;
+	int i, num, result;
+
+	if (len == 0 || (offset & ~PAGE_FRAME) != 0 || offset < 0 ||
+	    (prot & ~(PROT_READ|PROT_WRITE|PROT_EXEC)) != 0 ||
+	    (flags != MAP_SHARED && flags != MAP_PRIVATE)) {
+		return EINVAL;
+	}
+
+	size = (len + PAGE_SIZE - 1) & PAGE_FRAME;
+	if (size < len) {
+		return ENOMEM;
+	}
+
+	result = VOP_MMAP(v);
+	if (result) {
+		return result;
+	}
+
+	top = USERSTACK - VM_STACKPAGES * PAGE_SIZE;
+	num = array_getnum(as->as_regions);
+ again:
+	if (top < size) {
+		return ENOMEM;
+	}
+	addr = top - size;
+	for (i=0; i<num; i++) {
+		r = array_getguy(as->as_regions, i);
+		lo = r->vr_start;
+		hi = r->vr_end;
+		if (r == as->as_heap && hi < lo + VM_HEAPMAX) {
+			hi = lo + VM_HEAPMAX;
+		}
+		if (addr < hi && addr + size > lo) {
+			top = lo;
+			goto again;
+		}
+	}
+
+	/* PROT_* and VM_PROT_* are the same bits */
+	result = as_addregion(as, addr, size, prot, v, offset, size, flags);
+	if (result) {
+		return result;
+	}
+
+	*ret = addr;
+	return 0;
+}
+
+/*
+ * Remove a mapping from the address space. Call only on the current
+ * address space.
+ */
+static
+int
+as_removemapping(struct addrspace *as, int ix)
+{
+	struct vm_region *r = array_getguy(as->as_regions, ix);
+	int result;
+
+	result = as_syncregion(as, r, r->vr_start, r->vr_end);
+	if (result) {
+		return result;
+	}
+
+	as_unmap(as, r->vr_start, r->vr_end);
+	array_remove(as->as_regions, ix);
+	VOP_DECREF(r->vr_vnode);
+	kfree(r);
+	return 0;
+}
+
+/*
+ * Unmapping works on whole mappings only: a range that covers part
+ * of a mapping, or any region that isn't a mapping, is rejected.
+ */
+int
+as_munmap(struct addrspace *as, vaddr_t addr, size_t len)
 {
+	struct vm_region *r;
+	vaddr_t end;
+	int i, result;
+
+	if ((addr & ~PAGE_FRAME) != 0 || len == 0) {
+		return EINVAL;
+	}
+	end = (addr + len + PAGE_SIZE - 1) & PAGE_FRAME;
+	if (end < addr || end > USERTOP) {
+		return EINVAL;
+	}
+
+	for (i=0; i<array_getnum(as->as_regions); i++) {
+		r = array_getguy(as->as_regions, i);
+		if (r->vr_end <= addr || r->vr_start >= end) {
+			continue;
+		}
+		if (r->vr_mmap == 0 ||
+		    r->vr_start < addr || r->vr_end > end) {
+			return EINVAL;
+		}
+	}
+
+	i = 0;
+	while (i < array_getnum(as->as_regions)) {
+		r = array_getguy(as->as_regions, i);
+		if (r->vr_end <= addr || r->vr_start >= end) {
+			i++;
+			continue;
+		}
+		result = as_removemapping(as, i);
+		if (result) {
+			return result;
+		}
+	}
+	return 0;
+}
+
+int
+as_msync(struct addrspace *as, vaddr_t addr, size_t len)
+{
+	struct vm_region *r;
+	vaddr_t end;
+	int i, num, result;
+
+	if ((addr & ~PAGE_FRAME) != 0) {
+		return EINVAL;
+	}
+	end = (addr + len + PAGE_SIZE - 1) & PAGE_FRAME;
+	if (end < addr || end > USERTOP) {
+		return ENOMEM;
+	}
+
+	num = array_getnum(as->as_regions);
+	for (i=0; i<num; i++) {
+		r = array_getguy(as->as_regions, i);
+		result = as_syncregion(as, r, addr, end);
+		if (result) {
+			return result;
+		}
+	}
+	return 0;
+}
+
+int
+as_fsyncvnode(struct addrspace *as, struct vnode *v)
+{
+	struct vm_region *r;
+	int i, num, result;
+
+	num = array_getnum(as->as_regions);
+	for (i=0; i<num; i++) {
+		r = array_getguy(as->as_regions, i);
+		if (r->vr_vnode != v) {
+			continue;
+		}
+		result = as_syncregion(as, r, r->vr_start, r->vr_end);
+		if (result) {
+			return result;
+		}
+	}
+	return 0;
+}
+
+void
+as_destroy(struct addrspace *as)
+{
+	struct vm_region *r;
+	u_int32_t *pt;
+	unsigned dir;
+	int i, j, num;
+
+	/* Write back shared mappings; there's no one to report errors to */
+	num = array_getnum(as->as_regions);
+	for (i=0; i<num; i++) {
+		r = array_getguy(as->as_regions, i);
+		if (r->vr_mmap == MAP_SHARED && (r->vr_prot & VM_PROT_WRITE)) {
+			as_wprotect(as, r, r->vr_start, r->vr_end, 0);
+			vmobj_sync(r->vr_vnode, r->vr_foffset,
+				   r->vr_end - r->vr_start);
+		}
+	}
+
+	for (dir=0; dir<AS_NPTDIR; dir++) {
+		pt = as->as_pt[dir];
+		if (pt == NULL) {
+			continue;
+		}
+		for (j=0; j<AS_PTPAGES; j++) {
+			if (pt[j] & PTE_VALID) {
+				page_decref(pt[j] & PTE_FRAME);
+			}
+		}
+		kfree(pt);
+	}
+
+	num = array_getnum(as->as_regions);
+	for (i=0; i<num; i++) {
+		r = array_getguy(as->as_regions, i);
+		if (r->vr_vnode != NULL) {
+			VOP_DECREF(r->vr_vnode);
+		}
+		kfree(r);
+	}
+	array_destroy(as->as_regions);
+
+	kfree(as);
+}
+
+int
+as_copy(struct addrspace *old, struct addrspace **ret)
+{
+	struct addrspace *newas;
+	struct vm_region *r;
+	u_int32_t *opt, *npt;
+	paddr_t pa;
+	unsigned dir;
+	int i, j, num, result;
+
+	newas = as_create();
+	if (newas==NULL) {
+		return ENOMEM;
+	}
+
+	num = array_getnum(old->as_regions);
+	for (i=0; i<num; i++) {
+		r = array_getguy(old->as_regions, i);
+		if (r == old->as_heap) {
+			result = as_defineheap(newas, r->vr_start);
+			if (result) {
+				as_destroy(newas);
+				return result;
+			}
+			newas->as_heap->vr_end = r->vr_end;
+			newas->as_heap->vr_mend = r->vr_mend;
+			continue;
+		}
+		if (r->vr_page != 0) {
+			result = as_definetimepage(newas);
+			if (result) {
+				as_destroy(newas);
+				return result;
+			}
+			continue;
+		}
+		result = as_addregion(newas, r->vr_fstart,
+				      r->vr_mend - r->vr_fstart, r->vr_prot,
+				      r->vr_vnode, r->vr_foffset,
+				      r->vr_fend - r->vr_fstart, r->vr_mmap);
+		if (result) {
+			as_destroy(newas);
+			return result;
+		}
+	}
+
 	/*
-	 * Write this.
+	 * Shared pages are shared with the copy too; private pages
+	 * are copied. Shared pages start out read-only in the copy so
+	 * its writes dirty them.
 	 */
+	for (dir=0; dir<AS_NPTDIR; dir++) {
+		opt = old->as_pt[dir];
+		if (opt == NULL) {
+			continue;
+		}
+		npt = (u_int32_t *) alloc_kzpage();
+		if (npt == NULL) {
+			as_destroy(newas);
+			return ENOMEM;
+		}
+		newas->as_pt[dir] = npt;
 
-	(void)as;
+		for (j=0; j<AS_PTPAGES; j++) {
+			if ((opt[j] & PTE_VALID)==0) {
+				continue;
+			}
+			if (opt[j] & PTE_OBJ) {
+				page_incref(opt[j] & PTE_FRAME);
+				npt[j] = opt[j] & ~PTE_WRITE;
+				continue;
+			}
+			pa = page_alloc();
+			if (pa == 0) {
+				as_destroy(newas);
+				return ENOMEM;
+			}
+			memmove((void *)PADDR_TO_KVADDR(pa),
+				(const void *)PADDR_TO_KVADDR(opt[j] & PTE_FRAME),
+				PAGE_SIZE);
+			npt[j] = pa | (opt[j] & ~PTE_FRAME);
+		}
+	}
 
-	/* Initial user-level stack pointer */
-	*stackptr = USERSTACK;
-	
+	*ret = newas;
 	return 0;
 }
 
+void
+as_activate(struct addrspace *as)
+{
+	asid_activate(&as->as_asid, &as->as_asidgen);
+}
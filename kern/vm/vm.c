@@ -15,45 +15,510 @@
  */
 
 /*
- * alloc_kpages() and free_kpages() are called by kmalloc() and thus the whole
- * kernel will not boot if these 2 functions are not completed.
+ * Coremap: one entry per physical page that the VM system manages.
+ *
+ * Kernel allocations (alloc_kpages) are runs of contiguous pages,
+ * since the kernel addresses them through kseg0; the first entry of a
+ * run records its length. User pages are single pages with a
+ * reference count, so that a page can be mapped by several address
+ * spaces and held by a vnode's page cache at the same time.
+ *
+ * The coremap is protected by splhigh, as kmalloc may be called from
+ * anywhere.
+ *
+ * Free pages are either dirty (CME_FREE) or known to be zero
+ * (CME_ZERO). The idle loop zeroes free pages a page at a time, with
+ * interrupts on, and pushes them on zpool; zero-fill faults and
+ * zeroed kernel pages pop them from there instead of running bzero
+ * on the faulting thread. Allocations that don't need zeroed memory
+ * take dirty pages first so as not to waste the pool.
  */
 
+#define CME_FREE    0
+#define CME_KERNEL  1
+#define CME_USER    2
+#define CME_ZERO    3	/* free, and already zeroed */
+#define CME_ZEROING 4	/* free, being zeroed by vm_idlezero */
+
+/* Most pages kept pre-zeroed */
+#define ZPOOL_MAX   64
+
+struct coremap_entry {
+	u_int8_t cme_kind;	/* CME_* */
+	u_int8_t cme_pad;
+	u_int16_t cme_npages;	/* kernel: length of run (first page only) */
+	u_int32_t cme_refs;	/* user: number of references */
+};
+
+static struct coremap_entry *coremap;
+static paddr_t coremap_base;	/* physical address of page 0 */
+static u_int32_t coremap_npages;
+static u_int32_t coremap_nfree;
+static u_int32_t coremap_hint;	/* where to start looking */
+
+/* Pre-zeroed pages (coremap indices); all and only the CME_ZERO pages */
+static u_int32_t zpool[ZPOOL_MAX];
+static u_int32_t zpool_n;
+static u_int32_t zpool_hint;	/* where vm_idlezero looks next */
+
+struct vm_stats vm_stats;
+
+paddr_t vm_timepage;
+
+/*
+ * Set up the coremap. It lives at the bottom of the memory
+ * ram_getsize reports, and manages everything above itself. Memory
+ * stolen before this point stays with the kernel for good.
+ */
 void
 vm_bootstrap(void)
 {
-	/* do nothing */
+	struct coremap_entry *cm;
+	paddr_t lo, hi;
+	u_int32_t npages, cmpages, i;
+
+	ram_getsize(&lo, &hi);
+	assert((lo & PAGE_FRAME) == lo);
+	assert((hi & PAGE_FRAME) == hi);
+
+	npages = (hi - lo) / PAGE_SIZE;
+	cmpages = (npages * sizeof(struct coremap_entry) + PAGE_SIZE - 1)
+		/ PAGE_SIZE;
+	if (cmpages >= npages) {
+		panic("vm: no memory left for the coremap\n");
+	}
+
+	cm = (struct coremap_entry *) PADDR_TO_KVADDR(lo);
+	coremap_base = lo + cmpages * PAGE_SIZE;
+	coremap_npages = npages - cmpages;
+	for (i=0; i<coremap_npages; i++) {
+		cm[i].cme_kind = CME_FREE;
+		cm[i].cme_pad = 0;
+		cm[i].cme_npages = 0;
+		cm[i].cme_refs = 0;
+	}
+	coremap_nfree = coremap_npages;
+	coremap_hint = 0;
+
+	/* Set last; until now alloc_kpages steals from ram.c */
+	coremap = cm;
+
+	/* A user page, so address spaces can hold references to it */
+	vm_timepage = page_zalloc();
+	if (vm_timepage == 0) {
+		panic("vm: no memory for the time page\n");
+	}
+
+	kprintf("vm: %uk managed in %u pages, coremap %uk\n",
+		coremap_npages * PAGE_SIZE / 1024, coremap_npages,
+		cmpages * PAGE_SIZE / 1024);
 }
 
-vaddr_t 
+/*
+ * Find NPAGES contiguous free pages, using pre-zeroed ones only if
+ * ALLOWZERO is set. Call at splhigh. Returns the index of the first,
+ * or -1.
+ */
+static
+int
+coremap_findrun(u_int32_t npages, int allowzero)
+{
+	u_int32_t i, start, run, tries;
+
+	if (npages > coremap_nfree - (allowzero ? 0 : zpool_n)) {
+		return -1;
+	}
+
+	start = coremap_hint;
+	run = 0;
+	for (tries=0; tries < coremap_npages + npages; tries++) {
+		i = (coremap_hint + tries) % coremap_npages;
+		if (i == 0) {
+			/* runs don't wrap around */
+			run = 0;
+		}
+		if (coremap[i].cme_kind != CME_FREE &&
+		    !(allowzero && coremap[i].cme_kind == CME_ZERO)) {
+			run = 0;
+			continue;
+		}
+		if (run == 0) {
+			start = i;
+		}
+		run++;
+		if (run == npages) {
+			return start;
+		}
+	}
+	return -1;
+}
+
+/*
+ * Take page IX out of the zero pool, making it an ordinary free page.
+ * Call at splhigh.
+ */
+static
+void
+zpool_remove(u_int32_t ix)
+{
+	u_int32_t i;
+
+	assert(coremap[ix].cme_kind == CME_ZERO);
+	for (i=0; i<zpool_n; i++) {
+		if (zpool[i] == ix) {
+			zpool[i] = zpool[--zpool_n];
+			coremap[ix].cme_kind = CME_FREE;
+			return;
+		}
+	}
+	panic("vm: zeroed page %u not in zero pool\n", ix);
+}
+
+/*
+ * Claim a pre-zeroed page as KIND. Returns its index, or -1 if the
+ * pool is empty. Call at splhigh.
+ */
+static
+int
+zpool_take(int kind)
+{
+	u_int32_t ix;
+
+	if (zpool_n == 0) {
+		vm_stats.vs_zmiss++;
+		return -1;
+	}
+
+	ix = zpool[--zpool_n];
+	assert(coremap[ix].cme_kind == CME_ZERO);
+	coremap[ix].cme_kind = kind;
+	coremap[ix].cme_npages = 1;
+	coremap[ix].cme_refs = 1;
+	coremap_nfree--;
+	vm_stats.vs_zhit++;
+	return ix;
+}
+
+static
+paddr_t
+getppages(u_int32_t npages, int kind)
+{
+	int spl, ix;
+	u_int32_t i;
+	paddr_t pa;
+
+	spl = splhigh();
+
+	if (coremap == NULL) {
+		pa = ram_stealmem(npages);
+		splx(spl);
+		return pa;
+	}
+
+	ix = coremap_findrun(npages, 0);
+	if (ix < 0) {
+		/* Only pre-zeroed pages left; use them anyway */
+		ix = coremap_findrun(npages, 1);
+	}
+	if (ix < 0) {
+		splx(spl);
+		return 0;
+	}
+
+	for (i=0; i<npages; i++) {
+		if (coremap[ix+i].cme_kind == CME_ZERO) {
+			zpool_remove(ix+i);
+		}
+		assert(coremap[ix+i].cme_kind == CME_FREE);
+		coremap[ix+i].cme_kind = kind;
+		coremap[ix+i].cme_npages = 0;
+		coremap[ix+i].cme_refs = 1;
+	}
+	coremap[ix].cme_npages = npages;
+	coremap_nfree -= npages;
+	coremap_hint = (ix + npages) % coremap_npages;
+
+	splx(spl);
+	return coremap_base + ix * PAGE_SIZE;
+}
+
+/*
+ * Coremap index of a managed physical address; -1 for memory stolen
+ * before vm_bootstrap.
+ */
+static
+int
+coremap_index(paddr_t pa)
+{
+	assert((pa & PAGE_FRAME) == pa);
+	if (coremap == NULL || pa < coremap_base) {
+		return -1;
+	}
+	assert(pa < coremap_base + coremap_npages * PAGE_SIZE);
+	return (pa - coremap_base) / PAGE_SIZE;
+}
+
+/* Allocate/free some kernel-space virtual pages */
+vaddr_t
 alloc_kpages(int npages)
 {
-	/*
-	 * Write this.
-	 */
-	 
-	(void)npages;
-	return 0;
+	paddr_t pa;
+
+	pa = getppages(npages, CME_KERNEL);
+	if (pa==0) {
+		return 0;
+	}
+	return PADDR_TO_KVADDR(pa);
 }
 
-void 
+void
 free_kpages(vaddr_t addr)
 {
-	/*
-	 * Write this.
-	 */
+	int spl, ix;
+	u_int32_t i, npages;
+
+	assert(addr >= MIPS_KSEG0);
+
+	spl = splhigh();
+
+	ix = coremap_index(addr - MIPS_KSEG0);
+	if (ix < 0) {
+		/* stolen at boot; can't give it back */
+		splx(spl);
+		return;
+	}
+
+	assert(coremap[ix].cme_kind == CME_KERNEL);
+	npages = coremap[ix].cme_npages;
+	assert(npages > 0);
+
+	for (i=0; i<npages; i++) {
+		assert(coremap[ix+i].cme_kind == CME_KERNEL);
+		coremap[ix+i].cme_kind = CME_FREE;
+		coremap[ix+i].cme_npages = 0;
+		coremap[ix+i].cme_refs = 0;
+	}
+	coremap_nfree += npages;
+
+	splx(spl);
+}
+
+paddr_t
+page_alloc(void)
+{
+	return getppages(1, CME_USER);
+}
+
+paddr_t
+page_zalloc(void)
+{
+	paddr_t pa;
+	int spl, ix;
+
+	spl = splhigh();
+	ix = zpool_take(CME_USER);
+	splx(spl);
+	if (ix >= 0) {
+		return coremap_base + ix * PAGE_SIZE;
+	}
 
-	(void)addr;
+	pa = page_alloc();
+	if (pa != 0) {
+		bzero((void *)PADDR_TO_KVADDR(pa), PAGE_SIZE);
+	}
+	return pa;
+}
+
+vaddr_t
+alloc_kzpage(void)
+{
+	vaddr_t va;
+	int spl, ix;
+
+	spl = splhigh();
+	ix = (coremap != NULL) ? zpool_take(CME_KERNEL) : -1;
+	splx(spl);
+	if (ix >= 0) {
+		return PADDR_TO_KVADDR(coremap_base + ix * PAGE_SIZE);
+	}
+
+	va = alloc_kpages(1);
+	if (va != 0) {
+		bzero((void *)va, PAGE_SIZE);
+	}
+	return va;
+}
+
+/*
+ * Zero one free page for the pool. Called by the scheduler's idle
+ * loop, at splhigh and with no current thread; interrupts are turned
+ * on while the page is being cleared. Returns nonzero if it did any
+ * work, zero if there's nothing to do.
+ */
+int
+vm_idlezero(void)
+{
+	u_int32_t i, ix;
+
+	assert(curspl>0);
+
+	if (coremap == NULL || zpool_n >= ZPOOL_MAX ||
+	    coremap_nfree <= zpool_n) {
+		return 0;
+	}
+
+	for (i=0; i<coremap_npages; i++) {
+		ix = (zpool_hint + i) % coremap_npages;
+		if (coremap[ix].cme_kind == CME_FREE) {
+			break;
+		}
+	}
+	if (i == coremap_npages) {
+		return 0;
+	}
+	zpool_hint = (ix + 1) % coremap_npages;
+
+	/* Not free while we work on it, so nobody allocates it */
+	coremap[ix].cme_kind = CME_ZEROING;
+	coremap_nfree--;
+
+	spl0();
+	bzero((void *)PADDR_TO_KVADDR(coremap_base + ix * PAGE_SIZE),
+	      PAGE_SIZE);
+	splhigh();
+
+	assert(coremap[ix].cme_kind == CME_ZEROING);
+	coremap[ix].cme_kind = CME_ZERO;
+	coremap_nfree++;
+	assert(zpool_n < ZPOOL_MAX);
+	zpool[zpool_n++] = ix;
+	vm_stats.vs_zeroed++;
+
+	return 1;
+}
+
+void
+page_incref(paddr_t pa)
+{
+	int spl, ix;
+
+	spl = splhigh();
+	ix = coremap_index(pa);
+	assert(ix >= 0);
+	assert(coremap[ix].cme_kind == CME_USER);
+	assert(coremap[ix].cme_refs > 0);
+	coremap[ix].cme_refs++;
+	splx(spl);
+}
+
+void
+page_decref(paddr_t pa)
+{
+	int spl, ix;
+
+	spl = splhigh();
+	ix = coremap_index(pa);
+	assert(ix >= 0);
+	assert(coremap[ix].cme_kind == CME_USER);
+	assert(coremap[ix].cme_refs > 0);
+	coremap[ix].cme_refs--;
+	if (coremap[ix].cme_refs == 0) {
+		coremap[ix].cme_kind = CME_FREE;
+		coremap_nfree++;
+	}
+	splx(spl);
 }
 
 int
 vm_fault(int faulttype, vaddr_t faultaddress)
 {
+	struct addrspace *as;
+	u_int32_t pte, ehi, elo, majflt;
+	int spl, ix, result;
+
+	faultaddress &= PAGE_FRAME;
+
+	DEBUG(DB_VM, "vm: fault: 0x%x\n", faultaddress);
+
+	switch (faulttype) {
+	    case VM_FAULT_READONLY:
+		tlb_stats.ts_modfaults++;
+		break;
+	    case VM_FAULT_READ:
+	    case VM_FAULT_WRITE:
+		tlb_stats.ts_misses++;
+		break;
+	    default:
+		return EINVAL;
+	}
+
+	as = curthread->t_vmspace;
+	if (as == NULL) {
+		/*
+		 * No address space set up. This is probably a kernel
+		 * fault early in boot. Return EFAULT so as to panic
+		 * instead of getting into an infinite faulting loop.
+		 */
+		return EFAULT;
+	}
+
+	if (faultaddress >= USERTOP) {
+		return EFAULT;
+	}
+
+	/* This may sleep (reading from a file) */
+	majflt = curthread->t_ru.ru_majflt;
+	result = as_fault(as, faulttype, faultaddress, &pte);
+	if (result) {
+		return result;
+	}
+	if (curthread->t_ru.ru_majflt == majflt) {
+		curthread->t_ru.ru_minflt++;
+	}
+
 	/*
-	 * Definitely write this.
+	 * If we slept reading the page, the TLB was flushed when we
+	 * got the CPU back; if not, there may already be an entry for
+	 * this page (VM_FAULT_READONLY). Replace it if so.
 	 */
+	ehi = faultaddress | asid_hi();
+	elo = (pte & PTE_FRAME) | TLBLO_VALID;
+	if (pte & PTE_WRITE) {
+		elo |= TLBLO_DIRTY;
+	}
 
-	(void)faulttype;
-	(void)faultaddress;
+	spl = splhigh();
+
+	vm_stats.vs_faults++;
+
+	ix = TLB_Probe(ehi, 0);
+	if (ix >= 0) {
+		TLB_Write(ehi, elo, ix);
+	}
+	else {
+		TLB_Random(ehi, elo);
+	}
+	DEBUG(DB_VM, "vm: 0x%x -> 0x%x\n", ehi, elo);
+
+	splx(spl);
 	return 0;
 }
+
+void
+vm_printstats(void)
+{
+	kprintf("vm: %u of %u pages free, %u pre-zeroed\n",
+		coremap_nfree, coremap_npages, zpool_n);
+	kprintf("vm: zero pool: %u hits, %u misses, %u zeroed when idle\n",
+		vm_stats.vs_zhit, vm_stats.vs_zmiss, vm_stats.vs_zeroed);
+	kprintf("vm: %u faults: %u zero-fill, %u file, "
+		"%u shared hit, %u shared miss\n",
+		vm_stats.vs_faults, vm_stats.vs_zerofill,
+		vm_stats.vs_fileread, vm_stats.vs_objhit,
+		vm_stats.vs_objmiss);
+	kprintf("vm: heap: %u grows, %u shrinks, %u pages freed\n",
+		vm_stats.vs_heapgrow, vm_stats.vs_heapshrink,
+		vm_stats.vs_heapfreed);
+	kprintf("vm: mmap: %u copy-on-write, %u pages written back\n",
+		vm_stats.vs_cow, vm_stats.vs_objsync);
+}
@@ -0,0 +1,295 @@
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/stat.h>
+#include <lib.h>
+#include <synch.h>
+#include <thread.h>
+#include <curthread.h>
+#include <uio.h>
+#include <vnode.h>
+#include <vm.h>
+
+/*
+ * Per-vnode page cache.
+ *
+ * A vm_object hangs off vn_vmobj and holds physical pages of the
+ * file, indexed by file page number. Each cached page carries one
+ * reference for the cache and one for every address space mapping
+ * it, so twenty copies of the same program share one copy of its
+ * text, and only the first of them reads it from disk.
+ *
+ * Pages of shared writable mappings (mmap MAP_SHARED) are written in
+ * place. The fault that grants write access marks the page dirty
+ * (VO_DIRTY, kept in the low bits of the page address), and
+ * vmobj_sync writes dirty pages back with VOP_WRITE. Mappings sync
+ * before they go away, so by the time the vnode is reclaimed
+ * (vnode_kill) nothing is dirty and the cache is simply dropped.
+ *
+ * Several address spaces can have the same page mapped writable, and
+ * a write through any of them doesn't fault once it's writable. So
+ * the low bits also count the mappings that currently have write
+ * access (vmobj_dirty adds one, vmobj_wprotect drops one), and
+ * vmobj_sync only marks a page clean once there are none left;
+ * until then it stays dirty and is written again at the next sync.
+ *
+ * The cache is not coherent with read() and write(): changes made
+ * through a mapping are visible to read() only after msync, and
+ * writes to a file that's mapped or being run don't reach pages
+ * already cached.
+ */
+
+struct vm_object {
+	struct lock *vo_lock;		/* protects the rest */
+	paddr_t *vo_pages;		/* by file page number; 0 if absent */
+	u_int32_t vo_npages;		/* size of vo_pages */
+};
+
+#define VO_DIRTY	0x1	/* in vo_pages[]: page must be written */
+#define VO_WRITER	0x2	/* in vo_pages[]: one writable mapping */
+#define VO_WRITERS	(~PAGE_FRAME & ~VO_DIRTY)	/* count of them */
+
+/*
+ * Get V's object, creating it if necessary.
+ */
+static
+struct vm_object *
+vmobj_get(struct vnode *v)
+{
+	struct vm_object *vo;
+
+	/*
+	 * Use the vnode's count lock to settle races between two
+	 * faults creating the object at the same time.
+	 */
+	lock_acquire(v->vn_countlock);
+	vo = v->vn_vmobj;
+	if (vo == NULL) {
+		vo = kmalloc(sizeof(struct vm_object));
+		if (vo == NULL) {
+			lock_release(v->vn_countlock);
+			return NULL;
+		}
+		vo->vo_lock = lock_create("vmobj");
+		if (vo->vo_lock == NULL) {
+			kfree(vo);
+			lock_release(v->vn_countlock);
+			return NULL;
+		}
+		vo->vo_pages = NULL;
+		vo->vo_npages = 0;
+		v->vn_vmobj = vo;
+	}
+	lock_release(v->vn_countlock);
+
+	return vo;
+}
+
+/*
+ * Make sure VO has a slot for page IX. Call with vo_lock held.
+ */
+static
+int
+vmobj_grow(struct vm_object *vo, u_int32_t ix)
+{
+	paddr_t *newpages;
+	u_int32_t newsize;
+
+	if (ix < vo->vo_npages) {
+		return 0;
+	}
+
+	newsize = vo->vo_npages ? vo->vo_npages : 16;
+	while (newsize <= ix) {
+		newsize *= 2;
+	}
+
+	newpages = kmalloc(newsize * sizeof(paddr_t));
+	if (newpages == NULL) {
+		return ENOMEM;
+	}
+	bzero(newpages, newsize * sizeof(paddr_t));
+	if (vo->vo_pages != NULL) {
+		memcpy(newpages, vo->vo_pages, vo->vo_npages * sizeof(paddr_t));
+		kfree(vo->vo_pages);
+	}
+	vo->vo_pages = newpages;
+	vo->vo_npages = newsize;
+	return 0;
+}
+
+int
+vmobj_getpage(struct vnode *v, off_t offset, paddr_t *ret)
+{
+	struct vm_object *vo;
+	struct uio ku;
+	u_int32_t ix;
+	paddr_t pa;
+	int result;
+
+	assert(offset >= 0);
+	assert((offset & ~PAGE_FRAME) == 0);
+
+	vo = vmobj_get(v);
+	if (vo == NULL) {
+		return ENOMEM;
+	}
+
+	ix = offset / PAGE_SIZE;
+
+	lock_acquire(vo->vo_lock);
+
+	result = vmobj_grow(vo, ix);
+	if (result) {
+		lock_release(vo->vo_lock);
+		return result;
+	}
+
+	pa = vo->vo_pages[ix] & PAGE_FRAME;
+	if (pa != 0) {
+		page_incref(pa);
+		vm_stats.vs_objhit++;
+		lock_release(vo->vo_lock);
+		*ret = pa;
+		return 0;
+	}
+
+	pa = page_alloc();
+	if (pa == 0) {
+		lock_release(vo->vo_lock);
+		return ENOMEM;
+	}
+
+	mk_kuio(&ku, (void *)PADDR_TO_KVADDR(pa), PAGE_SIZE, offset, UIO_READ);
+	result = VOP_READ(v, &ku);
+	if (result) {
+		page_decref(pa);
+		lock_release(vo->vo_lock);
+		return result;
+	}
+	if (ku.uio_resid > 0) {
+		/* EOF: the rest of the page is zeros */
+		bzero((void *)(PADDR_TO_KVADDR(pa) + PAGE_SIZE - ku.uio_resid),
+		      ku.uio_resid);
+	}
+
+	/* one reference for the cache, one for the caller */
+	vo->vo_pages[ix] = pa;
+	page_incref(pa);
+	vm_stats.vs_objmiss++;
+	curthread->t_ru.ru_majflt++;
+
+	lock_release(vo->vo_lock);
+
+	*ret = pa;
+	return 0;
+}
+
+void
+vmobj_dirty(struct vnode *v, off_t offset)
+{
+	struct vm_object *vo = v->vn_vmobj;
+	u_int32_t ix = offset / PAGE_SIZE;
+
+	/* The caller has the page mapped, so it's in the cache */
+	assert(vo != NULL);
+
+	lock_acquire(vo->vo_lock);
+	assert(ix < vo->vo_npages && vo->vo_pages[ix] != 0);
+	assert((vo->vo_pages[ix] & VO_WRITERS) != VO_WRITERS);
+	vo->vo_pages[ix] += VO_WRITER;
+	vo->vo_pages[ix] |= VO_DIRTY;
+	lock_release(vo->vo_lock);
+}
+
+void
+vmobj_wprotect(struct vnode *v, off_t offset)
+{
+	struct vm_object *vo = v->vn_vmobj;
+	u_int32_t ix = offset / PAGE_SIZE;
+
+	assert(vo != NULL);
+
+	lock_acquire(vo->vo_lock);
+	assert(ix < vo->vo_npages && (vo->vo_pages[ix] & VO_WRITERS) != 0);
+	vo->vo_pages[ix] -= VO_WRITER;
+	lock_release(vo->vo_lock);
+}
+
+int
+vmobj_sync(struct vnode *v, off_t offset, off_t len)
+{
+	struct vm_object *vo = v->vn_vmobj;
+	struct stat st;
+	struct uio ku;
+	u_int32_t ix, end;
+	off_t pos, size;
+	paddr_t pa;
+	int result;
+
+	if (vo == NULL) {
+		return 0;
+	}
+
+	result = VOP_STAT(v, &st);
+	if (result) {
+		return result;
+	}
+
+	lock_acquire(vo->vo_lock);
+
+	ix = offset / PAGE_SIZE;
+	end = (offset + len + PAGE_SIZE - 1) / PAGE_SIZE;
+	if (end > vo->vo_npages) {
+		end = vo->vo_npages;
+	}
+
+	for (; ix < end; ix++) {
+		if ((vo->vo_pages[ix] & VO_DIRTY) == 0) {
+			continue;
+		}
+		pa = vo->vo_pages[ix] & PAGE_FRAME;
+
+		/*
+		 * Mappings can't extend the file: whatever was written
+		 * past EOF is dropped.
+		 */
+		pos = (off_t)ix * PAGE_SIZE;
+		size = st.st_size - pos;
+		if (size > PAGE_SIZE) {
+			size = PAGE_SIZE;
+		}
+		if (size > 0) {
+			mk_kuio(&ku, (void *)PADDR_TO_KVADDR(pa), size, pos,
+				UIO_WRITE);
+			result = VOP_WRITE(v, &ku);
+			if (result) {
+				lock_release(vo->vo_lock);
+				return result;
+			}
+			vm_stats.vs_objsync++;
+		}
+		if ((vo->vo_pages[ix] & VO_WRITERS) == 0) {
+			vo->vo_pages[ix] = pa;
+		}
+	}
+
+	lock_release(vo->vo_lock);
+	return 0;
+}
+
+void
+vmobj_destroy(struct vm_object *vo)
+{
+	u_int32_t i;
+
+	for (i=0; i<vo->vo_npages; i++) {
+		if (vo->vo_pages[i] != 0) {
+			page_decref(vo->vo_pages[i] & PAGE_FRAME);
+		}
+	}
+	if (vo->vo_pages != NULL) {
+		kfree(vo->vo_pages);
+	}
+	lock_destroy(vo->vo_lock);
+	kfree(vo);
+}
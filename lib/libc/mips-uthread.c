@@ -0,0 +1,32 @@
+/*
+ * Machine-dependent part of the user-level thread library.
+ */
+
+#include <sys/types.h>
+#include <string.h>
+#include <setjmp.h>
+
+void __uthread_mdinit(jmp_buf jb, char *stack, size_t stacksize,
+		      void (*func)(void));
+
+/*
+ * Set up JB so that longjmp to it calls FUNC, with the stack pointer
+ * near the top of STACK. The slots are the ones mips-setjmp.S uses
+ * for sp and ra; the callee-saved registers start out zero.
+ *
+ * The stack pointer must be 8-byte aligned, and the calling
+ * convention has the caller leave 16 bytes above it for the callee
+ * to store its argument registers in.
+ */
+void
+__uthread_mdinit(jmp_buf jb, char *stack, size_t stacksize,
+		 void (*func)(void))
+{
+	u_int32_t sp;
+
+	sp = ((u_int32_t)(stack + stacksize) & ~(u_int32_t)7) - 16;
+
+	bzero(jb, sizeof(jmp_buf));
+	jb[0] = sp;
+	jb[1] = (u_int32_t)func;
+}
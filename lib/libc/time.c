@@ -1,9 +1,44 @@
+#include <sys/types.h>
 #include <unistd.h>
+#include <kern/timepage.h>
+
+/*
+ * OS/161 C function: retrieve time in seconds since the epoch, and
+ * optionally nanoseconds.
+ *
+ * Seconds alone come from the kernel's time page without a system
+ * call; they can be up to a clock tick behind. Nanoseconds, or any
+ * call before the clock has ticked, go to the __time system call.
+ */
+
+time_t
+__time(time_t *seconds, unsigned long *nanoseconds)
+{
+	const struct timepage *tp = (const struct timepage *)TIMEPAGE;
+	u_int32_t seq;
+	time_t secs;
+
+	if (nanoseconds != NULL) {
+		return __sys_time(seconds, nanoseconds);
+	}
+
+	do {
+		seq = tp->tp_seq;
+		secs = tp->tp_secs;
+	} while ((seq & 1) != 0 || seq != tp->tp_seq);
+
+	if (seq == 0) {
+		return __sys_time(seconds, NULL);
+	}
+
+	if (seconds != NULL) {
+		*seconds = secs;
+	}
+	return secs;
+}
 
 /*
  * POSIX C function: retrieve time in seconds since the epoch.
- * Uses the OS/161 system call __time, which does the same thing
- * but also returns nanoseconds.
  */
 
 time_t
@@ -0,0 +1,448 @@
+/*
+ * User-level threads. See uthread.h.
+ *
+ * A context switch is a setjmp into the outgoing thread's jmp_buf and
+ * a longjmp to the incoming one's. A new thread's jmp_buf is built by
+ * the machine-dependent __uthread_mdinit so that the first longjmp to
+ * it lands in uthread_start on the new stack.
+ *
+ * A thread can't free the stack it's running on, so exiting threads
+ * that nobody will join are left in ut_dead, and whichever thread
+ * runs next frees them.
+ */
+
+#include <sys/types.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include <assert.h>
+#include <errno.h>
+#include <err.h>
+#include <uthread.h>
+
+struct uthread {
+	jmp_buf ut_jb;			/* saved context, when not running */
+	char *ut_stack;			/* from malloc; NULL for main */
+	void (*ut_func)(void *);
+	void *ut_arg;
+	int ut_joinable;		/* kept after exit until joined */
+	int ut_exited;
+	int ut_inlib;			/* ut_inlib, while switched out */
+	struct uthread *ut_joiner;	/* thread in uthread_join on us */
+	struct uthread *ut_next;	/* run queue or wait queue link */
+};
+
+/* Machine-dependent: see $(PLATFORM)-uthread.c */
+void __uthread_mdinit(jmp_buf jb, char *stack, size_t stacksize,
+		      void (*func)(void));
+
+/* The thread that was running main() */
+static struct uthread ut_main;
+
+/* Running thread; NULL until the library is first used */
+static struct uthread *ut_cur;
+
+/* Ready threads */
+static struct uthread_queue ut_runq;
+
+/* Exited threads waiting to be freed */
+static struct uthread *ut_dead;
+
+/* Threads that haven't exited */
+static int ut_nlive;
+
+/*
+ * For uthread_tick: how deep the running thread is in library calls,
+ * and whether a yield is owed.
+ */
+static int ut_inlib;
+static int ut_tickpending;
+
+////////////////////////////////////////////////////////////
+// queues
+
+static
+void
+uq_add(struct uthread_queue *q, struct uthread *t)
+{
+	t->ut_next = NULL;
+	if (q->uq_tail != NULL) {
+		q->uq_tail->ut_next = t;
+	}
+	else {
+		q->uq_head = t;
+	}
+	q->uq_tail = t;
+}
+
+static
+struct uthread *
+uq_remove(struct uthread_queue *q)
+{
+	struct uthread *t;
+
+	t = q->uq_head;
+	if (t != NULL) {
+		q->uq_head = t->ut_next;
+		if (q->uq_head == NULL) {
+			q->uq_tail = NULL;
+		}
+		t->ut_next = NULL;
+	}
+	return t;
+}
+
+////////////////////////////////////////////////////////////
+// core
+
+/*
+ * Make the thread running main() a uthread, the first time through.
+ */
+static
+void
+uthread_init(void)
+{
+	if (ut_cur == NULL) {
+		ut_main.ut_stack = NULL;
+		ut_main.ut_joinable = 0;
+		ut_main.ut_exited = 0;
+		ut_main.ut_inlib = 0;
+		ut_main.ut_joiner = NULL;
+		ut_main.ut_next = NULL;
+		ut_cur = &ut_main;
+		ut_nlive = 1;
+	}
+}
+
+static
+void
+uthread_enter(void)
+{
+	uthread_init();
+	ut_inlib++;
+}
+
+static
+void
+uthread_leave(void)
+{
+	ut_inlib--;
+	if (ut_inlib == 0 && ut_tickpending) {
+		ut_tickpending = 0;
+		uthread_yield();
+	}
+}
+
+static
+void
+uthread_free(struct uthread *t)
+{
+	assert(t != ut_cur);
+	if (t != &ut_main) {
+		free(t->ut_stack);
+		free(t);
+	}
+}
+
+static
+void
+uthread_reap(void)
+{
+	struct uthread *t;
+
+	while (ut_dead != NULL) {
+		t = ut_dead;
+		ut_dead = t->ut_next;
+		uthread_free(t);
+	}
+}
+
+/*
+ * Switch to the next ready thread. The caller has already put the
+ * current thread wherever it's supposed to go: on the run queue, on
+ * a wait queue, or nowhere if it's exiting.
+ */
+static
+void
+uthread_switch(void)
+{
+	struct uthread *next;
+
+	next = uq_remove(&ut_runq);
+	if (next == NULL) {
+		if (ut_nlive == 0) {
+			/* Everyone has exited */
+			exit(0);
+		}
+		errx(1, "uthread: deadlock: all %d threads are blocked",
+		     ut_nlive);
+	}
+	if (next == ut_cur) {
+		return;
+	}
+
+	ut_cur->ut_inlib = ut_inlib;
+	if (setjmp(ut_cur->ut_jb) == 0) {
+		ut_cur = next;
+		longjmp(next->ut_jb, 1);
+	}
+
+	/* Back again */
+	ut_inlib = ut_cur->ut_inlib;
+	uthread_reap();
+}
+
+/*
+ * Where new threads start, on their own stacks.
+ */
+static
+void
+uthread_start(void)
+{
+	uthread_reap();
+	ut_inlib = 0;
+	ut_cur->ut_func(ut_cur->ut_arg);
+	uthread_exit();
+}
+
+int
+uthread_create(struct uthread **ret, size_t stacksize,
+	       void (*func)(void *), void *arg)
+{
+	struct uthread *t;
+
+	uthread_enter();
+
+	if (stacksize == 0) {
+		stacksize = UTHREAD_STACKSIZE;
+	}
+	if (stacksize < UTHREAD_STACKMIN) {
+		uthread_leave();
+		errno = EINVAL;
+		return -1;
+	}
+
+	t = malloc(sizeof(struct uthread));
+	if (t == NULL) {
+		uthread_leave();
+		errno = ENOMEM;
+		return -1;
+	}
+	t->ut_stack = malloc(stacksize);
+	if (t->ut_stack == NULL) {
+		free(t);
+		uthread_leave();
+		errno = ENOMEM;
+		return -1;
+	}
+
+	t->ut_func = func;
+	t->ut_arg = arg;
+	t->ut_joinable = ret != NULL;
+	t->ut_exited = 0;
+	t->ut_inlib = 0;
+	t->ut_joiner = NULL;
+	__uthread_mdinit(t->ut_jb, t->ut_stack, stacksize, uthread_start);
+
+	ut_nlive++;
+	uq_add(&ut_runq, t);
+	if (ret != NULL) {
+		*ret = t;
+	}
+
+	uthread_leave();
+	return 0;
+}
+
+void
+uthread_exit(void)
+{
+	uthread_enter();
+
+	ut_cur->ut_exited = 1;
+	ut_nlive--;
+
+	if (ut_cur->ut_joiner != NULL) {
+		uq_add(&ut_runq, ut_cur->ut_joiner);
+	}
+	if (!ut_cur->ut_joinable) {
+		ut_cur->ut_next = ut_dead;
+		ut_dead = ut_cur;
+	}
+
+	uthread_switch();
+	errx(1, "uthread: thread came back from the dead");
+}
+
+int
+uthread_join(struct uthread *t)
+{
+	uthread_enter();
+
+	if (t == ut_cur) {
+		uthread_leave();
+		errno = EDEADLK;
+		return -1;
+	}
+	if (!t->ut_joinable || t->ut_joiner != NULL) {
+		uthread_leave();
+		errno = EINVAL;
+		return -1;
+	}
+
+	t->ut_joiner = ut_cur;
+	while (!t->ut_exited) {
+		uthread_switch();
+	}
+	uthread_free(t);
+
+	uthread_leave();
+	return 0;
+}
+
+void
+uthread_yield(void)
+{
+	uthread_enter();
+	uq_add(&ut_runq, ut_cur);
+	uthread_switch();
+	ut_inlib--;
+	/* Not uthread_leave: this was the yield any tick was owed */
+	ut_tickpending = 0;
+}
+
+struct uthread *
+uthread_self(void)
+{
+	uthread_init();
+	return ut_cur;
+}
+
+void
+uthread_tick(void)
+{
+	if (ut_inlib > 0) {
+		ut_tickpending = 1;
+	}
+	else {
+		uthread_yield();
+	}
+}
+
+////////////////////////////////////////////////////////////
+// mutexes
+
+void
+umutex_init(struct umutex *m)
+{
+	m->um_owner = NULL;
+	m->um_waiters.uq_head = NULL;
+	m->um_waiters.uq_tail = NULL;
+}
+
+void
+umutex_lock(struct umutex *m)
+{
+	uthread_enter();
+
+	assert(m->um_owner != ut_cur);
+	if (m->um_owner == NULL) {
+		m->um_owner = ut_cur;
+	}
+	else {
+		/* umutex_unlock hands it straight to us */
+		uq_add(&m->um_waiters, ut_cur);
+		uthread_switch();
+		assert(m->um_owner == ut_cur);
+	}
+
+	uthread_leave();
+}
+
+int
+umutex_trylock(struct umutex *m)
+{
+	int result = 0;
+
+	uthread_enter();
+
+	if (m->um_owner == NULL) {
+		m->um_owner = ut_cur;
+	}
+	else {
+		errno = EBUSY;
+		result = -1;
+	}
+
+	uthread_leave();
+	return result;
+}
+
+void
+umutex_unlock(struct umutex *m)
+{
+	struct uthread *t;
+
+	uthread_enter();
+
+	assert(m->um_owner == ut_cur);
+	t = uq_remove(&m->um_waiters);
+	m->um_owner = t;
+	if (t != NULL) {
+		uq_add(&ut_runq, t);
+	}
+
+	uthread_leave();
+}
+
+////////////////////////////////////////////////////////////
+// condition variables
+
+void
+ucond_init(struct ucond *c)
+{
+	c->uc_waiters.uq_head = NULL;
+	c->uc_waiters.uq_tail = NULL;
+}
+
+void
+ucond_wait(struct ucond *c, struct umutex *m)
+{
+	uthread_enter();
+
+	uq_add(&c->uc_waiters, ut_cur);
+	umutex_unlock(m);
+	uthread_switch();
+	umutex_lock(m);
+
+	uthread_leave();
+}
+
+void
+ucond_signal(struct ucond *c)
+{
+	struct uthread *t;
+
+	uthread_enter();
+
+	t = uq_remove(&c->uc_waiters);
+	if (t != NULL) {
+		uq_add(&ut_runq, t);
+	}
+
+	uthread_leave();
+}
+
+void
+ucond_broadcast(struct ucond *c)
+{
+	struct uthread *t;
+
+	uthread_enter();
+
+	while ((t = uq_remove(&c->uc_waiters)) != NULL) {
+		uq_add(&ut_runq, t);
+	}
+
+	uthread_leave();
+}
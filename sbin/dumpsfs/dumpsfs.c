@@ -26,6 +26,32 @@
 
 #include "disk.h"
 
+static
+void
+dumpjournal(u_int32_t jstart, u_int32_t jblocks)
+{
+	struct sfs_jheader jh;
+	u_int32_t i, n;
+
+	printf("Journal: blocks %u-%u\n", jstart, jstart+jblocks-1);
+
+	diskread(&jh, jstart);
+	if (SWAPL(jh.jh_magic) != SFS_JMAGIC) {
+		printf("    clean\n");
+		return;
+	}
+
+	n = SWAPL(jh.jh_nblocks);
+	printf("    transaction %u pending, %u blocks:", SWAPL(jh.jh_seq), n);
+	if (n > SFS_JMAXHOME) {
+		n = SFS_JMAXHOME;
+	}
+	for (i=0; i<n; i++) {
+		printf(" %u", SWAPL(jh.jh_home[i]));
+	}
+	printf("\n");
+}
+
 static
 u_int32_t
 dumpsb(void)
@@ -38,6 +64,18 @@ dumpsb(void)
 	sp.sp_volname[sizeof(sp.sp_volname)-1] = 0;
 	printf("Volume name: %-40s  %u blocks\n", sp.sp_volname, 
 	       SWAPL(sp.sp_nblocks));
+	printf("Format version: %u\n", SWAPL(sp.sp_version));
+	if (SWAPL(sp.sp_version) > SFS_VERSION) {
+		warnx("Warning: unknown format version (expected <= %u)",
+		      SFS_VERSION);
+	}
+	if (SWAPL(sp.sp_version) >= SFS_VERSION_JOURNAL &&
+	    SWAPL(sp.sp_jblocks) > 0) {
+		dumpjournal(SWAPL(sp.sp_jstart), SWAPL(sp.sp_jblocks));
+	}
+	else {
+		printf("Journal: none\n");
+	}
 
 	return SWAPL(sp.sp_nblocks);
 }
@@ -65,12 +103,41 @@ dodirblock(u_int32_t block)
 	}
 }
 
+/*
+ * Walk an indirect block of the given level (1 = single, 2 = double,
+ * 3 = triple), dumping each directory block found under it. Returns
+ * the number of directory blocks seen.
+ */
+static
+u_int32_t
+doindirect(u_int32_t idblock, int level)
+{
+	u_int32_t ib[SFS_DBPERIDB];
+	u_int32_t block, nblocks=0;
+	int i;
+
+	diskread(&ib, idblock);
+	for (i=0; i<SFS_DBPERIDB; i++) {
+		block = SWAPL(ib[i]);
+		if (block==0) {
+			continue;
+		}
+		if (level > 1) {
+			nblocks += doindirect(block, level-1);
+		}
+		else {
+			dodirblock(block);
+			nblocks++;
+		}
+	}
+	return nblocks;
+}
+
 static
 void
 dumpdir(u_int32_t ino)
 {
 	struct sfs_inode sfi;
-	u_int32_t ib[SFS_DBPERIDB];
 	int nentries, i;
 	u_int32_t block, nblocks=0;
 
@@ -90,14 +157,13 @@ dumpdir(u_int32_t ino)
 		}
 	}
 	if (SWAPL(sfi.sfi_indirect)) {
-		diskread(&ib, SWAPL(sfi.sfi_indirect));
-		for (i=0; i<SFS_DBPERIDB; i++) {
-			block = SWAPL(ib[i]);
-			if (block) {
-				dodirblock(block);
-				nblocks++;
-			}
-		}
+		nblocks += doindirect(SWAPL(sfi.sfi_indirect), 1);
+	}
+	if (SWAPL(sfi.sfi_dindirect)) {
+		nblocks += doindirect(SWAPL(sfi.sfi_dindirect), 2);
+	}
+	if (SWAPL(sfi.sfi_tindirect)) {
+		nblocks += doindirect(SWAPL(sfi.sfi_tindirect), 3);
 	}
 	printf("    %u blocks in directory\n", nblocks);
 }
@@ -4,11 +4,18 @@ mksfs.ho: \
  support.h \
  $(OSTREE)/hostinclude/kern/sfs.h \
  $(OSTREE)/hostinclude/hostcompat.h \
- disk.h
+ disk.h \
+ loadtree.h
 disk.ho: \
  disk.c \
  support.h \
  disk.h
 support.ho: \
  support.c
-
+loadtree.ho: \
+ loadtree.c \
+ support.h \
+ $(OSTREE)/hostinclude/kern/sfs.h \
+ $(OSTREE)/hostinclude/hostcompat.h \
+ disk.h \
+ loadtree.h
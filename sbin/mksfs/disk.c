@@ -107,6 +107,43 @@ diskwrite(const void *data, u_int32_t block)
 	}
 }
 
+/*
+ * Write COUNT consecutive blocks in one go.
+ */
+void
+diskwriteblocks(const void *data, u_int32_t block, u_int32_t count)
+{
+	const char *cdata = data;
+	size_t tot=0, want;
+	ssize_t len;
+
+	assert(fd>=0);
+
+#ifdef HOST
+	// skip over disk file header
+	block++;
+#endif
+
+	if (lseek(fd, ((off_t)block)*BLOCKSIZE, SEEK_SET)<0) {
+		err(1, "lseek");
+	}
+
+	want = ((size_t)count)*BLOCKSIZE;
+	while (tot < want) {
+		len = write(fd, cdata + tot, want - tot);
+		if (len < 0) {
+			if (errno==EINTR || errno==EAGAIN) {
+				continue;
+			}
+			err(1, "write");
+		}
+		if (len==0) {
+			err(1, "write returned 0?");
+		}
+		tot += len;
+	}
+}
+
 void
 diskread(void *data, u_int32_t block)
 {
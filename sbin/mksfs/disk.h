@@ -4,6 +4,7 @@ u_int32_t diskblocksize(void);
 u_int32_t diskblocks(void);
 
 void diskwrite(const void *data, u_int32_t block);
+void diskwriteblocks(const void *data, u_int32_t block, u_int32_t count);
 void diskread(void *data, u_int32_t block);
 
 void closedisk(void);
@@ -0,0 +1,421 @@
+/*
+ * Bulk loader for mksfs: copy a directory tree from the host into a
+ * freshly made sfs image.
+ *
+ * Everything is laid out sequentially starting at the first block
+ * after the journal. Each file gets its inode, then its indirect
+ * blocks, then its data, all contiguous, and each of those groups is
+ * written with as few large writes as possible. A directory's inode
+ * comes before its children; its entries and indirect blocks come
+ * after them, once the children's inode numbers are known.
+ *
+ * This only works in the host build, since it needs to read host
+ * directories.
+ */
+
+#include <sys/types.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <limits.h>
+#include <err.h>
+
+#include "support.h"
+#include "kern/sfs.h"
+
+#ifdef HOST
+
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <netinet/in.h> // for arpa/inet.h
+#include <arpa/inet.h>  // for ntohl
+#include "hostcompat.h"
+#define SWAPL(x) ntohl(x)
+#define SWAPS(x) ntohs(x)
+
+#endif
+
+#include "disk.h"
+#include "loadtree.h"
+
+#ifdef HOST
+
+/* Largest number of data blocks we write at once */
+#define MAXCHUNK 256
+
+#define DIVROUNDUP(a,b) (((a)+(b)-1)/(b))
+
+/* Next block to lay something out in, and the end of the disk */
+static u_int32_t nextblock;
+static u_int32_t fsblocks;
+
+/* Statistics */
+static u_int32_t nfiles, ndirs, nwrites;
+
+static
+u_int32_t
+allocblocks(u_int32_t n)
+{
+	u_int32_t block = nextblock;
+
+	if (n > fsblocks - nextblock) {
+		errx(1, "Not enough room in the image for the tree "
+		     "(%u blocks)", fsblocks);
+	}
+	nextblock += n;
+	return block;
+}
+
+static
+void
+writeblocks(const void *data, u_int32_t block, u_int32_t count)
+{
+	diskwriteblocks(data, block, count);
+	nwrites++;
+}
+
+/*
+ * Build the indirect block of the given level (1 = single, 2 = double,
+ * 3 = triple) that maps file blocks starting at *FILEBLOCK, for a file
+ * of NBLOCKS blocks whose data starts at disk block DATA. The indirect
+ * blocks themselves are numbered from *META onward and stored in
+ * METABUF (which is indexed relative to METABASE); with METABUF NULL
+ * this only counts them. Returns the block number of the indirect
+ * block.
+ */
+static
+u_int32_t
+buildindirect(int level, u_int32_t *fileblock, u_int32_t nblocks,
+	      u_int32_t data, u_int32_t *meta,
+	      char *metabuf, u_int32_t metabase)
+{
+	u_int32_t idblock = (*meta)++;
+	u_int32_t *ib = NULL;
+	u_int32_t j, entry;
+
+	if (metabuf != NULL) {
+		ib = (u_int32_t *)(metabuf + (idblock-metabase)*SFS_BLOCKSIZE);
+		bzero(ib, SFS_BLOCKSIZE);
+	}
+
+	for (j=0; j<SFS_DBPERIDB && *fileblock < nblocks; j++) {
+		if (level > 1) {
+			entry = buildindirect(level-1, fileblock, nblocks,
+					      data, meta, metabuf, metabase);
+		}
+		else {
+			entry = data + (*fileblock)++;
+		}
+		if (ib != NULL) {
+			ib[j] = SWAPL(entry);
+		}
+	}
+	return idblock;
+}
+
+/*
+ * Fill in the block pointers of SFI for a file of NBLOCKS blocks at
+ * disk block DATA, putting indirect blocks from META on. Returns the
+ * number of indirect blocks used. As with buildindirect, with METABUF
+ * NULL this only counts.
+ */
+static
+u_int32_t
+mapfile(struct sfs_inode *sfi, u_int32_t nblocks, u_int32_t data,
+	u_int32_t meta, char *metabuf, u_int32_t metabase)
+{
+	u_int32_t fileblock, start = meta;
+	u_int32_t *slots[3];
+	int level;
+
+	if (nblocks > SFS_NDIRECT + SFS_DBPERIDB + SFS_DBPERDIDB +
+	    SFS_DBPERTIDB) {
+		errx(1, "File too large for sfs (%u blocks)", nblocks);
+	}
+
+	for (fileblock=0; fileblock<nblocks && fileblock<SFS_NDIRECT;
+	     fileblock++) {
+		sfi->sfi_direct[fileblock] = SWAPL(data + fileblock);
+	}
+
+	slots[0] = &sfi->sfi_indirect;
+	slots[1] = &sfi->sfi_dindirect;
+	slots[2] = &sfi->sfi_tindirect;
+	for (level=1; level<=3 && fileblock<nblocks; level++) {
+		u_int32_t id = buildindirect(level, &fileblock, nblocks, data,
+					     &meta, metabuf, metabase);
+		*slots[level-1] = SWAPL(id);
+	}
+
+	return meta - start;
+}
+
+/*
+ * Write an inode at INO for a file of NBLOCKS blocks at DATA, with its
+ * indirect blocks starting at META. If META immediately follows INO
+ * the whole lot goes out in one write.
+ */
+static
+void
+writeinode(u_int32_t ino, int type, u_int32_t size, u_int32_t nblocks,
+	   u_int32_t data, u_int32_t meta)
+{
+	struct sfs_inode sfi;
+	u_int32_t nmeta;
+	char *metabuf;
+
+	bzero(&sfi, sizeof(sfi));
+	nmeta = mapfile(&sfi, nblocks, data, meta, NULL, 0);
+
+	/* Room for the inode, followed by the indirect blocks */
+	metabuf = malloc((nmeta+1)*SFS_BLOCKSIZE);
+	if (metabuf == NULL) {
+		err(1, "malloc");
+	}
+
+	mapfile(&sfi, nblocks, data, meta, metabuf+SFS_BLOCKSIZE, meta);
+	sfi.sfi_size = SWAPL(size);
+	sfi.sfi_type = SWAPS(type);
+	sfi.sfi_linkcount = SWAPS(1);
+	memcpy(metabuf, &sfi, sizeof(sfi));
+
+	if (meta == ino+1) {
+		writeblocks(metabuf, ino, nmeta+1);
+	}
+	else {
+		writeblocks(metabuf, ino, 1);
+		if (nmeta > 0) {
+			writeblocks(metabuf+SFS_BLOCKSIZE, meta, nmeta);
+		}
+	}
+	free(metabuf);
+}
+
+/*
+ * Copy one regular file. Returns its inode number.
+ */
+static
+u_int32_t
+loadfile(const char *path, off_t hostsize)
+{
+	static char buf[MAXCHUNK*SFS_BLOCKSIZE];
+	struct sfs_inode dummy;
+	u_int32_t ino, nblocks, nmeta, data, done;
+	int fd;
+
+	if (hostsize > 0x7fffffff) {
+		errx(1, "%s: File too large for sfs", path);
+	}
+	nblocks = DIVROUNDUP((u_int32_t)hostsize, SFS_BLOCKSIZE);
+
+	/* Inode, then indirect blocks, then the data */
+	bzero(&dummy, sizeof(dummy));
+	nmeta = mapfile(&dummy, nblocks, 0, 0, NULL, 0);
+	ino = allocblocks(1 + nmeta);
+	data = allocblocks(nblocks);
+
+	writeinode(ino, SFS_TYPE_FILE, hostsize, nblocks, data, ino+1);
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		err(1, "%s", path);
+	}
+
+	for (done=0; done<nblocks; ) {
+		u_int32_t chunk = nblocks - done;
+		size_t want, got = 0;
+		ssize_t len;
+
+		if (chunk > MAXCHUNK) {
+			chunk = MAXCHUNK;
+		}
+		want = chunk*SFS_BLOCKSIZE;
+
+		while (got < want) {
+			len = read(fd, buf+got, want-got);
+			if (len < 0 && (errno==EINTR || errno==EAGAIN)) {
+				continue;
+			}
+			if (len < 0) {
+				err(1, "%s: read", path);
+			}
+			if (len == 0) {
+				break;
+			}
+			got += len;
+		}
+		if (got < want) {
+			/* Zero the tail of the last block */
+			if (done + DIVROUNDUP(got, SFS_BLOCKSIZE) < nblocks) {
+				errx(1, "%s: File shrank while copying", path);
+			}
+			bzero(buf+got, want-got);
+		}
+
+		writeblocks(buf, data+done, chunk);
+		done += chunk;
+	}
+
+	close(fd);
+	nfiles++;
+	return ino;
+}
+
+static
+int
+namecmp(const void *a, const void *b)
+{
+	return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/*
+ * Copy a directory and everything under it. INO is the directory's
+ * inode, already allocated.
+ */
+static
+void
+loaddir(const char *path, u_int32_t ino)
+{
+	DIR *d;
+	struct dirent *de;
+	struct stat st;
+	char **names = NULL;
+	struct sfs_dir *entries;
+	struct sfs_inode dummy;
+	u_int32_t nnames = 0, maxnames = 0, i;
+	u_int32_t size, nblocks, nmeta, data, meta;
+	char child[PATH_MAX];
+
+	d = opendir(path);
+	if (d == NULL) {
+		err(1, "%s", path);
+	}
+	while ((de = readdir(d)) != NULL) {
+		if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, "..")) {
+			continue;
+		}
+		if (strlen(de->d_name) >= SFS_NAMELEN) {
+			errx(1, "%s/%s: Name too long for sfs", path,
+			     de->d_name);
+		}
+		if (nnames == maxnames) {
+			maxnames = maxnames ? maxnames*2 : 16;
+			names = realloc(names, maxnames*sizeof(char *));
+			if (names == NULL) {
+				err(1, "realloc");
+			}
+		}
+		names[nnames] = strdup(de->d_name);
+		if (names[nnames] == NULL) {
+			err(1, "strdup");
+		}
+		nnames++;
+	}
+	closedir(d);
+
+	/* Sorted, so the image doesn't depend on host directory order */
+	qsort(names, nnames, sizeof(char *), namecmp);
+
+	entries = calloc(nnames ? nnames : 1, sizeof(struct sfs_dir));
+	if (entries == NULL) {
+		err(1, "calloc");
+	}
+
+	for (i=0; i<nnames; i++) {
+		u_int32_t cino;
+
+		snprintf(child, sizeof(child), "%s/%s", path, names[i]);
+		if (stat(child, &st)) {
+			err(1, "%s", child);
+		}
+
+		if (S_ISREG(st.st_mode)) {
+			cino = loadfile(child, st.st_size);
+		}
+		else if (S_ISDIR(st.st_mode)) {
+			cino = allocblocks(1);
+			loaddir(child, cino);
+		}
+		else {
+			warnx("%s: Not a file or directory; skipped", child);
+			continue;
+		}
+
+		entries[i].sfd_ino = SWAPL(cino);
+		strcpy(entries[i].sfd_name, names[i]);
+	}
+
+	/* Squeeze out anything we skipped */
+	size = 0;
+	for (i=0; i<nnames; i++) {
+		if (entries[i].sfd_ino != SWAPL(SFS_NOINO)) {
+			entries[size++] = entries[i];
+		}
+		free(names[i]);
+	}
+	free(names);
+	size *= sizeof(struct sfs_dir);
+
+	/* The entries go after the children, then their indirect blocks */
+	nblocks = DIVROUNDUP(size, SFS_BLOCKSIZE);
+	bzero(&dummy, sizeof(dummy));
+	nmeta = mapfile(&dummy, nblocks, 0, 0, NULL, 0);
+	data = allocblocks(nblocks);
+	meta = allocblocks(nmeta);
+
+	if (nblocks > 0) {
+		char *buf = calloc(nblocks, SFS_BLOCKSIZE);
+		if (buf == NULL) {
+			err(1, "calloc");
+		}
+		memcpy(buf, entries, size);
+		writeblocks(buf, data, nblocks);
+		free(buf);
+	}
+	free(entries);
+
+	writeinode(ino, SFS_TYPE_DIR, size, nblocks, data, meta);
+	ndirs++;
+}
+
+u_int32_t
+loadtree(const char *hostdir, u_int32_t firstblock, u_int32_t nblocks)
+{
+	struct stat st;
+
+	if (stat(hostdir, &st)) {
+		err(1, "%s", hostdir);
+	}
+	if (!S_ISDIR(st.st_mode)) {
+		errx(1, "%s: Not a directory", hostdir);
+	}
+
+	nextblock = firstblock;
+	fsblocks = nblocks;
+
+	loaddir(hostdir, SFS_ROOT_LOCATION);
+
+	printf("mksfs: loaded %u files and %u directories from %s: "
+	       "%u blocks in %u writes\n", nfiles, ndirs, hostdir,
+	       nextblock - firstblock, nwrites);
+
+	return nextblock;
+}
+
+#else /* not HOST */
+
+u_int32_t
+loadtree(const char *hostdir, u_int32_t firstblock, u_int32_t nblocks)
+{
+	(void)firstblock;
+	(void)nblocks;
+	errx(1, "%s: Loading a directory tree needs the host build of mksfs",
+	     hostdir);
+	return 0;
+}
+
+#endif /* HOST */
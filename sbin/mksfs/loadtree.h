@@ -0,0 +1,7 @@
+/*
+ * Copy the host directory HOSTDIR into the image as the root
+ * directory, laying things out from block FIRSTBLOCK on without
+ * going past NBLOCKS. Returns the first block left unused.
+ */
+u_int32_t loadtree(const char *hostdir, u_int32_t firstblock,
+		   u_int32_t nblocks);
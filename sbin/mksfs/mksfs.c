@@ -24,6 +24,7 @@
 #endif
 
 #include "disk.h"
+#include "loadtree.h"
 
 #define MAXBITBLOCKS 32
 
@@ -34,12 +35,32 @@ check(void)
 	assert(sizeof(struct sfs_super)==SFS_BLOCKSIZE);
 	assert(sizeof(struct sfs_inode)==SFS_BLOCKSIZE);
 	assert(SFS_BLOCKSIZE % sizeof(struct sfs_dir) == 0);
+	assert(sizeof(struct sfs_jheader)==SFS_BLOCKSIZE);
+	assert(sizeof(struct sfs_jcommit)==SFS_BLOCKSIZE);
+}
+
+/*
+ * Decide where the journal goes: right after the freemap, unless the
+ * disk is so small it would take up more than an eighth of it, in
+ * which case there's no journal.
+ */
+static
+void
+journalplace(u_int32_t fsblocks, u_int32_t *jstart, u_int32_t *jblocks)
+{
+	*jstart = SFS_MAP_LOCATION + SFS_BITBLOCKS(fsblocks);
+	*jblocks = SFS_JDEFBLOCKS;
+	if (fsblocks < 8*SFS_JDEFBLOCKS) {
+		*jstart = 0;
+		*jblocks = 0;
+	}
 }
 
 static
 void
 writesuper(const char *volname, u_int32_t nblocks)
 {
+	u_int32_t jstart, jblocks;
 	struct sfs_super sp;
 
 	bzero((void *)&sp, sizeof(sp));
@@ -50,6 +71,10 @@ writesuper(const char *volname, u_int32_t nblocks)
 
 	sp.sp_magic = SWAPL(SFS_MAGIC);
 	sp.sp_nblocks = SWAPL(nblocks);
+	sp.sp_version = SWAPL(SFS_VERSION);
+	journalplace(nblocks, &jstart, &jblocks);
+	sp.sp_jstart = SWAPL(jstart);
+	sp.sp_jblocks = SWAPL(jblocks);
 	strcpy(sp.sp_volname, volname);
 
 	diskwrite(&sp, SFS_SB_LOCATION);
@@ -83,14 +108,35 @@ doallocbit(u_int32_t bit)
 	bitbuf[byte] |= mask;
 }
 
+/*
+ * First block not used by the superblock, root inode, freemap, or
+ * journal.
+ */
+static
+u_int32_t
+firstfree(u_int32_t fsblocks)
+{
+	u_int32_t jstart, jblocks;
+
+	journalplace(fsblocks, &jstart, &jblocks);
+	if (jblocks > 0) {
+		return jstart + jblocks;
+	}
+	return SFS_MAP_LOCATION + SFS_BITBLOCKS(fsblocks);
+}
+
+/*
+ * Write the freemap. Blocks from firstfree() up to (but not including)
+ * USEDTO have been filled by loadtree.
+ */
 static
 void
-writebitmap(u_int32_t fsblocks)
+writebitmap(u_int32_t fsblocks, u_int32_t usedto)
 {
 
 	u_int32_t nbits = SFS_BITMAPSIZE(fsblocks);
 	u_int32_t nblocks = SFS_BITBLOCKS(fsblocks);
-	char *ptr;
+	u_int32_t jstart, jblocks;
 	u_int32_t i;
 
 	if (nblocks > MAXBITBLOCKS) {
@@ -103,33 +149,58 @@ writebitmap(u_int32_t fsblocks)
 	for (i=0; i<nblocks; i++) {
 		doallocbit(SFS_MAP_LOCATION+i);
 	}
+	journalplace(fsblocks, &jstart, &jblocks);
+	for (i=0; i<jblocks; i++) {
+		doallocbit(jstart+i);
+	}
+	for (i=firstfree(fsblocks); i<usedto; i++) {
+		doallocbit(i);
+	}
 	for (i=fsblocks; i<nbits; i++) {
 		doallocbit(i);
 	}
 
-	for (i=0; i<nblocks; i++) {
-		ptr = bitbuf + i*SFS_BLOCKSIZE;
-		diskwrite(ptr, SFS_MAP_LOCATION+i);
+	diskwriteblocks(bitbuf, SFS_MAP_LOCATION, nblocks);
+}
+
+/*
+ * Zero the journal header, so mount doesn't find a stale transaction.
+ */
+static
+void
+writejournal(u_int32_t fsblocks)
+{
+	struct sfs_jheader jh;
+	u_int32_t jstart, jblocks;
+
+	journalplace(fsblocks, &jstart, &jblocks);
+	if (jblocks == 0) {
+		return;
 	}
+
+	bzero((void *)&jh, sizeof(jh));
+	diskwrite(&jh, jstart);
 }
 
 int
 main(int argc, char **argv)
 {
-	u_int32_t size, blocksize;
-	char *volname, *s;
+	u_int32_t size, blocksize, usedto;
+	char *volname, *hostdir, *s;
 
 #ifdef HOST
 	hostcompat_init(argc, argv);
 #endif
 
-	if (argc!=3) {
-		errx(1, "Usage: mksfs device/diskfile volume-name");
+	if (argc!=3 && argc!=4) {
+		errx(1, "Usage: mksfs device/diskfile volume-name "
+		     "[host-directory]");
 	}
 
 	check();
 
 	volname = argv[2];
+	hostdir = argc==4 ? argv[3] : NULL;
 
 	/* Remove one trailing colon from volname, if present */
 	s = strchr(volname, ':');
@@ -156,8 +227,15 @@ main(int argc, char **argv)
 	size = diskblocks();
 
 	writesuper(volname, size);
-	writerootdir();
-	writebitmap(size);
+	if (hostdir != NULL) {
+		usedto = loadtree(hostdir, firstfree(size), size);
+	}
+	else {
+		writerootdir();
+		usedto = firstfree(size);
+	}
+	writebitmap(size, usedto);
+	writejournal(size);
 
 	closedisk();
 
@@ -1,5 +1,8 @@
 /*
  * __time
+ *
+ * Calls the system call directly: libc's __time reads seconds from
+ * the time page, and would just crash on a bad pointer.
  */
 
 #include <sys/types.h>
@@ -20,7 +23,7 @@ time_badsecs(void *ptr, const char *desc)
 {
 	int rv;
 
-	rv = __time(ptr, NULL);
+	rv = __sys_time(ptr, NULL);
 	report_test(rv, errno, EFAULT, desc);
 }
 
@@ -30,7 +33,7 @@ time_badnsecs(void *ptr, const char *desc)
 {
 	int rv;
 
-	rv = __time(NULL, ptr);
+	rv = __sys_time(NULL, ptr);
 	report_test(rv, errno, EFAULT, desc);
 }
 
@@ -0,0 +1,69 @@
+/*
+ * bfault.c
+ *
+ * Benchmarks page faults: the cost of touching pages of new heap,
+ * each of which faults, against touching the same pages again once
+ * they're mapped. The difference is the cost of a fault.
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+
+#include "bench.h"
+
+#define PAGESIZE 4096
+
+static char *lastpages;
+static int lastcount;
+
+static
+void
+touch(volatile char *p, int npages)
+{
+	int i;
+
+	for (i=0; i<npages; i++) {
+		p[i * PAGESIZE] = i;
+	}
+}
+
+/* Each batch grows the heap by ITERS pages and touches them. */
+static
+int
+fault_touch(void *arg, int iters)
+{
+	char *p;
+
+	(void)arg;
+
+	p = sbrk(iters * PAGESIZE);
+	if (p == (void *)-1) {
+		return -1;
+	}
+	touch(p, iters);
+	lastpages = p;
+	lastcount = iters;
+	return 0;
+}
+
+/* Touches the pages of the last fault_touch batch again. */
+static
+int
+resident_touch(void *arg, int iters)
+{
+	(void)arg;
+	touch(lastpages, iters < lastcount ? iters : lastcount);
+	return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+	bench_args(argc, argv);
+
+	if (bench_run("fault_touch", 64, 0, fault_touch, NULL) < 0) {
+		return 1;
+	}
+	bench_run("resident_touch", 64, 0, resident_touch, NULL);
+	return 0;
+}
@@ -0,0 +1,215 @@
+/*
+ * bfile.c
+ *
+ * Benchmarks file I/O in the current directory: writing (create or
+ * truncate, write, close) and reading whole files of several sizes,
+ * the full create/write/close/remove cycle, and 512-byte reads of a
+ * 128K file in order versus at random offsets.
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include "bench.h"
+
+#define FILENAME  "bfile.tmp"
+#define CHUNK     4096		/* I/O size for whole-file benchmarks */
+#define BLOCK     512		/* I/O size for seq/random reads */
+#define NBLOCKS   256		/* file size for seq/random reads */
+
+static char buf[CHUNK];
+static int randfd;
+
+/* Create or truncate FILENAME and write SIZE bytes to it. */
+static
+int
+writefile(int size)
+{
+	int fd, done, amt, n;
+
+	fd = open(FILENAME, O_WRONLY|O_CREAT|O_TRUNC);
+	if (fd < 0) {
+		return -1;
+	}
+	for (done=0; done<size; done += n) {
+		amt = size - done < CHUNK ? size - done : CHUNK;
+		n = write(fd, buf, amt);
+		if (n <= 0) {
+			if (n == 0) {
+				errno = EIO;
+			}
+			close(fd);
+			return -1;
+		}
+	}
+	return close(fd);
+}
+
+/* Read FILENAME through to the end. */
+static
+int
+readfile(void)
+{
+	int fd, n;
+
+	fd = open(FILENAME, O_RDONLY);
+	if (fd < 0) {
+		return -1;
+	}
+	do {
+		n = read(fd, buf, CHUNK);
+	} while (n > 0);
+	if (n < 0) {
+		close(fd);
+		return -1;
+	}
+	return close(fd);
+}
+
+static
+int
+file_write(void *arg, int iters)
+{
+	int size = *(int *)arg;
+	int i;
+
+	for (i=0; i<iters; i++) {
+		if (writefile(size) < 0) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static
+int
+file_read(void *arg, int iters)
+{
+	int i;
+
+	(void)arg;
+	for (i=0; i<iters; i++) {
+		if (readfile() < 0) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static
+int
+file_cycle(void *arg, int iters)
+{
+	int size = *(int *)arg;
+	int i;
+
+	for (i=0; i<iters; i++) {
+		if (writefile(size) < 0) {
+			return -1;
+		}
+		if (remove(FILENAME) < 0) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Read ITERS blocks in order, starting over from the beginning (by
+ * reopening, which needs no lseek) at end of file.
+ */
+static
+int
+seq_read(void *arg, int iters)
+{
+	int fd, i, n;
+
+	(void)arg;
+
+	fd = open(FILENAME, O_RDONLY);
+	if (fd < 0) {
+		return -1;
+	}
+	for (i=0; i<iters; i++) {
+		n = read(fd, buf, BLOCK);
+		if (n == 0) {
+			close(fd);
+			fd = open(FILENAME, O_RDONLY);
+			if (fd < 0) {
+				return -1;
+			}
+			n = read(fd, buf, BLOCK);
+		}
+		if (n < 0) {
+			close(fd);
+			return -1;
+		}
+	}
+	return close(fd);
+}
+
+static
+int
+rand_read(void *arg, int iters)
+{
+	int i;
+	off_t pos;
+
+	(void)arg;
+	for (i=0; i<iters; i++) {
+		pos = (random() % NBLOCKS) * BLOCK;
+		if (lseek(randfd, pos, SEEK_SET) < 0) {
+			return -1;
+		}
+		if (read(randfd, buf, BLOCK) < 0) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static const int sizes[] = { 512, 4096, 16384, 65536 };
+#define NSIZES (sizeof(sizes)/sizeof(sizes[0]))
+
+int
+main(int argc, char *argv[])
+{
+	char name[32];
+	unsigned i;
+
+	bench_args(argc, argv);
+
+	for (i=0; i<NSIZES; i++) {
+		snprintf(name, sizeof(name), "file_write_%d", sizes[i]);
+		if (bench_run(name, 20, sizes[i], file_write,
+			      (void *)&sizes[i]) < 0) {
+			continue;
+		}
+		snprintf(name, sizeof(name), "file_read_%d", sizes[i]);
+		bench_run(name, 20, sizes[i], file_read, NULL);
+		snprintf(name, sizeof(name), "file_create_remove_%d", sizes[i]);
+		bench_run(name, 10, sizes[i], file_cycle, (void *)&sizes[i]);
+	}
+
+	if (writefile(NBLOCKS * BLOCK) < 0) {
+		bench_fail("seq_read");
+		bench_fail("rand_read");
+		return 1;
+	}
+	bench_run("seq_read", NBLOCKS, BLOCK, seq_read, NULL);
+
+	srandom(1);
+	randfd = open(FILENAME, O_RDONLY);
+	if (randfd < 0) {
+		bench_fail("rand_read");
+	}
+	else {
+		bench_run("rand_read", NBLOCKS, BLOCK, rand_read, NULL);
+		close(randfd);
+	}
+
+	remove(FILENAME);
+	return 0;
+}
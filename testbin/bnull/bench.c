@@ -0,0 +1,146 @@
+/*
+ * bench.c
+ *
+ * Timing and reporting for the benchmark programs; see bench.h.
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <err.h>
+
+#include "bench.h"
+
+#define DEFSAMPLES  5
+#define MAXSAMPLES  101
+
+static int nsamples = DEFSAMPLES;
+static int forceiters;
+
+void
+bench_args(int argc, char *argv[])
+{
+	int i;
+
+	for (i=1; i<argc; i++) {
+		if (!strcmp(argv[i], "-s") && i+1 < argc) {
+			nsamples = atoi(argv[++i]);
+			if (nsamples < 1 || nsamples > MAXSAMPLES) {
+				errx(1, "samples must be 1 to %d", MAXSAMPLES);
+			}
+		}
+		else if (!strcmp(argv[i], "-n") && i+1 < argc) {
+			forceiters = atoi(argv[++i]);
+			if (forceiters < 1) {
+				errx(1, "iters must be positive");
+			}
+		}
+		else {
+			errx(1, "usage: %s [-s samples] [-n iters]", argv[0]);
+		}
+	}
+}
+
+/*
+ * A*B/C, shifting A and C down as needed to stay within 32 bits.
+ * There's no 64-bit division in libc.
+ */
+static
+unsigned long
+muldiv(unsigned long a, unsigned long b, unsigned long c)
+{
+	while (b != 0 && a > 0xffffffffUL / b) {
+		a >>= 1;
+		c >>= 1;
+	}
+	if (c == 0) {
+		return 0xffffffffUL;
+	}
+	return a * b / c;
+}
+
+/*
+ * Nanoseconds per operation, for ITERS operations taking SECS and
+ * NSECS. Exact below four seconds, which is all 32 bits hold;
+ * otherwise to the microsecond.
+ */
+static
+unsigned long
+perop(time_t secs, unsigned long nsecs, int iters)
+{
+	if (secs < 4) {
+		return (secs * 1000000000UL + nsecs) / iters;
+	}
+	return muldiv(secs * 1000000UL + nsecs / 1000, 1000, iters);
+}
+
+static
+void
+sort(unsigned long *v, int n)
+{
+	unsigned long t;
+	int i, j;
+
+	for (i=1; i<n; i++) {
+		t = v[i];
+		for (j=i; j>0 && v[j-1] > t; j--) {
+			v[j] = v[j-1];
+		}
+		v[j] = t;
+	}
+}
+
+void
+bench_fail(const char *name)
+{
+	printf("bench: name=%s error=%s\n", name, strerror(errno));
+}
+
+int
+bench_run(const char *name, int iters, unsigned long bytes,
+	  bench_func func, void *arg)
+{
+	unsigned long samples[MAXSAMPLES];
+	time_t secs1, secs2;
+	unsigned long nsecs1, nsecs2;
+	int i;
+
+	if (forceiters > 0) {
+		iters = forceiters;
+	}
+
+	if (func(arg, iters) < 0) {
+		bench_fail(name);
+		return -1;
+	}
+
+	for (i=0; i<nsamples; i++) {
+		__time(&secs1, &nsecs1);
+		if (func(arg, iters) < 0) {
+			bench_fail(name);
+			return -1;
+		}
+		__time(&secs2, &nsecs2);
+
+		if (nsecs2 < nsecs1) {
+			nsecs2 += 1000000000;
+			secs2--;
+		}
+		samples[i] = perop(secs2 - secs1, nsecs2 - nsecs1, iters);
+	}
+
+	sort(samples, nsamples);
+	printf("bench: name=%s iters=%d samples=%d "
+	       "min_ns=%lu med_ns=%lu max_ns=%lu",
+	       name, iters, nsamples,
+	       samples[0], samples[nsamples/2], samples[nsamples-1]);
+	if (bytes > 0) {
+		/* bytes per ns, times 10^9 / 1024 */
+		printf(" kb_per_s=%lu",
+		       muldiv(bytes, 976562, samples[nsamples/2]));
+	}
+	printf("\n");
+	return 0;
+}
@@ -0,0 +1,32 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+/*
+ * Common code for the benchmark programs: bnull, bproc, bfile, bpipe,
+ * bfault and buthread.
+ *
+ * bench_run runs FUNC once untimed to warm up, then times a number of
+ * batches of ITERS operations each with __time, and prints one line
+ *
+ *    bench: name=NAME iters=N samples=S min_ns=A med_ns=B max_ns=C
+ *
+ * giving nanoseconds per operation over the samples. If BYTES (per
+ * operation) is nonzero, the line also has kb_per_s, from the median.
+ * If FUNC fails, or a benchmark can't be set up (bench_fail), the
+ * line is instead
+ *
+ *    bench: name=NAME error=MESSAGE
+ *
+ * Every program takes "-s samples" (default 5) and "-n iters", which
+ * overrides the iteration count of all its benchmarks.
+ */
+
+/* Do ITERS operations; return 0, or -1 with errno set. */
+typedef int (*bench_func)(void *arg, int iters);
+
+void bench_args(int argc, char *argv[]);
+int bench_run(const char *name, int iters, unsigned long bytes,
+	      bench_func func, void *arg);
+void bench_fail(const char *name);
+
+#endif /* BENCH_H */
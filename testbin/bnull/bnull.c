@@ -0,0 +1,86 @@
+/*
+ * bnull.c
+ *
+ * Benchmarks system call overhead: a call the kernel rejects at once
+ * (read into a null buffer), getpid, and __time; and, for comparison,
+ * __time for seconds only, which reads the time page without a trap.
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+
+#include "bench.h"
+
+static
+int
+null_syscall(void *arg, int iters)
+{
+	int i;
+
+	(void)arg;
+	for (i=0; i<iters; i++) {
+		/* fails with EFAULT without doing anything */
+		read(-1, NULL, 0);
+	}
+	return 0;
+}
+
+static
+int
+getpid_syscall(void *arg, int iters)
+{
+	int i;
+
+	(void)arg;
+	for (i=0; i<iters; i++) {
+		if (getpid() < 0) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static
+int
+time_syscall(void *arg, int iters)
+{
+	time_t secs;
+	unsigned long nsecs;
+	int i;
+
+	(void)arg;
+	for (i=0; i<iters; i++) {
+		if (__time(&secs, &nsecs) == (time_t)-1) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static
+int
+time_page(void *arg, int iters)
+{
+	time_t secs;
+	int i;
+
+	(void)arg;
+	for (i=0; i<iters; i++) {
+		if (__time(&secs, NULL) == (time_t)-1) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+	bench_args(argc, argv);
+
+	bench_run("null_syscall", 10000, 0, null_syscall, NULL);
+	bench_run("getpid", 10000, 0, getpid_syscall, NULL);
+	bench_run("time", 10000, 0, time_syscall, NULL);
+	bench_run("time_page", 10000, 0, time_page, NULL);
+	return 0;
+}
@@ -0,0 +1,113 @@
+/*
+ * bpipe.c
+ *
+ * Benchmarks pipe throughput at several write sizes: within one
+ * process (write a chunk, read it back), and from a parent to a
+ * forked child that reads until end of file.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <stdio.h>
+
+#include "bench.h"
+
+/* Loopback chunks must fit in the pipe's buffer, or we'd block */
+#define MAXCHUNK 4096
+
+static char buf[MAXCHUNK];
+static int fds[2];
+
+static
+int
+pipe_loop(void *arg, int iters)
+{
+	int size = *(int *)arg;
+	int i;
+
+	for (i=0; i<iters; i++) {
+		if (write(fds[1], buf, size) != size) {
+			return -1;
+		}
+		if (read(fds[0], buf, size) != size) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static
+int
+pipe_write(void *arg, int iters)
+{
+	int size = *(int *)arg;
+	int i;
+
+	for (i=0; i<iters; i++) {
+		if (write(fds[1], buf, size) != size) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/* The child for pipe_xproc: read until EOF, then exit. */
+static
+void
+drain(void)
+{
+	close(fds[1]);
+	while (read(fds[0], buf, MAXCHUNK) > 0) {
+		/* nothing */
+	}
+	_exit(0);
+}
+
+static const int sizes[] = { 64, 512, 4096 };
+#define NSIZES (sizeof(sizes)/sizeof(sizes[0]))
+
+int
+main(int argc, char *argv[])
+{
+	char name[32];
+	pid_t pid;
+	unsigned i;
+	int status;
+
+	bench_args(argc, argv);
+
+	for (i=0; i<NSIZES; i++) {
+		snprintf(name, sizeof(name), "pipe_loop_%d", sizes[i]);
+		if (pipe(fds) < 0) {
+			bench_fail(name);
+			continue;
+		}
+		bench_run(name, 1000, sizes[i], pipe_loop, (void *)&sizes[i]);
+		close(fds[0]);
+		close(fds[1]);
+	}
+
+	for (i=0; i<NSIZES; i++) {
+		snprintf(name, sizeof(name), "pipe_xproc_%d", sizes[i]);
+		if (pipe(fds) < 0) {
+			bench_fail(name);
+			continue;
+		}
+		pid = fork();
+		if (pid < 0) {
+			bench_fail(name);
+			close(fds[0]);
+			close(fds[1]);
+			continue;
+		}
+		if (pid == 0) {
+			drain();
+		}
+		close(fds[0]);
+		bench_run(name, 1000, sizes[i], pipe_write, (void *)&sizes[i]);
+		close(fds[1]);
+		waitpid(pid, &status, 0);
+	}
+	return 0;
+}
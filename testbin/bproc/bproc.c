@@ -0,0 +1,77 @@
+/*
+ * bproc.c
+ *
+ * Benchmarks process creation: fork of a child that exits at once,
+ * and fork of a child that execs /bin/true, each reaped by waitpid.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <stdio.h>
+
+#include "bench.h"
+
+#define PROG "/bin/true"
+
+static
+int
+fork_exit(void *arg, int iters)
+{
+	pid_t pid;
+	int i, status;
+
+	(void)arg;
+	for (i=0; i<iters; i++) {
+		pid = fork();
+		if (pid < 0) {
+			return -1;
+		}
+		if (pid == 0) {
+			_exit(0);
+		}
+		if (waitpid(pid, &status, 0) < 0) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static
+int
+fork_execv(void *arg, int iters)
+{
+	char *args[2];
+	pid_t pid;
+	int i, status;
+
+	(void)arg;
+
+	args[0] = (char *)PROG;
+	args[1] = NULL;
+
+	for (i=0; i<iters; i++) {
+		pid = fork();
+		if (pid < 0) {
+			return -1;
+		}
+		if (pid == 0) {
+			execv(PROG, args);
+			_exit(1);
+		}
+		if (waitpid(pid, &status, 0) < 0) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+	bench_args(argc, argv);
+
+	bench_run("fork_exit", 20, 0, fork_exit, NULL);
+	bench_run("fork_execv_waitpid", 10, 0, fork_execv, NULL);
+	return 0;
+}
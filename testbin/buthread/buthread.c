@@ -0,0 +1,190 @@
+/*
+ * buthread.c
+ *
+ * Benchmarks the user-level thread library against processes: a
+ * yield between two threads (two switches per iteration), creating
+ * and joining a thread, an uncontended mutex, and a condition variable
+ * ping-pong between two threads; then fork of a child that exits at
+ * once, as in bproc, for comparison.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <errno.h>
+#include <uthread.h>
+
+#include "bench.h"
+
+/* Stack for threads that don't call much */
+#define SMALLSTACK  4096
+
+static volatile int stop;
+
+static
+void
+spinner(void *arg)
+{
+	(void)arg;
+	while (!stop) {
+		uthread_yield();
+	}
+}
+
+static
+int
+yield_pingpong(void *arg, int iters)
+{
+	struct uthread *t;
+	int i;
+
+	(void)arg;
+
+	stop = 0;
+	if (uthread_create(&t, SMALLSTACK, spinner, NULL)) {
+		return -1;
+	}
+	for (i=0; i<iters; i++) {
+		uthread_yield();
+	}
+	stop = 1;
+	return uthread_join(t);
+}
+
+static
+void
+nothing(void *arg)
+{
+	(void)arg;
+}
+
+static
+int
+create_join(void *arg, int iters)
+{
+	struct uthread *t;
+	int i;
+
+	(void)arg;
+	for (i=0; i<iters; i++) {
+		if (uthread_create(&t, SMALLSTACK, nothing, NULL)) {
+			return -1;
+		}
+		if (uthread_join(t)) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static
+int
+mutex_uncontended(void *arg, int iters)
+{
+	struct umutex *m = arg;
+	int i;
+
+	for (i=0; i<iters; i++) {
+		umutex_lock(m);
+		umutex_unlock(m);
+	}
+	return 0;
+}
+
+/*
+ * The condvar ping-pong passes a turn back and forth: each side waits
+ * until it's its turn, then hands the turn over and signals.
+ */
+struct pingpong {
+	struct umutex pp_lock;
+	struct ucond pp_cv;
+	int pp_turn;
+	int pp_iters;
+};
+
+static
+void
+ponger(void *arg)
+{
+	struct pingpong *pp = arg;
+	int i;
+
+	umutex_lock(&pp->pp_lock);
+	for (i=0; i<pp->pp_iters; i++) {
+		while (pp->pp_turn != 1) {
+			ucond_wait(&pp->pp_cv, &pp->pp_lock);
+		}
+		pp->pp_turn = 0;
+		ucond_signal(&pp->pp_cv);
+	}
+	umutex_unlock(&pp->pp_lock);
+}
+
+static
+int
+cond_pingpong(void *arg, int iters)
+{
+	struct pingpong *pp = arg;
+	struct uthread *t;
+	int i;
+
+	pp->pp_turn = 0;
+	pp->pp_iters = iters;
+	if (uthread_create(&t, SMALLSTACK, ponger, pp)) {
+		return -1;
+	}
+
+	umutex_lock(&pp->pp_lock);
+	for (i=0; i<iters; i++) {
+		pp->pp_turn = 1;
+		ucond_signal(&pp->pp_cv);
+		while (pp->pp_turn != 0) {
+			ucond_wait(&pp->pp_cv, &pp->pp_lock);
+		}
+	}
+	umutex_unlock(&pp->pp_lock);
+
+	return uthread_join(t);
+}
+
+static
+int
+fork_exit(void *arg, int iters)
+{
+	pid_t pid;
+	int i, status;
+
+	(void)arg;
+	for (i=0; i<iters; i++) {
+		pid = fork();
+		if (pid < 0) {
+			return -1;
+		}
+		if (pid == 0) {
+			_exit(0);
+		}
+		if (waitpid(pid, &status, 0) < 0) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+	static struct umutex m = UMUTEX_INITIALIZER;
+	static struct pingpong pp = {
+		UMUTEX_INITIALIZER, UCOND_INITIALIZER, 0, 0
+	};
+
+	bench_args(argc, argv);
+
+	bench_run("uthread_yield_pingpong", 10000, 0, yield_pingpong, NULL);
+	bench_run("uthread_create_join", 2000, 0, create_join, NULL);
+	bench_run("umutex_lock_unlock", 10000, 0, mutex_uncontended, &m);
+	bench_run("ucond_pingpong", 5000, 0, cond_pingpong, &pp);
+	bench_run("fork_exit", 20, 0, fork_exit, NULL);
+	return 0;
+}
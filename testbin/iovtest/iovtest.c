@@ -0,0 +1,84 @@
+/*
+ * iovtest.c
+ *
+ * Tests readv and writev: gathers a header and a body into one write,
+ * then scatters them back into separate buffers with one read.
+ */
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <err.h>
+
+#define FILENAME "iovtest.dat"
+
+int
+main(void)
+{
+	static char body[5000], rbody[5000];
+	static char hdr[] = "iovtest: ";
+	static char msg[] = "passed\n";
+	char head[16], rhead[16];
+	struct iovec iov[3];
+	int fd, i, n;
+
+	strcpy(head, "iovtest header");
+	for (i=0; i<(int)sizeof(body); i++) {
+		body[i] = 'A' + i % 23;
+	}
+
+	/* The empty middle buffer should just be skipped */
+	iov[0].iov_base = head;
+	iov[0].iov_len = sizeof(head);
+	iov[1].iov_base = NULL;
+	iov[1].iov_len = 0;
+	iov[2].iov_base = body;
+	iov[2].iov_len = sizeof(body);
+
+	fd = open(FILENAME, O_WRONLY|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s: open for write", FILENAME);
+	}
+	n = writev(fd, iov, 3);
+	if (n < 0) {
+		err(1, "writev");
+	}
+	if (n != sizeof(head) + sizeof(body)) {
+		errx(1, "writev: wrote %d bytes", n);
+	}
+	close(fd);
+
+	iov[0].iov_base = rhead;
+	iov[2].iov_base = rbody;
+
+	fd = open(FILENAME, O_RDONLY);
+	if (fd < 0) {
+		err(1, "%s: open for read", FILENAME);
+	}
+	n = readv(fd, iov, 3);
+	if (n < 0) {
+		err(1, "readv");
+	}
+	if (n != sizeof(head) + sizeof(body)) {
+		errx(1, "readv: read %d bytes", n);
+	}
+	close(fd);
+
+	if (memcmp(head, rhead, sizeof(head)) ||
+	    memcmp(body, rbody, sizeof(body))) {
+		errx(1, "data read back doesn't match");
+	}
+
+	/* And a gathered write to the console */
+	iov[0].iov_base = hdr;
+	iov[0].iov_len = 9;
+	iov[1].iov_base = msg;
+	iov[1].iov_len = 7;
+	if (writev(STDOUT_FILENO, iov, 2) != 16) {
+		err(1, "writev to console");
+	}
+
+	return 0;
+}
@@ -0,0 +1,285 @@
+/*
+ * hostshim.c
+ *
+ * The parts of the kernel that the kernel library code expects to be
+ * there, done with the host's C library and pthreads: kprintf, panic,
+ * spl, the page allocator under kmalloc, semaphores, thread_fork and
+ * the clock.
+ *
+ * This file is compiled against the host's headers only; everything
+ * else in klibtest is compiled against the kernel's. Types that
+ * differ between the two (time_t) are passed as fixed-size integers.
+ */
+
+#include <sys/types.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "hostcompat.h"
+
+#define PAGE_SIZE 4096
+
+int klibtest_main(int argc, char *argv[]);
+
+/* Referenced by the kernel's DEBUG() */
+uint32_t dbflags = 0;
+
+////////////////////////////////////////////////////////////
+// console
+
+int
+kprintf(const char *fmt, ...)
+{
+	va_list ap;
+	int chars;
+
+	va_start(ap, fmt);
+	chars = vprintf(fmt, ap);
+	va_end(ap);
+	return chars;
+}
+
+void
+panic(const char *fmt, ...)
+{
+	va_list ap;
+
+	fflush(stdout);
+	fprintf(stderr, "panic: ");
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	abort();
+}
+
+////////////////////////////////////////////////////////////
+// spl
+
+int curspl;
+int in_interrupt;
+
+static pthread_mutex_t spl_mutex;
+
+static
+void
+spl_init(void)
+{
+	pthread_mutexattr_t attr;
+
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&spl_mutex, &attr);
+	pthread_mutexattr_destroy(&attr);
+}
+
+int
+splhigh(void)
+{
+	int old;
+
+	pthread_mutex_lock(&spl_mutex);
+	old = curspl;
+	curspl = 15;
+	return old;
+}
+
+int
+splx(int spl)
+{
+	int old = curspl;
+
+	curspl = spl;
+	pthread_mutex_unlock(&spl_mutex);
+	return old;
+}
+
+////////////////////////////////////////////////////////////
+// kernel pages
+
+/*
+ * Each allocation gets an extra page in front, holding its size, so
+ * free_kpages knows how many pages to give back.
+ */
+static pthread_mutex_t kpages_mutex = PTHREAD_MUTEX_INITIALIZER;
+static unsigned long kpages_inuse;
+
+uintptr_t
+alloc_kpages(int npages)
+{
+	char *p;
+
+	p = aligned_alloc(PAGE_SIZE, (size_t)(npages + 1) * PAGE_SIZE);
+	if (p == NULL) {
+		return 0;
+	}
+	*(int *)p = npages;
+
+	pthread_mutex_lock(&kpages_mutex);
+	kpages_inuse += npages;
+	pthread_mutex_unlock(&kpages_mutex);
+
+	return (uintptr_t)(p + PAGE_SIZE);
+}
+
+void
+free_kpages(uintptr_t addr)
+{
+	char *p = (char *)addr - PAGE_SIZE;
+
+	pthread_mutex_lock(&kpages_mutex);
+	kpages_inuse -= *(int *)p;
+	pthread_mutex_unlock(&kpages_mutex);
+
+	free(p);
+}
+
+/* Pages handed out by alloc_kpages and not yet freed. */
+unsigned long
+hostshim_kpages(void)
+{
+	unsigned long n;
+
+	pthread_mutex_lock(&kpages_mutex);
+	n = kpages_inuse;
+	pthread_mutex_unlock(&kpages_mutex);
+	return n;
+}
+
+////////////////////////////////////////////////////////////
+// semaphores and threads
+
+struct semaphore {
+	pthread_mutex_t sem_mutex;
+	pthread_cond_t sem_cond;
+	int sem_count;
+};
+
+struct semaphore *
+sem_create(const char *name, int initial_count)
+{
+	struct semaphore *sem;
+
+	(void)name;
+
+	sem = malloc(sizeof(struct semaphore));
+	if (sem == NULL) {
+		return NULL;
+	}
+	pthread_mutex_init(&sem->sem_mutex, NULL);
+	pthread_cond_init(&sem->sem_cond, NULL);
+	sem->sem_count = initial_count;
+	return sem;
+}
+
+void
+P(struct semaphore *sem)
+{
+	pthread_mutex_lock(&sem->sem_mutex);
+	while (sem->sem_count == 0) {
+		pthread_cond_wait(&sem->sem_cond, &sem->sem_mutex);
+	}
+	sem->sem_count--;
+	pthread_mutex_unlock(&sem->sem_mutex);
+}
+
+void
+V(struct semaphore *sem)
+{
+	pthread_mutex_lock(&sem->sem_mutex);
+	sem->sem_count++;
+	pthread_cond_signal(&sem->sem_cond);
+	pthread_mutex_unlock(&sem->sem_mutex);
+}
+
+void
+sem_destroy(struct semaphore *sem)
+{
+	pthread_cond_destroy(&sem->sem_cond);
+	pthread_mutex_destroy(&sem->sem_mutex);
+	free(sem);
+}
+
+struct forkargs {
+	void (*fa_func)(void *, unsigned long);
+	void *fa_data1;
+	unsigned long fa_data2;
+};
+
+static
+void *
+thread_start(void *vfa)
+{
+	struct forkargs fa = *(struct forkargs *)vfa;
+
+	free(vfa);
+	fa.fa_func(fa.fa_data1, fa.fa_data2);
+	return NULL;
+}
+
+int
+thread_fork(const char *name, void *data1, unsigned long data2,
+	    void (*func)(void *, unsigned long), void *ret)
+{
+	struct forkargs *fa;
+	pthread_t t;
+
+	(void)name;
+
+	if (ret != NULL) {
+		panic("thread_fork: joinable threads aren't supported here\n");
+	}
+
+	fa = malloc(sizeof(struct forkargs));
+	if (fa == NULL) {
+		panic("thread_fork: out of memory\n");
+	}
+	fa->fa_func = func;
+	fa->fa_data1 = data1;
+	fa->fa_data2 = data2;
+
+	if (pthread_create(&t, NULL, thread_start, fa)) {
+		panic("thread_fork: pthread_create failed\n");
+	}
+	pthread_detach(t);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// clock
+
+void
+gettime(int32_t *secs, uint32_t *nsecs)
+{
+	time_t s;
+	unsigned long ns;
+
+	__time(&s, &ns);
+	*secs = s;
+	*nsecs = ns;
+}
+
+void
+getinterval(int32_t secs1, uint32_t nsecs1, int32_t secs2, uint32_t nsecs2,
+	    int32_t *rsecs, uint32_t *rnsecs)
+{
+	if (nsecs2 < nsecs1) {
+		nsecs2 += 1000000000;
+		secs2--;
+	}
+	*rsecs = secs2 - secs1;
+	*rnsecs = nsecs2 - nsecs1;
+}
+
+////////////////////////////////////////////////////////////
+
+int
+main(int argc, char *argv[])
+{
+	hostcompat_init(argc, argv);
+	spl_init();
+	return klibtest_main(argc, argv);
+}
@@ -0,0 +1,609 @@
+/*
+ * klibtest.c
+ *
+ * Runs the kernel's library code - array, queue, bitmap and the
+ * kmalloc heap - natively on the host, so it can be tested and timed
+ * without booting System/161. The kernel's own sources are compiled
+ * unchanged against the kernel headers, with a few host versions of
+ * machine headers from this directory; hostshim.c supplies what they
+ * call in the rest of the kernel.
+ *
+ * Usage: host-klibtest [-s seed] [-n ops] [tests] [stress] [bench]
+ *
+ *    tests   the kernel's menu tests: at, qt, bt, km1 and km2
+ *    stress  randomized operations checked against a simple model,
+ *            -n ops of each (default 200000), from seed -s
+ *    bench   throughput, reported in the same format as the kernel's
+ *            kb command (min/median/max nanoseconds per operation)
+ *
+ * With no arguments, does all three. Any failure panics, which
+ * aborts with a nonzero exit status.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <array.h>
+#include <queue.h>
+#include <bitmap.h>
+#include <clock.h>
+#include <test.h>
+
+/* In hostshim.c */
+int klibtest_main(int argc, char *argv[]);
+unsigned long hostshim_kpages(void);
+
+#define DEFOPS        200000
+#define MODELSIZE     1024	/* most elements in an array/queue model */
+#define KHEAPSLOTS    128	/* live allocations in the kheap stress */
+#define BENCH_SAMPLES 11
+
+static u_int32_t seed = 1;
+static unsigned long nops = DEFOPS;
+
+static
+u_int32_t
+rnd(void)
+{
+	seed = seed * 1103515245 + 12345;
+	return seed >> 8;
+}
+
+/* Pointer values for the containers to hold */
+#define TOKEN(n) ((void *)(uintptr_t)((n) * 8 + 8))
+
+static
+void
+checkleaks(const char *name, unsigned long before)
+{
+	unsigned long after = hostshim_kpages();
+
+	if (after != before) {
+		panic("%s: %ld kernel pages not freed\n", name,
+		      (long)(after - before));
+	}
+}
+
+////////////////////////////////////////////////////////////
+// menu tests
+
+static struct {
+	const char *name;
+	int (*func)(int, char **);
+} tests[] = {
+	{ "at",  arraytest },
+	{ "qt",  queuetest },
+	{ "bt",  bitmaptest },
+	{ "km1", malloctest },
+	{ "km2", mallocstress },
+	{ NULL, NULL },
+};
+
+static
+void
+runtests(void)
+{
+	char *args[2];
+	unsigned long pages;
+	int i;
+
+	for (i=0; tests[i].name != NULL; i++) {
+		args[0] = (char *)tests[i].name;
+		args[1] = NULL;
+		pages = hostshim_kpages();
+		if (tests[i].func(1, args)) {
+			panic("%s failed\n", tests[i].name);
+		}
+		checkleaks(tests[i].name, pages);
+	}
+}
+
+////////////////////////////////////////////////////////////
+// stress tests
+
+static
+void
+stress_array(void)
+{
+	static void *model[MODELSIZE];
+	struct array *a;
+	unsigned long op, pages;
+	int n = 0, i, ix, newn;
+
+	pages = hostshim_kpages();
+	a = array_create();
+	if (a == NULL) {
+		panic("array stress: array_create failed\n");
+	}
+
+	for (op=0; op<nops; op++) {
+		switch (rnd() % 6) {
+		    case 0:
+		    case 1:
+			if (n < MODELSIZE) {
+				if (array_add(a, TOKEN(op))) {
+					panic("array stress: array_add failed\n");
+				}
+				model[n++] = TOKEN(op);
+			}
+			break;
+		    case 2:
+			if (n > 0) {
+				ix = rnd() % n;
+				array_remove(a, ix);
+				for (i=ix; i<n-1; i++) {
+					model[i] = model[i+1];
+				}
+				n--;
+			}
+			break;
+		    case 3:
+			if (n > 0) {
+				ix = rnd() % n;
+				array_setguy(a, ix, TOKEN(op));
+				model[ix] = TOKEN(op);
+			}
+			break;
+		    case 4:
+			newn = rnd() % (MODELSIZE + 1);
+			if (array_setsize(a, newn)) {
+				panic("array stress: array_setsize failed\n");
+			}
+			for (i=n; i<newn; i++) {
+				array_setguy(a, i, TOKEN(op));
+				model[i] = TOKEN(op);
+			}
+			n = newn;
+			break;
+		    case 5:
+			if (n > 0) {
+				ix = rnd() % n;
+				if (array_getguy(a, ix) != model[ix]) {
+					panic("array stress: op %lu: "
+					      "element %d is wrong\n", op, ix);
+				}
+			}
+			break;
+		}
+		if (array_getnum(a) != n) {
+			panic("array stress: op %lu: size %d, should be %d\n",
+			      op, array_getnum(a), n);
+		}
+	}
+
+	for (i=0; i<n; i++) {
+		if (array_getguy(a, i) != model[i]) {
+			panic("array stress: element %d is wrong\n", i);
+		}
+	}
+	array_destroy(a);
+	checkleaks("array stress", pages);
+	kprintf("array stress: %lu ops ok\n", nops);
+}
+
+static
+void
+stress_queue(void)
+{
+	static void *model[MODELSIZE];
+	struct queue *q;
+	unsigned long op, pages;
+	int head = 0, n = 0;
+	void *ptr;
+
+	pages = hostshim_kpages();
+	q = q_create(1 + rnd() % 16);
+	if (q == NULL) {
+		panic("queue stress: q_create failed\n");
+	}
+
+	for (op=0; op<nops; op++) {
+		/* Lean towards adding, so the queue has to grow */
+		if (n == 0 || (n < MODELSIZE && rnd() % 5 < 3)) {
+			if (q_addtail(q, TOKEN(op))) {
+				panic("queue stress: q_addtail failed\n");
+			}
+			model[(head + n) % MODELSIZE] = TOKEN(op);
+			n++;
+		}
+		else {
+			ptr = q_remhead(q);
+			if (ptr != model[head]) {
+				panic("queue stress: op %lu: wrong element\n",
+				      op);
+			}
+			head = (head + 1) % MODELSIZE;
+			n--;
+		}
+		if ((q_empty(q) != 0) != (n == 0)) {
+			panic("queue stress: op %lu: q_empty is wrong\n", op);
+		}
+	}
+
+	while (n > 0) {
+		if (q_remhead(q) != model[head]) {
+			panic("queue stress: wrong element while draining\n");
+		}
+		head = (head + 1) % MODELSIZE;
+		n--;
+	}
+	q_destroy(q);
+	checkleaks("queue stress", pages);
+	kprintf("queue stress: %lu ops ok\n", nops);
+}
+
+static
+void
+stress_bitmap(void)
+{
+	struct bitmap *b;
+	unsigned char *model;
+	unsigned long op, pages;
+	u_int32_t nbits, nset = 0, ix;
+	int result;
+
+	pages = hostshim_kpages();
+	nbits = 1 + rnd() % 4096;
+	b = bitmap_create(nbits);
+	model = kmalloc(nbits);
+	if (b == NULL || model == NULL) {
+		panic("bitmap stress: out of memory\n");
+	}
+	bzero(model, nbits);
+
+	for (op=0; op<nops; op++) {
+		ix = rnd() % nbits;
+		switch (rnd() % 4) {
+		    case 0:
+			result = bitmap_alloc(b, &ix);
+			if (nset == nbits) {
+				if (result == 0) {
+					panic("bitmap stress: op %lu: "
+					      "alloc from a full map\n", op);
+				}
+				break;
+			}
+			if (result) {
+				panic("bitmap stress: op %lu: alloc failed\n",
+				      op);
+			}
+			if (ix >= nbits || model[ix]) {
+				panic("bitmap stress: op %lu: alloc returned "
+				      "%u, which was in use\n", op, ix);
+			}
+			model[ix] = 1;
+			nset++;
+			break;
+		    case 1:
+			if (!model[ix]) {
+				bitmap_mark(b, ix);
+				model[ix] = 1;
+				nset++;
+			}
+			break;
+		    case 2:
+			if (model[ix]) {
+				bitmap_unmark(b, ix);
+				model[ix] = 0;
+				nset--;
+			}
+			break;
+		    case 3:
+			if ((bitmap_isset(b, ix) != 0) != model[ix]) {
+				panic("bitmap stress: op %lu: bit %u is "
+				      "wrong\n", op, ix);
+			}
+			break;
+		}
+	}
+
+	for (ix=0; ix<nbits; ix++) {
+		if ((bitmap_isset(b, ix) != 0) != model[ix]) {
+			panic("bitmap stress: bit %u is wrong\n", ix);
+		}
+	}
+	kfree(model);
+	bitmap_destroy(b);
+	checkleaks("bitmap stress", pages);
+	kprintf("bitmap stress: %lu ops ok (%u bits)\n", nops, nbits);
+}
+
+/*
+ * Random kmalloc sizes, mostly small, sometimes several pages.
+ * Fill each block with a pattern and check it's intact when freed,
+ * which catches blocks that overlap or that kfree scribbles on.
+ */
+static
+size_t
+kheap_randsize(void)
+{
+	switch (rnd() % 8) {
+	    case 0:
+		return 1 + rnd() % 16384;
+	    case 1:
+	    case 2:
+		return 1 + rnd() % 2048;
+	    default:
+		return 1 + rnd() % 128;
+	}
+}
+
+static
+void
+stress_kheap(void)
+{
+	static struct {
+		unsigned char *ptr;
+		size_t size;
+		unsigned char pattern;
+	} slots[KHEAPSLOTS];
+	unsigned long op, pages;
+	size_t j;
+	int i;
+
+	pages = hostshim_kpages();
+
+	for (op=0; op<nops; op++) {
+		i = rnd() % KHEAPSLOTS;
+		if (slots[i].ptr == NULL) {
+			slots[i].size = kheap_randsize();
+			slots[i].ptr = kmalloc(slots[i].size);
+			if (slots[i].ptr == NULL) {
+				panic("kheap stress: op %lu: kmalloc(%lu) "
+				      "failed\n", op,
+				      (unsigned long)slots[i].size);
+			}
+			slots[i].pattern = rnd();
+			for (j=0; j<slots[i].size; j++) {
+				slots[i].ptr[j] = slots[i].pattern + j;
+			}
+			continue;
+		}
+		for (j=0; j<slots[i].size; j++) {
+			if (slots[i].ptr[j] !=
+			    (unsigned char)(slots[i].pattern + j)) {
+				panic("kheap stress: op %lu: block of %lu "
+				      "bytes at %p corrupted at offset %lu\n",
+				      op, (unsigned long)slots[i].size,
+				      slots[i].ptr, (unsigned long)j);
+			}
+		}
+		kfree(slots[i].ptr);
+		slots[i].ptr = NULL;
+	}
+
+	for (i=0; i<KHEAPSLOTS; i++) {
+		kfree(slots[i].ptr);
+		slots[i].ptr = NULL;
+	}
+	checkleaks("kheap stress", pages);
+	kprintf("kheap stress: %lu ops ok\n", nops);
+}
+
+static
+void
+runstress(void)
+{
+	kprintf("stress: seed %lu\n", (unsigned long)seed);
+	stress_array();
+	stress_queue();
+	stress_bitmap();
+	stress_kheap();
+}
+
+////////////////////////////////////////////////////////////
+// benchmarks
+
+static struct queue *bench_queue;
+static struct array *bench_array;
+static struct bitmap *bench_bitmap;
+
+static
+void
+bench_kmalloc(unsigned long size, unsigned iters)
+{
+	unsigned i;
+	void *p;
+
+	for (i=0; i<iters; i++) {
+		p = kmalloc(size);
+		if (p == NULL) {
+			panic("bench: kmalloc(%lu) failed\n", size);
+		}
+		kfree(p);
+	}
+}
+
+/* Sixteen allocations of assorted sizes live at once */
+static
+void
+bench_kmalloc_mixed(unsigned long arg, unsigned iters)
+{
+	static const size_t sizes[] = { 24, 100, 16, 700, 48, 3000, 200, 64 };
+	void *p[16];
+	unsigned i, j;
+
+	(void)arg;
+	for (i=0; i<iters; i += 16) {
+		for (j=0; j<16; j++) {
+			p[j] = kmalloc(sizes[j % 8]);
+			if (p[j] == NULL) {
+				panic("bench: kmalloc failed\n");
+			}
+		}
+		for (j=0; j<16; j++) {
+			kfree(p[(j * 7) % 16]);
+		}
+	}
+}
+
+static
+void
+bench_queue_run(unsigned long arg, unsigned iters)
+{
+	unsigned i;
+
+	(void)arg;
+	for (i=0; i<iters; i++) {
+		if (q_addtail(bench_queue, TOKEN(i))) {
+			panic("bench: q_addtail failed\n");
+		}
+		q_remhead(bench_queue);
+	}
+}
+
+static
+void
+bench_array_run(unsigned long arg, unsigned iters)
+{
+	unsigned i;
+
+	(void)arg;
+	for (i=0; i<iters; i++) {
+		if (array_add(bench_array, TOKEN(i))) {
+			panic("bench: array_add failed\n");
+		}
+		array_remove(bench_array, 0);
+	}
+}
+
+static
+void
+bench_bitmap_run(unsigned long arg, unsigned iters)
+{
+	unsigned i;
+	u_int32_t ix;
+
+	(void)arg;
+	for (i=0; i<iters; i++) {
+		if (bitmap_alloc(bench_bitmap, &ix)) {
+			panic("bench: bitmap_alloc failed\n");
+		}
+		bitmap_unmark(bench_bitmap, ix);
+	}
+}
+
+static
+u_int32_t
+bench_perop(time_t secs, u_int32_t nsecs, unsigned iters)
+{
+	return secs * (1000000000 / iters) + nsecs / iters;
+}
+
+static
+void
+bench_one(const char *name, unsigned iters, unsigned long arg,
+	  void (*func)(unsigned long, unsigned))
+{
+	u_int32_t samples[BENCH_SAMPLES], t;
+	time_t secs1, secs2, rsecs;
+	u_int32_t nsecs1, nsecs2, rnsecs;
+	int i, j;
+
+	func(arg, iters);
+
+	for (i=0; i<BENCH_SAMPLES; i++) {
+		gettime(&secs1, &nsecs1);
+		func(arg, iters);
+		gettime(&secs2, &nsecs2);
+		getinterval(secs1, nsecs1, secs2, nsecs2, &rsecs, &rnsecs);
+		t = bench_perop(rsecs, rnsecs, iters);
+		for (j=i; j>0 && samples[j-1] > t; j--) {
+			samples[j] = samples[j-1];
+		}
+		samples[j] = t;
+	}
+
+	kprintf("klibtest: name=%s samples=%d iters=%u "
+		"min_ns=%lu med_ns=%lu max_ns=%lu\n",
+		name, BENCH_SAMPLES, iters,
+		(unsigned long)samples[0],
+		(unsigned long)samples[BENCH_SAMPLES/2],
+		(unsigned long)samples[BENCH_SAMPLES-1]);
+}
+
+static
+void
+runbench(void)
+{
+	static const unsigned long sizes[] = {
+		16, 64, 256, 1024, 4096, 16384
+	};
+	char name[32];
+	unsigned i;
+	u_int32_t ix;
+
+	for (i=0; i<sizeof(sizes)/sizeof(sizes[0]); i++) {
+		snprintf(name, sizeof(name), "kmalloc_%lu", sizes[i]);
+		bench_one(name, 100000, sizes[i], bench_kmalloc);
+	}
+	bench_one("kmalloc_mixed", 100000, 0, bench_kmalloc_mixed);
+
+	bench_queue = q_create(16);
+	bench_array = array_create();
+	bench_bitmap = bitmap_create(1024);
+	if (bench_queue == NULL || bench_array == NULL ||
+	    bench_bitmap == NULL) {
+		panic("bench: out of memory\n");
+	}
+	/* Fill all but the last bit, so each alloc has to search */
+	for (ix=0; ix<1023; ix++) {
+		bitmap_mark(bench_bitmap, ix);
+	}
+
+	bench_one("queue", 1000000, 0, bench_queue_run);
+	bench_one("array", 1000000, 0, bench_array_run);
+	bench_one("bitmap_1024", 100000, 0, bench_bitmap_run);
+
+	q_destroy(bench_queue);
+	array_destroy(bench_array);
+	bitmap_destroy(bench_bitmap);
+}
+
+////////////////////////////////////////////////////////////
+
+static
+void
+usage(void)
+{
+	kprintf("Usage: host-klibtest [-s seed] [-n ops] "
+		"[tests] [stress] [bench]\n");
+	panic("bad arguments\n");
+}
+
+int
+klibtest_main(int argc, char *argv[])
+{
+	int i, did = 0;
+
+	for (i=1; i<argc; i++) {
+		if (!strcmp(argv[i], "-s") && i+1 < argc) {
+			seed = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-n") && i+1 < argc) {
+			nops = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "tests")) {
+			runtests();
+			did = 1;
+		}
+		else if (!strcmp(argv[i], "stress")) {
+			runstress();
+			did = 1;
+		}
+		else if (!strcmp(argv[i], "bench")) {
+			runbench();
+			did = 1;
+		}
+		else {
+			usage();
+		}
+	}
+
+	if (!did) {
+		runtests();
+		runstress();
+		runbench();
+	}
+	return 0;
+}
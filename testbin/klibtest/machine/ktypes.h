@@ -0,0 +1,12 @@
+#ifndef _MIPS_KTYPES_H_
+#define _MIPS_KTYPES_H_
+
+/*
+ * Host version of <machine/ktypes.h>. Addresses are pointer-sized,
+ * since the kernel heap hands out host memory.
+ */
+
+typedef uintptr_t paddr_t;
+typedef uintptr_t vaddr_t;
+
+#endif /* _MIPS_KTYPES_H_ */
@@ -0,0 +1,11 @@
+#ifndef _MIPS_SETJMP_H_
+#define _MIPS_SETJMP_H_
+
+/*
+ * Host version of <machine/setjmp.h>. lib.h declares setjmp and
+ * longjmp with this type; nothing here uses them.
+ */
+
+typedef long jmp_buf[32];
+
+#endif /* _MIPS_SETJMP_H_ */
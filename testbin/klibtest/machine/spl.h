@@ -0,0 +1,19 @@
+#ifndef _MACHINE_SPL_H_
+#define _MACHINE_SPL_H_
+
+/*
+ * Host version of <machine/spl.h>. There are no interrupts; instead
+ * splhigh takes a global (recursive) mutex and splx releases it, so
+ * code that protects itself with splhigh is also safe against the
+ * host threads that stand in for kernel threads.
+ */
+
+extern int curspl;
+extern int in_interrupt;
+
+int splhigh(void);
+int splx(int);
+
+#define SPL_HIGH   15
+
+#endif /* _MACHINE_SPL_H_ */
@@ -0,0 +1,37 @@
+#ifndef _MIPS_TYPES_H_
+#define _MIPS_TYPES_H_
+
+/*
+ * Host version of <machine/types.h>, for compiling kernel library
+ * code natively. Same names as the MIPS one, but sized for the host,
+ * so that size_t and pointers agree with the host's C library.
+ */
+
+typedef signed char int8_t;
+typedef short     int16_t;
+typedef int       int32_t;
+typedef long long int64_t;
+
+typedef unsigned char      u_int8_t;
+typedef unsigned short     u_int16_t;
+typedef unsigned int       u_int32_t;
+typedef unsigned long long u_int64_t;
+
+typedef __SIZE_TYPE__ size_t;
+typedef __INTPTR_TYPE__ intptr_t;
+typedef __UINTPTR_TYPE__ uintptr_t;
+
+#define CHAR_BIT  8
+
+#undef NULL
+#define NULL ((void *)0)
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#undef _LITTLE_ENDIAN
+#define _BIG_ENDIAN
+#else
+#undef _BIG_ENDIAN
+#define _LITTLE_ENDIAN
+#endif
+
+#endif /* _MIPS_TYPES_H_ */
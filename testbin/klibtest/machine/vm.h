@@ -0,0 +1,11 @@
+#ifndef _MIPS_VM_H_
+#define _MIPS_VM_H_
+
+/*
+ * Host version of <machine/vm.h>: just the page size.
+ */
+
+#define PAGE_SIZE  4096
+#define PAGE_FRAME (~(vaddr_t)(PAGE_SIZE-1))
+
+#endif /* _MIPS_VM_H_ */
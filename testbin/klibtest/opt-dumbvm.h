@@ -0,0 +1,2 @@
+/* Host build: leave out the VM system's declarations in <vm.h>. */
+#define OPT_DUMBVM 1
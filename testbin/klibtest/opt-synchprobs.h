@@ -0,0 +1,2 @@
+/* Host build */
+#define OPT_SYNCHPROBS 0
@@ -0,0 +1,16 @@
+#ifndef _SYNCH_H_
+#define _SYNCH_H_
+
+/*
+ * Host version of <synch.h>: semaphores only, built on pthreads in
+ * hostshim.c.
+ */
+
+struct semaphore;
+
+struct semaphore *sem_create(const char *name, int initial_count);
+void              P(struct semaphore *);
+void              V(struct semaphore *);
+void              sem_destroy(struct semaphore *);
+
+#endif /* _SYNCH_H_ */
@@ -0,0 +1,16 @@
+#ifndef _THREAD_H_
+#define _THREAD_H_
+
+/*
+ * Host version of <thread.h>: thread_fork runs FUNC in a new host
+ * thread. RET must be NULL; the threads can't be joined.
+ */
+
+struct thread;
+
+int thread_fork(const char *name,
+		void *data1, unsigned long data2,
+		void (*func)(void *, unsigned long),
+		struct thread **ret);
+
+#endif /* _THREAD_H_ */
@@ -0,0 +1,133 @@
+/*
+ * mmaptest.c
+ *
+ * Tests mmap, munmap and msync on a scratch file: shared mappings
+ * must write back to the file, private ones must not.
+ */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <err.h>
+
+#define FILENAME "mmaptest.dat"
+#define FILESIZE (3*4096 + 100)
+
+static char buf[FILESIZE];
+
+static
+void
+makefile(void)
+{
+	int fd, i;
+
+	for (i=0; i<FILESIZE; i++) {
+		buf[i] = 'a' + i % 26;
+	}
+
+	fd = open(FILENAME, O_WRONLY|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s: open for write", FILENAME);
+	}
+	if (write(fd, buf, FILESIZE) != FILESIZE) {
+		err(1, "%s: write", FILENAME);
+	}
+	close(fd);
+}
+
+/*
+ * Read the file back and compare it with buf.
+ */
+static
+void
+checkfile(const char *what)
+{
+	static char rbuf[FILESIZE];
+	int fd, i;
+
+	fd = open(FILENAME, O_RDONLY);
+	if (fd < 0) {
+		err(1, "%s: open for read", FILENAME);
+	}
+	if (read(fd, rbuf, FILESIZE) != FILESIZE) {
+		err(1, "%s: read", FILENAME);
+	}
+	close(fd);
+
+	for (i=0; i<FILESIZE; i++) {
+		if (rbuf[i] != buf[i]) {
+			errx(1, "%s: byte %d is %c, should be %c",
+			     what, i, rbuf[i], buf[i]);
+		}
+	}
+}
+
+int
+main(void)
+{
+	char *p;
+	int fd, i;
+
+	makefile();
+
+	fd = open(FILENAME, O_RDWR);
+	if (fd < 0) {
+		err(1, "%s: open", FILENAME);
+	}
+
+	/* Reading through a mapping */
+	p = mmap(NULL, FILESIZE, PROT_READ, MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED) {
+		err(1, "mmap");
+	}
+	for (i=0; i<FILESIZE; i++) {
+		if (p[i] != buf[i]) {
+			errx(1, "mapped byte %d is %c, should be %c",
+			     i, p[i], buf[i]);
+		}
+	}
+	if (munmap(p, FILESIZE)) {
+		err(1, "munmap");
+	}
+	printf("read mapping ok\n");
+
+	/* Private writes stay private */
+	p = mmap(NULL, FILESIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+	if (p == MAP_FAILED) {
+		err(1, "mmap private");
+	}
+	for (i=0; i<FILESIZE; i+=1000) {
+		p[i] = '*';
+	}
+	if (munmap(p, FILESIZE)) {
+		err(1, "munmap private");
+	}
+	checkfile("private mapping");
+	printf("private mapping ok\n");
+
+	/* Shared writes reach the file on msync and on munmap */
+	p = mmap(NULL, FILESIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED) {
+		err(1, "mmap shared");
+	}
+	p[5000] = buf[5000] = '#';
+	if (msync(p, FILESIZE, MS_SYNC)) {
+		err(1, "msync");
+	}
+	checkfile("msync");
+	p[100] = buf[100] = '!';
+	p[FILESIZE-1] = buf[FILESIZE-1] = '$';
+	if (munmap(p, FILESIZE)) {
+		err(1, "munmap shared");
+	}
+	checkfile("munmap");
+	printf("shared mapping ok\n");
+
+	close(fd);
+	remove(FILENAME);
+
+	printf("mmaptest done\n");
+	return 0;
+}
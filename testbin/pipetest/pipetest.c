@@ -0,0 +1,86 @@
+/*
+ * pipetest.c
+ *
+ * Tests pipes within one process: data comes out in order across the
+ * ring buffer's wraparound, reads return what's there rather than
+ * waiting for a full buffer, closing the write end gives EOF, and
+ * writing with the read end closed fails with EPIPE.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <err.h>
+
+/* Less than the pipe's buffer, so one process never blocks on itself */
+#define CHUNK 3000
+
+int
+main(void)
+{
+	static char wbuf[CHUNK], rbuf[CHUNK];
+	struct stat st;
+	int fds[2];
+	int i, round, n;
+
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+	if (fstat(fds[0], &st) < 0) {
+		err(1, "fstat");
+	}
+	if (!S_ISFIFO(st.st_mode)) {
+		errx(1, "fstat: pipe isn't S_IFIFO");
+	}
+
+	/* A few rounds, so the data wraps around the end of the ring */
+	for (round=0; round<5; round++) {
+		for (i=0; i<CHUNK; i++) {
+			wbuf[i] = round + i % 251;
+		}
+		n = write(fds[1], wbuf, CHUNK);
+		if (n != CHUNK) {
+			err(1, "write: round %d: %d", round, n);
+		}
+
+		/* Read it back in two pieces */
+		n = read(fds[0], rbuf, 1000);
+		if (n != 1000) {
+			err(1, "read: round %d: %d", round, n);
+		}
+		n = read(fds[0], rbuf+1000, sizeof(rbuf));
+		if (n != CHUNK-1000) {
+			err(1, "read: round %d: got %d", round, n);
+		}
+		if (memcmp(wbuf, rbuf, CHUNK)) {
+			errx(1, "round %d: data doesn't match", round);
+		}
+	}
+
+	/* EOF once the write end is closed and the data is gone */
+	write(fds[1], "x", 1);
+	close(fds[1]);
+	if (read(fds[0], rbuf, sizeof(rbuf)) != 1) {
+		errx(1, "last byte missing");
+	}
+	if (read(fds[0], rbuf, sizeof(rbuf)) != 0) {
+		errx(1, "no EOF after close of write end");
+	}
+	close(fds[0]);
+
+	/* EPIPE with no reader */
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+	close(fds[0]);
+	if (write(fds[1], "x", 1) >= 0 || errno != EPIPE) {
+		errx(1, "write with no reader didn't fail with EPIPE");
+	}
+	close(fds[1]);
+
+	printf("pipetest: passed\n");
+	return 0;
+}
@@ -0,0 +1,170 @@
+/*
+ * uthreadtest.c
+ *
+ * Tests the user-level thread library: a mutex keeps a counter right
+ * across yields inside the critical section, a bounded buffer works
+ * with condition variables, thousands of small threads can exist at
+ * once, joins wait for the thread and report misuse, and the process
+ * exits when the last thread does after main calls uthread_exit.
+ */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <errno.h>
+#include <err.h>
+#include <uthread.h>
+
+#define NWORKERS   8
+#define NINCS      100
+#define NITEMS     1000
+#define BUFSIZE    4
+#define NTINY      3000
+#define SMALLSTACK 4096
+
+static struct umutex lock = UMUTEX_INITIALIZER;
+static struct ucond cv = UCOND_INITIALIZER;
+
+static int counter;
+static int buf[BUFSIZE], nbuf, bufhead;
+static int ntiny;
+
+/* Read, yield, write back: wrong unless the mutex works */
+static
+void
+incrementer(void *arg)
+{
+	int i, v;
+
+	(void)arg;
+	for (i=0; i<NINCS; i++) {
+		umutex_lock(&lock);
+		v = counter;
+		uthread_yield();
+		counter = v+1;
+		umutex_unlock(&lock);
+	}
+}
+
+static
+void
+producer(void *arg)
+{
+	int i;
+
+	(void)arg;
+	for (i=0; i<NITEMS; i++) {
+		umutex_lock(&lock);
+		while (nbuf == BUFSIZE) {
+			ucond_wait(&cv, &lock);
+		}
+		buf[(bufhead + nbuf) % BUFSIZE] = i;
+		nbuf++;
+		ucond_broadcast(&cv);
+		umutex_unlock(&lock);
+	}
+}
+
+static
+void
+consumer(void *arg)
+{
+	int i, v;
+
+	(void)arg;
+	for (i=0; i<NITEMS; i++) {
+		umutex_lock(&lock);
+		while (nbuf == 0) {
+			ucond_wait(&cv, &lock);
+		}
+		v = buf[bufhead];
+		bufhead = (bufhead + 1) % BUFSIZE;
+		nbuf--;
+		ucond_broadcast(&cv);
+		umutex_unlock(&lock);
+		if (v != i) {
+			errx(1, "consumer: got %d, expected %d", v, i);
+		}
+	}
+}
+
+static
+void
+tiny(void *arg)
+{
+	(void)arg;
+	/* Make sure they all exist at once before any exits */
+	uthread_yield();
+	ntiny++;
+}
+
+static
+void
+last(void *arg)
+{
+	(void)arg;
+	uthread_yield();
+	printf("uthreadtest: passed\n");
+}
+
+int
+main(void)
+{
+	struct uthread *t[NWORKERS], *nj;
+	int i;
+
+	for (i=0; i<NWORKERS; i++) {
+		if (uthread_create(&t[i], 0, incrementer, NULL)) {
+			err(1, "uthread_create");
+		}
+	}
+	for (i=0; i<NWORKERS; i++) {
+		if (uthread_join(t[i])) {
+			err(1, "uthread_join");
+		}
+	}
+	if (counter != NWORKERS*NINCS) {
+		errx(1, "counter is %d, expected %d", counter,
+		     NWORKERS*NINCS);
+	}
+
+	if (uthread_create(&t[0], 0, producer, NULL) ||
+	    uthread_create(&t[1], 0, consumer, NULL)) {
+		err(1, "uthread_create");
+	}
+	if (uthread_join(t[0]) || uthread_join(t[1])) {
+		err(1, "uthread_join");
+	}
+
+	for (i=0; i<NTINY; i++) {
+		if (uthread_create(NULL, SMALLSTACK, tiny, NULL)) {
+			err(1, "uthread_create: thread %d", i);
+		}
+	}
+	while (ntiny < NTINY) {
+		uthread_yield();
+	}
+
+	if (uthread_create(NULL, 16, tiny, NULL) == 0 || errno != EINVAL) {
+		errx(1, "uthread_create with tiny stack didn't fail");
+	}
+	if (uthread_join(uthread_self()) == 0 || errno != EDEADLK) {
+		errx(1, "joining self didn't fail with EDEADLK");
+	}
+	if (umutex_trylock(&lock)) {
+		err(1, "umutex_trylock");
+	}
+	if (uthread_create(&nj, 0, incrementer, NULL)) {
+		err(1, "uthread_create");
+	}
+	umutex_unlock(&lock);
+	if (uthread_join(nj)) {
+		err(1, "uthread_join");
+	}
+
+	if (uthread_create(NULL, 0, last, NULL)) {
+		err(1, "uthread_create");
+	}
+
+	/* The process should exit when "last" does */
+	uthread_exit();
+}